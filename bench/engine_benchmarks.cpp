@@ -0,0 +1,1488 @@
+#pragma warning(push, 0)
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#pragma warning(pop, 0)
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <latch>
+#include <map>
+#include <memory_resource>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "async_io.hpp"
+#include "bounds_bvh.hpp"
+#include "camera.hpp"
+#include "dirty_ranges.hpp"
+#include "ecs.hpp"
+#include "instances.hpp"
+#include "mapped_file.hpp"
+#include "mesh.hpp"
+#include "meshlet.hpp"
+#include "microbench.hpp"
+#include "occlusion_culler.hpp"
+#include "scatter.hpp"
+#include "terrain.hpp"
+#include "thread_pool.hpp"
+#include "transform_hierarchy.hpp"
+#include "triangle_bvh.hpp"
+#include "utils.hpp"
+
+BEGIN_VISUALIZER_NAMESPACE
+
+namespace
+{
+    // Side of the generated terrain, about the size of the desert
+    constexpr float s_TerrainSize = 256.f;
+
+    struct Dunes
+    {
+        std::vector<VertexDataPosition3fColor3f> vertices;
+        std::vector<uint32_t> indices;
+    };
+
+    // Indexed height field of about triangleCount triangles, rolling like
+    // the desert with some seeded noise on top
+    const Dunes& GetDunes(int64_t triangleCount)
+    {
+        static std::map<int64_t, Dunes> s_Cache;
+
+        auto it = s_Cache.find(triangleCount);
+        if (it != s_Cache.end())
+        {
+            return it->second;
+        }
+
+        const uint32_t quads = std::max(1u, static_cast<uint32_t>(std::sqrt(triangleCount / 2.0)));
+        const float step = s_TerrainSize / quads;
+
+        std::mt19937_64 rng(s_BenchmarkSeed);
+        std::uniform_real_distribution<float> noise(-0.2f, 0.2f);
+
+        Dunes& dunes = s_Cache[triangleCount];
+        dunes.vertices.reserve(static_cast<size_t>(quads + 1) * (quads + 1));
+        dunes.indices.reserve(static_cast<size_t>(quads) * quads * 6);
+
+        for (uint32_t z = 0; z <= quads; ++z)
+        {
+            for (uint32_t x = 0; x <= quads; ++x)
+            {
+                const float px = x * step - 0.5f * s_TerrainSize;
+                const float pz = z * step - 0.5f * s_TerrainSize;
+                const float py = 4.f * std::sin(px * 0.05f) * std::cos(pz * 0.07f) + noise(rng);
+
+                dunes.vertices.push_back({ glm::vec3(px, py, pz), glm::vec3(0.f, 1.f, 0.f), glm::vec3(0.8f) });
+            }
+        }
+
+        for (uint32_t z = 0; z < quads; ++z)
+        {
+            for (uint32_t x = 0; x < quads; ++x)
+            {
+                const uint32_t a = z * (quads + 1) + x;
+                const uint32_t b = a + 1;
+                const uint32_t c = a + quads + 1;
+                const uint32_t d = c + 1;
+
+                dunes.indices.insert(dunes.indices.end(), { a, c, b, b, c, d });
+            }
+        }
+
+        return dunes;
+    }
+
+    std::filesystem::path GetScratchPath(const std::string& name)
+    {
+        const std::filesystem::path directory = std::filesystem::temp_directory_path() / "visualizer_bench";
+        std::filesystem::create_directories(directory);
+        return directory / name;
+    }
+
+    // The dunes as an OBJ file, written once per run
+    std::string GetDunesObj(int64_t triangleCount)
+    {
+        static std::map<int64_t, std::string> s_Paths;
+
+        auto it = s_Paths.find(triangleCount);
+        if (it != s_Paths.end())
+        {
+            return it->second;
+        }
+
+        const Dunes& dunes = GetDunes(triangleCount);
+        const std::string path = GetScratchPath("dunes_" + std::to_string(triangleCount) + ".obj").string();
+        std::ofstream ofs(path, std::ios::trunc);
+
+        for (const VertexDataPosition3fColor3f& vertex : dunes.vertices)
+        {
+            ofs << "v " << vertex.position.x << ' ' << vertex.position.y << ' ' << vertex.position.z << '\n';
+        }
+        for (size_t i = 0; i < dunes.indices.size(); i += 3)
+        {
+            ofs << "f " << dunes.indices[i] + 1 << ' ' << dunes.indices[i + 1] + 1 << ' ' << dunes.indices[i + 2] + 1 << '\n';
+        }
+
+        return s_Paths[triangleCount] = ofs ? path : std::string();
+    }
+
+    std::vector<InstanceTransform> MakePalms(int64_t count)
+    {
+        std::mt19937_64 rng(s_BenchmarkSeed);
+        std::uniform_real_distribution<float> position(-0.5f * s_TerrainSize, 0.5f * s_TerrainSize);
+        std::uniform_real_distribution<float> scale(0.8f, 1.2f);
+        std::uniform_real_distribution<float> yaw(0.f, 6.2831853f);
+
+        std::vector<InstanceTransform> palms(static_cast<size_t>(count));
+        for (InstanceTransform& palm : palms)
+        {
+            palm.position = glm::vec3(position(rng), 0.f, position(rng));
+            palm.scale = scale(rng);
+            palm.yaw = yaw(rng);
+        }
+        return palms;
+    }
+
+    // In the layout of palmTransfo.txt: a count, then "x y z scale" lines
+    std::string GetPalmText(int64_t count)
+    {
+        const std::string path = GetScratchPath("palms_" + std::to_string(count) + ".txt").string();
+
+        if (!std::filesystem::exists(path))
+        {
+            std::ofstream ofs(path, std::ios::trunc);
+            ofs << count << '\n';
+            for (const InstanceTransform& palm : MakePalms(count))
+            {
+                ofs << palm.position.x << ' ' << palm.position.y << ' ' << palm.position.z << ' ' << palm.scale << " \n";
+            }
+        }
+        return path;
+    }
+
+    // View over the terrain from above one edge, looking across it
+    glm::mat4 GetViewProjection()
+    {
+        const glm::mat4 projection = glm::perspective(glm::radians(70.f), 16.f / 9.f, 0.01f, 300.f);
+        const glm::mat4 view = glm::lookAt(glm::vec3(0.f, 6.f, -0.5f * s_TerrainSize), glm::vec3(0.f, 0.f, 0.f), glm::vec3(0.f, 1.f, 0.f));
+        return projection * view;
+    }
+
+    // One worker next to the pinned thread, the same on every machine
+    ThreadPool& GetBenchmarkPool()
+    {
+        static ThreadPool s_Pool(1);
+        return s_Pool;
+    }
+}
+
+void LoadMeshObj(BenchmarkState& state)
+{
+    const std::string path = GetDunesObj(state.GetArg());
+    if (path.empty())
+    {
+        state.SkipWithError("cannot write the OBJ file");
+        return;
+    }
+
+    const auto fileSize = static_cast<int64_t>(std::filesystem::file_size(path));
+
+    while (state.KeepRunning())
+    {
+        std::pmr::vector<VertexDataPosition3fColor3f> vertices;
+        std::pmr::vector<uint32_t> indices;
+
+        if (!LoadMesh(vertices, indices, path))
+        {
+            state.SkipWithError("LoadMesh failed");
+            return;
+        }
+        DoNotOptimize(vertices.data());
+    }
+
+    state.SetItemsPerIteration(state.GetArg());
+    state.SetBytesPerIteration(fileSize);
+}
+BENCHMARK(LoadMeshObj)->Arg(2048)->Arg(32768)->Arg(524288);
+
+void LoadMeshBinary(BenchmarkState& state)
+{
+    const std::string path = GetScratchPath("dunes_" + std::to_string(state.GetArg()) + ".vmesh").string();
+    const Dunes& dunes = GetDunes(state.GetArg());
+
+    if (!SaveMeshBinary(path, dunes.vertices, dunes.indices))
+    {
+        state.SkipWithError("cannot write the mesh file");
+        return;
+    }
+
+    while (state.KeepRunning())
+    {
+        std::pmr::vector<VertexDataPosition3fColor3f> vertices;
+        std::pmr::vector<uint32_t> indices;
+
+        if (!LoadMesh(vertices, indices, path))
+        {
+            state.SkipWithError("LoadMesh failed");
+            return;
+        }
+        DoNotOptimize(vertices.data());
+    }
+
+    state.SetItemsPerIteration(state.GetArg());
+    state.SetBytesPerIteration(static_cast<int64_t>(std::filesystem::file_size(path)));
+}
+BENCHMARK(LoadMeshBinary)->Arg(2048)->Arg(32768)->Arg(524288);
+
+void LoadPalmText(BenchmarkState& state)
+{
+    const std::string path = GetPalmText(state.GetArg());
+    std::vector<InstanceTransform> palms;
+
+    while (state.KeepRunning())
+    {
+        // LoadInstances appends
+        palms.clear();
+        if (!LoadInstances(path, palms, GetBenchmarkPool()))
+        {
+            state.SkipWithError("LoadInstances failed");
+            return;
+        }
+        DoNotOptimize(palms.data());
+    }
+
+    state.SetItemsPerIteration(state.GetArg());
+    state.SetBytesPerIteration(static_cast<int64_t>(std::filesystem::file_size(path)));
+}
+BENCHMARK(LoadPalmText)->Arg(1541)->Arg(100000)->Arg(1000000)->Arg(10000000);
+
+void LoadPalmBinary(BenchmarkState& state)
+{
+    const std::string path = GetScratchPath("palms_" + std::to_string(state.GetArg()) + ".bin").string();
+    std::vector<InstanceTransform> palms = MakePalms(state.GetArg());
+
+    if (!SaveInstancesBinary(path, palms))
+    {
+        state.SkipWithError("cannot write the instance file");
+        return;
+    }
+
+    while (state.KeepRunning())
+    {
+        palms.clear();
+        if (!LoadInstances(path, palms, GetBenchmarkPool()))
+        {
+            state.SkipWithError("LoadInstances failed");
+            return;
+        }
+        DoNotOptimize(palms.data());
+    }
+
+    state.SetItemsPerIteration(state.GetArg());
+}
+BENCHMARK(LoadPalmBinary)->Arg(100000)->Arg(1000000)->Arg(10000000);
+
+// Whole files read and summed, through iostreams as LoadFile used to and
+// through a mapping. The argument is the size in MiB.
+
+namespace
+{
+    std::string GetNoiseFile(int64_t megabytes)
+    {
+        const std::string path = GetScratchPath("noise_" + std::to_string(megabytes) + ".bin").string();
+
+        if (std::filesystem::exists(path) && std::filesystem::file_size(path) == static_cast<uintmax_t>(megabytes) << 20)
+        {
+            return path;
+        }
+
+        std::mt19937_64 rng(s_BenchmarkSeed);
+        std::vector<uint64_t> chunk((1 << 20) / sizeof(uint64_t));
+        std::ofstream ofs(path, std::ios::binary | std::ios::trunc);
+
+        for (int64_t i = 0; i < megabytes; ++i)
+        {
+            std::generate(chunk.begin(), chunk.end(), std::ref(rng));
+            ofs.write(reinterpret_cast<const char*>(chunk.data()), chunk.size() * sizeof(uint64_t));
+        }
+        return ofs ? path : std::string();
+    }
+
+    // Eight bytes at a time, so that every page is read
+    uint64_t SumBytes(std::span<const std::byte> bytes)
+    {
+        uint64_t sum = 0;
+        size_t i = 0;
+
+        for (; i + sizeof(uint64_t) <= bytes.size(); i += sizeof(uint64_t))
+        {
+            uint64_t word;
+            std::memcpy(&word, bytes.data() + i, sizeof(word));
+            sum += word;
+        }
+        for (; i < bytes.size(); ++i)
+        {
+            sum += std::to_integer<uint64_t>(bytes[i]);
+        }
+        return sum;
+    }
+}
+
+// LoadFile before it mapped files: istreambuf_iterator into a string
+void ReadFileStream(BenchmarkState& state)
+{
+    const std::string path = GetNoiseFile(state.GetArg());
+
+    while (state.KeepRunning())
+    {
+        std::ifstream ifs(path, std::ios::binary);
+        const std::string data(std::istreambuf_iterator<char>(ifs), {});
+        DoNotOptimize(SumBytes(std::as_bytes(std::span(data))));
+    }
+
+    state.SetBytesPerIteration(state.GetArg() << 20);
+}
+BENCHMARK(ReadFileStream)->Arg(64)->Arg(1024);
+
+// LoadFile now, the mapping copied into a string
+void ReadFileCopy(BenchmarkState& state)
+{
+    const std::string path = GetNoiseFile(state.GetArg());
+    std::string data;
+
+    while (state.KeepRunning())
+    {
+        if (!LoadFile(path, data))
+        {
+            state.SkipWithError("LoadFile failed");
+            return;
+        }
+        DoNotOptimize(SumBytes(std::as_bytes(std::span(data))));
+    }
+
+    state.SetBytesPerIteration(state.GetArg() << 20);
+}
+BENCHMARK(ReadFileCopy)->Arg(64)->Arg(1024);
+
+// What the loaders do, reading the mapping in place
+void ReadFileMapped(BenchmarkState& state)
+{
+    const std::string path = GetNoiseFile(state.GetArg());
+
+    while (state.KeepRunning())
+    {
+        MappedFile file;
+        if (!file.Open(path))
+        {
+            state.SkipWithError("cannot map the file");
+            return;
+        }
+        DoNotOptimize(SumBytes(file.GetBytes()));
+    }
+
+    state.SetBytesPerIteration(state.GetArg() << 20);
+}
+BENCHMARK(ReadFileMapped)->Arg(64)->Arg(1024);
+
+// The 64 MiB file read as many chunks, the way streaming reads a cell's
+// files. The argument is the chunk size in KiB.
+
+// One read after the other on the calling thread
+void ReadChunksBlocking(BenchmarkState& state)
+{
+    const std::string path = GetNoiseFile(64);
+    const size_t chunkSize = static_cast<size_t>(state.GetArg()) << 10;
+    const size_t chunkCount = (size_t(64) << 20) / chunkSize;
+    std::vector<char> chunk(chunkSize);
+
+    while (state.KeepRunning())
+    {
+        std::ifstream ifs(path, std::ios::binary);
+        uint64_t sum = 0;
+
+        for (size_t i = 0; i < chunkCount; ++i)
+        {
+            ifs.seekg(static_cast<std::streamoff>(i * chunkSize));
+            ifs.read(chunk.data(), static_cast<std::streamsize>(chunkSize));
+            sum += SumBytes(std::as_bytes(std::span(chunk)));
+        }
+        DoNotOptimize(sum);
+    }
+
+    state.SetBytesPerIteration(int64_t(64) << 20);
+}
+BENCHMARK(ReadChunksBlocking)->Arg(64)->Arg(1024);
+
+// All queued in one batch, summed in the callbacks as they complete
+void ReadChunksAsync(BenchmarkState& state)
+{
+    const std::string path = GetNoiseFile(64);
+    const size_t chunkSize = static_cast<size_t>(state.GetArg()) << 10;
+    const size_t chunkCount = (size_t(64) << 20) / chunkSize;
+    AsyncFileReader reader(ThreadPool::GetGlobal());
+    std::vector<ReadRequest> requests(chunkCount);
+
+    while (state.KeepRunning())
+    {
+        std::latch done(static_cast<std::ptrdiff_t>(chunkCount));
+        std::atomic<uint64_t> sum{ 0 };
+
+        for (size_t i = 0; i < chunkCount; ++i)
+        {
+            requests[i] = { path, i * chunkSize, chunkSize, IoPriority::Visible, [&done, &sum](ReadResult&& result)
+            {
+                sum.fetch_add(SumBytes(result.GetBytes()), std::memory_order_relaxed);
+                done.count_down();
+            } };
+        }
+        reader.ReadBatch(requests);
+        done.wait();
+        DoNotOptimize(sum.load());
+    }
+
+    state.SetBytesPerIteration(int64_t(64) << 20);
+}
+BENCHMARK(ReadChunksAsync)->Arg(64)->Arg(1024);
+
+void ComputeNormals(BenchmarkState& state)
+{
+    const Dunes& dunes = GetDunes(state.GetArg());
+    glm::vec3 sum(0.f);
+
+    while (state.KeepRunning())
+    {
+        for (size_t i = 0; i < dunes.indices.size(); i += 3)
+        {
+            sum += computeNormal(dunes.vertices[dunes.indices[i]].position, dunes.vertices[dunes.indices[i + 1]].position,
+                                 dunes.vertices[dunes.indices[i + 2]].position);
+        }
+        DoNotOptimize(sum);
+    }
+
+    state.SetItemsPerIteration(static_cast<int64_t>(dunes.indices.size() / 3));
+}
+BENCHMARK(ComputeNormals)->Arg(32768);
+
+void ComputeMagnitudes(BenchmarkState& state)
+{
+    const Dunes& dunes = GetDunes(state.GetArg());
+    float sum = 0.f;
+
+    while (state.KeepRunning())
+    {
+        for (const VertexDataPosition3fColor3f& vertex : dunes.vertices)
+        {
+            sum += computeMagnitude(vertex.position);
+        }
+        DoNotOptimize(sum);
+    }
+
+    state.SetItemsPerIteration(static_cast<int64_t>(dunes.vertices.size()));
+}
+BENCHMARK(ComputeMagnitudes)->Arg(32768);
+
+void ComputeBounds(BenchmarkState& state)
+{
+    const Dunes& dunes = GetDunes(state.GetArg());
+    glm::vec3 min, max;
+
+    while (state.KeepRunning())
+    {
+        computeBounds(dunes.vertices, min, max);
+        DoNotOptimize(max);
+    }
+
+    state.SetItemsPerIteration(static_cast<int64_t>(dunes.vertices.size()));
+}
+BENCHMARK(ComputeBounds)->Arg(32768)->Arg(524288);
+
+// The copy and shift InitObj makes of meshes placed away from the origin
+void TranslateVertices(BenchmarkState& state)
+{
+    const Dunes& dunes = GetDunes(state.GetArg());
+    std::vector<VertexDataPosition3fColor3f> translated;
+
+    while (state.KeepRunning())
+    {
+        translated.assign(dunes.vertices.begin(), dunes.vertices.end());
+        translateVertices(translated, glm::vec3(10.f, 0.f, -5.f));
+        DoNotOptimize(translated.data());
+    }
+
+    state.SetItemsPerIteration(static_cast<int64_t>(dunes.vertices.size()));
+    state.SetBytesPerIteration(static_cast<int64_t>(dunes.vertices.size() * sizeof(VertexDataPosition3fColor3f)));
+}
+BENCHMARK(TranslateVertices)->Arg(32768)->Arg(524288);
+
+// What a frame of mouse look and walking costs the camera
+void CameraUpdate(BenchmarkState& state)
+{
+    Camera camera(1280, 720, glm::vec3(0.f, 2.f, -2.5f));
+    int32_t direction = 1;
+
+    while (state.KeepRunning())
+    {
+        camera.HorizontalMovement(3 * direction);
+        camera.VerticalMovement(-2 * direction);
+        camera.MoveForward(1.f / 60.f);
+        camera.MoveLeft(1.f / 60.f);
+        direction = -direction;
+        DoNotOptimize(camera.GetViewProjectionMatrix());
+    }
+}
+BENCHMARK(CameraUpdate);
+
+void CameraProjection(BenchmarkState& state)
+{
+    Camera camera(1280, 720);
+    uint32_t width = 1280;
+
+    while (state.KeepRunning())
+    {
+        camera.ComputeProjection(width, 720);
+        width ^= 1;
+        DoNotOptimize(camera.GetViewProjectionMatrix());
+    }
+}
+BENCHMARK(CameraProjection);
+
+void FrustumTest(BenchmarkState& state)
+{
+    const std::vector<InstanceTransform> palms = MakePalms(state.GetArg());
+    const glm::mat4 viewProjection = GetViewProjection();
+    const glm::vec3 meshMin(-1.f, 0.f, -1.f);
+    const glm::vec3 meshMax(1.f, 6.f, 1.f);
+    size_t visible = 0;
+
+    while (state.KeepRunning())
+    {
+        for (const InstanceTransform& palm : palms)
+        {
+            glm::vec3 min, max;
+            GetInstanceBounds(palm, meshMin, meshMax, min, max);
+            visible += IntersectsFrustum(viewProjection, min, max);
+        }
+        DoNotOptimize(visible);
+    }
+
+    state.SetItemsPerIteration(state.GetArg());
+}
+BENCHMARK(FrustumTest)->Arg(10000);
+
+void TerrainHeights(BenchmarkState& state)
+{
+    const Dunes& dunes = GetDunes(state.GetArg());
+    Terrain terrain;
+    terrain.Build(dunes.vertices, dunes.indices);
+
+    std::mt19937_64 rng(s_BenchmarkSeed);
+    std::uniform_real_distribution<float> coordinate(-0.5f * s_TerrainSize, 0.5f * s_TerrainSize);
+    std::vector<glm::vec2> points(65536);
+    std::vector<float> heights(points.size());
+
+    for (glm::vec2& point : points)
+    {
+        point = glm::vec2(coordinate(rng), coordinate(rng));
+    }
+
+    while (state.KeepRunning())
+    {
+        DoNotOptimize(terrain.HeightAt(points, heights));
+    }
+
+    state.SetItemsPerIteration(static_cast<int64_t>(points.size()));
+}
+BENCHMARK(TerrainHeights)->Arg(32768);
+
+namespace
+{
+    // The dunes with their vertices jittered in XZ, so that triangles
+    // straddle the grid cells at every angle, and smooth normals from the
+    // height function's gradient. The border is left straight.
+    Dunes MakeJitteredDunes(int64_t triangleCount)
+    {
+        Dunes dunes = GetDunes(triangleCount);
+        const uint32_t quads = static_cast<uint32_t>(std::sqrt(static_cast<double>(dunes.vertices.size()))) - 1;
+        const float step = s_TerrainSize / quads;
+
+        std::mt19937_64 rng(s_BenchmarkSeed);
+        std::uniform_real_distribution<float> jitter(-0.3f * step, 0.3f * step);
+
+        for (uint32_t z = 0; z <= quads; ++z)
+        {
+            for (uint32_t x = 0; x <= quads; ++x)
+            {
+                VertexDataPosition3fColor3f& vertex = dunes.vertices[z * (quads + 1) + x];
+
+                if (x > 0 && x < quads && z > 0 && z < quads)
+                {
+                    vertex.position.x += jitter(rng);
+                    vertex.position.z += jitter(rng);
+                }
+
+                const float px = vertex.position.x;
+                const float pz = vertex.position.z;
+                const float dx = 0.2f * std::cos(px * 0.05f) * std::cos(pz * 0.07f);
+                const float dz = -0.28f * std::sin(px * 0.05f) * std::sin(pz * 0.07f);
+                vertex.normal = glm::normalize(glm::vec3(-dx, 1.f, -dz));
+            }
+        }
+
+        return dunes;
+    }
+
+    // Highest triangle under (x, z) by testing every one, its normal
+    // interpolated like Terrain does
+    bool BruteForceSample(const Dunes& dunes, float x, float z, float& height, glm::vec3& normal)
+    {
+        bool found = false;
+
+        for (size_t i = 0; i < dunes.indices.size(); i += 3)
+        {
+            const VertexDataPosition3fColor3f& a = dunes.vertices[dunes.indices[i]];
+            const VertexDataPosition3fColor3f& b = dunes.vertices[dunes.indices[i + 1]];
+            const VertexDataPosition3fColor3f& c = dunes.vertices[dunes.indices[i + 2]];
+
+            // Vertical ray against the triangle, in barycentric form
+            const glm::vec2 e1(b.position.x - a.position.x, b.position.z - a.position.z);
+            const glm::vec2 e2(c.position.x - a.position.x, c.position.z - a.position.z);
+            const glm::vec2 p(x - a.position.x, z - a.position.z);
+            const float det = e1.x * e2.y - e1.y * e2.x;
+
+            if (det == 0.f)
+            {
+                continue;
+            }
+
+            const float u = (p.x * e2.y - p.y * e2.x) / det;
+            const float v = (e1.x * p.y - e1.y * p.x) / det;
+
+            if (u < 0.f || v < 0.f || u + v > 1.f)
+            {
+                continue;
+            }
+
+            const float h = a.position.y + u * (b.position.y - a.position.y) + v * (c.position.y - a.position.y);
+
+            if (!found || h > height)
+            {
+                height = h;
+                normal = glm::normalize((1.f - u - v) * a.normal + u * b.normal + v * c.normal);
+                found = true;
+            }
+        }
+
+        return found;
+    }
+
+    // Worst height and normal errors of Terrain over random points, or a
+    // message for the first miss. Checked once per mesh size.
+    const std::string& CheckTerrainAccuracy(int64_t triangleCount)
+    {
+        static std::map<int64_t, std::string> s_Results;
+
+        auto it = s_Results.find(triangleCount);
+        if (it != s_Results.end())
+        {
+            return it->second;
+        }
+
+        constexpr size_t sampleCount = 4096;
+        constexpr float heightTolerance = 1e-3f;
+        constexpr float normalTolerance = 1e-3f;
+
+        const Dunes dunes = MakeJitteredDunes(triangleCount);
+        Terrain terrain;
+        terrain.Build(dunes.vertices, dunes.indices);
+
+        std::mt19937_64 rng(s_BenchmarkSeed);
+        std::uniform_real_distribution<float> coordinate(-0.499f * s_TerrainSize, 0.499f * s_TerrainSize);
+        std::vector<glm::vec2> points(sampleCount);
+        std::vector<float> batchHeights(sampleCount);
+        std::vector<glm::vec3> batchNormals(sampleCount);
+        float heightError = 0.f;
+        float normalError = 0.f;
+
+        for (glm::vec2& point : points)
+        {
+            point = glm::vec2(coordinate(rng), coordinate(rng));
+        }
+
+        // The batched queries must match the single ones exactly
+        if (terrain.SampleAt(points, batchHeights, batchNormals) != sampleCount)
+        {
+            return s_Results[triangleCount] = "batched queries missed the terrain";
+        }
+
+        for (size_t i = 0; i < sampleCount; ++i)
+        {
+            const float x = points[i].x;
+            const float z = points[i].y;
+            float expectedHeight = 0.f, height = 0.f;
+            glm::vec3 expectedNormal, normal;
+
+            if (!BruteForceSample(dunes, x, z, expectedHeight, expectedNormal) || !terrain.HeightAt(x, z, height) || !terrain.NormalAt(x, z, normal))
+            {
+                return s_Results[triangleCount] = "no terrain at " + std::to_string(x) + ' ' + std::to_string(z);
+            }
+            if (height != batchHeights[i] || normal != batchNormals[i])
+            {
+                return s_Results[triangleCount] = "batched query differs at " + std::to_string(x) + ' ' + std::to_string(z);
+            }
+
+            heightError = std::max(heightError, std::abs(height - expectedHeight));
+            normalError = std::max(normalError, glm::length(normal - expectedNormal));
+        }
+
+        if (heightError > heightTolerance || normalError > normalTolerance)
+        {
+            return s_Results[triangleCount] = "max height error " + std::to_string(heightError) + ", max normal error " + std::to_string(normalError);
+        }
+        return s_Results[triangleCount];
+    }
+}
+
+// Fails unless HeightAt and NormalAt agree with testing every triangle,
+// then times that brute force as the baseline for TerrainHeights
+void TerrainHeightsBruteForce(BenchmarkState& state)
+{
+    const std::string& error = CheckTerrainAccuracy(state.GetArg());
+
+    if (!error.empty())
+    {
+        state.SkipWithError(error);
+        return;
+    }
+
+    const Dunes& dunes = GetDunes(state.GetArg());
+    std::mt19937_64 rng(s_BenchmarkSeed);
+    std::uniform_real_distribution<float> coordinate(-0.5f * s_TerrainSize, 0.5f * s_TerrainSize);
+    std::vector<glm::vec2> points(256);
+
+    for (glm::vec2& point : points)
+    {
+        point = glm::vec2(coordinate(rng), coordinate(rng));
+    }
+
+    while (state.KeepRunning())
+    {
+        for (const glm::vec2& point : points)
+        {
+            float height;
+            glm::vec3 normal;
+            DoNotOptimize(BruteForceSample(dunes, point.x, point.y, height, normal));
+        }
+    }
+
+    state.SetItemsPerIteration(static_cast<int64_t>(points.size()));
+}
+BENCHMARK(TerrainHeightsBruteForce)->Arg(32768);
+
+namespace
+{
+    // About a million palms over the dunes, in 256 tiles
+    ScatterSettings GetMillionScatter()
+    {
+        ScatterSettings settings;
+        settings.seed = s_BenchmarkSeed;
+        settings.minDistance = 0.2f;
+        settings.tileSize = 16.f;
+        return settings;
+    }
+
+    const Terrain& GetScatterTerrain()
+    {
+        static Terrain s_Terrain;
+
+        if (s_Terrain.IsEmpty())
+        {
+            const Dunes& dunes = GetDunes(32768);
+            s_Terrain.Build(dunes.vertices, dunes.indices);
+        }
+        return s_Terrain;
+    }
+
+    // Scatters with the calling thread alone once, then with threadCount
+    // threads; both must give the same instances. Checked once per count.
+    const std::string& CheckScatterDeterminism(uint32_t threadCount, ThreadPool& pool)
+    {
+        static std::vector<InstanceTransform> s_Reference;
+        static std::map<uint32_t, std::string> s_Results;
+
+        auto it = s_Results.find(threadCount);
+        if (it != s_Results.end())
+        {
+            return it->second;
+        }
+
+        if (s_Reference.empty())
+        {
+            ThreadPool serial(0);
+            s_Reference = ScatterInstances(GetScatterTerrain(), GetMillionScatter(), serial);
+        }
+
+        const std::vector<InstanceTransform> instances = ScatterInstances(GetScatterTerrain(), GetMillionScatter(), pool);
+
+        if (instances.size() != s_Reference.size() || std::memcmp(instances.data(), s_Reference.data(), instances.size() * sizeof(InstanceTransform)) != 0)
+        {
+            return s_Results[threadCount] = "the instances differ from the single-threaded scatter";
+        }
+        return s_Results[threadCount];
+    }
+}
+
+// The argument is the thread count, the calling thread included
+void ScatterPalms(BenchmarkState& state)
+{
+    const uint32_t threadCount = static_cast<uint32_t>(state.GetArg());
+    ThreadPool pool(threadCount - 1);
+
+    const std::string& error = CheckScatterDeterminism(threadCount, pool);
+    if (!error.empty())
+    {
+        state.SkipWithError(error);
+        return;
+    }
+
+    size_t count = 0;
+
+    while (state.KeepRunning())
+    {
+        count = ScatterInstances(GetScatterTerrain(), GetMillionScatter(), pool).size();
+        DoNotOptimize(count);
+    }
+
+    state.SetItemsPerIteration(static_cast<int64_t>(count));
+}
+BENCHMARK(ScatterPalms)->Arg(1)->Arg(4);
+
+namespace
+{
+    // Height of the occluder over (x, z), following its quad split
+    float OccluderHeightAt(const OccluderMesh& occluder, uint32_t resolution, const glm::vec3& min, const glm::vec3& max, float x, float z)
+    {
+        const uint32_t side = resolution + 1;
+        const float fx = (x - min.x) / (max.x - min.x) * static_cast<float>(resolution);
+        const float fz = (z - min.z) / (max.z - min.z) * static_cast<float>(resolution);
+        const uint32_t qx = std::min(static_cast<uint32_t>(fx), resolution - 1);
+        const uint32_t qz = std::min(static_cast<uint32_t>(fz), resolution - 1);
+        const float u = fx - static_cast<float>(qx);
+        const float v = fz - static_cast<float>(qz);
+
+        const float h0 = occluder.vertices[qz * side + qx].y;
+        const float h1 = occluder.vertices[qz * side + qx + 1].y;
+        const float h2 = occluder.vertices[(qz + 1) * side + qx].y;
+        const float h3 = occluder.vertices[(qz + 1) * side + qx + 1].y;
+
+        return u + v <= 1.f ? h0 + u * (h1 - h0) + v * (h2 - h0) : h3 + (1.f - u) * (h2 - h3) + (1.f - v) * (h1 - h3);
+    }
+
+    // Highest point of the occluder above the jittered dunes over random
+    // points, or a message when it pokes out. Checked once per mesh size.
+    const std::string& CheckOccluderBelowTerrain(int64_t triangleCount)
+    {
+        static std::map<int64_t, std::string> s_Results;
+
+        auto it = s_Results.find(triangleCount);
+        if (it != s_Results.end())
+        {
+            return it->second;
+        }
+
+        constexpr uint32_t resolution = 64;
+        constexpr size_t sampleCount = 1 << 16;
+        // Clipping interpolates heights along cut edges
+        constexpr float heightTolerance = 1e-4f;
+
+        const Dunes dunes = MakeJitteredDunes(triangleCount);
+        Terrain terrain;
+        terrain.Build(dunes.vertices, dunes.indices);
+        const OccluderMesh occluder = BuildTerrainOccluder(terrain, resolution);
+
+        std::mt19937_64 rng(s_BenchmarkSeed);
+        std::uniform_real_distribution<float> coordinate(-0.5f * s_TerrainSize, 0.5f * s_TerrainSize);
+        float excess = 0.f;
+
+        for (size_t i = 0; i < sampleCount; ++i)
+        {
+            const float x = coordinate(rng);
+            const float z = coordinate(rng);
+            float height;
+
+            if (terrain.HeightAt(x, z, height))
+            {
+                excess = std::max(excess, OccluderHeightAt(occluder, resolution, terrain.GetMin(), terrain.GetMax(), x, z) - height);
+            }
+        }
+
+        if (excess > heightTolerance)
+        {
+            return s_Results[triangleCount] = "occluder rises " + std::to_string(excess) + " above the terrain";
+        }
+        return s_Results[triangleCount];
+    }
+}
+
+// Rasterizing the terrain occluder, then testing the palms against it, on
+// the pinned thread only. Fails if the occluder rises above the terrain.
+void OcclusionCull(BenchmarkState& state)
+{
+    const std::string& error = CheckOccluderBelowTerrain(32768);
+
+    if (!error.empty())
+    {
+        state.SkipWithError(error);
+        return;
+    }
+
+    const Dunes& dunes = GetDunes(32768);
+    Terrain terrain;
+    terrain.Build(dunes.vertices, dunes.indices);
+
+    const OccluderMesh occluder = BuildTerrainOccluder(terrain);
+    const std::vector<InstanceTransform> palms = MakePalms(state.GetArg());
+    const glm::mat4 viewProjection = GetViewProjection();
+    std::vector<InstanceTransform> visible(palms.size());
+    OcclusionCuller culler;
+
+    while (state.KeepRunning())
+    {
+        culler.BeginFrame(viewProjection);
+        culler.AddOccluder(occluder);
+        culler.RasterizeOccluders();
+        DoNotOptimize(culler.CullInstances(palms, glm::vec3(-1.f, 0.f, -1.f), glm::vec3(1.f, 6.f, 1.f), visible.data()));
+    }
+
+    state.SetItemsPerIteration(state.GetArg());
+}
+BENCHMARK(OcclusionCull)->Arg(1541)->Arg(100000);
+
+void BuildMeshletClusters(BenchmarkState& state)
+{
+    const Dunes& dunes = GetDunes(state.GetArg());
+
+    while (state.KeepRunning())
+    {
+        const MeshletMesh mesh = BuildMeshlets(dunes.vertices, dunes.indices);
+        DoNotOptimize(mesh.meshlets.data());
+    }
+
+    state.SetItemsPerIteration(state.GetArg());
+}
+BENCHMARK(BuildMeshletClusters)->Arg(32768)->Arg(524288);
+
+namespace
+{
+    // The dunes with three vertices of their own per triangle, the way
+    // LoadMesh hands OBJ meshes over
+    const Dunes& GetUnsharedDunes(int64_t triangleCount)
+    {
+        static std::map<int64_t, Dunes> s_Meshes;
+
+        auto it = s_Meshes.find(triangleCount);
+        if (it != s_Meshes.end())
+        {
+            return it->second;
+        }
+
+        const Dunes& shared = GetDunes(triangleCount);
+        Dunes& unshared = s_Meshes[triangleCount];
+        unshared.vertices.reserve(shared.indices.size());
+        unshared.indices.reserve(shared.indices.size());
+
+        for (uint32_t index : shared.indices)
+        {
+            unshared.indices.push_back(static_cast<uint32_t>(unshared.vertices.size()));
+            unshared.vertices.push_back(shared.vertices[index]);
+        }
+
+        return unshared;
+    }
+
+    // Fails unless the unshared dunes split into the same meshlets as the
+    // indexed ones. Checked once per mesh size.
+    const std::string& CheckMeshletWelding(int64_t triangleCount)
+    {
+        static std::map<int64_t, std::string> s_Results;
+
+        auto it = s_Results.find(triangleCount);
+        if (it != s_Results.end())
+        {
+            return it->second;
+        }
+
+        const MeshletMesh shared = BuildMeshlets(GetDunes(triangleCount).vertices, GetDunes(triangleCount).indices);
+        const MeshletMesh unshared = BuildMeshlets(GetUnsharedDunes(triangleCount).vertices, GetUnsharedDunes(triangleCount).indices);
+
+        if (shared.meshlets.size() != unshared.meshlets.size())
+        {
+            return s_Results[triangleCount] = std::to_string(unshared.meshlets.size()) + " meshlets unshared, " + std::to_string(shared.meshlets.size()) + " indexed";
+        }
+        return s_Results[triangleCount];
+    }
+}
+
+void BuildMeshletClustersUnshared(BenchmarkState& state)
+{
+    const std::string& error = CheckMeshletWelding(state.GetArg());
+
+    if (!error.empty())
+    {
+        state.SkipWithError(error);
+        return;
+    }
+
+    const Dunes& dunes = GetUnsharedDunes(state.GetArg());
+
+    while (state.KeepRunning())
+    {
+        const MeshletMesh mesh = BuildMeshlets(dunes.vertices, dunes.indices);
+        DoNotOptimize(mesh.meshlets.data());
+    }
+
+    state.SetItemsPerIteration(state.GetArg());
+}
+BENCHMARK(BuildMeshletClustersUnshared)->Arg(32768)->Arg(524288);
+
+void CullMeshletClusters(BenchmarkState& state)
+{
+    const Dunes& dunes = GetDunes(state.GetArg());
+    const MeshletMesh mesh = BuildMeshlets(dunes.vertices, dunes.indices);
+    const glm::mat4 viewProjection = GetViewProjection();
+    std::vector<DrawElementsIndirectCommand> commands(mesh.meshlets.size());
+    MeshletStats stats;
+
+    while (state.KeepRunning())
+    {
+        DoNotOptimize(CullMeshlets(mesh, viewProjection, glm::vec3(0.f, 6.f, -0.5f * s_TerrainSize), commands, stats));
+    }
+
+    state.SetItemsPerIteration(static_cast<int64_t>(mesh.meshlets.size()));
+}
+BENCHMARK(CullMeshletClusters)->Arg(32768)->Arg(524288);
+
+// Scene entities as the renderer keeps them, walked once per frame
+
+namespace
+{
+    struct PalmBounds
+    {
+        glm::vec3 min;
+        glm::vec3 max;
+    };
+
+    World MakePalmWorld(int64_t count)
+    {
+        World world;
+        for (const InstanceTransform& palm : MakePalms(count))
+        {
+            const glm::vec3 extent = glm::vec3(1.f, 6.f, 1.f) * palm.scale;
+            world.Create(palm, PalmBounds{ palm.position - glm::vec3(extent.x, 0.f, extent.z), palm.position + extent }, Visibility::Visible);
+        }
+        return world;
+    }
+}
+
+void EcsCreate(BenchmarkState& state)
+{
+    while (state.KeepRunning())
+    {
+        const World world = MakePalmWorld(state.GetArg());
+        DoNotOptimize(world.GetEntityCount());
+    }
+
+    state.SetItemsPerIteration(state.GetArg());
+}
+BENCHMARK(EcsCreate)->Arg(100000);
+
+void EcsEach(BenchmarkState& state)
+{
+    const World world = MakePalmWorld(state.GetArg());
+
+    while (state.KeepRunning())
+    {
+        world.Each<InstanceTransform>([](InstanceTransform& palm) { palm.yaw += 0.01f; });
+    }
+
+    state.SetItemsPerIteration(state.GetArg());
+}
+BENCHMARK(EcsEach)->Arg(10000)->Arg(100000)->Arg(1000000);
+
+void EcsParallelEach(BenchmarkState& state)
+{
+    const World world = MakePalmWorld(state.GetArg());
+    ThreadPool& pool = GetBenchmarkPool();
+
+    while (state.KeepRunning())
+    {
+        world.ParallelForEachChunk<InstanceTransform>(pool, [](const ChunkView& chunk)
+        {
+            for (InstanceTransform& palm : chunk.Get<InstanceTransform>())
+            {
+                palm.yaw += 0.01f;
+            }
+        });
+    }
+
+    state.SetItemsPerIteration(state.GetArg());
+}
+BENCHMARK(EcsParallelEach)->Arg(10000)->Arg(100000)->Arg(1000000);
+
+void EcsOcclusionCull(BenchmarkState& state)
+{
+    const Dunes& dunes = GetDunes(32768);
+    Terrain terrain;
+    terrain.Build(dunes.vertices, dunes.indices);
+
+    const OccluderMesh occluder = BuildTerrainOccluder(terrain);
+    const World world = MakePalmWorld(state.GetArg());
+    const glm::mat4 viewProjection = GetViewProjection();
+    ThreadPool& pool = GetBenchmarkPool();
+    OcclusionCuller culler;
+
+    while (state.KeepRunning())
+    {
+        culler.BeginFrame(viewProjection);
+        culler.AddOccluder(occluder);
+        culler.RasterizeOccluders();
+
+        world.ParallelForEachChunk<const PalmBounds, Visibility>(pool, [&culler](const ChunkView& chunk)
+        {
+            const std::span<const PalmBounds> bounds = chunk.Get<const PalmBounds>();
+            const std::span<Visibility> visibility = chunk.Get<Visibility>();
+
+            for (uint32_t i = 0; i < chunk.GetCount(); ++i)
+            {
+                visibility[i] = culler.ClassifyBox(bounds[i].min, bounds[i].max);
+            }
+        });
+    }
+
+    state.SetItemsPerIteration(state.GetArg());
+}
+BENCHMARK(EcsOcclusionCull)->Arg(1541)->Arg(100000);
+
+// Palms in groups of 100 below moving roots, as a scene graph sees them
+
+namespace
+{
+    struct PalmHierarchy
+    {
+        TransformHierarchy transforms;
+        std::vector<NodeId> roots;
+        std::vector<NodeId> palms;
+        std::vector<InstanceTransform> instances;
+    };
+
+    void MakePalmHierarchy(int64_t count, PalmHierarchy& hierarchy)
+    {
+        hierarchy.instances = MakePalms(count);
+        for (size_t i = 0; i < hierarchy.instances.size(); ++i)
+        {
+            if (i % 100 == 0)
+            {
+                hierarchy.roots.push_back(hierarchy.transforms.Create(LocalTransform{}));
+            }
+            hierarchy.palms.push_back(hierarchy.transforms.Create(ToLocalTransform(hierarchy.instances[i]), hierarchy.roots.back()));
+        }
+    }
+
+    // Every palm turned, then the world matrices composed and written in
+    // the instance layout
+    void TurnPalms(PalmHierarchy& hierarchy, float yaw, ThreadPool& pool)
+    {
+        for (NodeId palm : hierarchy.palms)
+        {
+            LocalTransform local = hierarchy.transforms.GetLocal(palm);
+            local.rotation = glm::angleAxis(yaw, glm::vec3(0.f, 1.f, 0.f));
+            hierarchy.transforms.SetLocal(palm, local);
+        }
+        DoNotOptimize(hierarchy.transforms.Update(pool));
+        hierarchy.transforms.WriteInstances(hierarchy.palms, hierarchy.instances.data(), pool);
+    }
+}
+
+void TransformPalms(BenchmarkState& state)
+{
+    PalmHierarchy hierarchy;
+    MakePalmHierarchy(state.GetArg(), hierarchy);
+    ThreadPool& pool = GetBenchmarkPool();
+    float yaw = 0.f;
+
+    while (state.KeepRunning())
+    {
+        yaw += 0.01f;
+        TurnPalms(hierarchy, yaw, pool);
+    }
+
+    state.SetItemsPerIteration(state.GetArg());
+}
+BENCHMARK(TransformPalms)->Arg(10000)->Arg(100000);
+
+// TransformPalms for 100000 palms; the argument is the thread count, the
+// calling thread included
+void TransformPalmsThreads(BenchmarkState& state)
+{
+    constexpr int64_t palmCount = 100000;
+
+    PalmHierarchy hierarchy;
+    MakePalmHierarchy(palmCount, hierarchy);
+    ThreadPool pool(static_cast<uint32_t>(state.GetArg()) - 1);
+    float yaw = 0.f;
+
+    while (state.KeepRunning())
+    {
+        yaw += 0.01f;
+        TurnPalms(hierarchy, yaw, pool);
+    }
+
+    state.SetItemsPerIteration(palmCount);
+}
+BENCHMARK(TransformPalmsThreads)->Arg(1)->Arg(4);
+
+// The roots moved, their subtrees following
+void TransformRoots(BenchmarkState& state)
+{
+    PalmHierarchy hierarchy;
+    MakePalmHierarchy(state.GetArg(), hierarchy);
+    ThreadPool& pool = GetBenchmarkPool();
+    float offset = 0.f;
+
+    while (state.KeepRunning())
+    {
+        offset += 0.01f;
+        for (NodeId root : hierarchy.roots)
+        {
+            hierarchy.transforms.SetLocal(root, { glm::vec3(offset, 0.f, 0.f) });
+        }
+        DoNotOptimize(hierarchy.transforms.Update(pool));
+    }
+
+    state.SetItemsPerIteration(state.GetArg());
+}
+BENCHMARK(TransformRoots)->Arg(10000)->Arg(100000);
+
+// Nothing moved, what a still frame costs
+void TransformStill(BenchmarkState& state)
+{
+    PalmHierarchy hierarchy;
+    MakePalmHierarchy(state.GetArg(), hierarchy);
+    ThreadPool& pool = GetBenchmarkPool();
+    hierarchy.transforms.Update(pool);
+
+    while (state.KeepRunning())
+    {
+        DoNotOptimize(hierarchy.transforms.Update(pool));
+    }
+
+    state.SetItemsPerIteration(state.GetArg());
+}
+BENCHMARK(TransformStill)->Arg(100000);
+
+// A frame of moving palms, out of 100k: the instance BVH refitted around
+// them, then the instance buffer entries that changed gathered into
+// uploads. The argument is the percentage moved every frame.
+void DynamicInstances(BenchmarkState& state)
+{
+    std::vector<InstanceTransform> palms = MakePalms(100000);
+    const glm::vec3 meshMin(-1.f, 0.f, -1.f);
+    const glm::vec3 meshMax(1.f, 8.f, 1.f);
+    ThreadPool& pool = GetBenchmarkPool();
+
+    DynamicBoundsBvh bvh;
+    for (uint32_t i = 0; i < palms.size(); ++i)
+    {
+        glm::vec3 min, max;
+        GetInstanceBounds(palms[i], meshMin, meshMax, min, max);
+        bvh.Insert(i, min, max);
+    }
+    bvh.Rebuild();
+
+    // What the instance buffer holds
+    std::vector<InstanceTransform> buffered = palms;
+    DirtyRanges dirty;
+
+    const size_t stride = static_cast<size_t>(100 / state.GetArg());
+    // Back and forth, so that the tree stays about as good
+    float offset = 0.01f;
+    size_t uploaded = 0;
+
+    while (state.KeepRunning())
+    {
+        offset = -offset;
+        for (size_t i = 0; i < palms.size(); i += stride)
+        {
+            palms[i].position.x += offset;
+
+            glm::vec3 min, max;
+            GetInstanceBounds(palms[i], meshMin, meshMax, min, max);
+            bvh.Move(static_cast<uint32_t>(i), min, max);
+        }
+        bvh.Update(pool);
+
+        for (uint32_t i = 0; i < palms.size(); ++i)
+        {
+            if (std::memcmp(&buffered[i], &palms[i], sizeof(InstanceTransform)) != 0)
+            {
+                buffered[i] = palms[i];
+                dirty.Add(i);
+            }
+        }
+        for (const DirtyRanges::Range& range : dirty.Coalesce())
+        {
+            uploaded += range.count;
+        }
+        dirty.Clear();
+    }
+
+    DoNotOptimize(uploaded);
+    state.SetItemsPerIteration(static_cast<int64_t>(palms.size() / stride));
+}
+BENCHMARK(DynamicInstances)->Arg(1)->Arg(10)->Arg(100);
+
+// Rays and swept spheres against the dunes, and against palms placed
+// through an instance BVH
+
+namespace
+{
+    constexpr size_t s_RayCount = 4096;
+
+    // From above the dunes, looking down at a slant as a camera would
+    std::vector<Ray> MakeRays()
+    {
+        std::mt19937_64 rng(s_BenchmarkSeed);
+        std::uniform_real_distribution<float> position(-0.45f * s_TerrainSize, 0.45f * s_TerrainSize);
+        std::uniform_real_distribution<float> slant(-1.f, 1.f);
+
+        std::vector<Ray> rays(s_RayCount);
+        for (Ray& ray : rays)
+        {
+            ray.origin = glm::vec3(position(rng), 10.f, position(rng));
+            ray.direction = glm::normalize(glm::vec3(slant(rng), -0.5f, slant(rng)));
+        }
+        return rays;
+    }
+
+    void CastDunes(BenchmarkState& state, bool wide, float radius)
+    {
+        const Dunes& dunes = GetDunes(state.GetArg());
+        TriangleBvhSettings settings;
+        settings.wide = wide;
+
+        TriangleBvh bvh;
+        bvh.Build(dunes.vertices, dunes.indices, GetBenchmarkPool(), settings);
+
+        const std::vector<Ray> rays = MakeRays();
+        size_t hits = 0;
+
+        while (state.KeepRunning())
+        {
+            for (const Ray& ray : rays)
+            {
+                RayHit hit;
+                hits += radius > 0.f ? bvh.SweepSphere(ray, radius, 1000.f, hit) : bvh.Raycast(ray, 1000.f, hit);
+            }
+        }
+
+        DoNotOptimize(hits);
+        state.SetItemsPerIteration(static_cast<int64_t>(rays.size()));
+    }
+}
+
+// Bounds on the pool, then the binned SAH tree and its 4-wide collapse
+void TriangleBvhBuild(BenchmarkState& state)
+{
+    const Dunes& dunes = GetDunes(state.GetArg());
+    ThreadPool& pool = GetBenchmarkPool();
+
+    while (state.KeepRunning())
+    {
+        TriangleBvh bvh;
+        bvh.Build(dunes.vertices, dunes.indices, pool);
+        DoNotOptimize(bvh.GetWideNodeCount());
+    }
+
+    state.SetItemsPerIteration(static_cast<int64_t>(dunes.indices.size() / 3));
+}
+BENCHMARK(TriangleBvhBuild)->Arg(32768)->Arg(524288);
+
+void RaycastDunes(BenchmarkState& state)
+{
+    CastDunes(state, false, 0.f);
+}
+BENCHMARK(RaycastDunes)->Arg(32768)->Arg(524288);
+
+void RaycastDunesWide(BenchmarkState& state)
+{
+    CastDunes(state, true, 0.f);
+}
+BENCHMARK(RaycastDunesWide)->Arg(32768)->Arg(524288);
+
+void SweepSphereDunes(BenchmarkState& state)
+{
+    CastDunes(state, true, 0.5f);
+}
+BENCHMARK(SweepSphereDunes)->Arg(32768);
+
+// Rays through the instance tree into a box trunk mesh per palm
+void RaycastPalms(BenchmarkState& state)
+{
+    const std::vector<InstanceTransform> palms = MakePalms(state.GetArg());
+    const glm::vec3 meshMin(-1.f, 0.f, -1.f);
+    const glm::vec3 meshMax(1.f, 8.f, 1.f);
+
+    std::vector<VertexDataPosition3fColor3f> vertices;
+    for (uint32_t corner = 0; corner < 8; ++corner)
+    {
+        const glm::vec3 position((corner & 1) ? meshMax.x : meshMin.x, (corner & 2) ? meshMax.y : meshMin.y, (corner & 4) ? meshMax.z : meshMin.z);
+        vertices.push_back({ position, glm::vec3(0.f, 1.f, 0.f), glm::vec3(0.5f) });
+    }
+    const std::vector<uint32_t> indices = { 0, 2, 1, 1, 2, 3, 4, 5, 6, 5, 7, 6, 0, 1, 4, 1, 5, 4,
+                                            2, 6, 3, 3, 6, 7, 0, 4, 2, 2, 4, 6, 1, 3, 5, 3, 7, 5 };
+
+    TriangleBvh trunk;
+    trunk.Build(vertices, indices, GetBenchmarkPool());
+
+    std::vector<uint32_t> items(palms.size());
+    std::vector<glm::vec3> mins(palms.size());
+    std::vector<glm::vec3> maxs(palms.size());
+    for (uint32_t i = 0; i < palms.size(); ++i)
+    {
+        items[i] = i;
+        GetInstanceBounds(palms[i], meshMin, meshMax, mins[i], maxs[i]);
+    }
+
+    BoundsBvh instances;
+    instances.Build(items, mins, maxs);
+
+    auto getMesh = [&palms, &trunk](uint32_t item, InstanceTransform& transform) -> const TriangleBvh*
+    {
+        transform = palms[item];
+        return &trunk;
+    };
+
+    const std::vector<Ray> rays = MakeRays();
+    size_t hits = 0;
+
+    while (state.KeepRunning())
+    {
+        for (const Ray& ray : rays)
+        {
+            InstanceHit hit;
+            hits += IntersectInstances(instances, ray, 0.f, 1000.f, getMesh, hit);
+        }
+    }
+
+    DoNotOptimize(hits);
+    state.SetItemsPerIteration(static_cast<int64_t>(rays.size()));
+}
+BENCHMARK(RaycastPalms)->Arg(100000);
+
+END_VISUALIZER_NAMESPACE
@@ -0,0 +1,110 @@
+#include <charconv>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string_view>
+
+#include "microbench.hpp"
+
+namespace
+{
+    template<typename T>
+    bool ParseValue(int32_t& i, int32_t argc, char** argv, T& value)
+    {
+        if (i + 1 >= argc)
+        {
+            std::cerr << "Missing value after " << argv[i] << '\n';
+            return false;
+        }
+
+        const std::string_view text(argv[++i]);
+        const auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), value);
+
+        if (error != std::errc() || end != text.data() + text.size())
+        {
+            std::cerr << "Invalid value for " << argv[i - 1] << ": " << text << '\n';
+            return false;
+        }
+        return true;
+    }
+
+    bool ParseSettings(int32_t argc, char** argv, visualizer::BenchmarkSettings& settings)
+    {
+        for (int32_t i = 1; i < argc; ++i)
+        {
+            const std::string_view arg(argv[i]);
+            bool parsed = true;
+
+            if (arg == "--filter" && i + 1 < argc)
+            {
+                settings.filter = argv[++i];
+            }
+            else if (arg == "--json" && i + 1 < argc)
+            {
+                settings.jsonPath = argv[++i];
+            }
+            else if (arg == "--repetitions")
+            {
+                parsed = ParseValue(i, argc, argv, settings.repetitions) && settings.repetitions > 0;
+            }
+            else if (arg == "--min-time")
+            {
+                parsed = ParseValue(i, argc, argv, settings.minSeconds);
+            }
+            else if (arg == "--cpu")
+            {
+                parsed = ParseValue(i, argc, argv, settings.cpu);
+            }
+            else
+            {
+                std::cerr << "Usage: " << argv[0] << " [--filter text] [--json file] [--repetitions n] [--min-time seconds] [--cpu index, -1 to not pin]\n";
+                return false;
+            }
+
+            if (!parsed)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+}
+
+int32_t main(int32_t argc, char** argv)
+{
+    visualizer::BenchmarkSettings settings;
+
+    if (!ParseSettings(argc, argv, settings))
+    {
+        return EXIT_FAILURE;
+    }
+
+    if (settings.cpu >= 0 && !visualizer::PinCurrentThread(settings.cpu))
+    {
+        std::cerr << "Cannot pin to CPU " << settings.cpu << ", running unpinned\n";
+        settings.cpu = -1;
+    }
+
+    const std::vector<visualizer::BenchmarkResult> results = visualizer::BenchmarkRegistry::GetGlobal().Run(settings, std::cout);
+
+    if (!settings.jsonPath.empty())
+    {
+        std::ofstream ofs(settings.jsonPath, std::ios::trunc);
+        visualizer::WriteBenchmarkJson(ofs, settings, results);
+
+        if (!ofs)
+        {
+            std::cerr << "Cannot write file : " << settings.jsonPath << '\n';
+            return EXIT_FAILURE;
+        }
+    }
+
+    for (const visualizer::BenchmarkResult& result : results)
+    {
+        if (!result.error.empty())
+        {
+            return EXIT_FAILURE;
+        }
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,300 @@
+#include <algorithm>
+#include <cmath>
+#include <ctime>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <thread>
+
+#ifdef _WIN32
+#include <Windows.h>
+#elif defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include "microbench.hpp"
+
+BEGIN_VISUALIZER_NAMESPACE
+
+namespace
+{
+    // Calibration grows the iteration count at most this much per try
+    constexpr double s_MaxGrowth = 10.0;
+    constexpr uint64_t s_MaxIterations = 1'000'000'000;
+
+    double ToSeconds(std::chrono::steady_clock::duration duration)
+    {
+        return std::chrono::duration<double>(duration).count();
+    }
+
+    bool RunOnce(const Benchmark& benchmark, int64_t arg, uint64_t iterations, BenchmarkState& state)
+    {
+        state = BenchmarkState(arg, iterations);
+        benchmark.GetFunction()(state);
+        return !state.HasError();
+    }
+
+    std::string FormatTime(double ns)
+    {
+        std::ostringstream ss;
+        ss << std::fixed << std::setprecision(ns < 10.0 ? 2 : ns < 1000.0 ? 1 : 0);
+
+        if (ns < 1e4)
+        {
+            ss << ns << " ns";
+        }
+        else if (ns < 1e7)
+        {
+            ss << ns * 1e-3 << " us";
+        }
+        else
+        {
+            ss << ns * 1e-6 << " ms";
+        }
+        return ss.str();
+    }
+
+    BenchmarkResult RunBenchmark(const Benchmark& benchmark, const std::string& name, int64_t arg, const BenchmarkSettings& settings)
+    {
+        BenchmarkResult result;
+        result.name = name;
+
+        BenchmarkState state(arg, 1);
+
+        // Grow the count until one run lasts minSeconds, aiming a bit past
+        // it so that repetitions do not fall short
+        uint64_t iterations = 1;
+        while (true)
+        {
+            if (!RunOnce(benchmark, arg, iterations, state))
+            {
+                result.error = state.GetError();
+                return result;
+            }
+
+            const double seconds = ToSeconds(state.GetElapsed());
+            if (seconds >= settings.minSeconds || iterations >= s_MaxIterations)
+            {
+                break;
+            }
+
+            const double growth = seconds > 0.0 ? std::clamp(settings.minSeconds * 1.4 / seconds, 2.0, s_MaxGrowth) : s_MaxGrowth;
+            iterations = std::min(static_cast<uint64_t>(iterations * growth), s_MaxIterations);
+        }
+
+        std::vector<double> nsPerIteration;
+        nsPerIteration.reserve(settings.repetitions);
+
+        for (uint32_t repetition = 0; repetition < settings.repetitions; ++repetition)
+        {
+            if (!RunOnce(benchmark, arg, iterations, state))
+            {
+                result.error = state.GetError();
+                return result;
+            }
+            nsPerIteration.push_back(ToSeconds(state.GetElapsed()) * 1e9 / static_cast<double>(iterations));
+        }
+
+        std::sort(nsPerIteration.begin(), nsPerIteration.end());
+
+        const size_t count = nsPerIteration.size();
+        result.iterations = iterations;
+        result.medianNs = count % 2 ? nsPerIteration[count / 2] : 0.5 * (nsPerIteration[count / 2 - 1] + nsPerIteration[count / 2]);
+        result.minNs = nsPerIteration.front();
+        result.maxNs = nsPerIteration.back();
+
+        if (result.medianNs > 0.0)
+        {
+            result.itemsPerSecond = state.GetItemsPerIteration() * 1e9 / result.medianNs;
+            result.bytesPerSecond = state.GetBytesPerIteration() * 1e9 / result.medianNs;
+        }
+
+        return result;
+    }
+
+    void PrintResult(std::ostream& os, const BenchmarkResult& result)
+    {
+        os << std::left << std::setw(40) << result.name << std::right;
+
+        if (!result.error.empty())
+        {
+            os << "  ERROR: " << result.error << '\n';
+            return;
+        }
+
+        os << std::setw(14) << FormatTime(result.medianNs) << std::setw(14) << FormatTime(result.minNs) << std::setw(14) << FormatTime(result.maxNs)
+           << std::setw(12) << result.iterations;
+
+        if (result.itemsPerSecond > 0.0)
+        {
+            os << "  " << std::fixed << std::setprecision(2) << result.itemsPerSecond * 1e-6 << " M items/s";
+        }
+        if (result.bytesPerSecond > 0.0)
+        {
+            os << "  " << std::fixed << std::setprecision(1) << result.bytesPerSecond / (1 << 20) << " MiB/s";
+        }
+        os << '\n' << std::flush;
+    }
+
+    void WriteJsonString(std::ostream& os, const std::string& value)
+    {
+        os << '"';
+        for (char c : value)
+        {
+            if (c == '"' || c == '\\')
+            {
+                os << '\\';
+            }
+            os << c;
+        }
+        os << '"';
+    }
+}
+
+BenchmarkState::BenchmarkState(int64_t arg, uint64_t iterations) :
+    m_Arg(arg),
+    m_Iterations(iterations),
+    m_Left(iterations)
+{}
+
+void BenchmarkState::PauseTiming()
+{
+    m_Elapsed += std::chrono::steady_clock::now() - m_Start;
+}
+
+void BenchmarkState::ResumeTiming()
+{
+    m_Start = std::chrono::steady_clock::now();
+}
+
+void BenchmarkState::SkipWithError(const std::string& message)
+{
+    m_Error = message;
+    m_Left = 0;
+}
+
+Benchmark::Benchmark(std::string name, BenchmarkFunction function) :
+    m_Name(std::move(name)),
+    m_Function(std::move(function))
+{}
+
+Benchmark* Benchmark::Arg(int64_t arg)
+{
+    m_Args.push_back(arg);
+    return this;
+}
+
+BenchmarkRegistry& BenchmarkRegistry::GetGlobal()
+{
+    static BenchmarkRegistry registry;
+    return registry;
+}
+
+Benchmark* BenchmarkRegistry::Register(std::string name, BenchmarkFunction function)
+{
+    return &m_Benchmarks.emplace_back(std::move(name), std::move(function));
+}
+
+std::vector<BenchmarkResult> BenchmarkRegistry::Run(const BenchmarkSettings& settings, std::ostream& os) const
+{
+    std::vector<BenchmarkResult> results;
+
+    os << std::left << std::setw(40) << "benchmark" << std::right << std::setw(14) << "median" << std::setw(14) << "min" << std::setw(14) << "max"
+       << std::setw(12) << "iterations" << '\n';
+
+    for (const Benchmark& benchmark : m_Benchmarks)
+    {
+        // Without arguments the benchmark runs once, with an argument of 0
+        const std::vector<int64_t> args = benchmark.GetArgs().empty() ? std::vector<int64_t>{ 0 } : benchmark.GetArgs();
+
+        for (int64_t arg : args)
+        {
+            const std::string name = benchmark.GetArgs().empty() ? benchmark.GetName() : benchmark.GetName() + '/' + std::to_string(arg);
+
+            if (!settings.filter.empty() && name.find(settings.filter) == std::string::npos)
+            {
+                continue;
+            }
+
+            results.push_back(RunBenchmark(benchmark, name, arg, settings));
+            PrintResult(os, results.back());
+        }
+    }
+
+    return results;
+}
+
+#ifdef _WIN32
+
+bool PinCurrentThread(int32_t cpu)
+{
+    if (cpu < 0 || cpu >= 64)
+    {
+        return false;
+    }
+
+    // A busy core still takes turns with other threads, raising the
+    // priority keeps those interruptions short
+    SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_HIGHEST);
+    return SetThreadAffinityMask(GetCurrentThread(), DWORD_PTR(1) << cpu) != 0;
+}
+
+#elif defined(__linux__)
+
+bool PinCurrentThread(int32_t cpu)
+{
+    if (cpu < 0 || cpu >= CPU_SETSIZE)
+    {
+        return false;
+    }
+
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+}
+
+#else
+
+bool PinCurrentThread(int32_t)
+{
+    return false;
+}
+
+#endif
+
+void WriteBenchmarkJson(std::ostream& os, const BenchmarkSettings& settings, const std::vector<BenchmarkResult>& results)
+{
+    const std::time_t now = std::time(nullptr);
+    char date[32] = {};
+    std::strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%SZ", std::gmtime(&now));
+
+    os << std::setprecision(10) << "{\n  \"context\": {\n    \"date\": \"" << date << "\",\n    \"hardwareThreads\": " << std::thread::hardware_concurrency()
+       << ",\n    \"pinnedCpu\": " << settings.cpu << ",\n    \"repetitions\": " << settings.repetitions << ",\n    \"minSeconds\": " << settings.minSeconds
+       << ",\n    \"seed\": " << s_BenchmarkSeed << "\n  },\n  \"benchmarks\": [\n";
+
+    for (size_t i = 0; i < results.size(); ++i)
+    {
+        const BenchmarkResult& result = results[i];
+
+        os << "    { \"name\": ";
+        WriteJsonString(os, result.name);
+
+        if (!result.error.empty())
+        {
+            os << ", \"error\": ";
+            WriteJsonString(os, result.error);
+        }
+        else
+        {
+            os << ", \"iterations\": " << result.iterations << ", \"medianNs\": " << result.medianNs << ", \"minNs\": " << result.minNs << ", \"maxNs\": "
+               << result.maxNs << ", \"itemsPerSecond\": " << result.itemsPerSecond << ", \"bytesPerSecond\": " << result.bytesPerSecond;
+        }
+        os << (i + 1 < results.size() ? " },\n" : " }\n");
+    }
+
+    os << "  ]\n}\n";
+}
+
+END_VISUALIZER_NAMESPACE
@@ -0,0 +1,175 @@
+#ifndef MICROBENCH_HPP
+#define MICROBENCH_HPP
+
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+#include "Visualizer.hpp"
+
+BEGIN_VISUALIZER_NAMESPACE
+
+// What a benchmark function sees of its run: the argument it was
+// registered with and a loop to put the measured code in,
+//
+//     while (state.KeepRunning())
+//     {
+//         DoNotOptimize(Work(state.GetArg()));
+//     }
+//
+// Set-up before the loop and tear-down after it are not timed.
+class BenchmarkState
+{
+public:
+    BenchmarkState(int64_t arg, uint64_t iterations);
+
+    inline bool KeepRunning()
+    {
+        if (m_Left == m_Iterations)
+        {
+            m_Start = std::chrono::steady_clock::now();
+        }
+        if (m_Left > 0)
+        {
+            --m_Left;
+            return true;
+        }
+
+        m_Elapsed += std::chrono::steady_clock::now() - m_Start;
+        return false;
+    }
+
+    // For work inside the loop that must not count, such as restoring
+    // what an iteration consumed
+    void PauseTiming();
+    void ResumeTiming();
+
+    inline int64_t GetArg() const { return m_Arg; }
+    inline uint64_t GetIterations() const { return m_Iterations; }
+    inline std::chrono::steady_clock::duration GetElapsed() const { return m_Elapsed; }
+
+    // Per iteration, turned into rates in the report
+    inline void SetItemsPerIteration(int64_t items) { m_ItemsPerIteration = items; }
+    inline void SetBytesPerIteration(int64_t bytes) { m_BytesPerIteration = bytes; }
+    inline int64_t GetItemsPerIteration() const { return m_ItemsPerIteration; }
+    inline int64_t GetBytesPerIteration() const { return m_BytesPerIteration; }
+
+    // Marks the run as failed, the message ends up in the report
+    void SkipWithError(const std::string& message);
+    inline bool HasError() const { return !m_Error.empty(); }
+    inline const std::string& GetError() const { return m_Error; }
+
+private:
+    int64_t m_Arg;
+    uint64_t m_Iterations;
+    uint64_t m_Left;
+    std::chrono::steady_clock::time_point m_Start;
+    std::chrono::steady_clock::duration m_Elapsed{};
+    int64_t m_ItemsPerIteration = 0;
+    int64_t m_BytesPerIteration = 0;
+    std::string m_Error;
+};
+
+// Keeps the compiler from dropping a computation whose result is unused
+template<typename T>
+inline void DoNotOptimize(const T& value)
+{
+#ifdef _MSC_VER
+    const volatile char sink = *reinterpret_cast<const volatile char*>(&value);
+    (void)sink;
+    _ReadWriteBarrier();
+#else
+    asm volatile("" : : "r,m"(value) : "memory");
+#endif
+}
+
+using BenchmarkFunction = std::function<void(BenchmarkState&)>;
+
+class Benchmark
+{
+public:
+    Benchmark(std::string name, BenchmarkFunction function);
+
+    // Runs the benchmark once per argument, named "name/arg"
+    Benchmark* Arg(int64_t arg);
+
+    inline const std::string& GetName() const { return m_Name; }
+    inline const BenchmarkFunction& GetFunction() const { return m_Function; }
+    inline const std::vector<int64_t>& GetArgs() const { return m_Args; }
+
+private:
+    std::string m_Name;
+    BenchmarkFunction m_Function;
+    std::vector<int64_t> m_Args;
+};
+
+struct BenchmarkSettings
+{
+    // Substring of the names to run, all of them when empty
+    std::string filter;
+    // Each repetition runs for at least this long
+    double minSeconds = 0.25;
+    uint32_t repetitions = 5;
+    // Core the benchmarks are pinned to, none when negative
+    int32_t cpu = 0;
+    std::string jsonPath;
+};
+
+// Timings of every repetition are reduced to their median and extremes,
+// per iteration
+struct BenchmarkResult
+{
+    std::string name;
+    uint64_t iterations = 0;
+    double medianNs = 0.0;
+    double minNs = 0.0;
+    double maxNs = 0.0;
+    double itemsPerSecond = 0.0;
+    double bytesPerSecond = 0.0;
+    std::string error;
+};
+
+// Self-registering list of benchmarks, filled by static initializers of
+// the files defining them
+class BenchmarkRegistry
+{
+public:
+    static BenchmarkRegistry& GetGlobal();
+
+    Benchmark* Register(std::string name, BenchmarkFunction function);
+
+    // Runs what passes the filter, printing one line per benchmark as it
+    // completes
+    std::vector<BenchmarkResult> Run(const BenchmarkSettings& settings, std::ostream& os) const;
+
+private:
+    // Stable addresses for the registration chains
+    std::deque<Benchmark> m_Benchmarks;
+};
+
+// Seed of everything the benchmarks generate, so runs see the same data
+constexpr uint64_t s_BenchmarkSeed = 0x5EED;
+
+bool PinCurrentThread(int32_t cpu);
+void WriteBenchmarkJson(std::ostream& os, const BenchmarkSettings& settings, const std::vector<BenchmarkResult>& results);
+
+END_VISUALIZER_NAMESPACE
+
+#define VISUALIZER_BENCHMARK_CONCAT_(a, b) a##b
+#define VISUALIZER_BENCHMARK_CONCAT(a, b) VISUALIZER_BENCHMARK_CONCAT_(a, b)
+
+// BENCHMARK(Function) registers void Function(BenchmarkState&) under its
+// name, arguments chain on: BENCHMARK(LoadMesh)->Arg(1024)->Arg(65536);
+#define BENCHMARK(function) \
+    [[maybe_unused]] static ::visualizer::Benchmark* VISUALIZER_BENCHMARK_CONCAT(s_Benchmark, __LINE__) = \
+        ::visualizer::BenchmarkRegistry::GetGlobal().Register(#function, function)
+
+#endif // !MICROBENCH_HPP
@@ -0,0 +1,85 @@
+#ifndef ALLOC_TRACKING_HPP
+#define ALLOC_TRACKING_HPP
+
+#include <cstdint>
+#include <ostream>
+#include <span>
+
+#include "Visualizer.hpp"
+
+// Define to 1 to replace the global allocation functions with counting
+// ones: operator new/delete everywhere, plus malloc and friends on glibc,
+// where operator new goes through malloc. Meant for profiling builds only;
+// the Profile|x64 configuration sets it.
+#ifndef VISUALIZER_TRACK_ALLOCATIONS
+#define VISUALIZER_TRACK_ALLOCATIONS 0
+#endif
+
+BEGIN_VISUALIZER_NAMESPACE
+
+struct AllocationCounters
+{
+    uint64_t allocations = 0;
+    uint64_t frees = 0;
+    uint64_t bytes = 0;
+};
+
+struct ThreadAllocationCounters
+{
+    uint32_t slot = 0;
+    AllocationCounters counters;
+};
+
+// Counters are kept per thread, in a fixed table so that the hooks never
+// allocate themselves. Without VISUALIZER_TRACK_ALLOCATIONS everything
+// reads zero.
+class AllocationTracker
+{
+public:
+    static constexpr bool s_Enabled = VISUALIZER_TRACK_ALLOCATIONS != 0;
+    static constexpr uint32_t s_MaxThreads = 64;
+
+    // Cumulative counters of the calling thread
+    static AllocationCounters GetThreadCounters();
+    // Slot of the calling thread in the table, for matching GetAllThreadCounters()
+    static uint32_t GetThreadSlot();
+    // Fills out with every thread seen so far and returns how many were written
+    static size_t GetAllThreadCounters(std::span<ThreadAllocationCounters> out);
+
+    // Record the call stack of every allocation the calling thread makes
+    // until unwatched. Identical stacks are merged.
+    static void WatchCurrentThread(bool watch);
+    static void PrintOffenders(std::ostream& os, size_t maxStacks = 8);
+};
+
+// Verifies that the frames of a loop stop allocating once warmed up.
+// Frames are checked on the thread that calls BeginFrame/EndFrame; the
+// other threads are only reported.
+class FrameAllocationCheck
+{
+public:
+    explicit FrameAllocationCheck(uint32_t warmupFrames);
+
+    void BeginFrame();
+    void EndFrame();
+
+    inline bool HasFailed() const { return m_OffendingFrames > 0; }
+    void PrintReport(std::ostream& os) const;
+
+private:
+    uint32_t m_WarmupFrames;
+    uint64_t m_Frame = 0;
+    uint64_t m_CheckedFrames = 0;
+    uint64_t m_OffendingFrames = 0;
+    uint64_t m_FirstOffendingFrame = 0;
+    AllocationCounters m_FrameStart;
+    AllocationCounters m_Total;
+    AllocationCounters m_Worst;
+
+    ThreadAllocationCounters m_ThreadsAtStart[AllocationTracker::s_MaxThreads];
+    size_t m_ThreadCountAtStart = 0;
+};
+
+END_VISUALIZER_NAMESPACE
+
+#endif // !ALLOC_TRACKING_HPP
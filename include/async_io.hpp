@@ -0,0 +1,149 @@
+#ifndef ASYNC_IO_HPP
+#define ASYNC_IO_HPP
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+#include "Visualizer.hpp"
+
+BEGIN_VISUALIZER_NAMESPACE
+
+class ThreadPool;
+
+enum class IoPriority : uint8_t
+{
+    // Needed for what is on screen now, issued first
+    Visible,
+    // Needed soon, issued when no visible read waits
+    Prefetch
+};
+
+enum class IoStatus : uint8_t
+{
+    Completed,
+    Failed,
+    Cancelled
+};
+
+struct ReadResult
+{
+    IoStatus status = IoStatus::Failed;
+    // Shorter than asked when the file ends first
+    std::unique_ptr<std::byte[]> data;
+    size_t size = 0;
+
+    inline std::span<const std::byte> GetBytes() const { return { data.get(), size }; }
+};
+
+using ReadCallback = std::function<void(ReadResult&&)>;
+using IoTicket = uint64_t;
+
+// As a read size, everything from the offset on
+constexpr size_t s_ReadToEnd = ~size_t(0);
+
+struct ReadRequest
+{
+    std::string path;
+    uint64_t offset = 0;
+    size_t size = s_ReadToEnd;
+    IoPriority priority = IoPriority::Visible;
+    ReadCallback callback;
+};
+
+struct AsyncIoStats
+{
+    uint64_t reads = 0;
+    uint64_t failed = 0;
+    uint64_t cancelled = 0;
+    uint64_t bytesRead = 0;
+    // io_uring_enter calls, each submitting every read ready at the time
+    uint64_t submissions = 0;
+    uint32_t maxInFlight = 0;
+};
+
+// Reads files without blocking the caller or a worker per read. On Linux
+// the reads go through an io_uring driven by one thread, so queueDepth of
+// them are in flight at once; elsewhere, or where io_uring is missing,
+// they are spread over the thread pool. Queued reads are issued visible
+// first, and prefetches never take the last quarter of the queue.
+// Callbacks run on the I/O thread or a pool worker, and should hand any
+// heavy work to the pool.
+class AsyncFileReader
+{
+public:
+    explicit AsyncFileReader(ThreadPool& pool, uint32_t queueDepth = 64);
+    // Cancels every read and waits for those in flight to report back
+    ~AsyncFileReader();
+
+    AsyncFileReader(const AsyncFileReader&) = delete;
+    AsyncFileReader(AsyncFileReader&&) = delete;
+
+    AsyncFileReader& operator=(const AsyncFileReader&) = delete;
+    AsyncFileReader& operator=(AsyncFileReader&&) = delete;
+
+    IoTicket ReadAsync(const std::string& path, uint64_t offset, size_t size, IoPriority priority, ReadCallback callback);
+    std::future<ReadResult> ReadAsync(const std::string& path, uint64_t offset, size_t size, IoPriority priority);
+    // Queues them all at once, to be submitted together. Their callbacks
+    // are moved from, and tickets receives one per request when given.
+    void ReadBatch(std::span<ReadRequest> requests, IoTicket* tickets = nullptr);
+
+    // Queued reads are dropped and reads in flight stopped where the OS
+    // allows; the callback then sees IoStatus::Cancelled. Returns false
+    // for reads that already reported back.
+    bool Cancel(IoTicket ticket);
+
+    inline bool UsesIoUring() const { return m_Ring != nullptr; }
+    AsyncIoStats GetStats() const;
+
+private:
+    struct Request;
+    struct Ring;
+
+    // Next queued read that may be issued, null when none. Called with
+    // m_Mutex held.
+    std::shared_ptr<Request> PopNext();
+    // Reports the read and frees its slot, returning the next read for a
+    // pool task to go on with
+    std::shared_ptr<Request> Finish(Request& request);
+    void Wake();
+
+    // Thread pool backend
+    void Dispatch();
+    void ReadBlocking(Request& request);
+
+    // io_uring backend
+    void RingLoop();
+
+    ThreadPool& m_Pool;
+    const uint32_t m_QueueDepth;
+    const uint32_t m_PrefetchDepth;
+
+    mutable std::mutex m_Mutex;
+    std::condition_variable m_Idle;
+    std::deque<std::shared_ptr<Request>> m_Queues[2];
+    // Queued or in flight, by ticket
+    std::unordered_map<IoTicket, std::shared_ptr<Request>> m_Pending;
+    std::deque<IoTicket> m_Cancels;
+    IoTicket m_NextTicket = 0;
+    uint32_t m_InFlight = 0;
+    uint32_t m_PrefetchInFlight = 0;
+    bool m_Stop = false;
+    AsyncIoStats m_Stats;
+
+    std::unique_ptr<Ring> m_Ring;
+    std::thread m_RingThread;
+};
+
+END_VISUALIZER_NAMESPACE
+
+#endif // !ASYNC_IO_HPP
@@ -0,0 +1,322 @@
+#ifndef BOUNDS_BVH_HPP
+#define BOUNDS_BVH_HPP
+
+#pragma warning(push, 0)
+#include <glm/glm.hpp>
+#pragma warning(pop, 0)
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <vector>
+
+#include "Visualizer.hpp"
+
+BEGIN_VISUALIZER_NAMESPACE
+
+class ThreadPool;
+
+// A leaf when count is non-zero, holding items [first, first + count) of
+// the item array; otherwise its children are nodes first and first + 1
+struct BvhNode
+{
+    glm::vec3 min;
+    uint32_t first;
+    glm::vec3 max;
+    uint32_t count;
+
+    inline bool IsLeaf() const { return count > 0; }
+};
+
+static_assert(sizeof(BvhNode) == 32, "BvhNode must stay 32 bytes");
+
+// Points origin + t * direction for t >= 0. Distances along it are in
+// units of the direction's length, which need not be one.
+struct Ray
+{
+    glm::vec3 origin;
+    glm::vec3 direction;
+};
+
+// Slab test against the box grown by margin, entry being where the ray
+// goes in, or 0 when it starts inside. inverseDirection is 1 / direction.
+inline bool IntersectBox(const glm::vec3& origin, const glm::vec3& inverseDirection, const glm::vec3& min, const glm::vec3& max, float margin, float maxDistance, float& entry)
+{
+    const glm::vec3 t0 = (min - glm::vec3(margin) - origin) * inverseDirection;
+    const glm::vec3 t1 = (max + glm::vec3(margin) - origin) * inverseDirection;
+    const glm::vec3 entries = glm::min(t0, t1);
+    const glm::vec3 exits = glm::max(t0, t1);
+
+    entry = std::max(std::max(entries.x, entries.y), std::max(entries.z, 0.f));
+    return entry <= std::min(std::min(exits.x, exits.y), std::min(exits.z, maxDistance));
+}
+
+struct BvhBuildSettings
+{
+    // Leaves are split down to this many items, and kept up to
+    // s_MaxLeafSize when splitting them costs more
+    uint32_t leafSize = 4;
+    // Candidate split planes per axis are the bin boundaries
+    uint32_t binCount = 16;
+};
+
+// Bounding volume hierarchy over boxes given by id, built with the binned
+// surface area heuristic. Children are stored after their parent, so
+// refitting bottom up is a reverse walk over the nodes.
+class BoundsBvh
+{
+public:
+    static constexpr uint32_t s_NoNode = ~0u;
+    static constexpr uint32_t s_MaxLeafSize = 16;
+    // Splits fall back to the median below this depth, which bounds it
+    static constexpr uint32_t s_MaxSahDepth = 48;
+    static constexpr uint32_t s_MaxDepth = 96;
+    // Smaller trees are built on the calling thread alone
+    static constexpr size_t s_ParallelBuildThreshold = 16384;
+    // Subtrees handed to the pool per thread, to even out their sizes
+    static constexpr size_t s_BuildTasksPerThread = 8;
+
+    // mins and maxs are indexed by item id, the tree holding items only
+    void Build(std::span<const uint32_t> items, std::span<const glm::vec3> mins, std::span<const glm::vec3> maxs, const BvhBuildSettings& settings = {});
+    // Same tree, the subtrees below the first few levels built on the pool
+    void Build(std::span<const uint32_t> items, std::span<const glm::vec3> mins, std::span<const glm::vec3> maxs, const BvhBuildSettings& settings, ThreadPool& pool);
+    // Takes nodes and items as a Build() laid them out, from a file say.
+    // Returns false, leaving the tree empty, when they do not form a tree
+    // over item ids below itemCapacity.
+    bool Assign(std::vector<BvhNode> nodes, std::vector<uint32_t> items, size_t itemCapacity);
+    void Clear();
+
+    // New bounds for every node
+    void Refit(std::span<const glm::vec3> mins, std::span<const glm::vec3> maxs);
+    // Only for the leaves of these items and the nodes above them whose
+    // bounds change
+    void RefitItems(std::span<const uint32_t> items, std::span<const glm::vec3> mins, std::span<const glm::vec3> maxs);
+
+    inline bool IsEmpty() const { return m_Nodes.empty(); }
+    inline std::span<const BvhNode> GetNodes() const { return m_Nodes; }
+    inline std::span<const uint32_t> GetItems() const { return m_Items; }
+    inline uint32_t GetItemLeaf(uint32_t item) const { return item < m_ItemLeaves.size() ? m_ItemLeaves[item] : s_NoNode; }
+
+    // Expected cost of a query by the surface area heuristic, relative to
+    // the root; grows as refits loosen the tree
+    float GetCost() const;
+    inline float GetBuildCost() const { return m_BuildCost; }
+
+    // Calls enter(index, node) for every node reached from root, going
+    // below it when it returns true, and visit(item) for every item of the
+    // leaves entered
+    template<typename EnterFn, typename VisitFn>
+    void Traverse(uint32_t root, EnterFn&& enter, VisitFn&& visit) const
+    {
+        if (m_Nodes.empty())
+        {
+            return;
+        }
+
+        std::array<uint32_t, s_MaxDepth + 1> stack;
+        uint32_t depth = 0;
+        stack[depth++] = root;
+
+        while (depth > 0)
+        {
+            const uint32_t index = stack[--depth];
+            const BvhNode& node = m_Nodes[index];
+
+            if (!enter(index, node))
+            {
+                continue;
+            }
+
+            if (node.IsLeaf())
+            {
+                for (uint32_t i = node.first; i < node.first + node.count; ++i)
+                {
+                    visit(m_Items[i]);
+                }
+                continue;
+            }
+
+            stack[depth++] = node.first + 1;
+            stack[depth++] = node.first;
+        }
+    }
+
+    // Visits the leaves the ray enters before maxDistance, nearest first,
+    // through visit(leaf, maxDistance). The visitor shortens maxDistance to
+    // its own hits, which skips the farther nodes. Boxes are grown by
+    // margin, to sweep a sphere of that radius.
+    template<typename VisitFn>
+    void Raycast(const Ray& ray, float maxDistance, VisitFn&& visit, float margin = 0.f) const
+    {
+        if (m_Nodes.empty())
+        {
+            return;
+        }
+
+        struct Entry
+        {
+            uint32_t index;
+            float distance;
+        };
+
+        const glm::vec3 inverseDirection = 1.f / ray.direction;
+        std::array<Entry, s_MaxDepth + 1> stack;
+        uint32_t depth = 0;
+
+        float distance;
+        if (IntersectBox(ray.origin, inverseDirection, m_Nodes[0].min, m_Nodes[0].max, margin, maxDistance, distance))
+        {
+            stack[depth++] = { 0, distance };
+        }
+
+        while (depth > 0)
+        {
+            const Entry entry = stack[--depth];
+            if (entry.distance > maxDistance)
+            {
+                continue;
+            }
+
+            const BvhNode& node = m_Nodes[entry.index];
+            if (node.IsLeaf())
+            {
+                visit(node, maxDistance);
+                continue;
+            }
+
+            // Near and far are macros on Windows
+            Entry first{ node.first, 0.f };
+            Entry second{ node.first + 1, 0.f };
+            const bool hitFirst = IntersectBox(ray.origin, inverseDirection, m_Nodes[first.index].min, m_Nodes[first.index].max, margin, maxDistance, first.distance);
+            const bool hitSecond = IntersectBox(ray.origin, inverseDirection, m_Nodes[second.index].min, m_Nodes[second.index].max, margin, maxDistance, second.distance);
+
+            if (hitFirst && hitSecond)
+            {
+                if (second.distance < first.distance)
+                {
+                    std::swap(first, second);
+                }
+                stack[depth++] = second;
+                stack[depth++] = first;
+            }
+            else if (hitFirst)
+            {
+                stack[depth++] = first;
+            }
+            else if (hitSecond)
+            {
+                stack[depth++] = second;
+            }
+        }
+    }
+
+    // visit(item) for every item below the node
+    template<typename VisitFn>
+    void ForEachItem(uint32_t root, VisitFn&& visit) const
+    {
+        Traverse(root, [](uint32_t, const BvhNode&) { return true; }, visit);
+    }
+
+    // Replaces roots with the nodes at the top of the tree, splitting the
+    // largest subtrees first until there are at least count of them or only
+    // leaves are left; handy to spread a traversal over a pool
+    void CollectSubtrees(size_t count, std::vector<uint32_t>& roots) const;
+
+private:
+    // Grows when the node's own bounds grow, in cost units
+    inline float GetWeight(const BvhNode& node) const { return node.IsLeaf() ? static_cast<float>(node.count) : 1.f; }
+    void Build(std::span<const uint32_t> items, std::span<const glm::vec3> mins, std::span<const glm::vec3> maxs, const BvhBuildSettings& settings, ThreadPool* pool);
+    void AssignItemLeaves();
+    void ComputeCost();
+    void RefitNode(uint32_t index, std::span<const glm::vec3> mins, std::span<const glm::vec3> maxs);
+
+    std::vector<BvhNode> m_Nodes;
+    std::vector<uint32_t> m_Parents;
+    std::vector<uint32_t> m_Items;
+    std::vector<uint32_t> m_ItemLeaves;
+    // Sum of every node's area times its weight, kept up to date by refits
+    float m_CostSum = 0.f;
+    float m_BuildCost = 0.f;
+};
+
+// BoundsBvh over boxes that move, come and go. Moves are refitted into the
+// tree; inserted boxes wait outside it and removed ones stay in their leaf
+// until the next rebuild. Rebuilds run on the pool once the tree has
+// degraded enough, and are swapped in when done.
+class DynamicBoundsBvh
+{
+public:
+    // Rebuild once refits made a query this much more expensive than after
+    // the last build
+    static constexpr float s_RebuildCostRatio = 1.5f;
+    // Or once this share of the items waits outside the tree or is gone
+    static constexpr float s_RebuildChurnRatio = 0.125f;
+
+    DynamicBoundsBvh() = default;
+    ~DynamicBoundsBvh() = default;
+
+    DynamicBoundsBvh(const DynamicBoundsBvh&) = delete;
+    DynamicBoundsBvh(DynamicBoundsBvh&&) = delete;
+
+    DynamicBoundsBvh& operator=(const DynamicBoundsBvh&) = delete;
+    DynamicBoundsBvh& operator=(DynamicBoundsBvh&&) = delete;
+
+    // Item ids are the caller's, free to be reused after Remove()
+    void Insert(uint32_t item, const glm::vec3& min, const glm::vec3& max);
+    // Safe to call from several threads at once for different items
+    void Move(uint32_t item, const glm::vec3& min, const glm::vec3& max);
+    void Remove(uint32_t item);
+    void Clear();
+
+    // Refits the tree around what moved, takes in a finished rebuild and
+    // starts another one when due
+    void Update(ThreadPool& pool);
+    // Rebuilds on the calling thread, after loading
+    void Rebuild();
+
+    inline const BoundsBvh& GetTree() const { return m_Tree; }
+    // Items outside the tree, to be tested one by one
+    inline std::span<const uint32_t> GetPendingItems() const { return m_Pending; }
+
+    // The tree also holds removed items, skipped through this
+    inline bool IsAlive(uint32_t item) const { return item < m_Alive.size() && m_Alive[item]; }
+    inline size_t GetItemCapacity() const { return m_Alive.size(); }
+    inline const glm::vec3& GetMin(uint32_t item) const { return m_Mins[item]; }
+    inline const glm::vec3& GetMax(uint32_t item) const { return m_Maxs[item]; }
+    inline uint64_t GetRebuildCount() const { return m_RebuildCount; }
+
+private:
+    struct PendingRebuild
+    {
+        BoundsBvh tree;
+        std::atomic<bool> done{ false };
+    };
+
+    bool NeedsRebuild() const;
+    void StartRebuild(ThreadPool& pool);
+    // Swaps the rebuilt tree in, then accounts for what changed meanwhile
+    void Adopt(BoundsBvh&& tree);
+    void GatherLiveItems(std::vector<uint32_t>& items) const;
+
+    BoundsBvh m_Tree;
+    std::vector<glm::vec3> m_Mins;
+    std::vector<glm::vec3> m_Maxs;
+    std::vector<uint8_t> m_Alive;
+    std::vector<uint8_t> m_Moved;
+    std::atomic<bool> m_AnyMoved{ false };
+    std::vector<uint32_t> m_MovedItems;
+    std::vector<uint32_t> m_Pending;
+    size_t m_LiveInTree = 0;
+    size_t m_DeadInTree = 0;
+
+    // Shared with the rebuild job, which may outlive this
+    std::shared_ptr<PendingRebuild> m_Rebuild;
+    uint64_t m_RebuildCount = 0;
+};
+
+END_VISUALIZER_NAMESPACE
+
+#endif // !BOUNDS_BVH_HPP
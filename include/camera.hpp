@@ -35,6 +35,9 @@ public:
 	void MoveLeft(float dt);
 	void MoveRight(float dt);
 
+	void SetPosition(const glm::vec3& position);
+	void SetOrientation(float horizontalAngle, float verticalAngle);
+
 	void ComputeProjection(uint32_t, uint32_t);
 	
 	inline const glm::mat4& GetViewMatrix() const
@@ -82,11 +85,31 @@ public:
 		m_MouseMovementSpeed = mouseMovementSpeed;
     }
 
+	inline float GetHorizontalAngle() const
+	{
+		return m_HorizontalAngle;
+	}
+
+	inline float GetVerticalAngle() const
+	{
+		return m_VerticalAngle;
+	}
+
 	inline float GetFOV() const
 	{
 		return m_FOV;
 	}
 
+	inline float GetNear() const
+	{
+		return m_Near;
+	}
+
+	inline float GetFar() const
+	{
+		return m_Far;
+	}
+
 	inline void SetNear(float near)
 	{
 		m_Near = near;
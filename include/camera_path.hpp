@@ -0,0 +1,94 @@
+#ifndef CAMERA_PATH_HPP
+#define CAMERA_PATH_HPP
+
+#pragma warning(push, 0)
+#include <glm/glm.hpp>
+#pragma warning(pop, 0)
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "Visualizer.hpp"
+#include "options.hpp"
+
+BEGIN_VISUALIZER_NAMESPACE
+
+struct CameraKey
+{
+    // Seconds since the start of the recording
+    float time;
+    glm::vec3 position;
+    float horizontalAngle;
+    float verticalAngle;
+};
+
+// Timestamped camera poses, recorded while flying and replayed by
+// interpolating between them. Stored as text, one "key" line per pose.
+class CameraPath
+{
+public:
+    // Poses closer in time to the last key are dropped while recording
+    static constexpr float s_RecordInterval = 1.f / 30.f;
+
+    bool Load(const std::string& path);
+    bool Save(const std::string& path) const;
+
+    void Record(float time, const glm::vec3& position, float horizontalAngle, float verticalAngle);
+
+    // Clamped to the first and last keys
+    CameraKey Sample(float time) const;
+
+    inline bool IsEmpty() const { return m_Keys.empty(); }
+    inline size_t GetKeyCount() const { return m_Keys.size(); }
+    inline float GetStartTime() const { return m_Keys.empty() ? 0.f : m_Keys.front().time; }
+    inline float GetDuration() const { return m_Keys.empty() ? 0.f : m_Keys.back().time - m_Keys.front().time; }
+
+private:
+    std::vector<CameraKey> m_Keys;
+};
+
+// Replays a path at a fixed timestep, iterations times, collecting the
+// time and submitted work of every frame once past a warm-up
+class FlythroughBenchmark
+{
+public:
+    static constexpr float s_TimeStep = 1.f / 60.f;
+    static constexpr uint32_t s_WarmupFrames = 30;
+
+    void Start(const CameraPath& path, uint32_t iterations);
+    inline bool IsRunning() const { return m_Iteration < m_Iterations; }
+
+    // Camera of this frame
+    CameraKey BeginFrame();
+    // gpuMs and triangles are negative when not available for the frame
+    void EndFrame(float frameMs, float gpuMs, uint32_t drawCommands, int64_t triangles);
+
+    void PrintReport(std::ostream& os) const;
+    // Percentiles and averages along with the options that shape the
+    // frame, meant to be diffed between builds
+    void WriteJson(std::ostream& os, const LaunchOptions& options) const;
+
+private:
+    struct Frame
+    {
+        float frameMs;
+        float gpuMs;
+        uint32_t drawCommands;
+        int64_t triangles;
+    };
+
+    const CameraPath* m_Path = nullptr;
+    uint32_t m_Iterations = 0;
+    uint32_t m_Iteration = 0;
+    uint32_t m_Step = 0;
+    uint32_t m_StepsPerIteration = 0;
+    uint32_t m_Warmup = 0;
+
+    std::vector<Frame> m_Frames;
+};
+
+END_VISUALIZER_NAMESPACE
+
+#endif // !CAMERA_PATH_HPP
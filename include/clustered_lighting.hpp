@@ -0,0 +1,179 @@
+#ifndef CLUSTERED_LIGHTING_HPP
+#define CLUSTERED_LIGHTING_HPP
+
+#include <GL/glew.h>
+
+#pragma warning(push, 0)
+#include <glm/glm.hpp>
+#pragma warning(pop, 0)
+
+#include <cstdint>
+#include <ostream>
+#include <span>
+#include <vector>
+
+#include "Visualizer.hpp"
+
+BEGIN_VISUALIZER_NAMESPACE
+
+class Terrain;
+
+// Laid out as read by the shaders (std430)
+struct PointLight
+{
+    glm::vec3 position;
+    float radius;
+    glm::vec3 color;
+    float intensity;
+};
+
+struct LightingStats
+{
+    uint32_t lights = 0;
+    // Lights inside the frustum, and their entries over all clusters
+    uint32_t visibleLights = 0;
+    uint32_t lightReferences = 0;
+    uint32_t maxLightsPerCluster = 0;
+    float binMs = 0.f;
+    float uploadMs = 0.f;
+};
+
+// Forward+ lighting over froxels: the view frustum is cut into a grid of
+// s_ClustersX x s_ClustersY tiles on screen and s_ClustersZ exponential
+// depth slices. Every frame the lights are binned into the clusters they
+// touch on the CPU, four lights at a time, and the lists are uploaded for
+// the fragment shader to loop over only the lights of its own cluster.
+//
+// Bindings read by the shader: the Clusters uniform block at 1, then the
+// lights, cluster ranges and light indices storage blocks at 5, 6 and 7,
+// clear of those the Hi-Z culler uses.
+class ClusteredLighting
+{
+public:
+    static constexpr uint32_t s_ClustersX = 16;
+    static constexpr uint32_t s_ClustersY = 9;
+    static constexpr uint32_t s_ClustersZ = 24;
+    static constexpr uint32_t s_ClusterCount = s_ClustersX * s_ClustersY * s_ClustersZ;
+
+    // GLSL declarations of the bindings above and of
+    // vec3 ShadePointLights(vec3 worldPosition, vec3 normal, vec3 color),
+    // to be pasted after the #version line of a fragment shader
+    static const char* GetShaderSource();
+
+    ClusteredLighting() = default;
+    ~ClusteredLighting() = default;
+
+    ClusteredLighting(const ClusteredLighting&) = delete;
+    ClusteredLighting(ClusteredLighting&&) = delete;
+
+    ClusteredLighting& operator=(const ClusteredLighting&) = delete;
+    ClusteredLighting& operator=(ClusteredLighting&&) = delete;
+
+    void Initialize();
+    void Cleanup();
+
+    void SetLights(std::span<const PointLight> lights);
+    inline size_t GetLightCount() const { return m_Lights.size(); }
+
+    // Bins the lights for this camera and uploads the lists. nearPlane and
+    // farPlane must be those of the projection, which is expected symmetric.
+    void Update(const glm::mat4& view, const glm::mat4& projection, float nearPlane, float farPlane, uint32_t width, uint32_t height);
+    void Bind() const;
+
+    // The CPU half of Update(), which needs no context
+    void Bin(const glm::mat4& view, const glm::mat4& projection, float nearPlane, float farPlane);
+    // Lights of a cluster after Bin()
+    std::span<const uint32_t> GetClusterLights(uint32_t x, uint32_t y, uint32_t z) const;
+
+    inline const LightingStats& GetFrameStats() const { return m_Stats; }
+
+private:
+    // Per light inclusive cluster ranges, empty when min > max
+    struct LightRange
+    {
+        uint8_t minX, maxX;
+        uint8_t minY, maxY;
+        uint8_t minZ, maxZ;
+    };
+
+    // Offset into the light indices and count, per cluster
+    struct ClusterRange
+    {
+        uint32_t offset;
+        uint32_t count;
+    };
+
+    struct ClusterParameters
+    {
+        glm::mat4 view;
+        // near, slices / log(far / near), 1 / width, 1 / height
+        glm::vec4 depthAndScreen;
+        glm::uvec4 grid;
+    };
+
+    void ComputeRanges(const glm::mat4& view, const glm::mat4& projection, float nearPlane, float farPlane);
+    void GrowBuffer(GLuint& buffer, size_t& capacity, size_t size);
+
+    std::vector<PointLight> m_Lights;
+    std::vector<LightRange> m_Ranges;
+    std::vector<ClusterRange> m_Clusters = std::vector<ClusterRange>(s_ClusterCount);
+    std::vector<uint32_t> m_Indices;
+    // View depth at which every slice but the first starts
+    float m_SliceDepths[s_ClustersZ - 1] = {};
+
+    GLuint m_ParameterBuffer = 0;
+    GLuint m_LightBuffer = 0;
+    GLuint m_ClusterBuffer = 0;
+    GLuint m_IndexBuffer = 0;
+    size_t m_LightCapacity = 0;
+    size_t m_IndexCapacity = 0;
+    // Nothing to upload while there are no lights, once the ranges are zero
+    bool m_EmptyUploaded = false;
+
+    LightingStats m_Stats;
+};
+
+// count lights a few units above random points of the terrain, with warm
+// torch-like colors
+std::vector<PointLight> ScatterLights(const Terrain& terrain, uint32_t count, uint64_t seed = 0);
+
+// Steps through increasing light counts, a fixed number of frames each,
+// and reports the average cost of every stage per count
+class LightingBenchmark
+{
+public:
+    static constexpr uint32_t s_WarmupFrames = 16;
+    static constexpr uint32_t s_MeasuredFrames = 128;
+
+    void Start(std::span<const uint32_t> lightCounts);
+    inline bool IsRunning() const { return m_Step < m_Steps.size(); }
+
+    // True when lightCount changes from this frame on
+    bool BeginFrame(uint32_t& lightCount);
+    // gpuMs is negative when no GPU time is available for the frame
+    void EndFrame(const LightingStats& stats, float gpuMs);
+
+    void PrintReport(std::ostream& os) const;
+
+private:
+    struct Step
+    {
+        uint32_t lightCount;
+        uint32_t frames = 0;
+        uint32_t gpuFrames = 0;
+        double visibleLights = 0.0;
+        double lightReferences = 0.0;
+        uint32_t maxLightsPerCluster = 0;
+        double binMs = 0.0;
+        double uploadMs = 0.0;
+        double gpuMs = 0.0;
+    };
+
+    std::vector<Step> m_Steps;
+    size_t m_Step = 0;
+    uint32_t m_Frame = 0;
+};
+
+END_VISUALIZER_NAMESPACE
+
+#endif // !CLUSTERED_LIGHTING_HPP
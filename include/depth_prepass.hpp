@@ -0,0 +1,117 @@
+#ifndef DEPTH_PREPASS_HPP
+#define DEPTH_PREPASS_HPP
+
+#include <GL/glew.h>
+
+#include <array>
+#include <cstdint>
+
+#include "Visualizer.hpp"
+
+BEGIN_VISUALIZER_NAMESPACE
+
+enum class PrepassMode : uint8_t
+{
+    Off,
+    On,
+    // On while the measured overdraw makes it worth it
+    Auto
+};
+
+const char* GetPrepassModeName(PrepassMode mode);
+
+// Decides, frame by frame, whether the opaque scene is first drawn depth
+// only, so that the color pass shades each pixel once under GL_EQUAL.
+//
+// Overdraw is measured with two GL_SAMPLES_PASSED queries on pre-pass
+// frames: the samples passing the depth pass are those a color pass alone
+// would have shaded, the samples passing the equal test are the pixels
+// covered. In Auto mode the pre-pass is also forced once in a while while
+// off, to keep measuring.
+class DepthPrepass
+{
+public:
+    static constexpr uint32_t s_Latency = 3;
+    static constexpr uint32_t s_MeasureInterval = 30;
+    // Hysteresis of the Auto mode, in shaded fragments per covered pixel
+    static constexpr float s_EnableOverdraw = 1.5f;
+    static constexpr float s_DisableOverdraw = 1.25f;
+
+    void Initialize(PrepassMode mode);
+    void Cleanup();
+
+    void SetMode(PrepassMode mode);
+    inline PrepassMode GetMode() const { return m_Mode; }
+
+    // Reads the results of s_Latency frames ago; true when this frame runs
+    // the pre-pass
+    bool BeginFrame();
+    void BeginDepthPass();
+    void EndDepthPass();
+    void BeginColorPass();
+    void EndColorPass();
+
+    // Negative until a pre-pass frame was measured
+    inline float GetOverdraw() const { return m_Overdraw; }
+    inline uint64_t GetFrameCount() const { return m_Frames; }
+    inline uint64_t GetPrepassFrames() const { return m_PrepassFrames; }
+    inline uint32_t GetSwitchCount() const { return m_Switches; }
+
+private:
+    struct FrameQueries
+    {
+        GLuint depthSamples = 0;
+        GLuint colorSamples = 0;
+        bool pending = false;
+    };
+
+    void ReadResults(FrameQueries& queries);
+
+    PrepassMode m_Mode = PrepassMode::Off;
+    // What Auto settled on
+    bool m_AutoEnabled = false;
+    bool m_RunsThisFrame = false;
+
+    std::array<FrameQueries, s_Latency> m_Queries{};
+    // Queries of this frame, then of the next one
+    uint32_t m_Current = 0;
+    uint32_t m_Next = 0;
+    uint32_t m_FramesSinceMeasure = 0;
+
+    float m_Overdraw = -1.f;
+    uint64_t m_Frames = 0;
+    uint64_t m_PrepassFrames = 0;
+    uint32_t m_Switches = 0;
+};
+
+// Debug view counting every shaded fragment with an atomic counter at
+// binding 0, which the overdraw fragment shader increments
+class OverdrawCounter
+{
+public:
+    static constexpr uint32_t s_Latency = 3;
+
+    // Fragment shader drawing additive heat while counting
+    static const char* GetFragmentShaderSource();
+
+    void Initialize();
+    void Cleanup();
+
+    // Clears and binds this frame's counter, reading the one written
+    // s_Latency frames ago
+    void BeginFrame();
+    void EndFrame();
+
+    // Shaded fragments of the latest frame read back, negative until then
+    inline int64_t GetLatestFragments() const { return m_LatestFragments; }
+
+private:
+    std::array<GLuint, s_Latency> m_Buffers{};
+    uint32_t m_Next = 0;
+    uint64_t m_Issued = 0;
+    int64_t m_LatestFragments = -1;
+};
+
+END_VISUALIZER_NAMESPACE
+
+#endif // !DEPTH_PREPASS_HPP
@@ -0,0 +1,50 @@
+#ifndef DIRTY_RANGES_HPP
+#define DIRTY_RANGES_HPP
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "Visualizer.hpp"
+
+BEGIN_VISUALIZER_NAMESPACE
+
+// Elements of a buffer written since its last upload, merged into as few
+// uploads as possible. Ranges less than mergeGap elements apart become one
+// upload, which also rewrites the clean elements between them: a few more
+// bytes are cheaper than another call.
+class DirtyRanges
+{
+public:
+    struct Range
+    {
+        uint32_t first;
+        uint32_t count;
+    };
+
+    DirtyRanges() = default;
+    explicit DirtyRanges(uint32_t mergeGap) :
+        m_MergeGap(mergeGap)
+    {}
+
+    // Writes in increasing order extend the last range without sorting
+    void Add(uint32_t first, uint32_t count = 1);
+    // Sorted and merged, valid until the next Add() or Clear()
+    std::span<const Range> Coalesce();
+    inline void Clear()
+    {
+        m_Ranges.clear();
+        m_Sorted = true;
+    }
+
+    inline bool IsEmpty() const { return m_Ranges.empty(); }
+
+private:
+    std::vector<Range> m_Ranges;
+    uint32_t m_MergeGap = 16;
+    bool m_Sorted = true;
+};
+
+END_VISUALIZER_NAMESPACE
+
+#endif // !DIRTY_RANGES_HPP
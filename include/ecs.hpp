@@ -0,0 +1,390 @@
+#ifndef ECS_HPP
+#define ECS_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <ostream>
+#include <span>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+#include "Visualizer.hpp"
+#include "thread_pool.hpp"
+
+BEGIN_VISUALIZER_NAMESPACE
+
+// Entity-component storage grouped by archetype, the set of component
+// types an entity has. Each archetype stores its entities in 16 KB chunks
+// holding one array per component, so a query over a few components walks
+// dense arrays of exactly those.
+//
+// Components must be trivially copyable: entities move between chunks and
+// archetypes with memcpy. Creating, destroying or changing the components
+// of entities while iterating is not allowed.
+
+constexpr size_t s_ChunkSize = 16 * 1024;
+constexpr uint32_t s_MaxComponentTypes = 64;
+// Below this many matching entities parallel iteration stays on the
+// calling thread, where it does not allocate
+constexpr size_t s_ParallelEntityThreshold = 16384;
+
+using ComponentMask = uint64_t;
+
+struct Entity
+{
+    uint32_t index = ~0u;
+    uint32_t generation = 0;
+
+    inline bool operator==(const Entity& other) const { return index == other.index && generation == other.generation; }
+};
+
+struct ComponentInfo
+{
+    uint32_t size;
+    uint32_t alignment;
+};
+
+// Ids are handed out on first use, in no particular order
+uint32_t RegisterComponent(const ComponentInfo& info);
+const ComponentInfo& GetComponentInfo(uint32_t id);
+
+template<typename T>
+struct ComponentType
+{
+    static_assert(std::is_trivially_copyable_v<T>, "Components are moved with memcpy");
+    static_assert(alignof(T) <= 64, "Chunks are aligned to 64 bytes");
+
+    static uint32_t GetId()
+    {
+        static const uint32_t s_Id = RegisterComponent({ sizeof(T), alignof(T) });
+        return s_Id;
+    }
+};
+
+// const T and T are the same component
+template<typename T>
+inline uint32_t GetComponentId()
+{
+    return ComponentType<std::remove_cv_t<T>>::GetId();
+}
+
+template<typename... Components>
+inline ComponentMask GetComponentMask()
+{
+    return (ComponentMask(0) | ... | (ComponentMask(1) << GetComponentId<Components>()));
+}
+
+class Archetype
+{
+public:
+    static constexpr uint8_t s_NoColumn = 0xFF;
+
+    explicit Archetype(ComponentMask mask);
+
+    struct Chunk
+    {
+        struct Free
+        {
+            void operator()(std::byte* data) const;
+        };
+
+        std::unique_ptr<std::byte[], Free> data;
+        uint32_t count = 0;
+    };
+
+    inline ComponentMask GetMask() const { return m_Mask; }
+    inline uint32_t GetCapacity() const { return m_Capacity; }
+    inline size_t GetEntityCount() const { return m_EntityCount; }
+    inline std::span<const Chunk> GetChunks() const { return m_Chunks; }
+    inline std::span<const uint32_t> GetComponents() const { return m_Components; }
+
+    // Byte offset of the component's array in every chunk, or ~0 when the
+    // archetype does not have it
+    inline size_t GetColumnOffset(uint32_t component) const
+    {
+        const uint8_t column = m_Columns[component];
+        return column == s_NoColumn ? ~size_t(0) : m_Offsets[column];
+    }
+
+    // Appends an uninitialized row, returning its chunk and row
+    void Allocate(Entity entity, uint32_t& chunk, uint32_t& row);
+    // Swaps the last row into (chunk, row) and returns the entity that
+    // moved, if any
+    bool Remove(uint32_t chunk, uint32_t row, Entity& moved);
+
+    // Null when the archetype does not have the component
+    inline std::byte* GetComponent(uint32_t chunk, uint32_t row, uint32_t component) const
+    {
+        const uint8_t column = m_Columns[component];
+        return column == s_NoColumn ? nullptr : m_Chunks[chunk].data.get() + m_Offsets[column] + static_cast<size_t>(row) * m_Sizes[column];
+    }
+
+    inline Entity* GetEntities(uint32_t chunk) const { return reinterpret_cast<Entity*>(m_Chunks[chunk].data.get()); }
+
+    void Clear();
+
+private:
+    ComponentMask m_Mask;
+    std::vector<uint32_t> m_Components;
+    std::array<uint8_t, s_MaxComponentTypes> m_Columns;
+    std::vector<size_t> m_Offsets;
+    std::vector<size_t> m_Sizes;
+    uint32_t m_Capacity = 0;
+    size_t m_EntityCount = 0;
+    std::vector<Chunk> m_Chunks;
+};
+
+// The arrays of one chunk, as seen by a query
+class ChunkView
+{
+public:
+    ChunkView(const Archetype& archetype, uint32_t chunk) :
+        m_Archetype(&archetype),
+        m_Data(archetype.GetChunks()[chunk].data.get()),
+        m_Count(archetype.GetChunks()[chunk].count)
+    {}
+
+    inline uint32_t GetCount() const { return m_Count; }
+    inline std::span<const Entity> GetEntities() const { return { reinterpret_cast<const Entity*>(m_Data), m_Count }; }
+
+    // Empty when the archetype lacks the component
+    template<typename T>
+    inline std::span<T> Get() const
+    {
+        const size_t offset = m_Archetype->GetColumnOffset(GetComponentId<T>());
+        if (offset == ~size_t(0))
+        {
+            return {};
+        }
+        return { reinterpret_cast<T*>(m_Data + offset), m_Count };
+    }
+
+private:
+    const Archetype* m_Archetype;
+    std::byte* m_Data;
+    uint32_t m_Count;
+};
+
+class World
+{
+public:
+    World() = default;
+
+    World(const World&) = delete;
+    World(World&&) = default;
+
+    World& operator=(const World&) = delete;
+    World& operator=(World&&) = default;
+
+    template<typename... Components>
+    Entity Create(const Components&... components)
+    {
+        const Entity entity = CreateEntity(GetComponentMask<Components...>());
+        (Write(entity, components), ...);
+        return entity;
+    }
+
+    void Destroy(Entity entity);
+    void Clear();
+
+    bool IsAlive(Entity entity) const;
+    // The handle of the entity holding this index, for indices known to be
+    // in use
+    inline Entity GetEntity(uint32_t index) const { return { index, m_Records[index].generation }; }
+    inline size_t GetEntityCount() const { return m_Records.size() - m_FreeIndices.size(); }
+
+    // Null when the entity is gone or lacks the component; invalidated by
+    // any change of the entity's archetype
+    template<typename T>
+    T* Get(Entity entity) const
+    {
+        return reinterpret_cast<T*>(GetComponent(entity, GetComponentId<T>()));
+    }
+
+    // Adds the component, or overwrites it when already there
+    template<typename T>
+    void Add(Entity entity, const T& component)
+    {
+        SetMask(entity, GetMask(entity) | GetComponentMask<T>());
+        Write(entity, component);
+    }
+
+    template<typename T>
+    void Remove(Entity entity)
+    {
+        SetMask(entity, GetMask(entity) & ~GetComponentMask<T>());
+    }
+
+    // Calls fn(ChunkView) for every non-empty chunk of the archetypes that
+    // have all of Components
+    template<typename... Components, typename Fn>
+    void ForEachChunk(Fn&& fn) const
+    {
+        const ComponentMask mask = GetComponentMask<Components...>();
+
+        for (const std::unique_ptr<Archetype>& archetype : m_Archetypes)
+        {
+            if ((archetype->GetMask() & mask) != mask)
+            {
+                continue;
+            }
+            for (uint32_t chunk = 0; chunk < archetype->GetChunks().size(); ++chunk)
+            {
+                fn(ChunkView(*archetype, chunk));
+            }
+        }
+    }
+
+    // Same, the chunks spread over the pool once there are enough entities
+    template<typename... Components, typename Fn>
+    void ParallelForEachChunk(ThreadPool& pool, Fn&& fn, size_t parallelThreshold = s_ParallelEntityThreshold) const
+    {
+        const ComponentMask mask = GetComponentMask<Components...>();
+
+        size_t chunkCount = 0;
+        size_t entityCount = 0;
+        for (const std::unique_ptr<Archetype>& archetype : m_Archetypes)
+        {
+            if ((archetype->GetMask() & mask) == mask)
+            {
+                chunkCount += archetype->GetChunks().size();
+                entityCount += archetype->GetEntityCount();
+            }
+        }
+
+        if (pool.GetWorkerCount() == 0 || entityCount < parallelThreshold || chunkCount < 2)
+        {
+            ForEachChunk<Components...>(fn);
+            return;
+        }
+
+        pool.ParallelFor(chunkCount, [this, mask, &fn](size_t index)
+        {
+            // Archetypes are few, finding the chunk's is a short walk
+            for (const std::unique_ptr<Archetype>& archetype : m_Archetypes)
+            {
+                if ((archetype->GetMask() & mask) != mask)
+                {
+                    continue;
+                }
+                if (index < archetype->GetChunks().size())
+                {
+                    fn(ChunkView(*archetype, static_cast<uint32_t>(index)));
+                    return;
+                }
+                index -= archetype->GetChunks().size();
+            }
+        });
+    }
+
+    // Calls fn(Components&...) for every matching entity
+    template<typename... Components, typename Fn>
+    void Each(Fn&& fn) const
+    {
+        ForEachChunk<Components...>([&fn](const ChunkView& view)
+        {
+            auto columns = std::make_tuple(view.Get<Components>().data()...);
+            for (uint32_t i = 0; i < view.GetCount(); ++i)
+            {
+                std::apply([&fn, i](auto*... column) { fn(column[i]...); }, columns);
+            }
+        });
+    }
+
+    inline std::span<const std::unique_ptr<Archetype>> GetArchetypes() const { return m_Archetypes; }
+
+    // One line per archetype: components, entities, chunks and fill
+    void PrintReport(std::ostream& os) const;
+
+private:
+    struct EntityRecord
+    {
+        uint32_t generation = 0;
+        uint32_t archetype = 0;
+        uint32_t chunk = 0;
+        uint32_t row = 0;
+    };
+
+    Entity CreateEntity(ComponentMask mask);
+    ComponentMask GetMask(Entity entity) const;
+    // Moves the entity to the archetype of mask, keeping the components
+    // both have
+    void SetMask(Entity entity, ComponentMask mask);
+    uint32_t GetArchetype(ComponentMask mask);
+    std::byte* GetComponent(Entity entity, uint32_t component) const;
+
+    template<typename T>
+    void Write(Entity entity, const T& component)
+    {
+        if (std::byte* destination = GetComponent(entity, GetComponentId<T>()))
+        {
+            std::memcpy(destination, &component, sizeof(T));
+        }
+    }
+
+    std::vector<std::unique_ptr<Archetype>> m_Archetypes;
+    std::unordered_map<ComponentMask, uint32_t> m_ArchetypeIndices;
+    std::vector<EntityRecord> m_Records;
+    std::vector<uint32_t> m_FreeIndices;
+};
+
+// Components a system reads and writes, from a list where const types are
+// read only: SystemAccess::Of<const InstanceTransform, Visibility>()
+struct SystemAccess
+{
+    ComponentMask reads = 0;
+    ComponentMask writes = 0;
+
+    template<typename... Components>
+    static SystemAccess Of()
+    {
+        SystemAccess access;
+        (((std::is_const_v<Components> ? access.reads : access.writes) |= GetComponentMask<Components>()), ...);
+        return access;
+    }
+
+    // Two systems conflict when one writes what the other touches
+    inline bool ConflictsWith(const SystemAccess& other) const
+    {
+        return (writes & (other.reads | other.writes)) != 0 || (other.writes & reads) != 0;
+    }
+};
+
+// Runs systems in stages: a system goes one stage after the last earlier
+// system it conflicts with, and the systems of a stage run concurrently on
+// the pool. A stage of one system runs on the calling thread, free to go
+// parallel over chunks itself.
+class SystemScheduler
+{
+public:
+    using SystemFunction = std::function<void(World&, ThreadPool&)>;
+
+    void Add(std::string name, const SystemAccess& access, SystemFunction function);
+    void Run(World& world, ThreadPool& pool);
+
+    inline const std::vector<std::vector<size_t>>& GetStages() const { return m_Stages; }
+    void PrintSchedule(std::ostream& os) const;
+
+private:
+    struct System
+    {
+        std::string name;
+        SystemAccess access;
+        SystemFunction function;
+        size_t stage;
+    };
+
+    std::vector<System> m_Systems;
+    std::vector<std::vector<size_t>> m_Stages;
+};
+
+END_VISUALIZER_NAMESPACE
+
+#endif // !ECS_HPP
@@ -0,0 +1,307 @@
+#ifndef GL_CAPTURE_HPP
+#define GL_CAPTURE_HPP
+
+#include <GL/glew.h>
+
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <span>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "Visualizer.hpp"
+#include "mapped_file.hpp"
+
+// Calls the frame makes through GLEW's function pointers, which capture
+// swaps for recording ones while active: X(name, category)
+#define VISUALIZER_GL_POINTER_CALLS(X) \
+    X(UseProgram, Bind) \
+    X(BindVertexArray, Bind) \
+    X(BindBuffer, Bind) \
+    X(BindBufferBase, Bind) \
+    X(BindBufferRange, Bind) \
+    X(BindTextureUnit, Bind) \
+    X(BindImageTexture, Bind) \
+    X(ProgramUniform1i, State) \
+    X(ProgramUniform1ui, State) \
+    X(ProgramUniform3fv, State) \
+    X(MemoryBarrier, State) \
+    X(DrawElementsInstancedBaseInstance, Draw) \
+    X(DrawElementsIndirect, Draw) \
+    X(MultiDrawElementsIndirect, Draw) \
+    X(DispatchCompute, Draw) \
+    X(BlitNamedFramebuffer, Draw) \
+    X(NamedBufferSubData, Upload) \
+    X(CopyNamedBufferSubData, Upload) \
+    X(ClearNamedBufferData, Upload) \
+    X(ClearNamedBufferSubData, Upload) \
+    X(FlushMappedNamedBufferRange, Upload) \
+    X(BeginQuery, Query) \
+    X(EndQuery, Query) \
+    X(GetQueryObjectuiv, Query) \
+    X(GetQueryObjectui64v, Query) \
+    X(GetNamedBufferSubData, Query) \
+    X(FenceSync, Sync) \
+    X(ClientWaitSync, Sync) \
+    X(DeleteSync, Sync)
+
+// OpenGL 1.1 entry points are exported by the GL library itself rather
+// than loaded by GLEW; the macros at the end of this file route them
+// through a recording wrapper instead
+#define VISUALIZER_GL_CORE_CALLS(X) \
+    X(Clear, Draw) \
+    X(Enable, State) \
+    X(Disable, State) \
+    X(DepthFunc, State) \
+    X(DepthMask, State) \
+    X(ColorMask, State) \
+    X(BlendFunc, State) \
+    X(Viewport, State) \
+    X(DrawElements, Draw) \
+    X(DrawArrays, Draw)
+
+BEGIN_VISUALIZER_NAMESPACE
+
+enum class GlCall : uint16_t
+{
+#define VISUALIZER_GL_ENUM(name, category) name,
+    VISUALIZER_GL_POINTER_CALLS(VISUALIZER_GL_ENUM)
+    VISUALIZER_GL_CORE_CALLS(VISUALIZER_GL_ENUM)
+#undef VISUALIZER_GL_ENUM
+    // Marks the end of a frame in the stream
+    FrameEnd,
+    Count
+};
+
+enum class GlCallCategory : uint8_t
+{
+    // Bindings and fixed function state, together the state changes
+    Bind,
+    State,
+    Draw,
+    Upload,
+    Query,
+    Sync,
+    Count
+};
+
+constexpr size_t s_GlCallCount = static_cast<size_t>(GlCall::Count);
+constexpr size_t s_GlCallCategoryCount = static_cast<size_t>(GlCallCategory::Count);
+
+const char* GetGlCallName(GlCall call);
+const char* GetGlCallCategoryName(GlCallCategory category);
+GlCallCategory GetGlCallCategory(GlCall call);
+
+// Calls of one frame, by call and by category
+struct GlFrameCalls
+{
+    std::array<uint32_t, s_GlCallCount> calls{};
+    std::array<uint32_t, s_GlCallCategoryCount> categories{};
+
+    inline uint32_t GetStateChanges() const
+    {
+        return categories[static_cast<size_t>(GlCallCategory::Bind)] + categories[static_cast<size_t>(GlCallCategory::State)];
+    }
+};
+
+// Integers, enums and pointers as they are, floats by their bits and
+// signed values zigzagged, so that small values stay small as varints
+template<typename T>
+inline uint64_t EncodeGlArgument(T value)
+{
+    if constexpr (std::is_pointer_v<T>)
+    {
+        return reinterpret_cast<uintptr_t>(value);
+    }
+    else if constexpr (std::is_same_v<T, float>)
+    {
+        return std::bit_cast<uint32_t>(value);
+    }
+    else if constexpr (std::is_same_v<T, double>)
+    {
+        return std::bit_cast<uint64_t>(value);
+    }
+    else if constexpr (std::is_signed_v<T>)
+    {
+        const int64_t wide = value;
+        return (static_cast<uint64_t>(wide) << 1) ^ static_cast<uint64_t>(wide >> 63);
+    }
+    else
+    {
+        return static_cast<uint64_t>(value);
+    }
+}
+
+// Counts the calls of every frame and, while writing, records them with
+// their arguments into a compact binary stream: a header holding the
+// launch arguments, then per call its id and arguments as varints,
+// followed by the bytes behind data pointers (buffer updates, uniforms,
+// clear values). Frames end with a FrameEnd record.
+//
+// Only one GL thread is expected, the same as for the rest of the renderer.
+class GlCapture
+{
+public:
+    static constexpr uint32_t s_Magic = 0x43474C56; // "VLGC"
+    static constexpr uint32_t s_Version = 1;
+
+    static GlCapture& GetGlobal();
+    static inline bool IsActive() { return s_Active; }
+
+    // Counting only, for budgets
+    void StartCounting();
+    // Writes frameCount frames to path, launchArguments being stored so
+    // that a replay can set the same scene up
+    void StartWriting(const std::string& path, const std::string& launchArguments, uint32_t frameCount);
+    // False when the stream could not be written
+    bool Stop();
+
+    // Returns the calls of the frame ending
+    const GlFrameCalls& EndFrame();
+
+    void Record(GlCall call, const uint64_t* arguments, size_t count);
+
+private:
+    void Install();
+    void Uninstall();
+    void WriteVarint(uint64_t value);
+    void WritePayload(const void* data, size_t size);
+    bool Flush();
+
+    static inline bool s_Active = false;
+
+    bool m_Installed = false;
+    bool m_Counting = false;
+    bool m_Writing = false;
+    uint32_t m_FramesLeft = 0;
+    uint32_t m_FramesWritten = 0;
+    uint64_t m_CallsWritten = 0;
+    std::string m_Path;
+    std::vector<uint8_t> m_Stream;
+
+    GlFrameCalls m_Frame;
+    GlFrameCalls m_LastFrame;
+};
+
+template<GlCall Call, typename Function>
+struct GlPointerHook;
+
+// Takes the place of a GLEW function pointer while capturing
+template<GlCall Call, typename R, typename... Args>
+struct GlPointerHook<Call, R(GLAPIENTRY*)(Args...)>
+{
+    static inline R(GLAPIENTRY* s_Next)(Args...) = nullptr;
+
+    static R GLAPIENTRY Invoke(Args... args)
+    {
+        const uint64_t encoded[] = { EncodeGlArgument(args)... };
+        GlCapture::GetGlobal().Record(Call, encoded, sizeof...(Args));
+        return s_Next(args...);
+    }
+};
+
+template<GlCall Call, typename Function>
+struct GlCoreHook;
+
+// Stands in for an OpenGL 1.1 function at every call site, see below. The
+// function comes as an argument since imported addresses are no constants.
+template<GlCall Call, typename R, typename... Args>
+struct GlCoreHook<Call, R(GLAPIENTRY*)(Args...)>
+{
+    static inline R Invoke(R(GLAPIENTRY* function)(Args...), Args... args)
+    {
+        if (GlCapture::IsActive())
+        {
+            const uint64_t encoded[] = { EncodeGlArgument(args)... };
+            GlCapture::GetGlobal().Record(Call, encoded, sizeof...(Args));
+        }
+        return function(args...);
+    }
+};
+
+// Fails a run whose frames change more state than allowed, once past a
+// warm-up, the way FrameAllocationCheck does for allocations
+class GlCallBudget
+{
+public:
+    // Frames spent loading and settling culling results
+    static constexpr uint32_t s_DefaultWarmupFrames = 30;
+
+    GlCallBudget(uint32_t maxStateChanges, uint32_t warmupFrames = s_DefaultWarmupFrames);
+
+    void EndFrame(const GlFrameCalls& calls);
+    void PrintReport(std::ostream& os) const;
+
+    inline bool HasFailed() const { return m_FramesOver > 0; }
+
+private:
+    uint32_t m_MaxStateChanges;
+    uint32_t m_Warmup;
+    uint32_t m_Frame = 0;
+    uint32_t m_FramesChecked = 0;
+    uint32_t m_FramesOver = 0;
+    uint32_t m_Worst = 0;
+    uint32_t m_WorstFrame = 0;
+};
+
+// Frames of a capture file, with the calls of each
+class GlCaptureFile
+{
+public:
+    bool Load(const std::string& path);
+
+    inline const std::string& GetLaunchArguments() const { return m_LaunchArguments; }
+    inline size_t GetFrameCount() const { return m_Frames.size(); }
+    inline const GlFrameCalls& GetFrameCalls(size_t frame) const { return m_Frames[frame].calls; }
+
+    // Per call and category averages and extremes over the frames, and the
+    // spread of state changes per frame
+    void PrintReport(std::ostream& os) const;
+
+    // Issues the calls of a frame on the current context. Data pointers
+    // are served from the file, results land in scratch memory, and sync
+    // objects are skipped as their handles differ between runs.
+    void ReplayFrame(size_t frame) const;
+
+    // Replays every frame iterations times, printing the CPU time spent
+    // issuing them and the time until the GPU is done with them
+    void Replay(std::ostream& os, uint32_t iterations) const;
+
+private:
+    struct Frame
+    {
+        size_t begin;
+        size_t end;
+        GlFrameCalls calls;
+    };
+
+    // Replayed from the mapping, frame after frame
+    MappedFile m_File;
+    std::span<const std::byte> m_Data;
+    std::string m_LaunchArguments;
+    std::vector<Frame> m_Frames;
+    mutable std::vector<uint8_t> m_Scratch;
+};
+
+END_VISUALIZER_NAMESPACE
+
+// Files issuing OpenGL 1.1 calls in the frame include this header so that
+// capture sees them too; the implementation opts out to reach the real ones
+#ifndef VISUALIZER_GL_CAPTURE_IMPLEMENTATION
+#define glClear(...) ::visualizer::GlCoreHook<::visualizer::GlCall::Clear, decltype(&::glClear)>::Invoke(&::glClear, __VA_ARGS__)
+#define glEnable(...) ::visualizer::GlCoreHook<::visualizer::GlCall::Enable, decltype(&::glEnable)>::Invoke(&::glEnable, __VA_ARGS__)
+#define glDisable(...) ::visualizer::GlCoreHook<::visualizer::GlCall::Disable, decltype(&::glDisable)>::Invoke(&::glDisable, __VA_ARGS__)
+#define glDepthFunc(...) ::visualizer::GlCoreHook<::visualizer::GlCall::DepthFunc, decltype(&::glDepthFunc)>::Invoke(&::glDepthFunc, __VA_ARGS__)
+#define glDepthMask(...) ::visualizer::GlCoreHook<::visualizer::GlCall::DepthMask, decltype(&::glDepthMask)>::Invoke(&::glDepthMask, __VA_ARGS__)
+#define glColorMask(...) ::visualizer::GlCoreHook<::visualizer::GlCall::ColorMask, decltype(&::glColorMask)>::Invoke(&::glColorMask, __VA_ARGS__)
+#define glBlendFunc(...) ::visualizer::GlCoreHook<::visualizer::GlCall::BlendFunc, decltype(&::glBlendFunc)>::Invoke(&::glBlendFunc, __VA_ARGS__)
+#define glViewport(...) ::visualizer::GlCoreHook<::visualizer::GlCall::Viewport, decltype(&::glViewport)>::Invoke(&::glViewport, __VA_ARGS__)
+#define glDrawElements(...) ::visualizer::GlCoreHook<::visualizer::GlCall::DrawElements, decltype(&::glDrawElements)>::Invoke(&::glDrawElements, __VA_ARGS__)
+#define glDrawArrays(...) ::visualizer::GlCoreHook<::visualizer::GlCall::DrawArrays, decltype(&::glDrawArrays)>::Invoke(&::glDrawArrays, __VA_ARGS__)
+#endif
+
+#endif // !GL_CAPTURE_HPP
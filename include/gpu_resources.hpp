@@ -0,0 +1,164 @@
+#ifndef GPU_RESOURCES_HPP
+#define GPU_RESOURCES_HPP
+
+#include <GL/glew.h>
+
+#include <array>
+#include <cstdint>
+#include <ostream>
+#include <unordered_map>
+
+#include "Visualizer.hpp"
+
+BEGIN_VISUALIZER_NAMESPACE
+
+enum class GpuResourceCategory : uint8_t
+{
+    MeshVertex,
+    MeshIndex,
+    Instance,
+    Uniform,
+    Staging,
+    Texture,
+    Program,
+    Lighting,
+    Count
+};
+
+const char* GetCategoryName(GpuResourceCategory category);
+
+// Layout read by glDrawElementsIndirect
+struct DrawElementsIndirectCommand
+{
+    uint32_t count;
+    uint32_t instanceCount;
+    uint32_t firstIndex;
+    int32_t baseVertex;
+    uint32_t baseInstance;
+};
+
+struct GpuCategoryStats
+{
+    uint32_t count = 0;
+    size_t liveBytes = 0;
+    size_t peakBytes = 0;
+};
+
+// Free video memory as reported by GL_NVX_gpu_memory_info or
+// GL_ATI_meminfo, in KiB
+struct DriverMemoryInfo
+{
+    const char* source = nullptr;
+    int64_t availableKiB = 0;
+    int64_t totalKiB = 0;
+
+    inline bool IsValid() const { return source != nullptr; }
+};
+
+DriverMemoryInfo QueryDriverMemory();
+
+// Keeps track of every buffer, texture and program the renderer creates,
+// so VRAM use can be reported per category. GL thread only.
+class GpuResourceTracker
+{
+public:
+    static GpuResourceTracker& GetGlobal();
+
+    // glCreateBuffers + glNamedBufferStorage
+    GLuint CreateBuffer(GpuResourceCategory category, size_t size, const void* data, GLbitfield flags);
+    // glCreateTextures + glTextureStorage2D, size estimated from the format
+    GLuint CreateTexture2D(GLenum internalFormat, uint32_t width, uint32_t height, uint32_t levels);
+    // Call after linking, the binary length stands in for the program size
+    void RegisterProgram(GLuint program);
+
+    // Untrack, delete and zero the name; zero names are ignored
+    void DeleteBuffer(GLuint& buffer);
+    void DeleteTexture(GLuint& texture);
+    void DeleteProgram(GLuint& program);
+
+    // Remember what the driver reports now, so that reports can show
+    // what it has seen allocated since
+    void CaptureDriverBaseline();
+
+    inline size_t GetLiveBytes() const { return m_LiveBytes; }
+    inline size_t GetPeakBytes() const { return m_PeakBytes; }
+    inline const GpuCategoryStats& GetCategoryStats(GpuResourceCategory category) const { return m_Categories[static_cast<size_t>(category)]; }
+
+    void PrintReport(std::ostream& os) const;
+
+private:
+    enum class Kind : uint8_t
+    {
+        Buffer,
+        Texture,
+        Program
+    };
+
+    struct Entry
+    {
+        GpuResourceCategory category;
+        size_t size;
+    };
+
+    static inline uint64_t MakeKey(Kind kind, GLuint name) { return (static_cast<uint64_t>(kind) << 32) | name; }
+
+    void Track(Kind kind, GLuint name, GpuResourceCategory category, size_t size);
+    void Untrack(Kind kind, GLuint name);
+
+    std::unordered_map<uint64_t, Entry> m_Entries;
+    std::array<GpuCategoryStats, static_cast<size_t>(GpuResourceCategory::Count)> m_Categories{};
+    size_t m_LiveBytes = 0;
+    size_t m_PeakBytes = 0;
+
+    DriverMemoryInfo m_DriverBaseline;
+};
+
+// Result of a query over a stretch of commands, such as GL_TIME_ELAPSED or
+// GL_PRIMITIVES_GENERATED, read s_Latency frames later so that reading never
+// waits
+class GpuQueryRing
+{
+public:
+    static constexpr uint32_t s_Latency = 3;
+
+    void Initialize(GLenum target);
+    void Cleanup();
+
+    void Begin();
+    void End();
+
+    // Result of the frame s_Latency frames before the current one, negative
+    // when it was not ready at Begin()
+    inline int64_t GetLatest() const { return m_Latest; }
+
+private:
+    std::array<GLuint, s_Latency> m_Queries{};
+    GLenum m_Target = GL_TIME_ELAPSED;
+    uint32_t m_Next = 0;
+    uint64_t m_Issued = 0;
+    int64_t m_Latest = -1;
+};
+
+// GPU time of a stretch of commands
+class GpuTimer
+{
+public:
+    static constexpr uint32_t s_Latency = GpuQueryRing::s_Latency;
+
+    inline void Initialize() { m_Queries.Initialize(GL_TIME_ELAPSED); }
+    inline void Cleanup() { m_Queries.Cleanup(); }
+
+    inline void Begin() { m_Queries.Begin(); }
+    inline void End() { m_Queries.End(); }
+
+    // Time of the frame s_Latency frames before the current one, negative
+    // when its result was not ready at Begin()
+    inline float GetLatestMs() const { return m_Queries.GetLatest() < 0 ? -1.f : static_cast<float>(m_Queries.GetLatest() * 1e-6); }
+
+private:
+    GpuQueryRing m_Queries;
+};
+
+END_VISUALIZER_NAMESPACE
+
+#endif // !GPU_RESOURCES_HPP
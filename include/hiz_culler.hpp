@@ -0,0 +1,132 @@
+#ifndef HIZ_CULLER_HPP
+#define HIZ_CULLER_HPP
+
+#include <GL/glew.h>
+
+#pragma warning(push, 0)
+#include <glm/glm.hpp>
+#pragma warning(pop, 0)
+
+#include <array>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "Visualizer.hpp"
+#include "gpu_resources.hpp"
+#include "instances.hpp"
+
+BEGIN_VISUALIZER_NAMESPACE
+
+struct HiZStats
+{
+    uint64_t tested = 0;
+    uint64_t frustumCulled = 0;
+    uint64_t occluded = 0;
+    // Visible last frame, drawn before the pyramid is built
+    uint64_t drawnFirstPass = 0;
+    // Newly visible, drawn after the test. Reusing last frame's result
+    // alone would have shown these a frame late.
+    uint64_t drawnSecondPass = 0;
+    // Drawn in the first pass although hidden by now
+    uint64_t drawnButOccluded = 0;
+};
+
+// Two pass hierarchical-Z occlusion culling of static instance sets, all
+// on the GPU:
+//
+//   1. the instances visible last frame are drawn with the rest of the
+//      scene, through the first indirect command of their set;
+//   2. Cull() copies the depth buffer, reduces it to a pyramid of
+//      farthest depths and tests the bounds of every instance against it,
+//      with the matrix of the camera uniform block at binding 0;
+//   3. the instances that just became visible are drawn through the
+//      second command.
+//
+// Visibility stays on the GPU from one frame to the next; the counters are
+// read back a few frames late, without waiting.
+class HiZCuller
+{
+public:
+    static constexpr uint32_t s_ReadbackFrames = 3;
+
+    HiZCuller() = default;
+    ~HiZCuller() = default;
+
+    HiZCuller(const HiZCuller&) = delete;
+    HiZCuller(HiZCuller&&) = delete;
+
+    HiZCuller& operator=(const HiZCuller&) = delete;
+    HiZCuller& operator=(HiZCuller&&) = delete;
+
+    bool Initialize(uint32_t width, uint32_t height);
+    // Follows the size of the default framebuffer
+    void Resize(uint32_t width, uint32_t height);
+    void Cleanup();
+
+    // Instances of a mesh with the given local bounds; returns the set index
+    size_t AddInstanceSet(std::span<const InstanceTransform> instances, const glm::vec3& meshMin, const glm::vec3& meshMax, uint32_t indexCount);
+
+    // Source of the instance attributes of a set, filled by the GPU
+    inline GLuint GetDrawBuffer(size_t set) const { return m_Sets[set].drawBuffer; }
+    // Holds the two indirect commands of a set, first and second pass
+    inline GLuint GetCommandBuffer(size_t set) const { return m_Sets[set].commandBuffer; }
+    static constexpr size_t GetFirstPassCommandOffset() { return 0; }
+    static constexpr size_t GetSecondPassCommandOffset() { return sizeof(DrawElementsIndirectCommand); }
+
+    void Cull();
+
+    // Counters of the latest frame read back, and their running total
+    inline const HiZStats& GetFrameStats() const { return m_FrameStats; }
+    inline const HiZStats& GetTotalStats() const { return m_TotalStats; }
+    inline uint64_t GetFrameCount() const { return m_ReadFrames; }
+    inline uint64_t GetSkippedReadbacks() const { return m_SkippedReadbacks; }
+
+private:
+    struct InstanceSet
+    {
+        uint32_t count;
+        glm::vec3 meshMin;
+        glm::vec3 meshMax;
+        GLuint instanceBuffer;
+        GLuint visibilityBuffer;
+        // count instances for the first pass, then count for the second
+        GLuint drawBuffer;
+        GLuint commandBuffer;
+    };
+
+    void CreateTargets();
+    void DestroyTargets();
+    void BuildPyramid();
+    void ReadStats();
+
+    uint32_t m_Width = 0;
+    uint32_t m_Height = 0;
+    uint32_t m_Levels = 0;
+    bool m_Initialized = false;
+
+    GLuint m_DepthTexture = 0;
+    GLuint m_DepthFramebuffer = 0;
+    GLuint m_Pyramid = 0;
+
+    GLuint m_CopyProgram = 0;
+    GLuint m_ReduceProgram = 0;
+    GLuint m_TestProgram = 0;
+
+    std::vector<InstanceSet> m_Sets;
+
+    GLuint m_StatsBuffer = 0;
+    GLuint m_ReadbackBuffer = 0;
+    const uint32_t* m_Readback = nullptr;
+    std::array<GLsync, s_ReadbackFrames> m_ReadbackFences{};
+    uint32_t m_NextReadback = 0;
+
+    HiZStats m_FrameStats;
+    HiZStats m_TotalStats;
+    uint64_t m_ReadFrames = 0;
+    uint64_t m_SkippedReadbacks = 0;
+};
+
+END_VISUALIZER_NAMESPACE
+
+#endif // !HIZ_CULLER_HPP
@@ -0,0 +1,63 @@
+#ifndef INSTANCES_HPP
+#define INSTANCES_HPP
+
+#pragma warning(push, 0)
+#include <glm/glm.hpp>
+#pragma warning(pop, 0)
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "Visualizer.hpp"
+
+BEGIN_VISUALIZER_NAMESPACE
+
+class ThreadPool;
+
+// Per-instance data as uploaded to the instance buffer: 20 bytes, read by
+// the vertex shader as a vec4 (position, scale) and a float (yaw).
+struct InstanceTransform
+{
+    glm::vec3 position;
+    float scale = 1.f;
+    float yaw = 0.f;
+};
+
+static_assert(sizeof(InstanceTransform) == 5 * sizeof(float), "InstanceTransform must stay tightly packed");
+
+// Box around the instance whatever its yaw, which turns the mesh about Y
+void GetInstanceBounds(const InstanceTransform& instance, const glm::vec3& meshMin, const glm::vec3& meshMax, glm::vec3& min, glm::vec3& max);
+
+// Binary instance file: this header followed by columnCount arrays of
+// count floats each, in the order x, y, z, scale, yaw (radians).
+struct InstanceFileHeader
+{
+    static constexpr char s_Magic[4] = { 'V', 'I', 'N', 'S' };
+    static constexpr uint32_t s_Version = 1;
+    static constexpr uint32_t s_ColumnCount = 5;
+
+    char magic[4];
+    uint32_t version;
+    uint64_t count;
+    uint32_t columnCount;
+    uint32_t reserved;
+};
+
+static_assert(sizeof(InstanceFileHeader) == 24, "InstanceFileHeader layout is part of the file format");
+
+// Loads either format, told apart by the magic. Text files hold one
+// instance per line as "x y z [scale [yaw in degrees]]"; a first line with
+// a single number is taken as a count header and skipped. Large text files
+// are parsed in parallel on the pool.
+bool LoadInstances(const std::string& path, std::vector<InstanceTransform>& instances, ThreadPool& pool);
+// Same, from the file's bytes already read
+bool LoadInstances(const std::string& path, std::span<const std::byte> bytes, std::vector<InstanceTransform>& instances, ThreadPool& pool);
+bool SaveInstancesBinary(const std::string& path, const std::vector<InstanceTransform>& instances);
+bool SaveInstancesText(const std::string& path, const std::vector<InstanceTransform>& instances);
+
+END_VISUALIZER_NAMESPACE
+
+#endif // !INSTANCES_HPP
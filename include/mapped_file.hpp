@@ -0,0 +1,73 @@
+#ifndef MAPPED_FILE_HPP
+#define MAPPED_FILE_HPP
+
+#include <cstddef>
+#include <span>
+#include <streambuf>
+#include <string>
+
+#include "Visualizer.hpp"
+
+BEGIN_VISUALIZER_NAMESPACE
+
+// How a mapping is going to be read, passed on to the OS
+enum class FileAccess
+{
+    // Front to back, once: read ahead far, pages dropped once read
+    Sequential,
+    // Over and over, as GL captures are replayed: pages kept
+    Repeated
+};
+
+// Read-only view of a whole file, unmapped on destruction. Loaders parse
+// the bytes in place rather than reading them into buffers of their own.
+class MappedFile
+{
+public:
+    MappedFile() = default;
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile(MappedFile&& other) noexcept;
+
+    MappedFile& operator=(const MappedFile&) = delete;
+    MappedFile& operator=(MappedFile&& other) noexcept;
+
+    // The whole file is asked to be paged in right away
+    bool Open(const std::string& path, FileAccess access = FileAccess::Sequential);
+    void Close();
+
+    // Asks for the pages of this range to be read in ahead of their use
+    void Prefetch(size_t offset, size_t size) const;
+
+    inline bool IsOpen() const { return m_IsOpen; }
+    inline const char* GetData() const { return m_Data; }
+    inline size_t GetSize() const { return m_Size; }
+    inline std::span<const std::byte> GetBytes() const { return { reinterpret_cast<const std::byte*>(m_Data), m_Size }; }
+
+private:
+    const char* m_Data = nullptr;
+    size_t m_Size = 0;
+    bool m_IsOpen = false;
+
+#ifdef _WIN32
+    void* m_File = nullptr;
+    void* m_Mapping = nullptr;
+#endif
+};
+
+// Read-only stream buffer over bytes it does not own, for the parsers that
+// take a std::istream. Seeking is supported so that tellg() works.
+class ByteStreamBuf : public std::streambuf
+{
+public:
+    explicit ByteStreamBuf(std::span<const std::byte> bytes);
+
+protected:
+    pos_type seekoff(off_type offset, std::ios_base::seekdir direction, std::ios_base::openmode mode) override;
+    pos_type seekpos(pos_type position, std::ios_base::openmode mode) override;
+};
+
+END_VISUALIZER_NAMESPACE
+
+#endif // !MAPPED_FILE_HPP
@@ -0,0 +1,82 @@
+#ifndef MEMORY_ARENA_HPP
+#define MEMORY_ARENA_HPP
+
+#include <cstddef>
+#include <memory_resource>
+#include <vector>
+
+#include "Visualizer.hpp"
+
+BEGIN_VISUALIZER_NAMESPACE
+
+// Bump allocator over blocks taken from an upstream resource. Individual
+// deallocations are ignored; Reset() releases everything at once. After a
+// reset that needed several blocks, they are merged into one, so a
+// workload that repeats settles on a single block and stops touching the
+// upstream resource.
+class LinearArena : public std::pmr::memory_resource
+{
+public:
+    explicit LinearArena(size_t blockSize = 64u << 10, std::pmr::memory_resource* upstream = std::pmr::new_delete_resource());
+    ~LinearArena() override;
+
+    LinearArena(const LinearArena&) = delete;
+    LinearArena(LinearArena&&) = delete;
+
+    LinearArena& operator=(const LinearArena&) = delete;
+    LinearArena& operator=(LinearArena&&) = delete;
+
+    void Reset();
+    // Returns every block to the upstream resource
+    void Release();
+
+    inline size_t GetUsedBytes() const { return m_Used; }
+    inline size_t GetPeakBytes() const { return m_Peak; }
+    inline size_t GetCapacity() const { return m_Capacity; }
+    inline size_t GetUpstreamAllocationCount() const { return m_UpstreamAllocations; }
+
+private:
+    struct Block
+    {
+        std::byte* data;
+        size_t size;
+    };
+
+    void* do_allocate(size_t bytes, size_t alignment) override;
+    inline void do_deallocate(void*, size_t, size_t) override {}
+    inline bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override { return this == &other; }
+
+    std::pmr::memory_resource* m_Upstream;
+    size_t m_BlockSize;
+
+    std::vector<Block> m_Blocks;
+    size_t m_CurrentBlock = 0;
+    size_t m_Offset = 0;
+
+    size_t m_Used = 0;
+    size_t m_Peak = 0;
+    size_t m_Capacity = 0;
+    size_t m_UpstreamAllocations = 0;
+};
+
+// Two arenas used on alternate frames, so that transient data written
+// during a frame stays valid until the end of the next one
+class FrameAllocator
+{
+public:
+    explicit FrameAllocator(size_t blockSize = 256u << 10);
+
+    // Resets the arena of the frame before last and makes it current
+    void BeginFrame();
+
+    inline std::pmr::memory_resource* GetResource() { return &m_Arenas[m_Current]; }
+    inline const LinearArena& GetArena() const { return m_Arenas[m_Current]; }
+
+private:
+    LinearArena m_Arenas[2];
+    size_t m_Current = 0;
+};
+
+END_VISUALIZER_NAMESPACE
+
+#endif // !MEMORY_ARENA_HPP
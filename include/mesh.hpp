@@ -0,0 +1,61 @@
+#ifndef MESH_HPP
+#define MESH_HPP
+
+#pragma warning(push, 0)
+#include <glm/glm.hpp>
+#pragma warning(pop, 0)
+
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "Visualizer.hpp"
+
+BEGIN_VISUALIZER_NAMESPACE
+
+struct VertexDataPosition3fColor3f
+{
+    glm::vec3 position;
+    glm::vec3 normal;
+    glm::vec3 color;
+};
+
+float computeMagnitude(const glm::vec3 &v);
+glm::vec3 computeNormal(const glm::vec3 &A, const glm::vec3 &B, const glm::vec3 &C);
+// Axis aligned box of the positions, zero when empty
+void computeBounds(std::span<const VertexDataPosition3fColor3f> vertices, glm::vec3 &min, glm::vec3 &max);
+void translateVertices(std::span<VertexDataPosition3fColor3f> vertices, const glm::vec3 &translate);
+
+// Binary mesh file: this header followed by vertexCount vertices as laid
+// out above, then indexCount indices into them
+struct MeshFileHeader
+{
+    static constexpr char s_Magic[4] = { 'V', 'M', 'S', 'H' };
+    static constexpr uint32_t s_Version = 1;
+
+    char magic[4];
+    uint32_t version;
+    uint64_t vertexCount;
+    uint64_t indexCount;
+};
+
+static_assert(sizeof(MeshFileHeader) == 24, "MeshFileHeader layout is part of the file format");
+static_assert(sizeof(VertexDataPosition3fColor3f) == 9 * sizeof(float), "VertexDataPosition3fColor3f is written to mesh files as is");
+
+// Loads OBJ or binary meshes, told apart by the magic. Appends to the
+// output vectors, which are sized once up front; pass them a LinearArena
+// to keep load-time scratch off the global heap
+bool LoadMesh(std::pmr::vector<VertexDataPosition3fColor3f> &vertices, std::pmr::vector<uint32_t> &indices, const std::string &path);
+// Same, from the file's bytes already read; path only names it in errors
+// and locates OBJ materials
+bool LoadMesh(std::pmr::vector<VertexDataPosition3fColor3f> &vertices, std::pmr::vector<uint32_t> &indices, const std::string &path, std::span<const std::byte> bytes);
+bool SaveMeshBinary(const std::string &path, std::span<const VertexDataPosition3fColor3f> vertices, std::span<const uint32_t> indices);
+// Positions and normals only, the loader gives OBJ meshes a flat grey
+bool SaveMeshObj(const std::string &path, std::span<const VertexDataPosition3fColor3f> vertices, std::span<const uint32_t> indices);
+
+END_VISUALIZER_NAMESPACE
+
+#endif // !MESH_HPP
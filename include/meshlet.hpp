@@ -0,0 +1,80 @@
+#ifndef MESHLET_HPP
+#define MESHLET_HPP
+
+#pragma warning(push, 0)
+#include <glm/glm.hpp>
+#pragma warning(pop, 0)
+
+#include <cstdint>
+#include <ostream>
+#include <span>
+#include <vector>
+
+#include "Visualizer.hpp"
+#include "gpu_resources.hpp"
+#include "mesh.hpp"
+
+BEGIN_VISUALIZER_NAMESPACE
+
+struct Meshlet
+{
+    // Range of the reordered index buffer
+    uint32_t firstIndex;
+    uint32_t triangleCount;
+    // Distinct positions among the corners
+    uint32_t vertexCount;
+
+    glm::vec3 center;
+    float radius;
+    // Every triangle normal lies within the cone around axis; cutoff is
+    // the sine of its half angle, 1 when the triangles face too many ways
+    // to ever be culled together
+    glm::vec3 coneAxis;
+    float coneCutoff;
+};
+
+struct MeshletMesh
+{
+    std::vector<Meshlet> meshlets;
+    // The input indices, regrouped so that each meshlet is contiguous
+    std::vector<uint32_t> indices;
+};
+
+struct MeshletStats
+{
+    uint64_t meshlets = 0;
+    uint64_t triangles = 0;
+    uint64_t frustumCulled = 0;
+    uint64_t backfaceCulled = 0;
+    uint64_t culledTriangles = 0;
+    // Commands emitted after merging neighbouring survivors
+    uint64_t commands = 0;
+};
+
+// Splits an indexed triangle list into meshlets of at most maxVertices
+// distinct positions and maxTriangles triangles; vertices that only differ
+// in normal or colour are welded for the count. Triangles are first sorted
+// along a Morton curve of their centroids so that meshlets stay compact.
+MeshletMesh BuildMeshlets(std::span<const VertexDataPosition3fColor3f> vertices, std::span<const uint32_t> indices,
+                          uint32_t maxVertices = 64, uint32_t maxTriangles = 124);
+
+// Keeps the meshlets that may be visible from cameraPosition, for a mesh
+// drawn in world space with counter-clockwise front faces, and writes one
+// command per run of consecutive survivors. out must hold
+// mesh.meshlets.size() commands; returns how many were written.
+size_t CullMeshlets(const MeshletMesh& mesh, const glm::mat4& viewProjection, const glm::vec3& cameraPosition,
+                    std::span<DrawElementsIndirectCommand> out, MeshletStats& stats);
+
+struct MeshletViewpoint
+{
+    glm::vec3 eye;
+    glm::vec3 target;
+};
+
+// Culled triangle fractions of a mesh seen from each of the viewpoints
+// with the given projection
+void PrintMeshletReport(std::ostream& os, const char* name, const MeshletMesh& mesh, const glm::mat4& projection, std::span<const MeshletViewpoint> viewpoints);
+
+END_VISUALIZER_NAMESPACE
+
+#endif // !MESHLET_HPP
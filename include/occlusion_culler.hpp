@@ -0,0 +1,159 @@
+#ifndef OCCLUSION_CULLER_HPP
+#define OCCLUSION_CULLER_HPP
+
+#pragma warning(push, 0)
+#include <glm/glm.hpp>
+#pragma warning(pop, 0)
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "Visualizer.hpp"
+#include "instances.hpp"
+
+BEGIN_VISUALIZER_NAMESPACE
+
+class Terrain;
+class ThreadPool;
+
+// World space triangles that only ever hide things: they must lie inside
+// (or below) the geometry they stand for
+struct OccluderMesh
+{
+    std::vector<glm::vec3> vertices;
+    std::vector<uint32_t> indices;
+};
+
+// Height field over the terrain bounds with resolution x resolution quads.
+// Each vertex takes the lowest terrain point over the quads around it,
+// triangles clipped exactly, so the occluder never rises above the dunes.
+OccluderMesh BuildTerrainOccluder(const Terrain& terrain, uint32_t resolution = 64);
+
+// False when the box lies entirely outside one of the side planes or
+// closer than nearClip in front of the eye; the far plane is ignored
+bool IntersectsFrustum(const glm::mat4& viewProjection, const glm::vec3& min, const glm::vec3& max, float nearClip = 0.01f);
+
+enum class Visibility : uint8_t
+{
+    Visible,
+    FrustumCulled,
+    Occluded
+};
+
+struct OcclusionStats
+{
+    uint32_t occluderTriangles = 0;
+    uint32_t rasterizedTriangles = 0;
+    uint64_t tested = 0;
+    uint64_t frustumCulled = 0;
+    uint64_t occluded = 0;
+    float rasterizeMs = 0.f;
+    float testMs = 0.f;
+};
+
+// Software occlusion culling on the CPU. Occluders are rasterized into a
+// small depth buffer holding 1/w, which interpolates linearly across the
+// screen, then reduced to one farthest value per 8x8 tile. A box is
+// occluded when its nearest point lies behind that value in every tile
+// it covers. Triangles are binned into screen regions that are rasterized
+// in parallel, four pixels at a time with SSE2 when available.
+//
+// Everything is sized on first use and reused, frames do not allocate
+// once warmed up unless the work is large enough to go to the thread pool.
+class OcclusionCuller
+{
+public:
+    static constexpr uint32_t s_TileSize = 8;
+    static constexpr uint32_t s_BinWidth = 64;
+    static constexpr uint32_t s_BinHeight = 32;
+
+    // pool may be null to stay on the calling thread
+    OcclusionCuller(uint32_t width = 320, uint32_t height = 192, ThreadPool* pool = nullptr, float nearClip = 0.01f);
+
+    // Clears the depth buffer for a new view
+    void BeginFrame(const glm::mat4& viewProjection);
+    // The mesh must stay alive until RasterizeOccluders() returns
+    void AddOccluder(const OccluderMesh& mesh);
+    void RasterizeOccluders();
+
+    // Counts into the frame stats
+    Visibility TestBox(const glm::vec3& min, const glm::vec3& max);
+    // Same without counting, safe to call from several threads at once
+    // between RasterizeOccluders() and the next BeginFrame()
+    Visibility ClassifyBox(const glm::vec3& min, const glm::vec3& max) const;
+    // Adds the outcome of ClassifyBox() calls to the frame stats
+    void AddTestResults(uint64_t tested, uint64_t frustumCulled, uint64_t occluded, float testMs);
+    // Tests every instance of a mesh with the given local bounds and copies
+    // the visible ones to out, which must hold instances.size() entries.
+    // Returns how many were written.
+    size_t CullInstances(std::span<const InstanceTransform> instances, const glm::vec3& localMin, const glm::vec3& localMax, InstanceTransform* out);
+
+    inline uint32_t GetWidth() const { return m_Width; }
+    inline uint32_t GetHeight() const { return m_Height; }
+    // 1/w per pixel, 0 where no occluder was drawn
+    inline std::span<const float> GetDepth() const { return m_Depth; }
+
+    // Counters of the current frame; totals add up the frames before it
+    inline const OcclusionStats& GetFrameStats() const { return m_FrameStats; }
+    inline const OcclusionStats& GetTotalStats() const { return m_TotalStats; }
+    inline uint64_t GetFrameCount() const { return m_FrameCount; }
+
+private:
+    struct ScreenTriangle
+    {
+        float x[3];
+        float y[3];
+        float z[3];
+        int32_t minX, minY, maxX, maxY;
+    };
+
+    void SetupTriangles(size_t chunk);
+    void EmitTriangle(size_t chunk, const glm::vec4& a, const glm::vec4& b, const glm::vec4& c);
+    void RasterizeBin(size_t bin);
+    void RasterizeTriangle(const ScreenTriangle& triangle, int32_t binMinX, int32_t binMinY, int32_t binMaxX, int32_t binMaxY);
+    void CullInstanceRange(size_t chunk);
+    void AccumulateFrameStats();
+
+    uint32_t m_Width;
+    uint32_t m_Height;
+    uint32_t m_TilesX;
+    uint32_t m_TilesY;
+    uint32_t m_BinsX;
+    uint32_t m_BinsY;
+    ThreadPool* m_Pool;
+    float m_NearClip;
+
+    glm::mat4 m_ViewProjection = glm::mat4(1.f);
+    std::vector<float> m_Depth;
+    // Farthest 1/w of each tile
+    std::vector<float> m_TileDepth;
+
+    std::vector<const OccluderMesh*> m_Occluders;
+    // Triangle chunks of all occluders, each (mesh, first triangle)
+    struct TriangleChunk
+    {
+        const OccluderMesh* mesh;
+        size_t first;
+        size_t count;
+    };
+    std::vector<TriangleChunk> m_Chunks;
+    // Per chunk: the screen triangles, and per bin the indices into them
+    std::vector<std::vector<ScreenTriangle>> m_ChunkTriangles;
+    std::vector<std::vector<uint32_t>> m_ChunkBins;
+
+    // Shared with the workers of CullInstances
+    std::span<const InstanceTransform> m_CullInstances;
+    glm::vec3 m_CullLocalMin = glm::vec3(0.f);
+    glm::vec3 m_CullLocalMax = glm::vec3(0.f);
+    std::vector<Visibility> m_InstanceVisibility;
+
+    OcclusionStats m_FrameStats;
+    OcclusionStats m_TotalStats;
+    uint64_t m_FrameCount = 0;
+    bool m_FrameStarted = false;
+};
+
+END_VISUALIZER_NAMESPACE
+
+#endif // !OCCLUSION_CULLER_HPP
@@ -0,0 +1,82 @@
+#ifndef OPTIONS_HPP
+#define OPTIONS_HPP
+
+#include <cstdint>
+#include <string>
+
+#include "Visualizer.hpp"
+#include "depth_prepass.hpp"
+
+BEGIN_VISUALIZER_NAMESPACE
+
+struct LaunchOptions
+{
+    // Scene manifest to load instead of the desert and its palms
+    std::string sceneManifest;
+    // Generate the palms on the desert instead of reading palmTransfo.txt,
+    // or the first prototype's instances of the scene
+    bool scatterPalms = false;
+    uint64_t scatterSeed = 0;
+    // Stream cells of this world manifest around the camera
+    std::string worldManifest;
+    // Fail the run if the render loop allocates once this many frames are
+    // past; needs a build with VISUALIZER_TRACK_ALLOCATIONS=1 (Profile|x64)
+    bool checkAllocations = false;
+    uint32_t allocationWarmupFrames = 0;
+    // Skip what the terrain hides, tested on the CPU each frame
+    bool occlusionCulling = true;
+    // Cull the palms on the GPU against a depth pyramid of the frame
+    bool gpuOcclusion = false;
+    // Or with hardware occlusion queries over clusters of palms
+    bool occlusionQueries = false;
+    // Sway the palms culled on the CPU through their transform nodes
+    bool wind = false;
+    // Directory where the triangle BVHs of the meshes are kept between
+    // runs, rebuilt when their mesh changed
+    std::string bvhCache;
+    // Split the desert into meshlets, culled against the frustum and by
+    // facing before being drawn
+    bool meshlets = false;
+    // Torches scattered over the terrain, shaded through clustered lighting
+    uint32_t pointLights = 0;
+    // Time lighting with 1 to 10000 lights before settling on pointLights
+    bool lightBenchmark = false;
+    // Lay down the depth of the scene before shading it, or let the
+    // measured overdraw decide
+    PrepassMode prepass = PrepassMode::Off;
+    // Draw shaded fragment counts as heat instead of the scene
+    bool overdrawView = false;
+    // Save the camera's flight to this path file on exit
+    std::string recordPath;
+    // Or replay one at a fixed timestep without V-Sync, iterations times,
+    // then report frame times and quit
+    std::string playPath;
+    uint32_t playIterations = 1;
+    // Where the playback summary is written as JSON, if anywhere
+    std::string benchmarkJson;
+    // Publish the renderer's stats to shared memory every frame
+    bool publishStats = false;
+    // Print the stats another instance publishes instead of rendering
+    bool readStats = false;
+    // Record every GL call of the first frames, with its arguments
+    std::string glCapture;
+    uint32_t glCaptureFrames = 300;
+    // Replay such a capture iterations times without showing anything
+    std::string glReplay;
+    // Or print how many calls of each kind its frames make
+    std::string glReport;
+    // Fail the run if a frame past the warm-up makes more bind and state
+    // calls than this
+    bool checkGlBudget = false;
+    uint32_t glStateChangeBudget = 0;
+    // The arguments given, one per line, kept in captures
+    std::string launchArguments;
+};
+
+bool ParseLaunchOptions(int32_t argc, char** argv, LaunchOptions& options);
+// Same from the arguments of a capture
+bool ParseLaunchOptions(const std::string& arguments, LaunchOptions& options);
+
+END_VISUALIZER_NAMESPACE
+
+#endif // !OPTIONS_HPP
@@ -0,0 +1,149 @@
+#ifndef QUERY_CULLER_HPP
+#define QUERY_CULLER_HPP
+
+#include <GL/glew.h>
+
+#pragma warning(push, 0)
+#include <glm/glm.hpp>
+#pragma warning(pop, 0)
+
+#include <cstdint>
+#include <vector>
+
+#include "Visualizer.hpp"
+#include "instances.hpp"
+
+BEGIN_VISUALIZER_NAMESPACE
+
+struct QueryStats
+{
+    uint32_t clustersDrawn = 0;
+    // Geometry of visible clusters drawn inside a query
+    uint32_t geometryQueries = 0;
+    // Bounding boxes of hidden clusters
+    uint32_t boxQueries = 0;
+    uint32_t resultsRead = 0;
+    // Polled but still in flight, retried next frame
+    uint32_t resultsNotReady = 0;
+    // Time spent reading query results
+    float waitMs = 0.f;
+};
+
+// Hardware occlusion queries over clusters of instances, after CHC++:
+// results are only read once available and are reused until the next
+// one arrives, so the CPU never waits on the GPU.
+//
+//   - clusters visible last time are drawn normally; every few frames
+//     their draw is wrapped in a query to check they still are;
+//   - hidden clusters get their bounding box queried once the visible
+//     geometry is in the depth buffer, all in one batch, then are drawn
+//     under conditional rendering so that clusters coming into view show
+//     up in the same frame. The GPU resolves those queries itself.
+class OcclusionQueryCuller
+{
+public:
+    // Visible clusters are checked again after this many frames, staggered
+    // so that the queries spread over frames
+    static constexpr uint32_t s_VisibleCheckInterval = 4;
+
+    OcclusionQueryCuller() = default;
+    ~OcclusionQueryCuller() = default;
+
+    OcclusionQueryCuller(const OcclusionQueryCuller&) = delete;
+    OcclusionQueryCuller(OcclusionQueryCuller&&) = delete;
+
+    OcclusionQueryCuller& operator=(const OcclusionQueryCuller&) = delete;
+    OcclusionQueryCuller& operator=(OcclusionQueryCuller&&) = delete;
+
+    bool Initialize();
+    void Cleanup();
+
+    // Groups the instances into square XZ clusters of clusterSize and
+    // reorders them so that each cluster is a contiguous range
+    void Build(std::vector<InstanceTransform>& instances, const glm::vec3& meshMin, const glm::vec3& meshMax, float clusterSize = 64.f);
+
+    inline bool IsEmpty() const { return m_Clusters.empty(); }
+    inline size_t GetClusterCount() const { return m_Clusters.size(); }
+
+    // Reads the results that arrived and sorts the clusters for this frame
+    void BeginFrame(const glm::mat4& viewProjection, const glm::vec3& cameraPosition);
+
+    // draw(firstInstance, instanceCount) for every cluster predicted visible
+    template<typename DrawFn>
+    void DrawVisible(DrawFn&& draw)
+    {
+        for (uint32_t index : m_VisibleClusters)
+        {
+            Cluster& cluster = m_Clusters[index];
+            const bool check = MustCheck(cluster);
+
+            if (check)
+            {
+                BeginQuery(cluster);
+                ++m_FrameStats.geometryQueries;
+            }
+            draw(cluster.first, cluster.count);
+            if (check)
+            {
+                glEndQuery(GL_ANY_SAMPLES_PASSED_CONSERVATIVE);
+            }
+        }
+        m_FrameStats.clustersDrawn += static_cast<uint32_t>(m_VisibleClusters.size());
+    }
+
+    // After every other opaque draw, expects the camera uniform block at binding 0
+    void IssueBoxQueries();
+
+    // draw(firstInstance, instanceCount) for the hidden clusters, each only
+    // rendered if its box query passed
+    template<typename DrawFn>
+    void DrawRevealed(DrawFn&& draw)
+    {
+        for (uint32_t index : m_HiddenClusters)
+        {
+            const Cluster& cluster = m_Clusters[index];
+
+            glBeginConditionalRender(cluster.query, GL_QUERY_WAIT);
+            draw(cluster.first, cluster.count);
+            glEndConditionalRender();
+        }
+    }
+
+    inline const QueryStats& GetFrameStats() const { return m_FrameStats; }
+    inline const QueryStats& GetTotalStats() const { return m_TotalStats; }
+    inline uint64_t GetFrameCount() const { return m_FrameCount; }
+
+private:
+    struct Cluster
+    {
+        glm::vec3 min;
+        glm::vec3 max;
+        uint32_t first;
+        uint32_t count;
+        GLuint query;
+        bool visible;
+        bool queryPending;
+        uint64_t nextCheckFrame;
+    };
+
+    inline bool MustCheck(const Cluster& cluster) const { return !cluster.queryPending && cluster.nextCheckFrame <= m_FrameCount; }
+    void BeginQuery(Cluster& cluster);
+    void ReadResults();
+    void AccumulateFrameStats();
+
+    std::vector<Cluster> m_Clusters;
+    std::vector<uint32_t> m_VisibleClusters;
+    std::vector<uint32_t> m_HiddenClusters;
+
+    GLuint m_BoxProgram = 0;
+    GLuint m_BoxVAO = 0;
+
+    QueryStats m_FrameStats;
+    QueryStats m_TotalStats;
+    uint64_t m_FrameCount = 0;
+    bool m_FrameStarted = false;
+};
+
+END_VISUALIZER_NAMESPACE
+
+#endif // !QUERY_CULLER_HPP
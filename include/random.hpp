@@ -0,0 +1,51 @@
+#ifndef RANDOM_HPP
+#define RANDOM_HPP
+
+#include <cstdint>
+
+#include "Visualizer.hpp"
+
+BEGIN_VISUALIZER_NAMESPACE
+
+// SplitMix64's increment, 2^64 / golden ratio
+constexpr uint64_t s_GoldenGamma = 0x9E3779B97F4A7C15ull;
+
+inline uint64_t SplitMix64(uint64_t x)
+{
+    x += s_GoldenGamma;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+    return x ^ (x >> 31);
+}
+
+// The standard distributions are implementation defined, which would
+// make generated content differ between compilers, so roll our own
+class Random
+{
+public:
+    explicit Random(uint64_t seed) : m_State(seed) {}
+
+    inline uint64_t Next()
+    {
+        m_State += s_GoldenGamma;
+        return SplitMix64(m_State);
+    }
+
+    // [0, 1) with 24 bits of precision
+    inline float NextFloat()
+    {
+        return static_cast<float>(Next() >> 40) * (1.f / 16777216.f);
+    }
+
+    inline float NextFloat(float min, float max)
+    {
+        return min + (max - min) * NextFloat();
+    }
+
+private:
+    uint64_t m_State;
+};
+
+END_VISUALIZER_NAMESPACE
+
+#endif // !RANDOM_HPP
@@ -2,51 +2,306 @@
 #define RENDERER_HPP
 
 #include "Visualizer.hpp"
+#include "bounds_bvh.hpp"
+#include "clustered_lighting.hpp"
+#include "depth_prepass.hpp"
+#include "dirty_ranges.hpp"
+#include "ecs.hpp"
+#include "gpu_resources.hpp"
+#include "hiz_culler.hpp"
+#include "instances.hpp"
+#include "memory_arena.hpp"
+#include "meshlet.hpp"
+#include "occlusion_culler.hpp"
+#include "options.hpp"
+#include "query_culler.hpp"
+#include "terrain.hpp"
+#include "transform_hierarchy.hpp"
+#include "triangle_bvh.hpp"
+#include "upload_manager.hpp"
 
+#include <cstring>
 #include <memory>
+#include <memory_resource>
+#include <span>
 
 BEGIN_VISUALIZER_NAMESPACE
 
 class Camera;
+class StreamingManager;
 struct VertexDataPosition3fColor3f;
 
 struct Object
 {
     uint32_t m_IndexCount;
     GLuint m_VAO, m_VBO, m_IBO;
+    // Positions alone, read by m_DepthVAO for the depth pre-pass
+    GLuint m_PositionVBO = 0;
+    GLuint m_DepthVAO = 0;
+    // Drawn instanced when non-zero
+    uint32_t m_InstanceCount = 0;
+    GLuint m_InstanceBuffer = 0;
+    // Bounds of the vertices, and of everything drawn in world space
+    glm::vec3 m_MeshMin = glm::vec3(0.f);
+    glm::vec3 m_MeshMax = glm::vec3(0.f);
+    glm::vec3 m_BoundsMin = glm::vec3(0.f);
+    glm::vec3 m_BoundsMax = glm::vec3(0.f);
+};
+
+// Work submitted by the last Render(), the GPU counts being those of
+// GpuQueryRing::s_Latency frames before and negative until available
+struct FrameCounters
+{
+    uint32_t drawCommands = 0;
+    int64_t triangles = -1;
+    float sceneGpuMs = -1.f;
 };
 
 class Renderer
 {
 public:
-    Renderer(const std::shared_ptr<Camera>& camera)
-        : m_Camera(camera)
-    {}
+    Renderer(const std::shared_ptr<Camera>& camera, const LaunchOptions& options = {});
 
     Renderer() = delete;
-    ~Renderer() = default;
+    ~Renderer();
     Renderer(const Renderer&) = delete;
     Renderer(Renderer&&) = delete;
 
     Renderer& operator=(const Renderer&) = delete;
     Renderer& operator=(Renderer&&) = delete;
 
-    Object InitObj(std::vector<VertexDataPosition3fColor3f> vertices, const std::vector<uint32_t>& indices, const glm::vec3& translate = glm::vec3(0.0));
+    // Load-time copies come from scratch, which the caller frees with the
+    // asset; the frame allocator is only for per-frame data
+    Object InitObj(std::span<const VertexDataPosition3fColor3f> vertices, std::span<const uint32_t> indices, std::pmr::memory_resource* scratch, const glm::vec3& translate = glm::vec3(0.0));
+    // New vertex array over the prototype's buffers, which stay owned by the prototype
+    Object ShareObj(const Object& prototype);
+    // storageFlags are passed on to the instance buffer, GL_DYNAMIC_STORAGE_BIT
+    // allowing it to be rewritten
+    void AttachInstances(Object& obj, std::span<const InstanceTransform> instances, GLbitfield storageFlags = 0);
+    // Same as above with uninitialized buffers, to be filled by GPU copies
+    Object CreateObj(uint32_t vertexCount, uint32_t indexCount);
+    void CreateInstanceBuffer(Object& obj, uint32_t instanceCount);
     void Initialize();
+    void Update(float dt);
     void Render();
     void Cleanup();
 
     void UpdateViewport(uint32_t width, uint32_t height);
     void UpdateCamera();
 
+    // Live and peak GPU memory per resource category
+    void PrintResourceReport() const;
+
+    void SetOcclusionCulling(bool enabled);
+    inline bool IsOcclusionCullingEnabled() const { return m_OcclusionCulling; }
+
+    void SetPrepassMode(PrepassMode mode);
+    inline PrepassMode GetPrepassMode() const { return m_Prepass.GetMode(); }
+    void SetOverdrawView(bool enabled);
+    inline bool IsOverdrawViewEnabled() const { return m_OverdrawView; }
+
+    inline const FrameCounters& GetFrameCounters() const { return m_FrameCounters; }
+
+    inline const Terrain& GetTerrain() const { return m_Terrain; }
+    inline UploadManager& GetUploads() { return m_Uploads; }
+    // Transient allocations valid until the end of the next frame
+    inline FrameAllocator& GetFrameAllocator() { return m_FrameAllocator; }
+
+    // The instances culled on the CPU can change at runtime, showing from
+    // the next frame. Sets are numbered in load order, and transforms are
+    // in world space. Null entities are returned for sets that do not exist.
+    Entity AddInstance(size_t set, const InstanceTransform& instance);
+    void MoveInstance(Entity instance, const InstanceTransform& transform);
+    void RemoveInstance(Entity instance);
+    inline size_t GetInstanceSetCount() const { return m_CulledInstances.size(); }
+
+    // Nearest hit among the terrain and the instances culled on the CPU,
+    // instance being null for the terrain
+    struct PickResult
+    {
+        Entity instance;
+        glm::vec3 position;
+        glm::vec3 normal;
+        float distance;
+    };
+
+    bool Pick(const Ray& ray, float maxDistance, PickResult& result) const;
+    // Moves a sphere from `from` towards `to`, sliding along what it runs
+    // into, and returns where it stops
+    glm::vec3 MoveSphere(const glm::vec3& from, const glm::vec3& to, float radius) const;
+
 private:
+    void SetupVertexArray(Object& obj);
+    void SetupInstanceAttributes(Object& obj);
+    void DrawObject(const Object& obj);
+    void DrawObject(const Object& obj, uint32_t instanceCount, uint32_t baseInstance = 0);
+    void DrawObjectIndirect(const Object& obj, GLuint commandBuffer, size_t commandOffset);
+    struct MeshletObject;
+    // Frustum and cone culls the meshlets and uploads the survivors' commands
+    void CullMeshlets(MeshletObject& meshlets);
+    // Draws the survivors at once
+    void DrawMeshlets(const MeshletObject& meshlets);
+    // Gathers what the passes of this frame draw, then draws it
+    void CollectSceneDraws();
+    void DrawScene();
+    inline GLuint GetPassVertexArray(const Object& obj) const { return m_DepthOnlyPass ? obj.m_DepthVAO : obj.m_VAO; }
+    // Rasterizes the occluders and culls the instance sets for this frame
+    void CullObjects();
+    bool IsVisible(const Object& obj);
+    struct CulledInstances;
+    Entity CreateInstance(uint32_t set, const InstanceTransform& instance);
+    // Doubles the set's instance buffer, which then holds nothing
+    void GrowInstanceBuffer(CulledInstances& set);
+    // Settles whole subtrees of m_InstanceBvh at once where it can, then
+    // the instances of the leaves reached one by one
+    void ClassifyInstanceBvh(ThreadPool& pool);
+    // Writes the entries that changed since the last upload
+    void UploadInstances(CulledInstances& set);
+    // From the cache directory when there is one
+    void BuildMeshBvh(TriangleBvh& bvh, const std::string& meshPath, std::span<const VertexDataPosition3fColor3f> vertices, std::span<const uint32_t> indices);
+    // Pick() for rays, a sphere sweep for a non-zero radius
+    bool IntersectScene(const Ray& ray, float radius, float maxDistance, PickResult& result) const;
+
+    LaunchOptions m_Options;
+    LinearArena m_LoadArena{ 4u << 20 };
+    FrameAllocator m_FrameAllocator;
     std::vector<Object> m_objects;
+    Terrain m_Terrain;
 
     GLuint m_UBO;
     glm::mat4* m_UBOData = nullptr;
 
     GLuint m_ShaderProgram;
     std::shared_ptr<Camera> m_Camera;
+    glm::vec3 m_LastCameraPosition = glm::vec3(0.f);
+
+    // Instances of m_objects[object] tested one by one, the survivors are
+    // written to its instance buffer every frame, skipping the entries that
+    // already hold the same instance
+    struct CulledInstances
+    {
+        size_t object;
+        NodeId root;
+        uint32_t instanceCount;
+        // As big as the instance buffer, whose first bufferedCount entries
+        // hold the same
+        std::vector<InstanceTransform> visible;
+        uint32_t visibleCount;
+        uint32_t bufferedCount;
+        DirtyRanges dirty;
+
+        inline void Push(const InstanceTransform& instance)
+        {
+            InstanceTransform& entry = visible[visibleCount];
+            if (visibleCount >= bufferedCount || std::memcmp(&entry, &instance, sizeof(InstanceTransform)) != 0)
+            {
+                entry = instance;
+                dirty.Add(visibleCount);
+            }
+            ++visibleCount;
+        }
+    };
+
+    // Those instances are entities of m_Scene, with these components next
+    // to their InstanceTransform and Visibility
+    struct InstanceBounds
+    {
+        glm::vec3 min;
+        glm::vec3 max;
+    };
+
+    struct InstanceSetIndex
+    {
+        uint32_t set;
+    };
+
+    // Node of m_Transforms the instance takes its transform from
+    struct InstanceNode
+    {
+        NodeId node;
+    };
+
+    // Yaw at rest and phase of a palm turning in the wind
+    struct WindSway
+    {
+        float yaw;
+        float phase;
+    };
+
+    bool m_OcclusionCulling = true;
+    OcclusionCuller m_Occlusion;
+    OccluderMesh m_TerrainOccluder;
+    std::vector<CulledInstances> m_CulledInstances;
+    World m_Scene;
+    // One root per instance set, the instances below it
+    TransformHierarchy m_Transforms;
+    float m_WindTime = 0.f;
+    // Since the instance buffers were last rewritten
+    bool m_InstancesMoved = false;
+    // Over the instances' bounds, an item per entity index
+    DynamicBoundsBvh m_InstanceBvh;
+    std::vector<Visibility> m_InstanceVisibility;
+    std::vector<uint32_t> m_BvhSubtrees;
+    // In mesh space, one per instance set, and the terrain's in world space
+    std::vector<TriangleBvh> m_InstanceMeshBvhs;
+    TriangleBvh m_TerrainBvh;
+    // Classifies every instance, then gathers the visible ones by set
+    SystemScheduler m_CullSystems;
+
+    // Instance sets culled on the GPU instead, one object per HiZCuller set
+    HiZCuller m_HiZ;
+    std::vector<Object> m_HiZObjects;
+
+    // Or by hardware queries over clusters of them
+    OcclusionQueryCuller m_Queries;
+    Object m_QueryObject{};
+
+    // Objects drawn meshlet by meshlet, with their index buffer regrouped
+    struct MeshletObject
+    {
+        size_t object;
+        MeshletMesh mesh;
+        std::vector<DrawElementsIndirectCommand> commands;
+        GLuint commandBuffer;
+        size_t commandCount = 0;
+    };
+
+    std::vector<MeshletObject> m_MeshletObjects;
+    MeshletStats m_MeshletStats;
+    uint64_t m_MeshletFrames = 0;
+
+    ClusteredLighting m_Lighting;
+    LightingBenchmark m_LightBenchmark;
+    // Around every draw of the frame
+    GpuTimer m_SceneTimer;
+    GpuQueryRing m_ScenePrimitives;
+    FrameCounters m_FrameCounters;
+    uint32_t m_ViewportWidth = 0;
+    uint32_t m_ViewportHeight = 0;
+
+    // Drawn by the depth and color passes alike
+    struct SceneDraw
+    {
+        const Object* object;
+        uint32_t instanceCount;
+        const MeshletObject* meshlets;
+    };
+
+    std::vector<SceneDraw> m_SceneDraws;
+    DepthPrepass m_Prepass;
+    GLuint m_DepthProgram = 0;
+    // Program and vertex arrays the draws of the current pass use
+    GLuint m_PassProgram = 0;
+    bool m_DepthOnlyPass = false;
+
+    OverdrawCounter m_OverdrawCounter;
+    GLuint m_OverdrawProgram = 0;
+    bool m_OverdrawView = false;
+    uint64_t m_OverdrawFrames = 0;
+
+    // Declared before m_Streaming, whose load jobs write into it
+    UploadManager m_Uploads;
+    std::unique_ptr<StreamingManager> m_Streaming;
 };
 
 END_VISUALIZER_NAMESPACE
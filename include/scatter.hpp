@@ -0,0 +1,56 @@
+#ifndef SCATTER_HPP
+#define SCATTER_HPP
+
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#include "Visualizer.hpp"
+#include "instances.hpp"
+
+BEGIN_VISUALIZER_NAMESPACE
+
+class Terrain;
+class ThreadPool;
+
+// Grayscale [0, 1] image stretched over the terrain XZ bounds, row 0 at min z
+struct DensityMask
+{
+    uint32_t width = 0;
+    uint32_t height = 0;
+    std::vector<float> values;
+
+    float Sample(float u, float v) const;
+};
+
+struct ScatterSettings
+{
+    uint64_t seed = 0;
+
+    // Tiles are the unit of work and of determinism: each one is sampled
+    // from its own seed, so the output does not depend on the thread count
+    float tileSize = 64.f;
+    float minDistance = 8.f;
+    // Candidates tried around each active sample (Bridson's k)
+    uint32_t attemptsPerSample = 16;
+
+    float minHeight = std::numeric_limits<float>::lowest();
+    float maxHeight = std::numeric_limits<float>::max();
+    float maxSlopeDegrees = 30.f;
+
+    float minScale = 0.8f;
+    float maxScale = 1.2f;
+    float minYaw = 0.f;
+    float maxYaw = 6.2831853f;
+
+    const DensityMask* densityMask = nullptr;
+};
+
+// Blue-noise instance placement on top of the terrain. Tiles are sampled
+// independently with Poisson-disk sampling inset by minDistance on their
+// far edges, which keeps the spacing valid across tile borders.
+std::vector<InstanceTransform> ScatterInstances(const Terrain& terrain, const ScatterSettings& settings, ThreadPool& pool);
+
+END_VISUALIZER_NAMESPACE
+
+#endif // !SCATTER_HPP
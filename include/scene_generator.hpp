@@ -0,0 +1,95 @@
+#ifndef SCENE_GENERATOR_HPP
+#define SCENE_GENERATOR_HPP
+
+#pragma warning(push, 0)
+#include <glm/glm.hpp>
+#pragma warning(pop, 0)
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "Visualizer.hpp"
+#include "instances.hpp"
+#include "mesh.hpp"
+
+BEGIN_VISUALIZER_NAMESPACE
+
+// Synthetic content for stress tests. Everything is generated from a seed
+// with the same output on every platform, so a scene can be regenerated
+// instead of shipped.
+
+struct GeneratedMesh
+{
+    std::vector<VertexDataPosition3fColor3f> vertices;
+    std::vector<uint32_t> indices;
+
+    inline size_t GetTriangleCount() const { return indices.size() / 3; }
+};
+
+struct NoiseTerrainSettings
+{
+    uint64_t seed = 0;
+    // Rounded to the nearest square grid of quads
+    uint64_t triangleCount = 1u << 17;
+    // Square centred on the origin in XZ
+    float size = 512.f;
+    float baseHeight = -40.f;
+    float amplitude = 12.f;
+    // Fractal value noise: octaves of doubling frequency and halving
+    // amplitude, the first with this many waves across the terrain
+    uint32_t octaves = 5;
+    float frequency = 4.f;
+};
+
+// Tapered, bent trunk under a crown of drooping double-sided fronds,
+// standing on the origin
+struct TreeSettings
+{
+    uint64_t seed = 0;
+    // Split evenly between trunk and fronds, rounded to what their grids
+    // hold; small counts bottom out at a three-sided trunk and
+    // fronds one quad wide
+    uint64_t triangleCount = 2048;
+    float height = 10.f;
+    float trunkRadius = 0.35f;
+    float bend = 1.5f;
+    uint32_t fronds = 8;
+    float frondLength = 5.f;
+    float frondWidth = 0.8f;
+};
+
+enum class InstanceDistribution
+{
+    Uniform,
+    // Gaussian blobs around uniformly placed centres
+    Clustered,
+    // Rows of a square grid, filled in order
+    Grid
+};
+
+struct InstanceSettings
+{
+    uint64_t seed = 0;
+    uint64_t count = 10000;
+    InstanceDistribution distribution = InstanceDistribution::Uniform;
+    // XZ rectangle the instances are placed in
+    glm::vec2 min = glm::vec2(-256.f);
+    glm::vec2 max = glm::vec2(256.f);
+    uint32_t clusterCount = 64;
+    float clusterRadius = 16.f;
+    float minScale = 0.8f;
+    float maxScale = 1.2f;
+};
+
+GeneratedMesh GenerateNoiseTerrain(const NoiseTerrainSettings& settings);
+GeneratedMesh GenerateTree(const TreeSettings& settings);
+// Instances are left at a height of 0, to be put on a terrain
+std::vector<InstanceTransform> GenerateInstances(const InstanceSettings& settings);
+
+bool ParseInstanceDistribution(const std::string& name, InstanceDistribution& distribution);
+const char* GetInstanceDistributionName(InstanceDistribution distribution);
+
+END_VISUALIZER_NAMESPACE
+
+#endif // !SCENE_GENERATOR_HPP
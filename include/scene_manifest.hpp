@@ -0,0 +1,53 @@
+#ifndef SCENE_MANIFEST_HPP
+#define SCENE_MANIFEST_HPP
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "Visualizer.hpp"
+
+BEGIN_VISUALIZER_NAMESPACE
+
+// What the renderer loads at start-up: one terrain and instance sets of
+// prototype meshes, read from a manifest of the form:
+//
+//   terrain desert.obj
+//   prototype palm.obj
+//   instances <prototype index> palmTransfo.txt
+//
+// Meshes are OBJ or binary, instance files text or binary. Relative paths
+// are resolved against the manifest directory. Instances are put on the
+// terrain where they stand over it.
+class SceneManifest
+{
+public:
+    struct InstanceSet
+    {
+        uint32_t prototype;
+        std::string path;
+    };
+
+    // The desert and its palms
+    static SceneManifest GetDefault();
+
+    bool Load(const std::string& manifestPath);
+    bool Save(const std::string& manifestPath) const;
+
+    inline void SetTerrain(const std::string& meshPath) { m_Terrain = meshPath; }
+    uint32_t AddPrototype(const std::string& meshPath);
+    void AddInstances(uint32_t prototype, const std::string& path);
+
+    inline const std::string& GetTerrain() const { return m_Terrain; }
+    inline const std::vector<std::string>& GetPrototypes() const { return m_Prototypes; }
+    inline const std::vector<InstanceSet>& GetInstanceSets() const { return m_InstanceSets; }
+
+private:
+    std::string m_Terrain;
+    std::vector<std::string> m_Prototypes;
+    std::vector<InstanceSet> m_InstanceSets;
+};
+
+END_VISUALIZER_NAMESPACE
+
+#endif // !SCENE_MANIFEST_HPP
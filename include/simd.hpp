@@ -0,0 +1,13 @@
+#ifndef SIMD_HPP
+#define SIMD_HPP
+
+// SSE2 is part of every x64 target, MSVC only advertises it through _M_X64
+// or /arch on 32-bit builds.
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define VISUALIZER_SSE2 1
+#include <emmintrin.h>
+#else
+#define VISUALIZER_SSE2 0
+#endif
+
+#endif // !SIMD_HPP
@@ -0,0 +1,57 @@
+#ifndef STATISTICS_HPP
+#define STATISTICS_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+#include "Visualizer.hpp"
+
+BEGIN_VISUALIZER_NAMESPACE
+
+struct Summary
+{
+    size_t count = 0;
+    double mean = 0.0;
+    double p50 = 0.0;
+    double p95 = 0.0;
+    double p99 = 0.0;
+    double max = 0.0;
+};
+
+// Nearest rank percentiles, values is sorted in place
+inline Summary Summarize(std::vector<double>& values)
+{
+    Summary summary;
+    summary.count = values.size();
+
+    if (values.empty())
+    {
+        return summary;
+    }
+
+    std::sort(values.begin(), values.end());
+
+    auto percentile = [&values](double p)
+    {
+        const size_t rank = static_cast<size_t>(std::ceil(p * values.size()));
+        return values[std::clamp<size_t>(rank, 1, values.size()) - 1];
+    };
+
+    for (double value : values)
+    {
+        summary.mean += value;
+    }
+    summary.mean /= static_cast<double>(values.size());
+    summary.p50 = percentile(0.50);
+    summary.p95 = percentile(0.95);
+    summary.p99 = percentile(0.99);
+    summary.max = values.back();
+
+    return summary;
+}
+
+END_VISUALIZER_NAMESPACE
+
+#endif // !STATISTICS_HPP
@@ -0,0 +1,161 @@
+#ifndef STATS_REGISTRY_HPP
+#define STATS_REGISTRY_HPP
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <type_traits>
+
+#include "Visualizer.hpp"
+
+BEGIN_VISUALIZER_NAMESPACE
+
+// Only ever grow, readers turn them into rates
+enum class StatCounter : uint32_t
+{
+    Frames,
+    DrawCommands,
+    Triangles,
+    VisibleInstances,
+    CulledInstances,
+    UploadBytes,
+    // Fence polls that found the GPU not done yet
+    FenceWaits,
+    Count
+};
+
+// Latest value wins
+enum class StatGauge : uint32_t
+{
+    CpuFrameMs,
+    GpuFrameMs,
+    StagingBytesInUse,
+    GpuLiveBytes,
+    Count
+};
+
+enum class StatHistogram : uint32_t
+{
+    CpuFrameTime,
+    GpuFrameTime,
+    Count
+};
+
+const char* GetStatName(StatCounter counter);
+const char* GetStatName(StatGauge gauge);
+const char* GetStatName(StatHistogram histogram);
+
+constexpr size_t s_StatCounterCount = static_cast<size_t>(StatCounter::Count);
+constexpr size_t s_StatGaugeCount = static_cast<size_t>(StatGauge::Count);
+constexpr size_t s_StatHistogramCount = static_cast<size_t>(StatHistogram::Count);
+// Bucket 0 holds durations under 64 us, bucket b those under 64 << b us,
+// the last one everything longer
+constexpr size_t s_StatHistogramBuckets = 16;
+
+// Every stat at one point in time, also the binary layout of the shared
+// segment
+struct StatsSnapshot
+{
+    uint64_t publishCount = 0;
+    // Steady clock of the publisher
+    uint64_t publishTimeNs = 0;
+    std::array<uint64_t, s_StatCounterCount> counters{};
+    std::array<double, s_StatGaugeCount> gauges{};
+    std::array<std::array<uint64_t, s_StatHistogramBuckets>, s_StatHistogramCount> histograms{};
+};
+
+// Process-wide stats, each update being a single relaxed atomic operation
+// so that any thread, the render loop first, can record without locking
+class StatsRegistry
+{
+public:
+    static StatsRegistry& GetGlobal();
+
+    inline void Add(StatCounter counter, uint64_t value = 1)
+    {
+        m_Counters[static_cast<size_t>(counter)].fetch_add(value, std::memory_order_relaxed);
+    }
+
+    inline void Set(StatGauge gauge, double value)
+    {
+        m_Gauges[static_cast<size_t>(gauge)].store(value, std::memory_order_relaxed);
+    }
+
+    void Record(StatHistogram histogram, float ms);
+
+    // Not a consistent cut across stats, each one is exact on its own
+    void Snapshot(StatsSnapshot& snapshot) const;
+
+private:
+    std::array<std::atomic<uint64_t>, s_StatCounterCount> m_Counters{};
+    std::array<std::atomic<double>, s_StatGaugeCount> m_Gauges{};
+    std::array<std::array<std::atomic<uint64_t>, s_StatHistogramBuckets>, s_StatHistogramCount> m_Histograms{};
+};
+
+// Named shared memory holding the latest snapshot behind a sequence lock:
+// odd while the publisher writes, readers copy and retry until they saw
+// the same even value on both sides. POSIX shared memory, or a named file
+// mapping on Windows.
+class SharedStats
+{
+public:
+    static constexpr uint32_t s_Magic = 0x53544156; // "VATS"
+    static constexpr uint32_t s_Version = 1;
+    static constexpr const char* s_DefaultName = "visualizer_stats";
+
+    SharedStats() = default;
+    ~SharedStats();
+
+    SharedStats(const SharedStats&) = delete;
+    SharedStats(SharedStats&&) = delete;
+
+    SharedStats& operator=(const SharedStats&) = delete;
+    SharedStats& operator=(SharedStats&&) = delete;
+
+    // Publisher side, creating or taking over the segment
+    bool Create(const char* name = s_DefaultName);
+    void Publish(const StatsRegistry& registry);
+
+    // Reader side, read only
+    bool Open(const char* name = s_DefaultName);
+    // False when no consistent copy could be made, or the layout differs
+    bool Read(StatsSnapshot& snapshot) const;
+
+    void Close();
+
+private:
+    struct Segment
+    {
+        uint32_t magic;
+        uint32_t version;
+        // Layout checks for readers built from other sources
+        uint32_t snapshotSize;
+        std::atomic<uint32_t> sequence;
+        StatsSnapshot snapshot;
+    };
+
+    static_assert(std::is_standard_layout_v<Segment>);
+    static_assert(std::atomic<uint32_t>::is_always_lock_free);
+
+    bool Map(const char* name, bool create);
+
+    Segment* m_Segment = nullptr;
+    bool m_Owner = false;
+    StatsSnapshot m_Scratch;
+
+#ifdef _WIN32
+    void* m_Mapping = nullptr;
+#else
+    char m_Name[64] = {};
+#endif
+};
+
+// Prints the published stats every second as rates, until the publisher
+// stops for a few seconds. Returns false when there is nothing to read.
+bool RunStatsReader(std::ostream& os, const char* name = SharedStats::s_DefaultName);
+
+END_VISUALIZER_NAMESPACE
+
+#endif // !STATS_REGISTRY_HPP
@@ -0,0 +1,110 @@
+#ifndef TERRAIN_HPP
+#define TERRAIN_HPP
+
+#pragma warning(push, 0)
+#include <glm/glm.hpp>
+#pragma warning(pop, 0)
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "Visualizer.hpp"
+
+BEGIN_VISUALIZER_NAMESPACE
+
+struct VertexDataPosition3fColor3f;
+
+// Height field queries over a triangle mesh seen from above. Triangles are
+// binned into a regular XZ grid and stored per cell in packs of four so a
+// query only tests the few triangles overlapping its cell, four at a time.
+class Terrain
+{
+public:
+    // A cellSize of 0 picks one from the average triangle footprint
+    void Build(std::span<const VertexDataPosition3fColor3f> vertices, std::span<const uint32_t> indices, float cellSize = 0.f);
+    void Clear();
+
+    // Returns false when (x, z) lies outside every triangle. Where surfaces
+    // overlap the highest one wins.
+    bool HeightAt(float x, float z, float& height) const;
+    bool NormalAt(float x, float z, glm::vec3& normal) const;
+
+    // Batched variants: misses are written as NaN heights / zero normals.
+    // Return the number of hits. Each query runs the same SIMD test over
+    // its cell's packs as the single ones; cells hold one or two packs, so
+    // the lanes are already full and spreading queries across lanes
+    // measured no faster, only adding gathers.
+    size_t HeightAt(std::span<const glm::vec2> xz, std::span<float> heights) const;
+    size_t NormalAt(std::span<const glm::vec2> xz, std::span<glm::vec3> normals) const;
+    // Both at once for callers needing height and slope, one lookup per point
+    size_t SampleAt(std::span<const glm::vec2> xz, std::span<float> heights, std::span<glm::vec3> normals) const;
+
+    // Lowest point of any triangle over the XZ rectangle [min, max], found
+    // by clipping the triangles of the cells it covers. Returns false when
+    // no triangle reaches into the rectangle.
+    bool LowestIn(const glm::vec2& min, const glm::vec2& max, float& height) const;
+
+    inline bool IsEmpty() const { return m_TriangleCount == 0; }
+    inline const glm::vec3& GetMin() const { return m_Min; }
+    inline const glm::vec3& GetMax() const { return m_Max; }
+    inline float GetCellSize() const { return m_CellSize; }
+    inline size_t GetTriangleCount() const { return m_TriangleCount; }
+
+private:
+    static constexpr uint32_t s_PackWidth = 4;
+    static constexpr uint32_t s_InvalidTriangle = ~0u;
+
+    // Four triangles in SoA form. (u, v) = M * (p - p0).xz are the
+    // barycentric coordinates of p and h = y0 + u * dy1 + v * dy2.
+    struct TrianglePack
+    {
+        alignas(16) float x0[s_PackWidth];
+        alignas(16) float z0[s_PackWidth];
+        alignas(16) float m00[s_PackWidth];
+        alignas(16) float m01[s_PackWidth];
+        alignas(16) float m10[s_PackWidth];
+        alignas(16) float m11[s_PackWidth];
+        alignas(16) float y0[s_PackWidth];
+        alignas(16) float dy1[s_PackWidth];
+        alignas(16) float dy2[s_PackWidth];
+        uint32_t triangle[s_PackWidth];
+    };
+
+    struct TriangleNormals
+    {
+        glm::vec3 n0, n1, n2;
+    };
+
+    struct TriangleCorners
+    {
+        glm::vec3 p0, p1, p2;
+    };
+
+    struct Hit
+    {
+        uint32_t triangle = s_InvalidTriangle;
+        float u = 0.f, v = 0.f;
+        float height = 0.f;
+    };
+
+    bool Locate(float x, float z, Hit& hit) const;
+    glm::vec3 InterpolateNormal(const Hit& hit) const;
+
+    std::vector<TrianglePack> m_Packs;
+    std::vector<uint32_t> m_CellPackStart; // CSR offsets into m_Packs, one per cell + 1
+    std::vector<TriangleNormals> m_Normals;
+    std::vector<TriangleCorners> m_Corners;
+
+    glm::vec3 m_Min = glm::vec3(0.f);
+    glm::vec3 m_Max = glm::vec3(0.f);
+    float m_CellSize = 1.f;
+    float m_InvCellSize = 1.f;
+    uint32_t m_CellCountX = 0;
+    uint32_t m_CellCountZ = 0;
+    size_t m_TriangleCount = 0;
+};
+
+END_VISUALIZER_NAMESPACE
+
+#endif // !TERRAIN_HPP
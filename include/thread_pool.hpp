@@ -0,0 +1,56 @@
+#ifndef THREAD_POOL_HPP
+#define THREAD_POOL_HPP
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "Visualizer.hpp"
+
+BEGIN_VISUALIZER_NAMESPACE
+
+class ThreadPool
+{
+public:
+    // One worker per hardware thread, minus the calling thread
+    static constexpr uint32_t s_HardwareWorkers = ~0u;
+
+    // With 0 workers everything runs on the calling thread
+    explicit ThreadPool(uint32_t workerCount = s_HardwareWorkers);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool(ThreadPool&&) = delete;
+
+    ThreadPool& operator=(const ThreadPool&) = delete;
+    ThreadPool& operator=(ThreadPool&&) = delete;
+
+    void Submit(std::function<void()> task);
+
+    // Calls fn(i) for every i in [0, count). The calling thread takes part
+    // and the call returns once every index has been processed. Called from
+    // one of this pool's own workers it runs serially instead of waiting on
+    // helpers that may never get a free worker.
+    void ParallelFor(size_t count, const std::function<void(size_t)>& fn);
+
+    inline uint32_t GetWorkerCount() const { return static_cast<uint32_t>(m_Workers.size()); }
+
+    static ThreadPool& GetGlobal();
+
+private:
+    void WorkerLoop();
+
+    std::vector<std::thread> m_Workers;
+    std::deque<std::function<void()>> m_Tasks;
+    std::mutex m_Mutex;
+    std::condition_variable m_Condition;
+    bool m_Stop = false;
+};
+
+END_VISUALIZER_NAMESPACE
+
+#endif // !THREAD_POOL_HPP
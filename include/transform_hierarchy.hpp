@@ -0,0 +1,104 @@
+#ifndef TRANSFORM_HIERARCHY_HPP
+#define TRANSFORM_HIERARCHY_HPP
+
+#pragma warning(push, 0)
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+#pragma warning(pop, 0)
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "Visualizer.hpp"
+#include "instances.hpp"
+
+BEGIN_VISUALIZER_NAMESPACE
+
+class ThreadPool;
+
+// Parent-relative transforms composed into world matrices. Nodes are kept
+// sorted by depth in flat arrays, one per field, so each level only reads
+// the finished level above it and large levels are split over the pool.
+// Update() recomputes the nodes whose local transform changed and what is
+// below them, nothing else.
+
+using NodeId = uint32_t;
+constexpr NodeId s_NoNode = ~0u;
+
+struct LocalTransform
+{
+    glm::vec3 position = glm::vec3(0.f);
+    glm::quat rotation = glm::quat(1.f, 0.f, 0.f, 0.f);
+    float scale = 1.f;
+};
+
+// The yaw about Y and uniform scale the instance buffers hold
+LocalTransform ToLocalTransform(const InstanceTransform& instance);
+// And back from a world matrix, exact when every rotation up the chain
+// turns about Y
+InstanceTransform ToInstanceTransform(const glm::mat4& world);
+
+class TransformHierarchy
+{
+public:
+    // Ids of destroyed nodes are handed out again
+    NodeId Create(const LocalTransform& local, NodeId parent = s_NoNode);
+    // Along with every node below it
+    void Destroy(NodeId node);
+    // The parent must not be below the node
+    void SetParent(NodeId node, NodeId parent);
+    void Clear();
+
+    inline bool IsAlive(NodeId node) const { return node < m_Alive.size() && m_Alive[node]; }
+
+    void SetLocal(NodeId node, const LocalTransform& local);
+    LocalTransform GetLocal(NodeId node) const;
+    // As of the last Update()
+    inline const glm::mat4& GetWorld(NodeId node) const { return m_World[m_Slots[node]]; }
+    // Whether the last Update() recomputed the node's world matrix
+    inline bool WasUpdated(NodeId node) const { return m_Updated[m_Slots[node]] != 0; }
+
+    // Composes the world matrices of the changed nodes and their
+    // descendants, returning how many. Creating, destroying or reparenting
+    // nodes re-sorts the arrays first.
+    size_t Update(ThreadPool& pool);
+
+    // World matrices of the nodes in the instance buffer layout, large
+    // spans split over the pool
+    void WriteInstances(std::span<const NodeId> nodes, InstanceTransform* out, ThreadPool& pool) const;
+
+    inline size_t GetNodeCount() const { return m_SlotNodes.size(); }
+    inline size_t GetLevelCount() const { return m_LevelStarts.empty() ? 0 : m_LevelStarts.size() - 1; }
+
+private:
+    // Regroups the slots by depth, dropping destroyed subtrees
+    void Sort();
+    size_t UpdateRange(size_t first, size_t last);
+
+    // By node id
+    std::vector<NodeId> m_Parents;
+    std::vector<uint32_t> m_Slots;
+    std::vector<uint8_t> m_Alive;
+    std::vector<NodeId> m_FreeNodes;
+
+    // By slot, depth after depth
+    std::vector<NodeId> m_SlotNodes;
+    std::vector<uint32_t> m_ParentSlots;
+    std::vector<glm::vec3> m_Positions;
+    std::vector<glm::quat> m_Rotations;
+    std::vector<float> m_Scales;
+    std::vector<glm::mat4> m_World;
+    std::vector<uint8_t> m_Dirty;
+    std::vector<uint8_t> m_Updated;
+    // First slot of every depth, then the slot count
+    std::vector<uint32_t> m_LevelStarts;
+
+    bool m_NeedsSort = false;
+    bool m_HasChanges = false;
+    bool m_HasUpdated = false;
+};
+
+END_VISUALIZER_NAMESPACE
+
+#endif // !TRANSFORM_HIERARCHY_HPP
@@ -0,0 +1,176 @@
+#ifndef TRIANGLE_BVH_HPP
+#define TRIANGLE_BVH_HPP
+
+#pragma warning(push, 0)
+#include <glm/glm.hpp>
+#pragma warning(pop, 0)
+
+#include <cstdint>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "Visualizer.hpp"
+#include "bounds_bvh.hpp"
+#include "instances.hpp"
+
+BEGIN_VISUALIZER_NAMESPACE
+
+class ThreadPool;
+struct VertexDataPosition3fColor3f;
+
+struct TriangleBvhSettings
+{
+    BvhBuildSettings build;
+    // Collapse the tree into nodes of four children, tested at once
+    bool wide = true;
+};
+
+struct RayHit
+{
+    // Along the ray, in units of its direction
+    float distance = 0.f;
+    // Index of the triangle's first index / 3
+    uint32_t triangle = 0;
+    // Of the triangle facing the ray, or from the contact point towards the
+    // sphere's center for sweeps
+    glm::vec3 normal = glm::vec3(0.f);
+};
+
+// Binary BVH cache file: this header, nodeCount BvhNode, then triangleCount
+// triangle indices in leaf order
+struct TriangleBvhFileHeader
+{
+    static constexpr char s_Magic[4] = { 'V', 'B', 'V', 'H' };
+    static constexpr uint32_t s_Version = 1;
+
+    char magic[4];
+    uint32_t version;
+    // Of the positions and indices it was built over
+    uint64_t meshHash;
+    uint64_t triangleCount;
+    uint64_t nodeCount;
+};
+
+static_assert(sizeof(TriangleBvhFileHeader) == 32, "TriangleBvhFileHeader layout is part of the file format");
+
+// Ray and swept sphere queries against a triangle mesh, through a binned
+// SAH BoundsBvh over its triangles. The triangles are copied in leaf
+// order, and with settings.wide the tree is collapsed into 4-wide nodes
+// whose boxes are tested with SSE.
+class TriangleBvh
+{
+public:
+    static constexpr uint32_t s_WideWidth = 4;
+
+    // Bounds are computed on the pool, and the tree built on it past a few
+    // thousand triangles
+    void Build(std::span<const VertexDataPosition3fColor3f> vertices, std::span<const uint32_t> indices, ThreadPool& pool, const TriangleBvhSettings& settings = {});
+    // Loads the tree from path when it was saved for this same mesh, else
+    // builds it and saves it there. Returns whether it was loaded.
+    bool BuildCached(const std::string& path, std::span<const VertexDataPosition3fColor3f> vertices, std::span<const uint32_t> indices, ThreadPool& pool, const TriangleBvhSettings& settings = {});
+    bool Save(const std::string& path) const;
+    // Fails on files of another version or mesh
+    bool Load(const std::string& path, std::span<const VertexDataPosition3fColor3f> vertices, std::span<const uint32_t> indices, const TriangleBvhSettings& settings = {});
+    void Clear();
+
+    // Nearest hit before maxDistance
+    bool Raycast(const Ray& ray, float maxDistance, RayHit& hit) const;
+    // Nearest contact of a sphere of this radius moved along the ray,
+    // whose distance is where the sphere's center stops
+    bool SweepSphere(const Ray& ray, float radius, float maxDistance, RayHit& hit) const;
+
+    inline bool IsEmpty() const { return m_Triangles.empty(); }
+    inline bool IsWide() const { return !m_WideNodes.empty(); }
+    inline size_t GetTriangleCount() const { return m_Triangles.size(); }
+    inline const BoundsBvh& GetTree() const { return m_Tree; }
+    inline size_t GetWideNodeCount() const { return m_WideNodes.size(); }
+
+private:
+    // A vertex and the two edges from it, in leaf order
+    struct Triangle
+    {
+        glm::vec3 v0;
+        glm::vec3 edge1;
+        glm::vec3 edge2;
+    };
+
+    // Four children's boxes in SoA form. A child is a wide node index, or
+    // a leaf with s_LeafBit set, its first triangle shifted by
+    // s_LeafCountBits and its count - 1 below.
+    struct alignas(16) WideNode
+    {
+        float minX[s_WideWidth];
+        float minY[s_WideWidth];
+        float minZ[s_WideWidth];
+        float maxX[s_WideWidth];
+        float maxY[s_WideWidth];
+        float maxZ[s_WideWidth];
+        uint32_t children[s_WideWidth];
+    };
+
+    static constexpr uint32_t s_LeafBit = 1u << 31;
+    static constexpr uint32_t s_LeafCountBits = 4;
+    static constexpr uint32_t s_EmptyChild = ~0u;
+
+    static_assert(BoundsBvh::s_MaxLeafSize <= (1u << s_LeafCountBits), "Leaf counts must fit below the first triangle");
+
+    // Copies the triangles in leaf order and collapses the tree if asked
+    void Finish(std::span<const VertexDataPosition3fColor3f> vertices, std::span<const uint32_t> indices, bool wide);
+    uint32_t Collapse(uint32_t node);
+
+    template<typename LeafFn>
+    void TraverseWide(const Ray& ray, float maxDistance, float margin, LeafFn&& leaf) const;
+    template<typename TriangleFn>
+    void Traverse(const Ray& ray, float maxDistance, float margin, TriangleFn&& test) const;
+
+    BoundsBvh m_Tree;
+    std::vector<Triangle> m_Triangles;
+    std::vector<WideNode> m_WideNodes;
+    uint64_t m_MeshHash = 0;
+};
+
+// A hit on an instanced mesh: which item of the instance tree, and the
+// hit in world space
+struct InstanceHit
+{
+    uint32_t item = 0;
+    RayHit hit;
+};
+
+// The ray or sphere sweep, moved into the space of the instance's mesh,
+// and the hit moved back out. A radius of 0 casts a ray.
+bool IntersectInstance(const TriangleBvh& mesh, const InstanceTransform& instance, const Ray& ray, float radius, float maxDistance, RayHit& hit);
+
+// Two-level queries: the items of the instance tree are meshes placed by
+// an InstanceTransform. getMesh(item, transform) returns the item's mesh,
+// filling its transform, or null to skip it.
+template<typename MeshFn>
+bool IntersectInstances(const BoundsBvh& instances, const Ray& ray, float radius, float maxDistance, MeshFn&& getMesh, InstanceHit& result)
+{
+    bool found = false;
+
+    instances.Raycast(ray, maxDistance, [&](const BvhNode& leaf, float& distance)
+    {
+        for (uint32_t i = leaf.first; i < leaf.first + leaf.count; ++i)
+        {
+            const uint32_t item = instances.GetItems()[i];
+            InstanceTransform transform;
+            RayHit hit;
+
+            const TriangleBvh* mesh = getMesh(item, transform);
+            if (mesh && IntersectInstance(*mesh, transform, ray, radius, distance, hit))
+            {
+                distance = hit.distance;
+                result = { item, hit };
+                found = true;
+            }
+        }
+    }, radius);
+
+    return found;
+}
+
+END_VISUALIZER_NAMESPACE
+
+#endif // !TRIANGLE_BVH_HPP
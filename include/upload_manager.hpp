@@ -0,0 +1,146 @@
+#ifndef UPLOAD_MANAGER_HPP
+#define UPLOAD_MANAGER_HPP
+
+#include <GL/glew.h>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <span>
+
+#include "Visualizer.hpp"
+
+BEGIN_VISUALIZER_NAMESPACE
+
+// A region of the staging ring, writable from any thread until submitted
+struct StagingAllocation
+{
+    void* data = nullptr;
+    size_t offset = 0;
+    size_t size = 0;
+    uint64_t id = 0;
+
+    inline explicit operator bool() const { return data != nullptr; }
+};
+
+// Part of an allocation copied into a destination buffer
+struct UploadCopy
+{
+    size_t offset;
+    size_t size;
+    GLuint destination;
+    size_t destinationOffset = 0;
+};
+
+struct UploadStats
+{
+    size_t capacity = 0;
+    size_t bytesInUse = 0;
+    size_t peakBytesInUse = 0;
+    size_t bytesCopiedLastFrame = 0;
+    size_t bytesPending = 0;
+    uint64_t copiesIssued = 0;
+    uint64_t failedAllocations = 0;
+};
+
+// Asynchronous uploads through one persistently mapped staging buffer.
+// Workers allocate a region, write into it and submit it with a
+// destination; the GL thread turns submissions into
+// glCopyNamedBufferSubData calls in Flush(), at most frameBudgetBytes per
+// frame, and recycles regions once the fence after their copy signals.
+//
+// Regions are recycled in allocation order, so every allocation must be
+// either submitted or cancelled.
+class UploadManager
+{
+public:
+    UploadManager() = default;
+    ~UploadManager() = default;
+
+    UploadManager(const UploadManager&) = delete;
+    UploadManager(UploadManager&&) = delete;
+
+    UploadManager& operator=(const UploadManager&) = delete;
+    UploadManager& operator=(UploadManager&&) = delete;
+
+    // GL thread only
+    bool Initialize(size_t capacity = 64u << 20, size_t frameBudgetBytes = 8u << 20);
+    void Flush();
+    void Cleanup();
+
+    // Any thread. Returns an empty allocation when the ring has no room
+    // left, the caller is expected to retry after a later Flush().
+    StagingAllocation Allocate(size_t size, size_t alignment = 16);
+    // Returns a ticket that IsIssued() accepts once the copies went out;
+    // GL commands issued after that see the data. An allocation is
+    // submitted once, with all of its copies.
+    uint64_t Submit(const StagingAllocation& allocation, std::span<const UploadCopy> copies);
+    uint64_t Submit(const StagingAllocation& allocation, GLuint destination, size_t destinationOffset = 0);
+    void Cancel(const StagingAllocation& allocation);
+
+    bool IsIssued(uint64_t ticket) const;
+
+    inline size_t GetCapacity() const { return m_Capacity; }
+    UploadStats GetStats() const;
+
+private:
+    enum class RegionState
+    {
+        Allocated,
+        Submitted,
+        Copied,
+        Cancelled
+    };
+
+    struct Region
+    {
+        size_t offset;
+        size_t size;
+        RegionState state;
+        uint32_t remainingCopies;
+        uint64_t batch;
+    };
+
+    struct Copy
+    {
+        uint64_t region;
+        GLuint destination;
+        size_t destinationOffset;
+        size_t sourceOffset;
+        size_t size;
+    };
+
+    struct FenceBatch
+    {
+        uint64_t serial;
+        GLsync fence;
+    };
+
+    Region* FindRegion(uint64_t id);
+    void RetireRegions();
+
+    GLuint m_Buffer = 0;
+    char* m_Mapped = nullptr;
+    size_t m_Capacity = 0;
+    size_t m_FrameBudget = 0;
+
+    mutable std::mutex m_Mutex;
+    // Live regions in ring order, the front one is the oldest
+    std::deque<Region> m_Regions;
+    uint64_t m_FrontRegionId = 0;
+    std::deque<Copy> m_PendingCopies;
+    uint64_t m_SubmitCount = 0;
+    std::atomic<uint64_t> m_IssuedCount{ 0 };
+
+    std::deque<FenceBatch> m_Fences;
+    uint64_t m_NextBatch = 1;
+    uint64_t m_CompletedBatch = 0;
+
+    UploadStats m_Stats;
+};
+
+END_VISUALIZER_NAMESPACE
+
+#endif // !UPLOAD_MANAGER_HPP
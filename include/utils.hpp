@@ -1,10 +1,14 @@
 #ifndef UTILS_HPP
 #define UTILS_HPP
 
+#include <string>
+
 #include "Visualizer.hpp"
 
 BEGIN_VISUALIZER_NAMESPACE
 
+// A copy of the whole file, for text that has to outlive it. Loaders
+// parse a MappedFile in place instead.
 bool LoadFile(const std::string& fileName, std::string& result);
 void DisplayLastWinAPIError();
 
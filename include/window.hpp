@@ -6,10 +6,12 @@
 #include <memory>
 
 #include "Visualizer.hpp"
+#include "options.hpp"
 
 BEGIN_VISUALIZER_NAMESPACE
 
 class Camera;
+class GlCaptureFile;
 class Renderer;
 
 class Window
@@ -31,7 +33,11 @@ public:
 
     bool InitWindow(const std::string_view&, uint16_t width, uint16_t height);
     
-    void Run();
+    // Returns false when a check requested by the options failed
+    bool Run(const LaunchOptions& options = {});
+    // Sets the scene of the capture up as it was recorded, then replays its
+    // frames without showing the window
+    bool Replay(const GlCaptureFile& capture, const LaunchOptions& options, uint32_t iterations);
 
     void DestroyWindow();
 
@@ -39,6 +45,15 @@ public:
 
     void SetCameraMovement(long horizontalMovement, long verticalMovement);
 
+    void PrintResourceReport() const;
+    void ToggleOcclusionCulling();
+    void CyclePrepassMode();
+    void ToggleOverdrawView();
+    // Adds an instance of the first CPU-culled set in front of the camera
+    void PlantInstance();
+    // Prints what is under the cursor, in client coordinates
+    void PickAt(uint32_t x, uint32_t y);
+
     inline void SetMouseButtonDown(bool mouseButtonDown) { m_MouseButtonDown = mouseButtonDown; }
     inline bool GetMouseButtonDown() const { return m_MouseButtonDown; }
 
@@ -57,12 +72,15 @@ public:
 private:
     Window();
 
+    void CreateRenderer(const LaunchOptions& options);
+
     void MoveCameraForward(float dt);
     void MoveCameraBackward(float dt);
     void MoveCameraLeft(float dt);
     void MoveCameraRight(float dt);
 
     void HandleCameraMovement(float dt);
+    void ClampCameraToGround();
 
     uint16_t m_Width, m_Height;
     bool m_WindowShouldRun = true;
@@ -97,6 +115,14 @@ private:
 
     bool m_DirectStateAccessAvailable = false;
     bool m_BufferStorageAvailable = false;
+
+    // Minimum eye height above the terrain
+    static constexpr float s_CameraGroundOffset = 1.f;
+    // How far ahead of the camera PlantInstance() puts it
+    static constexpr float s_PlantDistance = 10.f;
+    // Of the sphere the camera collides as, and how far PickAt() reaches
+    static constexpr float s_CameraRadius = 0.5f;
+    static constexpr float s_PickDistance = 1000.f;
 };
 
 END_VISUALIZER_NAMESPACE
@@ -0,0 +1,272 @@
+#ifndef WORLD_STREAMING_HPP
+#define WORLD_STREAMING_HPP
+
+#include <GL/glew.h>
+
+#pragma warning(push, 0)
+#include <glm/glm.hpp>
+#pragma warning(pop, 0)
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "Visualizer.hpp"
+#include "async_io.hpp"
+#include "instances.hpp"
+#include "mesh.hpp"
+#include "renderer.hpp"
+#include "upload_manager.hpp"
+
+BEGIN_VISUALIZER_NAMESPACE
+
+class ThreadPool;
+
+struct CellCoord
+{
+    int32_t x = 0;
+    int32_t z = 0;
+
+    inline bool operator==(const CellCoord& other) const { return x == other.x && z == other.z; }
+};
+
+struct CellCoordHash
+{
+    inline size_t operator()(const CellCoord& c) const
+    {
+        return std::hash<uint64_t>()((static_cast<uint64_t>(static_cast<uint32_t>(c.x)) << 32) | static_cast<uint32_t>(c.z));
+    }
+};
+
+struct WorldCellDesc
+{
+    // World space OBJ meshes
+    std::vector<std::string> meshes;
+    // Binary or text instance files, each drawn with one prototype mesh
+    struct InstanceSet
+    {
+        uint32_t prototype;
+        std::string path;
+    };
+    std::vector<InstanceSet> instanceSets;
+};
+
+// Assignment of meshes and instance sets to square XZ cells, read from a
+// manifest of the form:
+//
+//   cellsize 256
+//   prototype palm.obj
+//   mesh <x> <z> desert_0_0.obj
+//   instances <x> <z> <prototype index> palms_0_0.vins
+//
+// Relative paths are resolved against the manifest directory.
+class WorldPartition
+{
+public:
+    bool Load(const std::string& manifestPath);
+    bool Save(const std::string& manifestPath) const;
+
+    uint32_t AddPrototype(const std::string& meshPath);
+    void AddMesh(const CellCoord& cell, const std::string& meshPath);
+
+    // Buckets the instances by cell and writes one binary file per cell
+    // into directory, adding each to the partition
+    bool PartitionInstances(const std::vector<InstanceTransform>& instances, uint32_t prototype, const std::string& directory);
+
+    CellCoord CellAt(const glm::vec3& position) const;
+    glm::vec3 CellCenter(const CellCoord& cell) const;
+    const WorldCellDesc* FindCell(const CellCoord& cell) const;
+
+    inline float GetCellSize() const { return m_CellSize; }
+    inline void SetCellSize(float cellSize) { m_CellSize = cellSize; }
+    inline const std::vector<std::string>& GetPrototypes() const { return m_Prototypes; }
+
+private:
+    float m_CellSize = 256.f;
+    std::vector<std::string> m_Prototypes;
+    std::unordered_map<CellCoord, WorldCellDesc, CellCoordHash> m_Cells;
+};
+
+struct StreamingSettings
+{
+    // Cells whose center comes within loadDistance are loaded, and only
+    // dropped once further than unloadDistance, so hovering on a border
+    // does not thrash
+    float loadDistance = 512.f;
+    float unloadDistance = 768.f;
+    // Also load around where the camera will be this many seconds ahead
+    float prefetchSeconds = 2.f;
+    uint32_t maxLoadsInFlight = 8;
+};
+
+struct StreamingStats
+{
+    uint32_t residentCells = 0;
+    uint32_t loadingCells = 0;
+    size_t residentBytes = 0;
+    size_t peakResidentBytes = 0;
+    uint64_t cellsLoaded = 0;
+    uint64_t cellsUnloaded = 0;
+    uint64_t loadsCancelled = 0;
+    // Request to resident, in milliseconds
+    float lastLoadLatency = 0.f;
+    float averageLoadLatency = 0.f;
+    float maxLoadLatency = 0.f;
+};
+
+// Keeps the cells around the camera resident. A cell's files are read
+// together through the AsyncFileReader, then decoded on the thread pool
+// straight into the staging ring; Update() only creates the GL objects and
+// queues their copies, on the calling thread.
+class StreamingManager
+{
+public:
+    StreamingManager(WorldPartition partition, ThreadPool& pool, UploadManager& uploads, const StreamingSettings& settings = {});
+    ~StreamingManager();
+
+    StreamingManager(const StreamingManager&) = delete;
+    StreamingManager(StreamingManager&&) = delete;
+
+    StreamingManager& operator=(const StreamingManager&) = delete;
+    StreamingManager& operator=(StreamingManager&&) = delete;
+
+    // Must be called on the GL thread
+    void LoadPrototypes(Renderer& renderer);
+    void Update(Renderer& renderer, const glm::vec3& cameraPosition, const glm::vec3& cameraVelocity);
+    void Cleanup();
+
+    template<typename Fn>
+    void ForEachResidentObject(Fn&& fn) const
+    {
+        for (const auto& [coord, cell] : m_Cells)
+        {
+            if (cell.state == CellState::Resident)
+            {
+                for (const Object& obj : cell.objects)
+                {
+                    fn(obj);
+                }
+            }
+        }
+    }
+
+    inline const StreamingStats& GetStats() const { return m_Stats; }
+    void PrintStats() const;
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    enum class CellState
+    {
+        Loading,
+        // Objects created, waiting for their copies to be issued
+        Uploading,
+        Resident
+    };
+
+    // Filled on a worker, consumed on the GL thread. Offsets are relative
+    // to the staging allocation.
+    struct CellPayload
+    {
+        struct Mesh
+        {
+            size_t vertexOffset;
+            uint32_t vertexCount;
+            size_t indexOffset;
+            uint32_t indexCount;
+            glm::vec3 min;
+            glm::vec3 max;
+        };
+        struct Instances
+        {
+            uint32_t prototype;
+            size_t offset;
+            uint32_t count;
+            // Enough to bound the set once the prototype is known
+            glm::vec3 positionMin;
+            glm::vec3 positionMax;
+            float minScale;
+            float maxScale;
+        };
+
+        CellCoord coord;
+        WorldCellDesc desc;
+        // Contents of the desc's meshes then instance sets, freed once
+        // decoded
+        std::vector<ReadResult> files;
+        std::vector<IoTicket> reads;
+        std::atomic<uint32_t> readsLeft{ 0 };
+        std::vector<Mesh> meshes;
+        std::vector<Instances> instanceSets;
+        // The whole cell is staged in a single allocation, so a job never
+        // waits for ring space while holding some
+        StagingAllocation staging;
+        size_t byteSize = 0;
+        std::atomic<bool> cancelled{ false };
+    };
+
+    struct Cell
+    {
+        CellState state = CellState::Loading;
+        Clock::time_point requestTime;
+        std::shared_ptr<CellPayload> payload;
+        std::vector<Object> objects;
+        // Objects flagged here share their geometry with a prototype
+        std::vector<bool> sharesGeometry;
+        size_t byteSize = 0;
+        uint64_t uploadTicket = 0;
+    };
+
+    struct LoadRequest
+    {
+        CellCoord coord;
+        float priority;
+        IoPriority ioPriority;
+    };
+
+    void RequestLoads(const glm::vec3& cameraPosition, const glm::vec3& predictedPosition, std::pmr::memory_resource* frame);
+    void UnloadDistantCells(const glm::vec3& cameraPosition, const glm::vec3& predictedPosition);
+    static void LoadCell(CellPayload& payload, UploadManager& uploads, ThreadPool& pool);
+    void CancelReads(const CellPayload& payload);
+    void UploadCompleted(Renderer& renderer);
+    void PromoteUploaded();
+    void DestroyCell(Cell& cell);
+    float DistanceToCell(const glm::vec3& position, const CellCoord& cell) const;
+    inline bool IsPrototypeLoaded(uint32_t prototype) const { return prototype < m_Prototypes.size() && m_Prototypes[prototype].m_VAO != 0; }
+
+    WorldPartition m_Partition;
+    ThreadPool& m_Pool;
+    UploadManager& m_Uploads;
+    StreamingSettings m_Settings;
+
+    std::vector<Object> m_Prototypes;
+    std::unordered_map<CellCoord, Cell, CellCoordHash> m_Cells;
+    uint32_t m_LoadsInFlight = 0;
+
+    // Shared with the load jobs so that jobs outliving the manager have
+    // somewhere harmless to drop their results
+    struct Mailbox
+    {
+        std::mutex mutex;
+        std::vector<std::shared_ptr<CellPayload>> completed;
+    };
+    std::shared_ptr<Mailbox> m_Mailbox = std::make_shared<Mailbox>();
+    std::vector<std::shared_ptr<CellPayload>> m_Completed;
+
+    StreamingStats m_Stats;
+    double m_TotalLoadLatency = 0.0;
+
+    // Last, so that it is destroyed first and waits for the read callbacks
+    // still holding on to the mailbox and the pool
+    AsyncFileReader m_Reader;
+};
+
+END_VISUALIZER_NAMESPACE
+
+#endif // !WORLD_STREAMING_HPP
@@ -0,0 +1,228 @@
+#include <charconv>
+#include <cmath>
+#include <cstdlib>
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "instances.hpp"
+#include "mesh.hpp"
+#include "scene_generator.hpp"
+#include "scene_manifest.hpp"
+#include "terrain.hpp"
+
+namespace
+{
+    struct GeneratorSettings
+    {
+        std::string outputDirectory = "scene";
+        bool binary = true;
+        uint64_t seed = 0;
+        uint32_t prototypes = 1;
+        visualizer::NoiseTerrainSettings terrain;
+        visualizer::TreeSettings tree;
+        visualizer::InstanceSettings instances;
+    };
+
+    template<typename T>
+    bool ParseValue(int32_t& i, int32_t argc, char** argv, T& value)
+    {
+        if (i + 1 >= argc)
+        {
+            std::cerr << "Missing value after " << argv[i] << '\n';
+            return false;
+        }
+
+        const std::string_view text(argv[++i]);
+        const auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), value);
+
+        if (error != std::errc() || end != text.data() + text.size())
+        {
+            std::cerr << "Invalid value for " << argv[i - 1] << ": " << text << '\n';
+            return false;
+        }
+        return true;
+    }
+
+    bool ParseSettings(int32_t argc, char** argv, GeneratorSettings& settings)
+    {
+        for (int32_t i = 1; i < argc; ++i)
+        {
+            const std::string_view arg(argv[i]);
+            bool parsed = true;
+
+            if (arg == "--out" && i + 1 < argc)
+            {
+                settings.outputDirectory = argv[++i];
+            }
+            else if (arg == "--format" && i + 1 < argc)
+            {
+                const std::string_view format(argv[++i]);
+                settings.binary = format == "binary";
+                parsed = settings.binary || format == "text";
+            }
+            else if (arg == "--seed")
+            {
+                parsed = ParseValue(i, argc, argv, settings.seed);
+            }
+            else if (arg == "--terrain-triangles")
+            {
+                parsed = ParseValue(i, argc, argv, settings.terrain.triangleCount);
+            }
+            else if (arg == "--terrain-size")
+            {
+                parsed = ParseValue(i, argc, argv, settings.terrain.size) && settings.terrain.size > 0.f;
+            }
+            else if (arg == "--tree-triangles")
+            {
+                parsed = ParseValue(i, argc, argv, settings.tree.triangleCount);
+            }
+            else if (arg == "--prototypes")
+            {
+                parsed = ParseValue(i, argc, argv, settings.prototypes) && settings.prototypes > 0;
+            }
+            else if (arg == "--instances")
+            {
+                parsed = ParseValue(i, argc, argv, settings.instances.count);
+            }
+            else if (arg == "--distribution" && i + 1 < argc)
+            {
+                parsed = visualizer::ParseInstanceDistribution(argv[++i], settings.instances.distribution);
+            }
+            else if (arg == "--clusters")
+            {
+                parsed = ParseValue(i, argc, argv, settings.instances.clusterCount) && settings.instances.clusterCount > 0;
+            }
+            else if (arg == "--cluster-radius")
+            {
+                parsed = ParseValue(i, argc, argv, settings.instances.clusterRadius);
+            }
+            else
+            {
+                std::cerr << "Usage: " << argv[0] << " [--out directory] [--format binary|text] [--seed n]\n"
+                          << "    [--terrain-triangles n] [--terrain-size units] [--tree-triangles n] [--prototypes n]\n"
+                          << "    [--instances n] [--distribution uniform|clustered|grid] [--clusters n] [--cluster-radius units]\n";
+                return false;
+            }
+
+            if (!parsed)
+            {
+                std::cerr << "Invalid value for " << arg << '\n';
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool SaveMesh(const std::string& path, const visualizer::GeneratedMesh& mesh, bool binary)
+    {
+        return binary ? visualizer::SaveMeshBinary(path, mesh.vertices, mesh.indices) : visualizer::SaveMeshObj(path, mesh.vertices, mesh.indices);
+    }
+}
+
+int32_t main(int32_t argc, char** argv)
+{
+    GeneratorSettings settings;
+
+    if (!ParseSettings(argc, argv, settings))
+    {
+        return EXIT_FAILURE;
+    }
+
+    const std::filesystem::path directory(settings.outputDirectory);
+    std::error_code error;
+    std::filesystem::create_directories(directory, error);
+
+    if (error)
+    {
+        std::cerr << "Cannot create directory : " << directory.string() << '\n';
+        return EXIT_FAILURE;
+    }
+
+    const char* meshExtension = settings.binary ? ".vmesh" : ".obj";
+    const char* instanceExtension = settings.binary ? ".vins" : ".txt";
+
+    visualizer::SceneManifest scene;
+
+    // Every file gets its own seed, derived from the one given
+    settings.terrain.seed = settings.seed;
+
+    const visualizer::GeneratedMesh terrain = visualizer::GenerateNoiseTerrain(settings.terrain);
+    const std::string terrainName = std::string("terrain") + meshExtension;
+
+    if (!SaveMesh((directory / terrainName).string(), terrain, settings.binary))
+    {
+        return EXIT_FAILURE;
+    }
+    scene.SetTerrain(terrainName);
+
+    std::cout << terrainName << ": " << terrain.GetTriangleCount() << " triangles\n";
+
+    // Instances are put on the terrain here so the files stand on their own
+    visualizer::Terrain heightField;
+    heightField.Build(terrain.vertices, terrain.indices);
+
+    settings.instances.min = glm::vec2(-0.5f * settings.terrain.size);
+    settings.instances.max = glm::vec2(0.5f * settings.terrain.size);
+
+    const uint64_t totalInstances = settings.instances.count;
+
+    for (uint32_t prototype = 0; prototype < settings.prototypes; ++prototype)
+    {
+        settings.tree.seed = settings.seed + 1 + prototype;
+
+        const visualizer::GeneratedMesh tree = visualizer::GenerateTree(settings.tree);
+        const std::string treeName = "tree_" + std::to_string(prototype) + meshExtension;
+
+        if (!SaveMesh((directory / treeName).string(), tree, settings.binary))
+        {
+            return EXIT_FAILURE;
+        }
+        scene.AddPrototype(treeName);
+
+        // The count is split evenly, the first prototypes taking the remainder
+        settings.instances.seed = settings.seed + 1 + settings.prototypes + prototype;
+        settings.instances.count = totalInstances / settings.prototypes + (prototype < totalInstances % settings.prototypes ? 1 : 0);
+
+        std::vector<visualizer::InstanceTransform> instances = visualizer::GenerateInstances(settings.instances);
+
+        std::vector<glm::vec2> xz(instances.size());
+        std::vector<float> heights(instances.size());
+
+        for (size_t i = 0; i < instances.size(); ++i)
+        {
+            xz[i] = glm::vec2(instances[i].position.x, instances[i].position.z);
+        }
+
+        heightField.HeightAt(xz, heights);
+
+        for (size_t i = 0; i < instances.size(); ++i)
+        {
+            instances[i].position.y = std::isnan(heights[i]) ? settings.terrain.baseHeight : heights[i];
+        }
+
+        const std::string instanceName = "instances_" + std::to_string(prototype) + instanceExtension;
+        const std::string instancePath = (directory / instanceName).string();
+
+        if (!(settings.binary ? visualizer::SaveInstancesBinary(instancePath, instances) : visualizer::SaveInstancesText(instancePath, instances)))
+        {
+            return EXIT_FAILURE;
+        }
+        scene.AddInstances(prototype, instanceName);
+
+        std::cout << treeName << ": " << tree.GetTriangleCount() << " triangles, " << instanceName << ": " << instances.size() << ' '
+                  << visualizer::GetInstanceDistributionName(settings.instances.distribution) << " instances\n";
+    }
+
+    const std::string manifestPath = (directory / "scene.txt").string();
+
+    if (!scene.Save(manifestPath))
+    {
+        return EXIT_FAILURE;
+    }
+
+    std::cout << "Run with --scene " << manifestPath << '\n';
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,478 @@
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdlib>
+#include <new>
+
+#include "alloc_tracking.hpp"
+
+#if VISUALIZER_TRACK_ALLOCATIONS
+#if defined(_WIN32)
+#include <Windows.h>
+#else
+#include <execinfo.h>
+#endif
+#endif
+
+BEGIN_VISUALIZER_NAMESPACE
+
+#if VISUALIZER_TRACK_ALLOCATIONS
+
+namespace
+{
+    constexpr uint32_t s_MaxStackFrames = 16;
+    constexpr uint32_t s_MaxStacks = 64;
+
+    struct ThreadSlot
+    {
+        std::atomic<uint64_t> allocations{ 0 };
+        std::atomic<uint64_t> frees{ 0 };
+        std::atomic<uint64_t> bytes{ 0 };
+    };
+
+    struct StackRecord
+    {
+        uint64_t hash;
+        uint32_t depth;
+        void* frames[s_MaxStackFrames];
+        uint64_t count;
+        uint64_t bytes;
+    };
+
+    // Plain statics only, the hooks run before and after every constructor
+    ThreadSlot g_Slots[AllocationTracker::s_MaxThreads];
+    std::atomic<uint32_t> g_SlotCount{ 0 };
+
+    StackRecord g_Stacks[s_MaxStacks];
+    uint32_t g_StackCount = 0;
+    uint64_t g_DroppedStacks = 0;
+    std::atomic_flag g_StackLock = ATOMIC_FLAG_INIT;
+
+    thread_local int32_t t_Slot = -1;
+    thread_local bool t_Watched = false;
+    // Stack capture may allocate on first use
+    thread_local bool t_InHook = false;
+
+    ThreadSlot& GetSlot()
+    {
+        if (t_Slot < 0)
+        {
+            // Threads past the table share its last slot
+            t_Slot = static_cast<int32_t>(std::min(g_SlotCount.fetch_add(1, std::memory_order_relaxed), AllocationTracker::s_MaxThreads - 1));
+        }
+        return g_Slots[t_Slot];
+    }
+
+    void RecordStack(size_t size)
+    {
+        void* frames[s_MaxStackFrames];
+        uint64_t hash = 1469598103934665603ull;
+
+#if defined(_WIN32)
+        const uint32_t depth = CaptureStackBackTrace(2, s_MaxStackFrames, frames, nullptr);
+#else
+        const uint32_t depth = static_cast<uint32_t>(backtrace(frames, s_MaxStackFrames));
+#endif
+
+        for (uint32_t i = 0; i < depth; ++i)
+        {
+            hash = (hash ^ reinterpret_cast<uintptr_t>(frames[i])) * 1099511628211ull;
+        }
+
+        while (g_StackLock.test_and_set(std::memory_order_acquire))
+        {
+        }
+
+        StackRecord* record = nullptr;
+        for (uint32_t i = 0; i < g_StackCount && !record; ++i)
+        {
+            record = g_Stacks[i].hash == hash ? &g_Stacks[i] : nullptr;
+        }
+
+        if (!record && g_StackCount < s_MaxStacks)
+        {
+            record = &g_Stacks[g_StackCount++];
+            record->hash = hash;
+            record->depth = depth;
+            std::copy(frames, frames + depth, record->frames);
+            record->count = 0;
+            record->bytes = 0;
+        }
+
+        if (record)
+        {
+            ++record->count;
+            record->bytes += size;
+        }
+        else
+        {
+            ++g_DroppedStacks;
+        }
+
+        g_StackLock.clear(std::memory_order_release);
+    }
+
+    void OnAllocate(size_t size)
+    {
+        if (t_InHook)
+        {
+            return;
+        }
+        t_InHook = true;
+
+        ThreadSlot& slot = GetSlot();
+        slot.allocations.fetch_add(1, std::memory_order_relaxed);
+        slot.bytes.fetch_add(size, std::memory_order_relaxed);
+
+        if (t_Watched)
+        {
+            RecordStack(size);
+        }
+
+        t_InHook = false;
+    }
+
+    void OnFree(void* p)
+    {
+        if (p && !t_InHook)
+        {
+            GetSlot().frees.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    AllocationCounters ReadSlot(const ThreadSlot& slot)
+    {
+        return { slot.allocations.load(std::memory_order_relaxed), slot.frees.load(std::memory_order_relaxed), slot.bytes.load(std::memory_order_relaxed) };
+    }
+}
+
+AllocationCounters AllocationTracker::GetThreadCounters()
+{
+    return ReadSlot(GetSlot());
+}
+
+uint32_t AllocationTracker::GetThreadSlot()
+{
+    GetSlot();
+    return static_cast<uint32_t>(t_Slot);
+}
+
+size_t AllocationTracker::GetAllThreadCounters(std::span<ThreadAllocationCounters> out)
+{
+    const size_t count = std::min<size_t>({ g_SlotCount.load(std::memory_order_relaxed), s_MaxThreads, out.size() });
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        out[i].slot = static_cast<uint32_t>(i);
+        out[i].counters = ReadSlot(g_Slots[i]);
+    }
+    return count;
+}
+
+void AllocationTracker::WatchCurrentThread(bool watch)
+{
+    if (watch)
+    {
+        // Let backtrace() load its unwinder now rather than in a hook
+        void* frames[1];
+#if defined(_WIN32)
+        CaptureStackBackTrace(0, 1, frames, nullptr);
+#else
+        t_InHook = true;
+        backtrace(frames, 1);
+        t_InHook = false;
+#endif
+    }
+    t_Watched = watch;
+}
+
+void AllocationTracker::PrintOffenders(std::ostream& os, size_t maxStacks)
+{
+    while (g_StackLock.test_and_set(std::memory_order_acquire))
+    {
+    }
+
+    StackRecord* sorted[s_MaxStacks];
+    const uint32_t count = g_StackCount;
+    const uint64_t dropped = g_DroppedStacks;
+
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        sorted[i] = &g_Stacks[i];
+    }
+
+    g_StackLock.clear(std::memory_order_release);
+
+    // Stacks are only appended, the records read below stay put
+    std::sort(sorted, sorted + count, [](const StackRecord* a, const StackRecord* b) { return a->count > b->count; });
+
+    for (size_t i = 0; i < std::min<size_t>(count, maxStacks); ++i)
+    {
+        const StackRecord& record = *sorted[i];
+        os << "  " << record.count << " allocations, " << record.bytes << " bytes from:\n";
+
+#if defined(_WIN32)
+        // Module relative, for lookup in the PDB
+        const uintptr_t base = reinterpret_cast<uintptr_t>(GetModuleHandle(nullptr));
+        for (uint32_t f = 0; f < record.depth; ++f)
+        {
+            const uintptr_t address = reinterpret_cast<uintptr_t>(record.frames[f]);
+            os << "    0x" << std::hex << address << " (exe+0x" << address - base << ')' << std::dec << '\n';
+        }
+#else
+        char** symbols = backtrace_symbols(record.frames, static_cast<int>(record.depth));
+        for (uint32_t f = 0; f < record.depth; ++f)
+        {
+            os << "    " << (symbols ? symbols[f] : "?") << '\n';
+        }
+        std::free(symbols);
+#endif
+    }
+
+    if (dropped > 0)
+    {
+        os << "  " << dropped << " allocations from further stacks not recorded\n";
+    }
+}
+
+#else
+
+AllocationCounters AllocationTracker::GetThreadCounters()
+{
+    return {};
+}
+
+uint32_t AllocationTracker::GetThreadSlot()
+{
+    return 0;
+}
+
+size_t AllocationTracker::GetAllThreadCounters(std::span<ThreadAllocationCounters>)
+{
+    return 0;
+}
+
+void AllocationTracker::WatchCurrentThread(bool)
+{}
+
+void AllocationTracker::PrintOffenders(std::ostream&, size_t)
+{}
+
+#endif
+
+FrameAllocationCheck::FrameAllocationCheck(uint32_t warmupFrames)
+    : m_WarmupFrames(warmupFrames)
+{}
+
+void FrameAllocationCheck::BeginFrame()
+{
+    if (m_Frame == m_WarmupFrames)
+    {
+        m_ThreadCountAtStart = AllocationTracker::GetAllThreadCounters(m_ThreadsAtStart);
+        AllocationTracker::WatchCurrentThread(true);
+    }
+
+    m_FrameStart = AllocationTracker::GetThreadCounters();
+}
+
+void FrameAllocationCheck::EndFrame()
+{
+    if (m_Frame++ < m_WarmupFrames)
+    {
+        return;
+    }
+
+    const AllocationCounters now = AllocationTracker::GetThreadCounters();
+    const AllocationCounters frame{ now.allocations - m_FrameStart.allocations, now.frees - m_FrameStart.frees, now.bytes - m_FrameStart.bytes };
+
+    ++m_CheckedFrames;
+    m_Total.allocations += frame.allocations;
+    m_Total.frees += frame.frees;
+    m_Total.bytes += frame.bytes;
+
+    if (frame.allocations > 0)
+    {
+        if (m_OffendingFrames++ == 0)
+        {
+            m_FirstOffendingFrame = m_Frame - 1;
+        }
+        if (frame.allocations > m_Worst.allocations)
+        {
+            m_Worst = frame;
+        }
+    }
+}
+
+void FrameAllocationCheck::PrintReport(std::ostream& os) const
+{
+    if (!AllocationTracker::s_Enabled)
+    {
+        os << "Allocation check: tracking not compiled in, build the Profile configuration\n";
+        return;
+    }
+
+    // Snapshot before printing, which allocates
+    ThreadAllocationCounters threads[AllocationTracker::s_MaxThreads];
+    const size_t threadCount = AllocationTracker::GetAllThreadCounters(threads);
+    const uint32_t self = AllocationTracker::GetThreadSlot();
+
+    AllocationTracker::WatchCurrentThread(false);
+
+    os << "Allocation check: " << m_CheckedFrames << " frames after " << m_WarmupFrames << " warm-up frames, " << m_OffendingFrames << " allocated\n";
+
+    if (m_OffendingFrames > 0)
+    {
+        os << "  first at frame " << m_FirstOffendingFrame << ", worst " << m_Worst.allocations << " allocations (" << m_Worst.bytes << " bytes), total "
+           << m_Total.allocations << " allocations (" << m_Total.bytes << " bytes)\n";
+    }
+
+    for (size_t i = 0; i < threadCount; ++i)
+    {
+        const AllocationCounters start = i < m_ThreadCountAtStart ? m_ThreadsAtStart[i].counters : AllocationCounters{};
+        const uint64_t allocations = threads[i].counters.allocations - start.allocations;
+
+        if (allocations > 0)
+        {
+            os << "  thread " << i << (i == self ? " (checked)" : "") << ": " << allocations << " allocations, "
+               << threads[i].counters.bytes - start.bytes << " bytes since warm-up\n";
+        }
+    }
+
+    if (m_OffendingFrames > 0)
+    {
+        AllocationTracker::PrintOffenders(os);
+    }
+}
+
+END_VISUALIZER_NAMESPACE
+
+#if VISUALIZER_TRACK_ALLOCATIONS
+
+#if defined(__GLIBC__)
+
+// glibc lets the executable interpose malloc; libstdc++'s operator new
+// lands here too
+extern "C"
+{
+    void* __libc_malloc(size_t size);
+    void* __libc_calloc(size_t count, size_t size);
+    void* __libc_realloc(void* p, size_t size);
+    void* __libc_memalign(size_t alignment, size_t size);
+    void __libc_free(void* p);
+
+    void* malloc(size_t size)
+    {
+        visualizer::OnAllocate(size);
+        return __libc_malloc(size);
+    }
+
+    void* calloc(size_t count, size_t size)
+    {
+        visualizer::OnAllocate(count * size);
+        return __libc_calloc(count, size);
+    }
+
+    void* realloc(void* p, size_t size)
+    {
+        visualizer::OnAllocate(size);
+        return __libc_realloc(p, size);
+    }
+
+    void* memalign(size_t alignment, size_t size)
+    {
+        visualizer::OnAllocate(size);
+        return __libc_memalign(alignment, size);
+    }
+
+    void* aligned_alloc(size_t alignment, size_t size)
+    {
+        visualizer::OnAllocate(size);
+        return __libc_memalign(alignment, size);
+    }
+
+    int posix_memalign(void** p, size_t alignment, size_t size)
+    {
+        visualizer::OnAllocate(size);
+        *p = __libc_memalign(alignment, size);
+        return *p ? 0 : ENOMEM;
+    }
+
+    void free(void* p)
+    {
+        visualizer::OnFree(p);
+        __libc_free(p);
+    }
+}
+
+#else
+
+namespace
+{
+    void* TrackedNew(size_t size)
+    {
+        visualizer::OnAllocate(size);
+        void* p = std::malloc(size ? size : 1);
+        if (!p)
+        {
+            throw std::bad_alloc();
+        }
+        return p;
+    }
+
+    void* TrackedAlignedNew(size_t size, std::align_val_t alignment)
+    {
+        visualizer::OnAllocate(size);
+#if defined(_MSC_VER)
+        void* p = _aligned_malloc(size ? size : 1, static_cast<size_t>(alignment));
+#else
+        void* p = std::aligned_alloc(static_cast<size_t>(alignment), (size + static_cast<size_t>(alignment) - 1) / static_cast<size_t>(alignment) * static_cast<size_t>(alignment));
+#endif
+        if (!p)
+        {
+            throw std::bad_alloc();
+        }
+        return p;
+    }
+
+    void TrackedDelete(void* p) noexcept
+    {
+        visualizer::OnFree(p);
+        std::free(p);
+    }
+
+    void TrackedAlignedDelete(void* p) noexcept
+    {
+        visualizer::OnFree(p);
+#if defined(_MSC_VER)
+        _aligned_free(p);
+#else
+        std::free(p);
+#endif
+    }
+}
+
+void* operator new(size_t size) { return TrackedNew(size); }
+void* operator new[](size_t size) { return TrackedNew(size); }
+void* operator new(size_t size, const std::nothrow_t&) noexcept { try { return TrackedNew(size); } catch (...) { return nullptr; } }
+void* operator new[](size_t size, const std::nothrow_t&) noexcept { try { return TrackedNew(size); } catch (...) { return nullptr; } }
+void* operator new(size_t size, std::align_val_t alignment) { return TrackedAlignedNew(size, alignment); }
+void* operator new[](size_t size, std::align_val_t alignment) { return TrackedAlignedNew(size, alignment); }
+void* operator new(size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept { try { return TrackedAlignedNew(size, alignment); } catch (...) { return nullptr; } }
+void* operator new[](size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept { try { return TrackedAlignedNew(size, alignment); } catch (...) { return nullptr; } }
+
+void operator delete(void* p) noexcept { TrackedDelete(p); }
+void operator delete[](void* p) noexcept { TrackedDelete(p); }
+void operator delete(void* p, size_t) noexcept { TrackedDelete(p); }
+void operator delete[](void* p, size_t) noexcept { TrackedDelete(p); }
+void operator delete(void* p, const std::nothrow_t&) noexcept { TrackedDelete(p); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept { TrackedDelete(p); }
+void operator delete(void* p, std::align_val_t) noexcept { TrackedAlignedDelete(p); }
+void operator delete[](void* p, std::align_val_t) noexcept { TrackedAlignedDelete(p); }
+void operator delete(void* p, size_t, std::align_val_t) noexcept { TrackedAlignedDelete(p); }
+void operator delete[](void* p, size_t, std::align_val_t) noexcept { TrackedAlignedDelete(p); }
+void operator delete(void* p, std::align_val_t, const std::nothrow_t&) noexcept { TrackedAlignedDelete(p); }
+void operator delete[](void* p, std::align_val_t, const std::nothrow_t&) noexcept { TrackedAlignedDelete(p); }
+
+#endif
+
+#endif
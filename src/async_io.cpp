@@ -0,0 +1,819 @@
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <utility>
+#include <vector>
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef __linux__
+#include <linux/io_uring.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+
+#include "async_io.hpp"
+#include "thread_pool.hpp"
+
+BEGIN_VISUALIZER_NAMESPACE
+
+namespace
+{
+    // Blocking reads check for cancellation this often
+    constexpr size_t s_ReadChunkSize = 1u << 20;
+}
+
+struct AsyncFileReader::Request
+{
+    IoTicket ticket = 0;
+    std::string path;
+    uint64_t offset = 0;
+    // Clamped to the file once it is open
+    size_t size = 0;
+    IoPriority priority = IoPriority::Visible;
+    ReadCallback callback;
+
+    std::atomic<bool> cancelled{ false };
+    // Still in m_Queues, under m_Mutex
+    bool queued = true;
+    ReadResult result;
+
+    // While on the ring
+    int fd = -1;
+    size_t done = 0;
+    bool cancelSubmitted = false;
+};
+
+#ifdef __linux__
+
+namespace
+{
+    // user_data of what is not a read, reads carry their ticket
+    constexpr uint64_t s_WakeTag = 0;
+    constexpr uint64_t s_CancelTag = ~0ull;
+    // Reads longer than this are split, the length being 32 bits
+    constexpr size_t s_MaxRingRead = 1u << 30;
+
+    // Size of the range to read, clamped to the file
+    bool ResolveSize(int fd, uint64_t offset, size_t& size)
+    {
+        struct stat info;
+        if (fstat(fd, &info) != 0)
+        {
+            return false;
+        }
+
+        const uint64_t fileSize = static_cast<uint64_t>(info.st_size);
+        size = offset >= fileSize ? 0 : static_cast<size_t>(std::min<uint64_t>(size, fileSize - offset));
+        return true;
+    }
+}
+
+// The rings mapped from the kernel, driven without liburing. Only the
+// ring thread touches them.
+struct AsyncFileReader::Ring
+{
+    int fd = -1;
+    // Written to wake the ring thread, which keeps a read of it queued
+    int wakeFd = -1;
+    uint64_t wakeValue = 0;
+    bool wakeArmed = false;
+
+    void* sqMemory = nullptr;
+    size_t sqMemorySize = 0;
+    void* cqMemory = nullptr;
+    size_t cqMemorySize = 0;
+    io_uring_sqe* sqes = nullptr;
+    size_t sqesSize = 0;
+
+    unsigned* sqHead = nullptr;
+    unsigned* sqTail = nullptr;
+    unsigned* sqArray = nullptr;
+    unsigned sqMask = 0;
+    unsigned sqEntries = 0;
+    unsigned* cqHead = nullptr;
+    unsigned* cqTail = nullptr;
+    io_uring_cqe* cqes = nullptr;
+    unsigned cqMask = 0;
+    unsigned toSubmit = 0;
+
+    // Reads on the ring, by ticket
+    std::unordered_map<IoTicket, std::shared_ptr<Request>> reads;
+
+    ~Ring()
+    {
+        if (sqes)
+        {
+            munmap(sqes, sqesSize);
+        }
+        if (cqMemory && cqMemory != sqMemory)
+        {
+            munmap(cqMemory, cqMemorySize);
+        }
+        if (sqMemory)
+        {
+            munmap(sqMemory, sqMemorySize);
+        }
+        if (wakeFd >= 0)
+        {
+            close(wakeFd);
+        }
+        if (fd >= 0)
+        {
+            close(fd);
+        }
+    }
+
+    bool Init(unsigned entries)
+    {
+        io_uring_params params;
+        std::memset(&params, 0, sizeof(params));
+
+        fd = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+
+        // IORING_OP_READ came along with this feature, in Linux 5.6
+        if (fd < 0 || !(params.features & IORING_FEAT_RW_CUR_POS))
+        {
+            return false;
+        }
+
+        sqMemorySize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cqMemorySize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+
+        const bool singleMapping = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+        if (singleMapping)
+        {
+            sqMemorySize = cqMemorySize = std::max(sqMemorySize, cqMemorySize);
+        }
+
+        auto map = [this](size_t size, off_t offset) -> void*
+        {
+            void* memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, offset);
+            return memory == MAP_FAILED ? nullptr : memory;
+        };
+
+        sqMemory = map(sqMemorySize, IORING_OFF_SQ_RING);
+        cqMemory = singleMapping ? sqMemory : map(cqMemorySize, IORING_OFF_CQ_RING);
+        sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+        sqes = static_cast<io_uring_sqe*>(map(sqesSize, IORING_OFF_SQES));
+
+        if (!sqMemory || !cqMemory || !sqes)
+        {
+            return false;
+        }
+
+        char* sq = static_cast<char*>(sqMemory);
+        sqHead = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+        sqTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+        sqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+        sqMask = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+        sqEntries = params.sq_entries;
+
+        char* cq = static_cast<char*>(cqMemory);
+        cqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+        cqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+        cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+        cqMask = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+
+        wakeFd = eventfd(0, EFD_CLOEXEC);
+        return wakeFd >= 0;
+    }
+
+    // Queues an operation for the next Enter(), false when the queue is full
+    bool Prepare(uint8_t opcode, int file, uint64_t address, uint32_t length, uint64_t offset, uint64_t userData)
+    {
+        const unsigned tail = *sqTail;
+        if (tail - std::atomic_ref<unsigned>(*sqHead).load(std::memory_order_acquire) >= sqEntries)
+        {
+            return false;
+        }
+
+        io_uring_sqe& sqe = sqes[tail & sqMask];
+        std::memset(&sqe, 0, sizeof(sqe));
+        sqe.opcode = opcode;
+        sqe.fd = file;
+        sqe.addr = address;
+        sqe.len = length;
+        sqe.off = offset;
+        sqe.user_data = userData;
+
+        sqArray[tail & sqMask] = tail & sqMask;
+        std::atomic_ref<unsigned>(*sqTail).store(tail + 1, std::memory_order_release);
+        ++toSubmit;
+        return true;
+    }
+
+    // Submits what was prepared, in a single call, and waits for a
+    // completion
+    int Enter()
+    {
+        const int submitted = static_cast<int>(syscall(__NR_io_uring_enter, fd, toSubmit, 1, IORING_ENTER_GETEVENTS, nullptr, 0));
+        if (submitted > 0)
+        {
+            toSubmit -= static_cast<unsigned>(submitted);
+        }
+        return submitted;
+    }
+};
+
+#else
+
+struct AsyncFileReader::Ring
+{
+};
+
+#endif
+
+AsyncFileReader::AsyncFileReader(ThreadPool& pool, uint32_t queueDepth)
+    : m_Pool(pool)
+    , m_QueueDepth(std::max(1u, queueDepth))
+    , m_PrefetchDepth(std::max(1u, m_QueueDepth * 3 / 4))
+{
+#ifdef __linux__
+    auto ring = std::make_unique<Ring>();
+
+    // Room for a cancel per read, and the wake-up read
+    if (ring->Init(2 * m_QueueDepth + 1))
+    {
+        m_Ring = std::move(ring);
+        m_RingThread = std::thread(&AsyncFileReader::RingLoop, this);
+    }
+    else
+    {
+        std::cerr << "io_uring is unavailable, reading files on the thread pool\n";
+    }
+#endif
+}
+
+AsyncFileReader::~AsyncFileReader()
+{
+    std::vector<std::shared_ptr<Request>> queued;
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        m_Stop = true;
+
+        for (const auto& [ticket, request] : m_Pending)
+        {
+            request->cancelled.store(true, std::memory_order_relaxed);
+            if (!request->queued && m_Ring)
+            {
+                m_Cancels.push_back(ticket);
+            }
+        }
+        for (std::deque<std::shared_ptr<Request>>& queue : m_Queues)
+        {
+            queued.insert(queued.end(), queue.begin(), queue.end());
+            queue.clear();
+        }
+    }
+
+    for (const std::shared_ptr<Request>& request : queued)
+    {
+        Finish(*request);
+    }
+
+    if (m_Ring)
+    {
+        Wake();
+        m_RingThread.join();
+    }
+    else
+    {
+        std::unique_lock<std::mutex> lock(m_Mutex);
+        m_Idle.wait(lock, [this]() { return m_InFlight == 0; });
+    }
+}
+
+IoTicket AsyncFileReader::ReadAsync(const std::string& path, uint64_t offset, size_t size, IoPriority priority, ReadCallback callback)
+{
+    ReadRequest request{ path, offset, size, priority, std::move(callback) };
+    IoTicket ticket;
+    ReadBatch({ &request, 1 }, &ticket);
+    return ticket;
+}
+
+std::future<ReadResult> AsyncFileReader::ReadAsync(const std::string& path, uint64_t offset, size_t size, IoPriority priority)
+{
+    auto promise = std::make_shared<std::promise<ReadResult>>();
+    std::future<ReadResult> future = promise->get_future();
+
+    ReadAsync(path, offset, size, priority, [promise](ReadResult&& result)
+    {
+        promise->set_value(std::move(result));
+    });
+    return future;
+}
+
+void AsyncFileReader::ReadBatch(std::span<ReadRequest> requests, IoTicket* tickets)
+{
+    std::vector<std::shared_ptr<Request>> refused;
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+
+        for (size_t i = 0; i < requests.size(); ++i)
+        {
+            auto request = std::make_shared<Request>();
+            request->ticket = ++m_NextTicket;
+            request->path = std::move(requests[i].path);
+            request->offset = requests[i].offset;
+            request->size = requests[i].size;
+            request->priority = requests[i].priority;
+            request->callback = std::move(requests[i].callback);
+
+            if (tickets)
+            {
+                tickets[i] = request->ticket;
+            }
+
+            if (m_Stop)
+            {
+                request->cancelled.store(true, std::memory_order_relaxed);
+                refused.push_back(std::move(request));
+                continue;
+            }
+
+            m_Pending.emplace(request->ticket, request);
+            m_Queues[static_cast<size_t>(request->priority)].push_back(std::move(request));
+        }
+    }
+
+    for (const std::shared_ptr<Request>& request : refused)
+    {
+        Finish(*request);
+    }
+
+    Wake();
+}
+
+bool AsyncFileReader::Cancel(IoTicket ticket)
+{
+    std::shared_ptr<Request> request;
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+
+        const auto it = m_Pending.find(ticket);
+        if (it == m_Pending.end())
+        {
+            return false;
+        }
+
+        it->second->cancelled.store(true, std::memory_order_relaxed);
+
+        if (it->second->queued)
+        {
+            std::deque<std::shared_ptr<Request>>& queue = m_Queues[static_cast<size_t>(it->second->priority)];
+            queue.erase(std::find(queue.begin(), queue.end(), it->second));
+            request = it->second;
+        }
+        else if (m_Ring)
+        {
+            m_Cancels.push_back(ticket);
+        }
+    }
+
+    // Blocking reads notice the flag between chunks
+    if (request)
+    {
+        Finish(*request);
+    }
+    else if (m_Ring)
+    {
+        Wake();
+    }
+    return true;
+}
+
+AsyncIoStats AsyncFileReader::GetStats() const
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    return m_Stats;
+}
+
+std::shared_ptr<AsyncFileReader::Request> AsyncFileReader::PopNext()
+{
+    if (m_InFlight >= m_QueueDepth)
+    {
+        return nullptr;
+    }
+
+    std::deque<std::shared_ptr<Request>>& visible = m_Queues[static_cast<size_t>(IoPriority::Visible)];
+    std::deque<std::shared_ptr<Request>>& prefetch = m_Queues[static_cast<size_t>(IoPriority::Prefetch)];
+
+    std::deque<std::shared_ptr<Request>>* queue = nullptr;
+    if (!visible.empty())
+    {
+        queue = &visible;
+    }
+    else if (!prefetch.empty() && m_PrefetchInFlight < m_PrefetchDepth)
+    {
+        queue = &prefetch;
+        ++m_PrefetchInFlight;
+    }
+    else
+    {
+        return nullptr;
+    }
+
+    std::shared_ptr<Request> request = std::move(queue->front());
+    queue->pop_front();
+    request->queued = false;
+
+    ++m_InFlight;
+    m_Stats.maxInFlight = std::max(m_Stats.maxInFlight, m_InFlight);
+    return request;
+}
+
+std::shared_ptr<AsyncFileReader::Request> AsyncFileReader::Finish(Request& request)
+{
+    if (request.cancelled.load(std::memory_order_relaxed))
+    {
+        request.result = ReadResult();
+        request.result.status = IoStatus::Cancelled;
+    }
+
+    bool wasInFlight;
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        m_Pending.erase(request.ticket);
+        wasInFlight = !request.queued;
+
+        ++m_Stats.reads;
+        m_Stats.failed += request.result.status == IoStatus::Failed;
+        m_Stats.cancelled += request.result.status == IoStatus::Cancelled;
+        m_Stats.bytesRead += request.result.size;
+    }
+
+    if (request.callback)
+    {
+        std::exchange(request.callback, nullptr)(std::move(request.result));
+    }
+
+    if (!wasInFlight)
+    {
+        return nullptr;
+    }
+
+    // Only released once the callback returned, so that the destructor
+    // waits for it
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    --m_InFlight;
+    m_PrefetchInFlight -= request.priority == IoPriority::Prefetch;
+
+    std::shared_ptr<Request> next = m_Ring || m_Stop ? nullptr : PopNext();
+    if (m_InFlight == 0)
+    {
+        m_Idle.notify_all();
+    }
+    return next;
+}
+
+void AsyncFileReader::Wake()
+{
+#ifdef __linux__
+    if (m_Ring)
+    {
+        const uint64_t one = 1;
+        [[maybe_unused]] const ssize_t written = write(m_Ring->wakeFd, &one, sizeof(one));
+        return;
+    }
+#endif
+    Dispatch();
+}
+
+void AsyncFileReader::Dispatch()
+{
+    // Each task keeps taking queued reads until none may be issued
+    while (true)
+    {
+        std::shared_ptr<Request> request;
+        {
+            std::lock_guard<std::mutex> lock(m_Mutex);
+            request = m_Stop ? nullptr : PopNext();
+        }
+
+        if (!request)
+        {
+            return;
+        }
+
+        m_Pool.Submit([this, request = std::move(request)]() mutable
+        {
+            while (request)
+            {
+                if (!request->cancelled.load(std::memory_order_relaxed))
+                {
+                    ReadBlocking(*request);
+                }
+                request = Finish(*request);
+            }
+        });
+    }
+}
+
+#ifdef _WIN32
+
+void AsyncFileReader::ReadBlocking(Request& request)
+{
+    HANDLE file = CreateFileA(request.path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+
+    if (file == INVALID_HANDLE_VALUE)
+    {
+        std::cerr << "Cannot open file : " << request.path << '\n';
+        return;
+    }
+
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(file, &fileSize))
+    {
+        std::cerr << "Cannot get size of file : " << request.path << '\n';
+        CloseHandle(file);
+        return;
+    }
+
+    const uint64_t available = static_cast<uint64_t>(fileSize.QuadPart);
+    const size_t size = request.offset >= available ? 0 : static_cast<size_t>(std::min<uint64_t>(request.size, available - request.offset));
+    request.result.data = std::make_unique_for_overwrite<std::byte[]>(size);
+
+    size_t done = 0;
+    while (done < size && !request.cancelled.load(std::memory_order_relaxed))
+    {
+        const uint64_t offset = request.offset + done;
+        OVERLAPPED overlapped{};
+        overlapped.Offset = static_cast<DWORD>(offset);
+        overlapped.OffsetHigh = static_cast<DWORD>(offset >> 32);
+
+        DWORD read = 0;
+        if (!ReadFile(file, request.result.data.get() + done, static_cast<DWORD>(std::min(s_ReadChunkSize, size - done)), &read, &overlapped))
+        {
+            std::cerr << "Cannot read file : " << request.path << '\n';
+            CloseHandle(file);
+            return;
+        }
+        if (read == 0)
+        {
+            break;
+        }
+        done += read;
+    }
+
+    CloseHandle(file);
+    request.result.status = IoStatus::Completed;
+    request.result.size = done;
+}
+
+#else
+
+void AsyncFileReader::ReadBlocking(Request& request)
+{
+    const int fd = open(request.path.c_str(), O_RDONLY | O_CLOEXEC);
+
+    if (fd < 0)
+    {
+        std::cerr << "Cannot open file : " << request.path << '\n';
+        return;
+    }
+
+    size_t size = request.size;
+    struct stat info;
+    if (fstat(fd, &info) != 0)
+    {
+        std::cerr << "Cannot get size of file : " << request.path << '\n';
+        close(fd);
+        return;
+    }
+
+    const uint64_t available = static_cast<uint64_t>(info.st_size);
+    size = request.offset >= available ? 0 : static_cast<size_t>(std::min<uint64_t>(size, available - request.offset));
+    request.result.data = std::make_unique_for_overwrite<std::byte[]>(size);
+
+    size_t done = 0;
+    while (done < size && !request.cancelled.load(std::memory_order_relaxed))
+    {
+        const ssize_t read = pread(fd, request.result.data.get() + done, std::min(s_ReadChunkSize, size - done), static_cast<off_t>(request.offset + done));
+
+        if (read < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (read < 0)
+        {
+            std::cerr << "Cannot read file : " << request.path << '\n';
+            close(fd);
+            return;
+        }
+        if (read == 0)
+        {
+            break;
+        }
+        done += static_cast<size_t>(read);
+    }
+
+    close(fd);
+    request.result.status = IoStatus::Completed;
+    request.result.size = done;
+}
+
+#endif
+
+#ifdef __linux__
+
+void AsyncFileReader::RingLoop()
+{
+    Ring& ring = *m_Ring;
+
+    std::vector<std::shared_ptr<Request>> issued;
+    std::vector<std::shared_ptr<Request>> finished;
+    // Waiting for room in the submission queue
+    std::vector<std::shared_ptr<Request>> unsubmitted;
+    std::vector<IoTicket> cancels;
+
+    // The rest of the request, from where the last read stopped
+    auto submitRead = [&ring, &unsubmitted](const std::shared_ptr<Request>& request)
+    {
+        const uint64_t address = reinterpret_cast<uint64_t>(request->result.data.get() + request->done);
+        const uint32_t length = static_cast<uint32_t>(std::min(request->size - request->done, s_MaxRingRead));
+
+        if (!ring.Prepare(IORING_OP_READ, request->fd, address, length, request->offset + request->done, request->ticket))
+        {
+            unsubmitted.push_back(request);
+        }
+    };
+
+    while (true)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_Mutex);
+
+            if (m_Stop && m_InFlight == 0)
+            {
+                break;
+            }
+
+            cancels.insert(cancels.end(), m_Cancels.begin(), m_Cancels.end());
+            m_Cancels.clear();
+
+            while (std::shared_ptr<Request> request = m_Stop ? nullptr : PopNext())
+            {
+                issued.push_back(std::move(request));
+            }
+        }
+
+        std::vector<std::shared_ptr<Request>> waiting;
+        waiting.swap(unsubmitted);
+        for (const std::shared_ptr<Request>& request : waiting)
+        {
+            submitRead(request);
+        }
+
+        // Opened here, a short call next to the read it saves a worker
+        for (std::shared_ptr<Request>& request : issued)
+        {
+            if (request->cancelled.load(std::memory_order_relaxed))
+            {
+                finished.push_back(std::move(request));
+                continue;
+            }
+
+            request->fd = open(request->path.c_str(), O_RDONLY | O_CLOEXEC);
+            if (request->fd < 0 || !ResolveSize(request->fd, request->offset, request->size))
+            {
+                std::cerr << "Cannot open file : " << request->path << '\n';
+                finished.push_back(std::move(request));
+                continue;
+            }
+
+            request->result.data = std::make_unique_for_overwrite<std::byte[]>(request->size);
+            if (request->size == 0)
+            {
+                request->result.status = IoStatus::Completed;
+                finished.push_back(std::move(request));
+                continue;
+            }
+
+            ring.reads.emplace(request->ticket, request);
+            submitRead(request);
+        }
+        issued.clear();
+
+        for (size_t i = 0; i < cancels.size();)
+        {
+            const auto it = ring.reads.find(cancels[i]);
+            if (it == ring.reads.end() || it->second->cancelSubmitted)
+            {
+                cancels[i] = cancels.back();
+                cancels.pop_back();
+            }
+            else if (ring.Prepare(IORING_OP_ASYNC_CANCEL, -1, cancels[i], 0, 0, s_CancelTag))
+            {
+                it->second->cancelSubmitted = true;
+            }
+            else
+            {
+                ++i;
+            }
+        }
+
+        if (!ring.wakeArmed)
+        {
+            ring.wakeArmed = ring.Prepare(IORING_OP_READ, ring.wakeFd, reinterpret_cast<uint64_t>(&ring.wakeValue), sizeof(ring.wakeValue), 0, s_WakeTag);
+        }
+
+        // Opening can fail for every request, leaving nothing to wait for
+        if (finished.empty())
+        {
+            const unsigned toSubmit = ring.toSubmit;
+            const int result = ring.Enter();
+
+            if (result < 0 && errno != EINTR && errno != EBUSY && errno != EAGAIN)
+            {
+                std::cerr << "io_uring_enter failed : " << std::strerror(errno) << '\n';
+            }
+            if (result > 0 && toSubmit > 0)
+            {
+                std::lock_guard<std::mutex> lock(m_Mutex);
+                ++m_Stats.submissions;
+            }
+        }
+
+        unsigned head = *ring.cqHead;
+        const unsigned tail = std::atomic_ref<unsigned>(*ring.cqTail).load(std::memory_order_acquire);
+
+        for (; head != tail; ++head)
+        {
+            const io_uring_cqe& cqe = ring.cqes[head & ring.cqMask];
+
+            if (cqe.user_data == s_WakeTag)
+            {
+                ring.wakeArmed = false;
+                continue;
+            }
+
+            const auto it = cqe.user_data == s_CancelTag ? ring.reads.end() : ring.reads.find(cqe.user_data);
+            if (it == ring.reads.end())
+            {
+                continue;
+            }
+
+            Request& request = *it->second;
+            const bool cancelled = request.cancelled.load(std::memory_order_relaxed);
+
+            if (cqe.res > 0)
+            {
+                request.done += static_cast<size_t>(cqe.res);
+            }
+
+            const bool retry = cqe.res == -EAGAIN || cqe.res == -EINTR;
+            if (!cancelled && (retry || (cqe.res > 0 && request.done < request.size)))
+            {
+                submitRead(it->second);
+                continue;
+            }
+
+            if (cqe.res < 0 && !cancelled)
+            {
+                std::cerr << "Cannot read file : " << request.path << " (" << std::strerror(-cqe.res) << ")\n";
+            }
+            else
+            {
+                // A read of 0 bytes is the end of a file that shrank
+                request.result.status = IoStatus::Completed;
+                request.result.size = request.done;
+            }
+
+            finished.push_back(std::move(it->second));
+            ring.reads.erase(it);
+        }
+
+        std::atomic_ref<unsigned>(*ring.cqHead).store(head, std::memory_order_release);
+
+        for (const std::shared_ptr<Request>& request : finished)
+        {
+            if (request->fd >= 0)
+            {
+                close(request->fd);
+                request->fd = -1;
+            }
+            Finish(*request);
+        }
+        finished.clear();
+    }
+}
+
+#else
+
+void AsyncFileReader::RingLoop()
+{
+}
+
+#endif
+
+END_VISUALIZER_NAMESPACE
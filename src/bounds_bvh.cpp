@@ -0,0 +1,697 @@
+#include <algorithm>
+#include <limits>
+
+#include "bounds_bvh.hpp"
+#include "thread_pool.hpp"
+
+BEGIN_VISUALIZER_NAMESPACE
+
+namespace
+{
+    constexpr uint32_t s_MaxBins = 32;
+
+    struct BuildItem
+    {
+        glm::vec3 centroid;
+        uint32_t item;
+    };
+
+    struct BuildTask
+    {
+        uint32_t node;
+        uint32_t first;
+        uint32_t count;
+        uint32_t depth;
+    };
+
+    struct Bin
+    {
+        glm::vec3 min = glm::vec3(std::numeric_limits<float>::max());
+        glm::vec3 max = glm::vec3(-std::numeric_limits<float>::max());
+        uint32_t count = 0;
+    };
+
+    inline float GetArea(const glm::vec3& min, const glm::vec3& max)
+    {
+        const glm::vec3 extent = glm::max(max - min, glm::vec3(0.f));
+        return 2.f * (extent.x * extent.y + extent.y * extent.z + extent.z * extent.x);
+    }
+
+    inline uint32_t GetBin(float centroid, float origin, float scale, uint32_t binCount)
+    {
+        return std::min(binCount - 1, static_cast<uint32_t>(std::max(0.f, (centroid - origin) * scale)));
+    }
+
+    struct BuildContext
+    {
+        std::span<BuildItem> items;
+        std::span<const glm::vec3> mins;
+        std::span<const glm::vec3> maxs;
+        uint32_t leafSize;
+        uint32_t binCount;
+    };
+
+    // Splits the items of root down to leaves, the new nodes appended to
+    // nodes. With deferred set, tasks of at most deferBelow items are left
+    // there unsplit instead.
+    void BuildNodes(const BuildContext& context, const BuildTask& root, std::vector<BvhNode>& nodes, std::vector<uint32_t>& parents, size_t deferBelow, std::vector<BuildTask>* deferred)
+    {
+        std::vector<BuildTask> tasks;
+        tasks.push_back(root);
+
+        while (!tasks.empty())
+        {
+            const BuildTask task = tasks.back();
+            tasks.pop_back();
+
+            if (deferred && task.count <= deferBelow)
+            {
+                deferred->push_back(task);
+                continue;
+            }
+
+            const auto begin = context.items.begin() + task.first;
+            const auto end = begin + task.count;
+
+            glm::vec3 min(std::numeric_limits<float>::max());
+            glm::vec3 max(-std::numeric_limits<float>::max());
+            glm::vec3 centroidMin = min;
+            glm::vec3 centroidMax = max;
+
+            for (auto it = begin; it != end; ++it)
+            {
+                min = glm::min(min, context.mins[it->item]);
+                max = glm::max(max, context.maxs[it->item]);
+                centroidMin = glm::min(centroidMin, it->centroid);
+                centroidMax = glm::max(centroidMax, it->centroid);
+            }
+
+            nodes[task.node].min = min;
+            nodes[task.node].max = max;
+
+            auto makeLeaf = [&]()
+            {
+                nodes[task.node].first = task.first;
+                nodes[task.node].count = task.count;
+            };
+
+            if (task.count <= context.leafSize)
+            {
+                makeLeaf();
+                continue;
+            }
+
+            // Best split over the bin boundaries of every axis
+            const glm::vec3 centroidExtent = centroidMax - centroidMin;
+            float bestCost = std::numeric_limits<float>::max();
+            int32_t bestAxis = -1;
+            uint32_t bestSplit = 0;
+
+            for (int32_t axis = 0; axis < 3 && task.depth < BoundsBvh::s_MaxSahDepth; ++axis)
+            {
+                if (centroidExtent[axis] <= 0.f)
+                {
+                    continue;
+                }
+
+                std::array<Bin, s_MaxBins> bins;
+                const float scale = context.binCount / centroidExtent[axis];
+
+                for (auto it = begin; it != end; ++it)
+                {
+                    Bin& bin = bins[GetBin(it->centroid[axis], centroidMin[axis], scale, context.binCount)];
+                    bin.min = glm::min(bin.min, context.mins[it->item]);
+                    bin.max = glm::max(bin.max, context.maxs[it->item]);
+                    ++bin.count;
+                }
+
+                // Area and count left of every boundary, then swept from the right
+                std::array<float, s_MaxBins> leftCosts;
+                Bin left;
+                for (uint32_t i = 0; i + 1 < context.binCount; ++i)
+                {
+                    left.min = glm::min(left.min, bins[i].min);
+                    left.max = glm::max(left.max, bins[i].max);
+                    left.count += bins[i].count;
+                    leftCosts[i] = left.count > 0 ? GetArea(left.min, left.max) * left.count : 0.f;
+                }
+
+                Bin right;
+                for (uint32_t i = context.binCount - 1; i > 0; --i)
+                {
+                    right.min = glm::min(right.min, bins[i].min);
+                    right.max = glm::max(right.max, bins[i].max);
+                    right.count += bins[i].count;
+
+                    const float cost = leftCosts[i - 1] + (right.count > 0 ? GetArea(right.min, right.max) * right.count : 0.f);
+                    if (cost < bestCost)
+                    {
+                        bestCost = cost;
+                        bestAxis = axis;
+                        bestSplit = i;
+                    }
+                }
+            }
+
+            // A traversal step costs about as much as testing one item
+            const float area = GetArea(min, max);
+            const float splitCost = area > 0.f ? 1.f + bestCost / area : 1.f;
+            if (bestAxis >= 0 && splitCost >= static_cast<float>(task.count) && task.count <= BoundsBvh::s_MaxLeafSize)
+            {
+                makeLeaf();
+                continue;
+            }
+
+            uint32_t leftCount = 0;
+            if (bestAxis >= 0)
+            {
+                const float scale = context.binCount / centroidExtent[bestAxis];
+                const auto middle = std::partition(begin, end, [&](const BuildItem& item)
+                {
+                    return GetBin(item.centroid[bestAxis], centroidMin[bestAxis], scale, context.binCount) < bestSplit;
+                });
+                leftCount = static_cast<uint32_t>(middle - begin);
+            }
+
+            // Centroids all in one place, or too deep: halve along the widest axis
+            if (leftCount == 0 || leftCount == task.count)
+            {
+                const int32_t axis = centroidExtent.x >= centroidExtent.y && centroidExtent.x >= centroidExtent.z ? 0 : (centroidExtent.y >= centroidExtent.z ? 1 : 2);
+                leftCount = task.count / 2;
+                std::nth_element(begin, begin + leftCount, end, [axis](const BuildItem& a, const BuildItem& b) { return a.centroid[axis] < b.centroid[axis]; });
+            }
+
+            const uint32_t child = static_cast<uint32_t>(nodes.size());
+            nodes[task.node].first = child;
+            nodes[task.node].count = 0;
+            nodes.emplace_back();
+            nodes.emplace_back();
+            parents.push_back(task.node);
+            parents.push_back(task.node);
+
+            tasks.push_back({ child + 1, task.first + leftCount, task.count - leftCount, task.depth + 1 });
+            tasks.push_back({ child, task.first, leftCount, task.depth + 1 });
+        }
+    }
+}
+
+void BoundsBvh::Build(std::span<const uint32_t> items, std::span<const glm::vec3> mins, std::span<const glm::vec3> maxs, const BvhBuildSettings& settings)
+{
+    Build(items, mins, maxs, settings, nullptr);
+}
+
+void BoundsBvh::Build(std::span<const uint32_t> items, std::span<const glm::vec3> mins, std::span<const glm::vec3> maxs, const BvhBuildSettings& settings, ThreadPool& pool)
+{
+    Build(items, mins, maxs, settings, &pool);
+}
+
+void BoundsBvh::Build(std::span<const uint32_t> items, std::span<const glm::vec3> mins, std::span<const glm::vec3> maxs, const BvhBuildSettings& settings, ThreadPool* pool)
+{
+    Clear();
+    m_ItemLeaves.assign(mins.size(), s_NoNode);
+
+    if (items.empty())
+    {
+        return;
+    }
+
+    std::vector<BuildItem> buildItems(items.size());
+    for (size_t i = 0; i < items.size(); ++i)
+    {
+        buildItems[i] = { 0.5f * (mins[items[i]] + maxs[items[i]]), items[i] };
+    }
+
+    BuildContext context;
+    context.items = buildItems;
+    context.mins = mins;
+    context.maxs = maxs;
+    context.leafSize = std::clamp(settings.leafSize, 1u, s_MaxLeafSize);
+    context.binCount = std::clamp(settings.binCount, 2u, s_MaxBins);
+
+    m_Nodes.reserve(2 * items.size() / context.leafSize + 1);
+    m_Nodes.emplace_back();
+    m_Parents.push_back(s_NoNode);
+
+    const BuildTask root{ 0, 0, static_cast<uint32_t>(items.size()), 0 };
+    const bool parallel = pool && pool->GetWorkerCount() > 0 && items.size() >= s_ParallelBuildThreshold;
+
+    if (!parallel)
+    {
+        BuildNodes(context, root, m_Nodes, m_Parents, 0, nullptr);
+    }
+    else
+    {
+        // The top of the tree on this thread, until the tasks are small
+        // enough to keep every worker busy; those go to the pool
+        const size_t deferBelow = items.size() / (s_BuildTasksPerThread * (static_cast<size_t>(pool->GetWorkerCount()) + 1));
+        std::vector<BuildTask> deferred;
+        BuildNodes(context, root, m_Nodes, m_Parents, deferBelow, &deferred);
+
+        struct Subtree
+        {
+            std::vector<BvhNode> nodes;
+            std::vector<uint32_t> parents;
+        };
+
+        std::vector<Subtree> subtrees(deferred.size());
+        pool->ParallelFor(deferred.size(), [&context, &deferred, &subtrees](size_t i)
+        {
+            Subtree& subtree = subtrees[i];
+            subtree.nodes.emplace_back();
+            subtree.parents.push_back(s_NoNode);
+            BuildNodes(context, { 0, deferred[i].first, deferred[i].count, deferred[i].depth }, subtree.nodes, subtree.parents, 0, nullptr);
+        });
+
+        // Spliced in after the top, a subtree's root taking the place of
+        // the node it was deferred from
+        for (size_t i = 0; i < subtrees.size(); ++i)
+        {
+            const uint32_t target = deferred[i].node;
+            const uint32_t base = static_cast<uint32_t>(m_Nodes.size()) - 1;
+            auto global = [target, base](uint32_t local) { return local == 0 ? target : base + local; };
+
+            for (uint32_t local = 0; local < subtrees[i].nodes.size(); ++local)
+            {
+                BvhNode node = subtrees[i].nodes[local];
+                if (!node.IsLeaf())
+                {
+                    node.first = global(node.first);
+                }
+
+                if (local == 0)
+                {
+                    m_Nodes[target] = node;
+                    continue;
+                }
+                m_Nodes.push_back(node);
+                m_Parents.push_back(global(subtrees[i].parents[local]));
+            }
+        }
+    }
+
+    m_Items.resize(items.size());
+    for (size_t i = 0; i < buildItems.size(); ++i)
+    {
+        m_Items[i] = buildItems[i].item;
+    }
+    AssignItemLeaves();
+
+    ComputeCost();
+    m_BuildCost = GetCost();
+}
+
+bool BoundsBvh::Assign(std::vector<BvhNode> nodes, std::vector<uint32_t> items, size_t itemCapacity)
+{
+    Clear();
+
+    // Children after their parent, leaves within the items, and no deeper
+    // than traversals go
+    std::vector<uint32_t> depths(nodes.size(), 0);
+    for (uint32_t index = 0; index < nodes.size(); ++index)
+    {
+        const BvhNode& node = nodes[index];
+        if (node.IsLeaf())
+        {
+            if (node.count > items.size() || node.first > items.size() - node.count)
+            {
+                return false;
+            }
+            continue;
+        }
+
+        if (node.first <= index || node.first + 1 >= nodes.size() || depths[index] >= s_MaxDepth)
+        {
+            return false;
+        }
+        depths[node.first] = depths[node.first + 1] = depths[index] + 1;
+    }
+    for (uint32_t item : items)
+    {
+        if (item >= itemCapacity)
+        {
+            return false;
+        }
+    }
+
+    m_Nodes = std::move(nodes);
+    m_Items = std::move(items);
+    m_Parents.assign(m_Nodes.size(), s_NoNode);
+    for (uint32_t index = 0; index < m_Nodes.size(); ++index)
+    {
+        if (!m_Nodes[index].IsLeaf())
+        {
+            m_Parents[m_Nodes[index].first] = index;
+            m_Parents[m_Nodes[index].first + 1] = index;
+        }
+    }
+
+    m_ItemLeaves.assign(itemCapacity, s_NoNode);
+    AssignItemLeaves();
+
+    ComputeCost();
+    m_BuildCost = GetCost();
+    return true;
+}
+
+void BoundsBvh::AssignItemLeaves()
+{
+    for (uint32_t index = 0; index < m_Nodes.size(); ++index)
+    {
+        const BvhNode& node = m_Nodes[index];
+        for (uint32_t i = node.first; node.IsLeaf() && i < node.first + node.count; ++i)
+        {
+            m_ItemLeaves[m_Items[i]] = index;
+        }
+    }
+}
+
+void BoundsBvh::Clear()
+{
+    m_Nodes.clear();
+    m_Parents.clear();
+    m_Items.clear();
+    m_ItemLeaves.clear();
+    m_CostSum = 0.f;
+    m_BuildCost = 0.f;
+}
+
+void BoundsBvh::RefitNode(uint32_t index, std::span<const glm::vec3> mins, std::span<const glm::vec3> maxs)
+{
+    BvhNode& node = m_Nodes[index];
+    glm::vec3 min, max;
+
+    if (node.IsLeaf())
+    {
+        min = mins[m_Items[node.first]];
+        max = maxs[m_Items[node.first]];
+        for (uint32_t i = node.first + 1; i < node.first + node.count; ++i)
+        {
+            min = glm::min(min, mins[m_Items[i]]);
+            max = glm::max(max, maxs[m_Items[i]]);
+        }
+    }
+    else
+    {
+        min = glm::min(m_Nodes[node.first].min, m_Nodes[node.first + 1].min);
+        max = glm::max(m_Nodes[node.first].max, m_Nodes[node.first + 1].max);
+    }
+
+    m_CostSum += GetWeight(node) * (GetArea(min, max) - GetArea(node.min, node.max));
+    node.min = min;
+    node.max = max;
+}
+
+void BoundsBvh::Refit(std::span<const glm::vec3> mins, std::span<const glm::vec3> maxs)
+{
+    for (size_t index = m_Nodes.size(); index-- > 0;)
+    {
+        RefitNode(static_cast<uint32_t>(index), mins, maxs);
+    }
+
+    // Starting over keeps rounding from adding up
+    ComputeCost();
+}
+
+void BoundsBvh::RefitItems(std::span<const uint32_t> items, std::span<const glm::vec3> mins, std::span<const glm::vec3> maxs)
+{
+    for (uint32_t item : items)
+    {
+        uint32_t index = GetItemLeaf(item);
+
+        // Up until a node comes out the same, which leaves those above it
+        while (index != s_NoNode)
+        {
+            const glm::vec3 min = m_Nodes[index].min;
+            const glm::vec3 max = m_Nodes[index].max;
+
+            RefitNode(index, mins, maxs);
+
+            if (m_Nodes[index].min == min && m_Nodes[index].max == max)
+            {
+                break;
+            }
+            index = m_Parents[index];
+        }
+    }
+}
+
+void BoundsBvh::ComputeCost()
+{
+    m_CostSum = 0.f;
+    for (const BvhNode& node : m_Nodes)
+    {
+        m_CostSum += GetWeight(node) * GetArea(node.min, node.max);
+    }
+}
+
+float BoundsBvh::GetCost() const
+{
+    if (m_Nodes.empty())
+    {
+        return 0.f;
+    }
+
+    const float rootArea = GetArea(m_Nodes[0].min, m_Nodes[0].max);
+    return rootArea > 0.f ? m_CostSum / rootArea : static_cast<float>(m_Items.size());
+}
+
+void BoundsBvh::CollectSubtrees(size_t count, std::vector<uint32_t>& roots) const
+{
+    roots.clear();
+    if (m_Nodes.empty())
+    {
+        return;
+    }
+
+    roots.push_back(0);
+    while (roots.size() < count)
+    {
+        // The subtree with the largest bounds, about the most work
+        size_t largest = roots.size();
+        float largestArea = -1.f;
+
+        for (size_t i = 0; i < roots.size(); ++i)
+        {
+            const BvhNode& node = m_Nodes[roots[i]];
+            const float area = GetArea(node.min, node.max);
+
+            if (!node.IsLeaf() && area > largestArea)
+            {
+                largest = i;
+                largestArea = area;
+            }
+        }
+
+        if (largest == roots.size())
+        {
+            return;
+        }
+
+        const uint32_t child = m_Nodes[roots[largest]].first;
+        roots[largest] = child;
+        roots.push_back(child + 1);
+    }
+}
+
+void DynamicBoundsBvh::Insert(uint32_t item, const glm::vec3& min, const glm::vec3& max)
+{
+    if (item >= m_Alive.size())
+    {
+        const size_t size = static_cast<size_t>(item) + 1;
+        m_Mins.resize(size);
+        m_Maxs.resize(size);
+        m_Alive.resize(size, 0);
+        m_Moved.resize(size, 0);
+    }
+
+    if (m_Alive[item])
+    {
+        Move(item, min, max);
+        return;
+    }
+
+    m_Mins[item] = min;
+    m_Maxs[item] = max;
+    m_Alive[item] = 1;
+
+    // A reused id still in the tree takes its old leaf back
+    if (m_Tree.GetItemLeaf(item) != BoundsBvh::s_NoNode)
+    {
+        --m_DeadInTree;
+        ++m_LiveInTree;
+        m_Moved[item] = 1;
+        m_AnyMoved.store(true, std::memory_order_relaxed);
+        return;
+    }
+
+    m_Pending.push_back(item);
+}
+
+void DynamicBoundsBvh::Move(uint32_t item, const glm::vec3& min, const glm::vec3& max)
+{
+    m_Mins[item] = min;
+    m_Maxs[item] = max;
+    m_Moved[item] = 1;
+
+    if (!m_AnyMoved.load(std::memory_order_relaxed))
+    {
+        m_AnyMoved.store(true, std::memory_order_relaxed);
+    }
+}
+
+void DynamicBoundsBvh::Remove(uint32_t item)
+{
+    if (!IsAlive(item))
+    {
+        return;
+    }
+
+    m_Alive[item] = 0;
+
+    if (m_Tree.GetItemLeaf(item) != BoundsBvh::s_NoNode)
+    {
+        --m_LiveInTree;
+        ++m_DeadInTree;
+        return;
+    }
+
+    const auto it = std::find(m_Pending.begin(), m_Pending.end(), item);
+    if (it != m_Pending.end())
+    {
+        *it = m_Pending.back();
+        m_Pending.pop_back();
+    }
+}
+
+void DynamicBoundsBvh::Clear()
+{
+    m_Tree.Clear();
+    m_Mins.clear();
+    m_Maxs.clear();
+    m_Alive.clear();
+    m_Moved.clear();
+    m_AnyMoved.store(false, std::memory_order_relaxed);
+    m_Pending.clear();
+    m_LiveInTree = 0;
+    m_DeadInTree = 0;
+    // A rebuild still running finishes into a tree nobody reads
+    m_Rebuild.reset();
+}
+
+void DynamicBoundsBvh::Update(ThreadPool& pool)
+{
+    if (m_Rebuild && m_Rebuild->done.load(std::memory_order_acquire))
+    {
+        Adopt(std::move(m_Rebuild->tree));
+        m_Rebuild.reset();
+    }
+
+    if (m_AnyMoved.exchange(false, std::memory_order_relaxed))
+    {
+        m_MovedItems.clear();
+        for (uint32_t item = 0; item < m_Moved.size(); ++item)
+        {
+            if (m_Moved[item])
+            {
+                m_Moved[item] = 0;
+                m_MovedItems.push_back(item);
+            }
+        }
+
+        // Past a quarter of the tree one sweep over every node is cheaper
+        if (m_MovedItems.size() * 4 > m_LiveInTree)
+        {
+            m_Tree.Refit(m_Mins, m_Maxs);
+        }
+        else
+        {
+            m_Tree.RefitItems(m_MovedItems, m_Mins, m_Maxs);
+        }
+    }
+
+    if (!m_Rebuild && NeedsRebuild())
+    {
+        StartRebuild(pool);
+    }
+}
+
+void DynamicBoundsBvh::Rebuild()
+{
+    std::vector<uint32_t> items;
+    GatherLiveItems(items);
+
+    BoundsBvh tree;
+    tree.Build(items, m_Mins, m_Maxs);
+    Adopt(std::move(tree));
+    std::fill(m_Moved.begin(), m_Moved.end(), uint8_t(0));
+
+    // One running against the old items would undo this when done
+    m_Rebuild.reset();
+}
+
+bool DynamicBoundsBvh::NeedsRebuild() const
+{
+    const size_t churn = m_Pending.size() + m_DeadInTree;
+    if (churn > 0 && static_cast<float>(churn) > s_RebuildChurnRatio * static_cast<float>(std::max<size_t>(m_LiveInTree, 1)))
+    {
+        return true;
+    }
+    return !m_Tree.IsEmpty() && m_Tree.GetCost() > s_RebuildCostRatio * m_Tree.GetBuildCost();
+}
+
+void DynamicBoundsBvh::StartRebuild(ThreadPool& pool)
+{
+    std::vector<uint32_t> items;
+    GatherLiveItems(items);
+
+    m_Rebuild = std::make_shared<PendingRebuild>();
+
+    // The job builds over a copy, the boxes moving on meanwhile
+    pool.Submit([rebuild = m_Rebuild, items = std::move(items), mins = m_Mins, maxs = m_Maxs]()
+    {
+        rebuild->tree.Build(items, mins, maxs);
+        rebuild->done.store(true, std::memory_order_release);
+    });
+}
+
+void DynamicBoundsBvh::Adopt(BoundsBvh&& tree)
+{
+    m_Tree = std::move(tree);
+    ++m_RebuildCount;
+
+    // Items inserted or removed since the copy was taken
+    m_Pending.clear();
+    m_LiveInTree = 0;
+    m_DeadInTree = 0;
+
+    for (uint32_t item = 0; item < m_Alive.size(); ++item)
+    {
+        const bool inTree = m_Tree.GetItemLeaf(item) != BoundsBvh::s_NoNode;
+
+        if (m_Alive[item] && !inTree)
+        {
+            m_Pending.push_back(item);
+        }
+        else if (inTree)
+        {
+            ++(m_Alive[item] ? m_LiveInTree : m_DeadInTree);
+        }
+    }
+
+    // And the moves, along with any reused id sitting in an old leaf
+    m_Tree.Refit(m_Mins, m_Maxs);
+}
+
+void DynamicBoundsBvh::GatherLiveItems(std::vector<uint32_t>& items) const
+{
+    items.clear();
+    for (uint32_t item = 0; item < m_Alive.size(); ++item)
+    {
+        if (m_Alive[item])
+        {
+            items.push_back(item);
+        }
+    }
+}
+
+END_VISUALIZER_NAMESPACE
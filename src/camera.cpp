@@ -108,6 +108,33 @@ void Camera::MoveRight(float dt)
 	m_ViewProjectionMatrix = m_ProjectionMatrix * m_ViewMatrix;
 }
 
+void Camera::SetPosition(const glm::vec3& position)
+{
+	m_Position = position;
+
+	m_ViewMatrix = glm::lookAt(m_Position, m_Position + m_Direction, m_Up);
+
+	m_ViewProjectionMatrix = m_ProjectionMatrix * m_ViewMatrix;
+}
+
+void Camera::SetOrientation(float horizontalAngle, float verticalAngle)
+{
+	m_HorizontalAngle = horizontalAngle;
+	m_VerticalAngle = verticalAngle;
+
+	m_Direction.x = glm::cos(m_VerticalAngle) * glm::sin(m_HorizontalAngle);
+	m_Direction.y = glm::sin(m_VerticalAngle);
+	m_Direction.z = glm::cos(m_VerticalAngle) * glm::cos(m_HorizontalAngle);
+
+	m_Right = glm::vec3(glm::sin(m_HorizontalAngle - glm::half_pi<float>()), 0.f, glm::cos(m_HorizontalAngle - glm::half_pi<float>()));
+
+	m_Up = -glm::cross(m_Right, m_Direction);
+
+	m_ViewMatrix = glm::lookAt(m_Position, m_Position + m_Direction, m_Up);
+
+	m_ViewProjectionMatrix = m_ProjectionMatrix * m_ViewMatrix;
+}
+
 void Camera::ComputeProjection(uint32_t windowWidth, uint32_t windowHeight)
 {
 	m_WindowWidth = windowWidth;
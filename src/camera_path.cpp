@@ -0,0 +1,233 @@
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <istream>
+#include <limits>
+#include <sstream>
+
+#include "camera_path.hpp"
+#include "mapped_file.hpp"
+#include "statistics.hpp"
+
+BEGIN_VISUALIZER_NAMESPACE
+
+namespace
+{
+    void WriteSummary(std::ostream& os, const char* name, const Summary& summary, bool last = false)
+    {
+        os << "    \"" << name << "\": { \"samples\": " << summary.count << ", \"mean\": " << summary.mean << ", \"p50\": " << summary.p50
+           << ", \"p95\": " << summary.p95 << ", \"p99\": " << summary.p99 << ", \"max\": " << summary.max << " }" << (last ? "\n" : ",\n");
+    }
+}
+
+bool CameraPath::Load(const std::string& path)
+{
+    MappedFile file;
+
+    if (!file.Open(path))
+    {
+        return false;
+    }
+
+    ByteStreamBuf buffer(file.GetBytes());
+    std::istream stream(&buffer);
+
+    m_Keys.clear();
+
+    std::string line;
+    size_t lineNumber = 0;
+
+    while (std::getline(stream, line))
+    {
+        ++lineNumber;
+
+        std::istringstream ss(line);
+        std::string keyword;
+
+        if (!(ss >> keyword) || keyword[0] == '#')
+        {
+            continue;
+        }
+
+        CameraKey key;
+        const bool valid = keyword == "key" && ss >> key.time >> key.position.x >> key.position.y >> key.position.z >> key.horizontalAngle >> key.verticalAngle &&
+                           (m_Keys.empty() || key.time >= m_Keys.back().time);
+
+        if (!valid)
+        {
+            std::cerr << "Invalid camera path entry at " << path << ':' << lineNumber << '\n';
+            return false;
+        }
+
+        m_Keys.push_back(key);
+    }
+
+    if (m_Keys.empty())
+    {
+        std::cerr << "Empty camera path: " << path << '\n';
+        return false;
+    }
+
+    return true;
+}
+
+bool CameraPath::Save(const std::string& path) const
+{
+    std::ofstream ofs(path, std::ios::trunc);
+
+    if (!ofs)
+    {
+        std::cerr << "Cannot open file : " << path << '\n';
+        return false;
+    }
+
+    // Exact round trip, playback must see the recorded floats
+    ofs << std::setprecision(std::numeric_limits<float>::max_digits10);
+    ofs << "# key time x y z horizontalAngle verticalAngle\n";
+
+    for (const CameraKey& key : m_Keys)
+    {
+        ofs << "key " << key.time << ' ' << key.position.x << ' ' << key.position.y << ' ' << key.position.z << ' ' << key.horizontalAngle << ' '
+            << key.verticalAngle << '\n';
+    }
+
+    return static_cast<bool>(ofs);
+}
+
+void CameraPath::Record(float time, const glm::vec3& position, float horizontalAngle, float verticalAngle)
+{
+    if (!m_Keys.empty() && time - m_Keys.back().time < s_RecordInterval)
+    {
+        return;
+    }
+
+    m_Keys.push_back({ time, position, horizontalAngle, verticalAngle });
+}
+
+CameraKey CameraPath::Sample(float time) const
+{
+    if (time <= m_Keys.front().time)
+    {
+        return m_Keys.front();
+    }
+    if (time >= m_Keys.back().time)
+    {
+        return m_Keys.back();
+    }
+
+    const auto next = std::upper_bound(m_Keys.begin(), m_Keys.end(), time, [](float t, const CameraKey& key) { return t < key.time; });
+    const CameraKey& a = *(next - 1);
+    const CameraKey& b = *next;
+    const float t = (time - a.time) / (b.time - a.time);
+
+    // The camera never wraps its angles, blending them follows the recorded turn
+    return CameraKey{ time, glm::mix(a.position, b.position, t), glm::mix(a.horizontalAngle, b.horizontalAngle, t), glm::mix(a.verticalAngle, b.verticalAngle, t) };
+}
+
+void FlythroughBenchmark::Start(const CameraPath& path, uint32_t iterations)
+{
+    m_Path = &path;
+    m_Iterations = iterations;
+    m_Iteration = 0;
+    m_Step = 0;
+    m_StepsPerIteration = static_cast<uint32_t>(std::ceil(path.GetDuration() / s_TimeStep)) + 1;
+    m_Warmup = s_WarmupFrames;
+
+    m_Frames.clear();
+    m_Frames.reserve(static_cast<size_t>(m_StepsPerIteration) * iterations);
+}
+
+CameraKey FlythroughBenchmark::BeginFrame()
+{
+    return m_Path->Sample(m_Path->GetStartTime() + m_Step * s_TimeStep);
+}
+
+void FlythroughBenchmark::EndFrame(float frameMs, float gpuMs, uint32_t drawCommands, int64_t triangles)
+{
+    if (m_Warmup > 0)
+    {
+        // Spent on the first key, before the path starts moving
+        --m_Warmup;
+        return;
+    }
+
+    m_Frames.push_back({ frameMs, gpuMs, drawCommands, triangles });
+
+    if (++m_Step == m_StepsPerIteration)
+    {
+        m_Step = 0;
+        ++m_Iteration;
+    }
+}
+
+void FlythroughBenchmark::PrintReport(std::ostream& os) const
+{
+    std::vector<double> frameMs;
+    std::vector<double> gpuMs;
+    frameMs.reserve(m_Frames.size());
+
+    for (const Frame& frame : m_Frames)
+    {
+        frameMs.push_back(frame.frameMs);
+        if (frame.gpuMs >= 0.f)
+        {
+            gpuMs.push_back(frame.gpuMs);
+        }
+    }
+
+    const Summary frame = Summarize(frameMs);
+    const Summary gpu = Summarize(gpuMs);
+    const std::ios_base::fmtflags flags = os.flags();
+    const std::streamsize precision = os.precision();
+
+    os << std::fixed << std::setprecision(2) << "Flythrough: " << m_Iteration << " iterations of " << m_Path->GetDuration() << " s, " << m_Frames.size()
+       << " frames\n  frame ms: p50 " << frame.p50 << ", p95 " << frame.p95 << ", p99 " << frame.p99 << ", max " << frame.max << "\n  scene GPU ms: p50 "
+       << gpu.p50 << ", p95 " << gpu.p95 << ", p99 " << gpu.p99 << ", max " << gpu.max << '\n';
+
+    os.flags(flags);
+    os.precision(precision);
+}
+
+void FlythroughBenchmark::WriteJson(std::ostream& os, const LaunchOptions& options) const
+{
+    std::vector<double> frameMs;
+    std::vector<double> gpuMs;
+    std::vector<double> drawCommands;
+    std::vector<double> triangles;
+
+    for (const Frame& frame : m_Frames)
+    {
+        frameMs.push_back(frame.frameMs);
+        drawCommands.push_back(frame.drawCommands);
+        if (frame.gpuMs >= 0.f)
+        {
+            gpuMs.push_back(frame.gpuMs);
+        }
+        if (frame.triangles >= 0)
+        {
+            triangles.push_back(static_cast<double>(frame.triangles));
+        }
+    }
+
+    auto flag = [](bool value) { return value ? "true" : "false"; };
+
+    os << "{\n  \"iterations\": " << m_Iteration << ",\n  \"pathSeconds\": " << m_Path->GetDuration() << ",\n  \"timeStep\": " << s_TimeStep
+       << ",\n  \"frames\": " << m_Frames.size() << ",\n";
+
+    os << "  \"options\": {\n    \"scene\": " << flag(!options.sceneManifest.empty()) << ",\n    \"scatterPalms\": " << flag(options.scatterPalms)
+       << ",\n    \"world\": " << flag(!options.worldManifest.empty())
+       << ",\n    \"occlusionCulling\": " << flag(options.occlusionCulling) << ",\n    \"hiz\": " << flag(options.gpuOcclusion) << ",\n    \"queries\": "
+       << flag(options.occlusionQueries) << ",\n    \"wind\": " << flag(options.wind) << ",\n    \"meshlets\": " << flag(options.meshlets) << ",\n    \"pointLights\": " << options.pointLights
+       << ",\n    \"prepass\": \"" << GetPrepassModeName(options.prepass) << "\"\n  },\n";
+
+    os << "  \"stats\": {\n";
+    WriteSummary(os, "frameMs", Summarize(frameMs));
+    WriteSummary(os, "sceneGpuMs", Summarize(gpuMs));
+    WriteSummary(os, "drawCommands", Summarize(drawCommands));
+    WriteSummary(os, "triangles", Summarize(triangles), true);
+    os << "  }\n}\n";
+}
+
+END_VISUALIZER_NAMESPACE
@@ -0,0 +1,591 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+
+#include "clustered_lighting.hpp"
+#include "gpu_resources.hpp"
+#include "random.hpp"
+#include "simd.hpp"
+#include "terrain.hpp"
+
+BEGIN_VISUALIZER_NAMESPACE
+
+namespace
+{
+    constexpr GLuint s_ParameterBinding = 1;
+    constexpr GLuint s_LightBinding = 5;
+    constexpr GLuint s_ClusterBinding = 6;
+    constexpr GLuint s_IndexBinding = 7;
+    constexpr size_t s_InitialIndexCapacity = 16384;
+
+    char const* const s_ShaderSource =
+        R"(
+layout(std140, binding = 1) uniform Clusters
+{
+    mat4 u_View;
+    // near, slices / log(far / near), 1 / width, 1 / height
+    vec4 u_DepthAndScreen;
+    uvec4 u_Grid;
+};
+
+struct PointLight
+{
+    vec4 positionRadius;
+    vec4 colorIntensity;
+};
+
+layout(std430, binding = 5) readonly buffer Lights { PointLight lights[]; };
+layout(std430, binding = 6) readonly buffer ClusterRanges { uvec2 clusterRanges[]; };
+layout(std430, binding = 7) readonly buffer LightIndices { uint lightIndices[]; };
+
+vec3 ShadePointLights(vec3 worldPosition, vec3 normal, vec3 color)
+{
+    float depth = -(u_View * vec4(worldPosition, 1.0)).z;
+    float slice = log(max(depth / u_DepthAndScreen.x, 1.0)) * u_DepthAndScreen.y;
+    uvec3 cluster = min(uvec3(gl_FragCoord.xy * u_DepthAndScreen.zw * vec2(u_Grid.xy), slice), u_Grid.xyz - 1u);
+    uvec2 range = clusterRanges[(cluster.z * u_Grid.y + cluster.y) * u_Grid.x + cluster.x];
+
+    vec3 n = normal * inversesqrt(max(dot(normal, normal), 1e-8));
+    vec3 result = vec3(0.0);
+
+    for (uint i = 0u; i < range.y; ++i)
+    {
+        PointLight light = lights[lightIndices[range.x + i]];
+        vec3 toLight = light.positionRadius.xyz - worldPosition;
+        float distanceSquared = dot(toLight, toLight);
+        float radiusSquared = light.positionRadius.w * light.positionRadius.w;
+
+        if (distanceSquared < radiusSquared)
+        {
+            float falloff = 1.0 - distanceSquared / radiusSquared;
+            float diffuse = max(dot(n, toLight * inversesqrt(max(distanceSquared, 1e-8))), 0.0);
+
+            result += light.colorIntensity.rgb * (light.colorIntensity.w * falloff * falloff * diffuse);
+        }
+    }
+    return result * color;
+}
+)";
+
+    using Clock = std::chrono::steady_clock;
+
+    inline float ElapsedMs(Clock::time_point start)
+    {
+        return std::chrono::duration<float, std::milli>(Clock::now() - start).count();
+    }
+
+    // Clusters [min, max] covered by [lo, hi] on an axis cut into count
+    // cells over [-1, 1]
+    inline void ToCells(float lo, float hi, uint32_t count, uint8_t& min, uint8_t& max)
+    {
+        const float scale = 0.5f * static_cast<float>(count);
+        const float last = static_cast<float>(count - 1);
+
+        min = static_cast<uint8_t>(std::clamp((lo + 1.f) * scale, 0.f, last));
+        max = static_cast<uint8_t>(std::clamp((hi + 1.f) * scale, 0.f, last));
+    }
+
+    // NDC extent along one axis of a sphere in front of the near plane, from
+    // the two lines through the eye tangent to it in the plane of that axis
+    // and the view direction (Mara and McGuire 2013)
+    inline void ProjectSphere(float center, float depth, float radius, float scale, float& lo, float& hi)
+    {
+        const float tangent = std::sqrt(std::max(center * center + depth * depth - radius * radius, 0.f));
+        const float a = scale * (center * tangent - depth * radius) / (center * radius + depth * tangent);
+        const float b = scale * (center * tangent + depth * radius) / (depth * tangent - center * radius);
+
+        lo = std::min(a, b);
+        hi = std::max(a, b);
+    }
+
+    // Looser bound for spheres reaching behind the near plane: the extent
+    // of their box between nearDepth and farDepth, projected
+    inline void ProjectBox(float center, float nearDepth, float farDepth, float radius, float scale, float& lo, float& hi)
+    {
+        lo = scale * std::min((center - radius) / nearDepth, (center - radius) / farDepth);
+        hi = scale * std::max((center + radius) / nearDepth, (center + radius) / farDepth);
+    }
+
+#if VISUALIZER_SSE2
+    // Four lanes of ProjectSphere()
+    inline void ProjectSphere(__m128 center, __m128 depth, __m128 radius, __m128 scale, __m128& lo, __m128& hi)
+    {
+        const __m128 centerSquared = _mm_mul_ps(center, center);
+        const __m128 tangent = _mm_sqrt_ps(_mm_max_ps(_mm_sub_ps(_mm_add_ps(centerSquared, _mm_mul_ps(depth, depth)), _mm_mul_ps(radius, radius)), _mm_setzero_ps()));
+        const __m128 ct = _mm_mul_ps(center, tangent);
+        const __m128 dr = _mm_mul_ps(depth, radius);
+        const __m128 cr = _mm_mul_ps(center, radius);
+        const __m128 dt = _mm_mul_ps(depth, tangent);
+        const __m128 a = _mm_div_ps(_mm_mul_ps(scale, _mm_sub_ps(ct, dr)), _mm_add_ps(cr, dt));
+        const __m128 b = _mm_div_ps(_mm_mul_ps(scale, _mm_add_ps(ct, dr)), _mm_sub_ps(dt, cr));
+
+        lo = _mm_min_ps(a, b);
+        hi = _mm_max_ps(a, b);
+    }
+
+    // Four lanes of ProjectBox()
+    inline void ProjectBox(__m128 center, __m128 nearDepth, __m128 farDepth, __m128 radius, __m128 scale, __m128& lo, __m128& hi)
+    {
+        const __m128 min = _mm_sub_ps(center, radius);
+        const __m128 max = _mm_add_ps(center, radius);
+
+        lo = _mm_mul_ps(scale, _mm_min_ps(_mm_div_ps(min, nearDepth), _mm_div_ps(min, farDepth)));
+        hi = _mm_mul_ps(scale, _mm_max_ps(_mm_div_ps(max, nearDepth), _mm_div_ps(max, farDepth)));
+    }
+
+    inline __m128 Select(__m128 mask, __m128 a, __m128 b)
+    {
+        return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+    }
+
+    // Four lanes of ToCells(), NaN lanes land on cell 0
+    inline __m128i ToCells(__m128 value, uint32_t count)
+    {
+        const __m128 scaled = _mm_mul_ps(_mm_add_ps(value, _mm_set1_ps(1.f)), _mm_set1_ps(0.5f * static_cast<float>(count)));
+        return _mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(scaled, _mm_setzero_ps()), _mm_set1_ps(static_cast<float>(count - 1))));
+    }
+#endif
+}
+
+const char* ClusteredLighting::GetShaderSource()
+{
+    return s_ShaderSource;
+}
+
+void ClusteredLighting::Initialize()
+{
+    GpuResourceTracker& resources = GpuResourceTracker::GetGlobal();
+
+    m_ParameterBuffer = resources.CreateBuffer(GpuResourceCategory::Uniform, sizeof(ClusterParameters), nullptr, GL_DYNAMIC_STORAGE_BIT);
+    m_ClusterBuffer = resources.CreateBuffer(GpuResourceCategory::Lighting, sizeof(ClusterRange) * s_ClusterCount, nullptr, GL_DYNAMIC_STORAGE_BIT);
+    GrowBuffer(m_LightBuffer, m_LightCapacity, std::max<size_t>(sizeof(PointLight) * m_Lights.size(), sizeof(PointLight)));
+    GrowBuffer(m_IndexBuffer, m_IndexCapacity, sizeof(uint32_t) * s_InitialIndexCapacity);
+
+    if (!m_Lights.empty())
+    {
+        glNamedBufferSubData(m_LightBuffer, 0, sizeof(PointLight) * m_Lights.size(), m_Lights.data());
+    }
+    m_Indices.reserve(s_InitialIndexCapacity);
+    m_EmptyUploaded = false;
+}
+
+void ClusteredLighting::Cleanup()
+{
+    GpuResourceTracker& resources = GpuResourceTracker::GetGlobal();
+
+    resources.DeleteBuffer(m_ParameterBuffer);
+    resources.DeleteBuffer(m_LightBuffer);
+    resources.DeleteBuffer(m_ClusterBuffer);
+    resources.DeleteBuffer(m_IndexBuffer);
+    m_LightCapacity = 0;
+    m_IndexCapacity = 0;
+}
+
+void ClusteredLighting::GrowBuffer(GLuint& buffer, size_t& capacity, size_t size)
+{
+    if (size <= capacity)
+    {
+        return;
+    }
+
+    GpuResourceTracker& resources = GpuResourceTracker::GetGlobal();
+
+    resources.DeleteBuffer(buffer);
+    capacity = std::max(size, capacity * 2);
+    buffer = resources.CreateBuffer(GpuResourceCategory::Lighting, capacity, nullptr, GL_DYNAMIC_STORAGE_BIT);
+}
+
+void ClusteredLighting::SetLights(std::span<const PointLight> lights)
+{
+    m_Lights.assign(lights.begin(), lights.end());
+    m_Ranges.resize(m_Lights.size());
+
+    if (m_ParameterBuffer && !m_Lights.empty())
+    {
+        GrowBuffer(m_LightBuffer, m_LightCapacity, sizeof(PointLight) * m_Lights.size());
+        glNamedBufferSubData(m_LightBuffer, 0, sizeof(PointLight) * m_Lights.size(), m_Lights.data());
+    }
+    m_EmptyUploaded = false;
+}
+
+void ClusteredLighting::ComputeRanges(const glm::mat4& view, const glm::mat4& projection, float nearPlane, float farPlane)
+{
+    for (uint32_t k = 1; k < s_ClustersZ; ++k)
+    {
+        m_SliceDepths[k - 1] = nearPlane * std::pow(farPlane / nearPlane, static_cast<float>(k) / s_ClustersZ);
+    }
+
+    const float scaleX = projection[0][0];
+    const float scaleY = projection[1][1];
+    const size_t count = m_Lights.size();
+    size_t i = 0;
+
+#if VISUALIZER_SSE2
+    const __m128 near4 = _mm_set1_ps(nearPlane);
+    const __m128 far4 = _mm_set1_ps(farPlane);
+    const __m128 scaleX4 = _mm_set1_ps(scaleX);
+    const __m128 scaleY4 = _mm_set1_ps(scaleY);
+    const __m128 one = _mm_set1_ps(1.f);
+    const __m128 minusOne = _mm_set1_ps(-1.f);
+
+    for (; i + 4 <= count; i += 4)
+    {
+        const PointLight* light = &m_Lights[i];
+        const __m128 px = _mm_setr_ps(light[0].position.x, light[1].position.x, light[2].position.x, light[3].position.x);
+        const __m128 py = _mm_setr_ps(light[0].position.y, light[1].position.y, light[2].position.y, light[3].position.y);
+        const __m128 pz = _mm_setr_ps(light[0].position.z, light[1].position.z, light[2].position.z, light[3].position.z);
+        const __m128 radius = _mm_setr_ps(light[0].radius, light[1].radius, light[2].radius, light[3].radius);
+
+        auto transform = [&](int32_t row)
+        {
+            return _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(view[0][row]), px), _mm_mul_ps(_mm_set1_ps(view[1][row]), py)),
+                              _mm_add_ps(_mm_mul_ps(_mm_set1_ps(view[2][row]), pz), _mm_set1_ps(view[3][row])));
+        };
+
+        const __m128 cx = transform(0);
+        const __m128 cy = transform(1);
+        const __m128 depth = _mm_sub_ps(_mm_setzero_ps(), transform(2));
+        const __m128 zMin = _mm_sub_ps(depth, radius);
+        const __m128 zMax = _mm_add_ps(depth, radius);
+
+        // Slices are counted as the boundaries lying before each end
+        __m128i sliceMin = _mm_setzero_si128();
+        __m128i sliceMax = _mm_setzero_si128();
+        for (float boundary : m_SliceDepths)
+        {
+            const __m128 b = _mm_set1_ps(boundary);
+            sliceMin = _mm_sub_epi32(sliceMin, _mm_castps_si128(_mm_cmple_ps(b, zMin)));
+            sliceMax = _mm_sub_epi32(sliceMax, _mm_castps_si128(_mm_cmple_ps(b, zMax)));
+        }
+
+        __m128 loX, hiX, loY, hiY;
+        ProjectSphere(cx, depth, radius, scaleX4, loX, hiX);
+        ProjectSphere(cy, depth, radius, scaleY4, loY, hiY);
+
+        // The tangents of spheres through the near plane go behind the eye
+        __m128 boxLoX, boxHiX, boxLoY, boxHiY;
+        const __m128 clippedNear = _mm_max_ps(zMin, near4);
+        const __m128 clippedFar = _mm_max_ps(zMax, near4);
+        ProjectBox(cx, clippedNear, clippedFar, radius, scaleX4, boxLoX, boxHiX);
+        ProjectBox(cy, clippedNear, clippedFar, radius, scaleY4, boxLoY, boxHiY);
+
+        const __m128 crossesNear = _mm_cmple_ps(zMin, near4);
+        loX = Select(crossesNear, boxLoX, loX);
+        hiX = Select(crossesNear, boxHiX, hiX);
+        loY = Select(crossesNear, boxLoY, loY);
+        hiY = Select(crossesNear, boxHiY, hiY);
+
+        const __m128 visible = _mm_and_ps(_mm_and_ps(_mm_cmpgt_ps(zMax, near4), _mm_cmplt_ps(zMin, far4)),
+                                          _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(hiX, minusOne), _mm_cmple_ps(loX, one)),
+                                                     _mm_and_ps(_mm_cmpge_ps(hiY, minusOne), _mm_cmple_ps(loY, one))));
+        const int32_t visibleMask = _mm_movemask_ps(visible);
+
+        alignas(16) int32_t minX[4], maxX[4], minY[4], maxY[4], minZ[4], maxZ[4];
+        _mm_store_si128(reinterpret_cast<__m128i*>(minX), ToCells(loX, s_ClustersX));
+        _mm_store_si128(reinterpret_cast<__m128i*>(maxX), ToCells(hiX, s_ClustersX));
+        _mm_store_si128(reinterpret_cast<__m128i*>(minY), ToCells(loY, s_ClustersY));
+        _mm_store_si128(reinterpret_cast<__m128i*>(maxY), ToCells(hiY, s_ClustersY));
+        _mm_store_si128(reinterpret_cast<__m128i*>(minZ), sliceMin);
+        _mm_store_si128(reinterpret_cast<__m128i*>(maxZ), sliceMax);
+
+        for (int32_t lane = 0; lane < 4; ++lane)
+        {
+            LightRange& range = m_Ranges[i + lane];
+
+            if (visibleMask & (1 << lane))
+            {
+                range = { static_cast<uint8_t>(minX[lane]), static_cast<uint8_t>(maxX[lane]), static_cast<uint8_t>(minY[lane]),
+                          static_cast<uint8_t>(maxY[lane]), static_cast<uint8_t>(minZ[lane]), static_cast<uint8_t>(maxZ[lane]) };
+            }
+            else
+            {
+                range = { 1, 0, 1, 0, 1, 0 };
+            }
+        }
+    }
+#endif
+
+    for (; i < count; ++i)
+    {
+        const PointLight& light = m_Lights[i];
+        const glm::vec3 center = glm::vec3(view * glm::vec4(light.position, 1.f));
+        const float depth = -center.z;
+        const float zMin = depth - light.radius;
+        const float zMax = depth + light.radius;
+        LightRange& range = m_Ranges[i];
+
+        range = { 1, 0, 1, 0, 1, 0 };
+
+        if (zMax <= nearPlane || zMin >= farPlane)
+        {
+            continue;
+        }
+
+        float loX, hiX, loY, hiY;
+        if (zMin > nearPlane)
+        {
+            ProjectSphere(center.x, depth, light.radius, scaleX, loX, hiX);
+            ProjectSphere(center.y, depth, light.radius, scaleY, loY, hiY);
+        }
+        else
+        {
+            ProjectBox(center.x, nearPlane, zMax, light.radius, scaleX, loX, hiX);
+            ProjectBox(center.y, nearPlane, zMax, light.radius, scaleY, loY, hiY);
+        }
+
+        if (hiX < -1.f || loX > 1.f || hiY < -1.f || loY > 1.f)
+        {
+            continue;
+        }
+
+        ToCells(loX, hiX, s_ClustersX, range.minX, range.maxX);
+        ToCells(loY, hiY, s_ClustersY, range.minY, range.maxY);
+        range.minZ = static_cast<uint8_t>(std::upper_bound(std::begin(m_SliceDepths), std::end(m_SliceDepths), zMin) - std::begin(m_SliceDepths));
+        range.maxZ = static_cast<uint8_t>(std::upper_bound(std::begin(m_SliceDepths), std::end(m_SliceDepths), zMax) - std::begin(m_SliceDepths));
+    }
+}
+
+void ClusteredLighting::Bin(const glm::mat4& view, const glm::mat4& projection, float nearPlane, float farPlane)
+{
+    m_Stats = {};
+    m_Stats.lights = static_cast<uint32_t>(m_Lights.size());
+
+    ComputeRanges(view, projection, nearPlane, farPlane);
+
+    // Count, then place every light at the offset of its clusters
+    for (ClusterRange& cluster : m_Clusters)
+    {
+        cluster.count = 0;
+    }
+
+    for (const LightRange& range : m_Ranges)
+    {
+        if (range.minX > range.maxX)
+        {
+            continue;
+        }
+
+        ++m_Stats.visibleLights;
+        for (uint32_t z = range.minZ; z <= range.maxZ; ++z)
+        {
+            for (uint32_t y = range.minY; y <= range.maxY; ++y)
+            {
+                ClusterRange* row = &m_Clusters[(z * s_ClustersY + y) * s_ClustersX];
+                for (uint32_t x = range.minX; x <= range.maxX; ++x)
+                {
+                    ++row[x].count;
+                }
+            }
+        }
+    }
+
+    uint32_t offset = 0;
+    for (ClusterRange& cluster : m_Clusters)
+    {
+        cluster.offset = offset;
+        offset += cluster.count;
+        m_Stats.maxLightsPerCluster = std::max(m_Stats.maxLightsPerCluster, cluster.count);
+        cluster.count = 0;
+    }
+    m_Stats.lightReferences = offset;
+
+    m_Indices.resize(offset);
+
+    for (uint32_t light = 0; light < m_Ranges.size(); ++light)
+    {
+        const LightRange& range = m_Ranges[light];
+
+        if (range.minX > range.maxX)
+        {
+            continue;
+        }
+
+        for (uint32_t z = range.minZ; z <= range.maxZ; ++z)
+        {
+            for (uint32_t y = range.minY; y <= range.maxY; ++y)
+            {
+                ClusterRange* row = &m_Clusters[(z * s_ClustersY + y) * s_ClustersX];
+                for (uint32_t x = range.minX; x <= range.maxX; ++x)
+                {
+                    m_Indices[row[x].offset + row[x].count++] = light;
+                }
+            }
+        }
+    }
+}
+
+std::span<const uint32_t> ClusteredLighting::GetClusterLights(uint32_t x, uint32_t y, uint32_t z) const
+{
+    const ClusterRange& cluster = m_Clusters[(z * s_ClustersY + y) * s_ClustersX + x];
+    return std::span<const uint32_t>(m_Indices).subspan(cluster.offset, cluster.count);
+}
+
+void ClusteredLighting::Update(const glm::mat4& view, const glm::mat4& projection, float nearPlane, float farPlane, uint32_t width, uint32_t height)
+{
+    if (m_Lights.empty() && m_EmptyUploaded)
+    {
+        m_Stats = {};
+        return;
+    }
+
+    const Clock::time_point binStart = Clock::now();
+
+    Bin(view, projection, nearPlane, farPlane);
+    m_Stats.binMs = ElapsedMs(binStart);
+
+    const Clock::time_point uploadStart = Clock::now();
+
+    ClusterParameters parameters;
+    parameters.view = view;
+    parameters.depthAndScreen = glm::vec4(nearPlane, s_ClustersZ / std::log(farPlane / nearPlane), 1.f / std::max(width, 1u), 1.f / std::max(height, 1u));
+    parameters.grid = glm::uvec4(s_ClustersX, s_ClustersY, s_ClustersZ, 0);
+
+    glNamedBufferSubData(m_ParameterBuffer, 0, sizeof(ClusterParameters), &parameters);
+    glNamedBufferSubData(m_ClusterBuffer, 0, sizeof(ClusterRange) * s_ClusterCount, m_Clusters.data());
+    if (!m_Indices.empty())
+    {
+        GrowBuffer(m_IndexBuffer, m_IndexCapacity, sizeof(uint32_t) * m_Indices.size());
+        glNamedBufferSubData(m_IndexBuffer, 0, sizeof(uint32_t) * m_Indices.size(), m_Indices.data());
+    }
+    m_Stats.uploadMs = ElapsedMs(uploadStart);
+
+    m_EmptyUploaded = m_Lights.empty();
+}
+
+void ClusteredLighting::Bind() const
+{
+    glBindBufferBase(GL_UNIFORM_BUFFER, s_ParameterBinding, m_ParameterBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, s_LightBinding, m_LightBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, s_ClusterBinding, m_ClusterBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, s_IndexBinding, m_IndexBuffer);
+}
+
+std::vector<PointLight> ScatterLights(const Terrain& terrain, uint32_t count, uint64_t seed)
+{
+    std::vector<PointLight> lights;
+    lights.reserve(count);
+
+    // Random mixes one increment further ahead than the generator this
+    // used to keep; starting one back keeps the benchmark lights in place
+    Random random(seed - s_GoldenGamma);
+    const glm::vec3& min = terrain.GetMin();
+    const glm::vec3& max = terrain.GetMax();
+
+    while (lights.size() < count)
+    {
+        PointLight light;
+        light.position.x = random.NextFloat(min.x, max.x);
+        light.position.z = random.NextFloat(min.z, max.z);
+        light.radius = random.NextFloat(4.f, 12.f);
+        light.color = glm::vec3(1.f, random.NextFloat(0.45f, 0.75f), random.NextFloat(0.1f, 0.3f));
+        light.intensity = random.NextFloat(1.f, 3.f);
+
+        float height = 0.f;
+        if (!terrain.HeightAt(light.position.x, light.position.z, height))
+        {
+            height = min.y;
+        }
+        light.position.y = height + 2.f;
+
+        lights.push_back(light);
+    }
+
+    return lights;
+}
+
+void LightingBenchmark::Start(std::span<const uint32_t> lightCounts)
+{
+    m_Steps.clear();
+    for (uint32_t lightCount : lightCounts)
+    {
+        Step step;
+        step.lightCount = lightCount;
+        m_Steps.push_back(step);
+    }
+    m_Step = 0;
+    m_Frame = 0;
+}
+
+bool LightingBenchmark::BeginFrame(uint32_t& lightCount)
+{
+    if (!IsRunning())
+    {
+        return false;
+    }
+
+    lightCount = m_Steps[m_Step].lightCount;
+    return m_Frame == 0;
+}
+
+void LightingBenchmark::EndFrame(const LightingStats& stats, float gpuMs)
+{
+    if (!IsRunning())
+    {
+        return;
+    }
+
+    // The GPU times arrive a few frames late, the warmup keeps the previous
+    // step's out
+    if (m_Frame++ < s_WarmupFrames)
+    {
+        return;
+    }
+
+    Step& step = m_Steps[m_Step];
+    ++step.frames;
+    step.visibleLights += stats.visibleLights;
+    step.lightReferences += stats.lightReferences;
+    step.maxLightsPerCluster = std::max(step.maxLightsPerCluster, stats.maxLightsPerCluster);
+    step.binMs += stats.binMs;
+    step.uploadMs += stats.uploadMs;
+    if (gpuMs >= 0.f)
+    {
+        ++step.gpuFrames;
+        step.gpuMs += gpuMs;
+    }
+
+    if (step.frames == s_MeasuredFrames)
+    {
+        ++m_Step;
+        m_Frame = 0;
+    }
+}
+
+void LightingBenchmark::PrintReport(std::ostream& os) const
+{
+    const std::ios_base::fmtflags flags = os.flags();
+    const std::streamsize precision = os.precision();
+
+    os << "Lighting benchmark, " << ClusteredLighting::s_ClustersX << "x" << ClusteredLighting::s_ClustersY << "x" << ClusteredLighting::s_ClustersZ
+       << " clusters, averages over " << s_MeasuredFrames << " frames:\n";
+    os << "  " << std::setw(8) << "lights" << std::setw(9) << "visible" << std::setw(11) << "refs" << std::setw(9) << "max/cl"
+       << std::setw(10) << "bin ms" << std::setw(11) << "upload ms" << std::setw(11) << "scene ms" << '\n';
+
+    for (const Step& step : m_Steps)
+    {
+        if (step.frames == 0)
+        {
+            continue;
+        }
+
+        const double frames = step.frames;
+
+        os << std::fixed << std::setprecision(3) << "  " << std::setw(8) << step.lightCount << std::setw(9) << std::setprecision(0)
+           << step.visibleLights / frames << std::setw(11) << step.lightReferences / frames << std::setw(9) << step.maxLightsPerCluster
+           << std::setprecision(3) << std::setw(10) << step.binMs / frames << std::setw(11) << step.uploadMs / frames << std::setw(11);
+        if (step.gpuFrames > 0)
+        {
+            os << step.gpuMs / step.gpuFrames << '\n';
+        }
+        else
+        {
+            os << "n/a" << '\n';
+        }
+    }
+
+    os.flags(flags);
+    os.precision(precision);
+}
+
+END_VISUALIZER_NAMESPACE
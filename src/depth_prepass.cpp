@@ -0,0 +1,205 @@
+#include "depth_prepass.hpp"
+#include "gpu_resources.hpp"
+
+BEGIN_VISUALIZER_NAMESPACE
+
+namespace
+{
+    char const* const s_OverdrawFragmentShader =
+        R"(#version 450 core
+
+layout(binding = 0, offset = 0) uniform atomic_uint u_Fragments;
+
+layout(location = 0) out vec4 outColor;
+
+void main()
+{
+    atomicCounterIncrement(u_Fragments);
+    // Blended additively, ten layers saturate
+    outColor = vec4(0.1, 0.05, 0.02, 1.0);
+}
+)";
+}
+
+const char* GetPrepassModeName(PrepassMode mode)
+{
+    switch (mode)
+    {
+    case PrepassMode::Off:
+        return "off";
+    case PrepassMode::On:
+        return "on";
+    case PrepassMode::Auto:
+        return "auto";
+    default:
+        return "unknown";
+    }
+}
+
+void DepthPrepass::Initialize(PrepassMode mode)
+{
+    for (FrameQueries& queries : m_Queries)
+    {
+        glCreateQueries(GL_SAMPLES_PASSED, 1, &queries.depthSamples);
+        glCreateQueries(GL_SAMPLES_PASSED, 1, &queries.colorSamples);
+        queries.pending = false;
+    }
+    m_Mode = mode;
+    m_AutoEnabled = false;
+}
+
+void DepthPrepass::Cleanup()
+{
+    for (FrameQueries& queries : m_Queries)
+    {
+        if (queries.depthSamples)
+        {
+            glDeleteQueries(1, &queries.depthSamples);
+            glDeleteQueries(1, &queries.colorSamples);
+        }
+        queries = {};
+    }
+}
+
+void DepthPrepass::SetMode(PrepassMode mode)
+{
+    m_Mode = mode;
+    m_FramesSinceMeasure = s_MeasureInterval;
+}
+
+void DepthPrepass::ReadResults(FrameQueries& queries)
+{
+    if (!queries.pending)
+    {
+        return;
+    }
+
+    GLuint available = GL_FALSE;
+    glGetQueryObjectuiv(queries.colorSamples, GL_QUERY_RESULT_AVAILABLE, &available);
+
+    // Dropped rather than waited for, the next pre-pass frame measures again
+    queries.pending = false;
+    if (!available)
+    {
+        return;
+    }
+
+    GLuint64 depthSamples = 0;
+    GLuint64 colorSamples = 0;
+    glGetQueryObjectui64v(queries.depthSamples, GL_QUERY_RESULT, &depthSamples);
+    glGetQueryObjectui64v(queries.colorSamples, GL_QUERY_RESULT, &colorSamples);
+
+    if (colorSamples == 0)
+    {
+        return;
+    }
+
+    m_Overdraw = static_cast<float>(static_cast<double>(depthSamples) / static_cast<double>(colorSamples));
+
+    const bool enable = m_AutoEnabled ? m_Overdraw > s_DisableOverdraw : m_Overdraw > s_EnableOverdraw;
+    if (enable != m_AutoEnabled)
+    {
+        m_AutoEnabled = enable;
+        ++m_Switches;
+    }
+}
+
+bool DepthPrepass::BeginFrame()
+{
+    m_Current = m_Next;
+    m_Next = (m_Next + 1) % s_Latency;
+
+    ReadResults(m_Queries[m_Current]);
+
+    switch (m_Mode)
+    {
+    case PrepassMode::Off:
+        m_RunsThisFrame = false;
+        break;
+    case PrepassMode::On:
+        m_RunsThisFrame = true;
+        break;
+    case PrepassMode::Auto:
+        m_RunsThisFrame = m_AutoEnabled || m_FramesSinceMeasure >= s_MeasureInterval;
+        break;
+    }
+
+    m_FramesSinceMeasure = m_RunsThisFrame ? 0 : m_FramesSinceMeasure + 1;
+    ++m_Frames;
+    m_PrepassFrames += m_RunsThisFrame;
+
+    return m_RunsThisFrame;
+}
+
+void DepthPrepass::BeginDepthPass()
+{
+    glBeginQuery(GL_SAMPLES_PASSED, m_Queries[m_Current].depthSamples);
+}
+
+void DepthPrepass::EndDepthPass()
+{
+    glEndQuery(GL_SAMPLES_PASSED);
+}
+
+void DepthPrepass::BeginColorPass()
+{
+    glBeginQuery(GL_SAMPLES_PASSED, m_Queries[m_Current].colorSamples);
+}
+
+void DepthPrepass::EndColorPass()
+{
+    glEndQuery(GL_SAMPLES_PASSED);
+
+    m_Queries[m_Current].pending = true;
+}
+
+const char* OverdrawCounter::GetFragmentShaderSource()
+{
+    return s_OverdrawFragmentShader;
+}
+
+void OverdrawCounter::Initialize()
+{
+    GpuResourceTracker& resources = GpuResourceTracker::GetGlobal();
+
+    for (GLuint& buffer : m_Buffers)
+    {
+        buffer = resources.CreateBuffer(GpuResourceCategory::Staging, sizeof(GLuint), nullptr, GL_DYNAMIC_STORAGE_BIT);
+    }
+    m_Next = 0;
+    m_Issued = 0;
+    m_LatestFragments = -1;
+}
+
+void OverdrawCounter::Cleanup()
+{
+    for (GLuint& buffer : m_Buffers)
+    {
+        GpuResourceTracker::GetGlobal().DeleteBuffer(buffer);
+    }
+}
+
+void OverdrawCounter::BeginFrame()
+{
+    const GLuint buffer = m_Buffers[m_Next];
+
+    if (m_Issued >= s_Latency)
+    {
+        GLuint fragments = 0;
+        glGetNamedBufferSubData(buffer, 0, sizeof(GLuint), &fragments);
+        m_LatestFragments = fragments;
+    }
+
+    const GLuint zero = 0;
+    glNamedBufferSubData(buffer, 0, sizeof(GLuint), &zero);
+    glBindBufferBase(GL_ATOMIC_COUNTER_BUFFER, 0, buffer);
+}
+
+void OverdrawCounter::EndFrame()
+{
+    glBindBufferBase(GL_ATOMIC_COUNTER_BUFFER, 0, 0);
+    m_Next = (m_Next + 1) % s_Latency;
+    ++m_Issued;
+}
+
+END_VISUALIZER_NAMESPACE
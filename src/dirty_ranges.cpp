@@ -0,0 +1,59 @@
+#include <algorithm>
+
+#include "dirty_ranges.hpp"
+
+BEGIN_VISUALIZER_NAMESPACE
+
+void DirtyRanges::Add(uint32_t first, uint32_t count)
+{
+    if (count == 0)
+    {
+        return;
+    }
+
+    if (!m_Ranges.empty())
+    {
+        Range& last = m_Ranges.back();
+
+        if (first >= last.first && first <= last.first + last.count + m_MergeGap)
+        {
+            last.count = std::max(last.count, first + count - last.first);
+            return;
+        }
+        m_Sorted = m_Sorted && first > last.first;
+    }
+
+    m_Ranges.push_back({ first, count });
+}
+
+std::span<const DirtyRanges::Range> DirtyRanges::Coalesce()
+{
+    if (m_Ranges.size() < 2 || m_Sorted)
+    {
+        return m_Ranges;
+    }
+
+    std::sort(m_Ranges.begin(), m_Ranges.end(), [](const Range& a, const Range& b) { return a.first < b.first; });
+
+    size_t merged = 0;
+    for (size_t i = 1; i < m_Ranges.size(); ++i)
+    {
+        Range& last = m_Ranges[merged];
+        const Range& range = m_Ranges[i];
+
+        if (range.first <= last.first + last.count + m_MergeGap)
+        {
+            last.count = std::max(last.count, range.first + range.count - last.first);
+        }
+        else
+        {
+            m_Ranges[++merged] = range;
+        }
+    }
+
+    m_Ranges.resize(merged + 1);
+    m_Sorted = true;
+    return m_Ranges;
+}
+
+END_VISUALIZER_NAMESPACE
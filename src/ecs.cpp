@@ -0,0 +1,336 @@
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <new>
+
+#include "ecs.hpp"
+
+BEGIN_VISUALIZER_NAMESPACE
+
+namespace
+{
+    constexpr size_t s_ChunkAlignment = 64;
+
+    // Written once per id under the mutex, before the id is handed out
+    std::array<ComponentInfo, s_MaxComponentTypes> s_ComponentInfos;
+    std::atomic<uint32_t> s_ComponentCount{ 0 };
+    std::mutex s_RegistryMutex;
+
+    inline size_t AlignUp(size_t value, size_t alignment)
+    {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+}
+
+uint32_t RegisterComponent(const ComponentInfo& info)
+{
+    std::lock_guard<std::mutex> lock(s_RegistryMutex);
+
+    const uint32_t id = s_ComponentCount.load(std::memory_order_relaxed);
+    if (id == s_MaxComponentTypes)
+    {
+        std::cerr << "More than " << s_MaxComponentTypes << " component types\n";
+        std::abort();
+    }
+
+    s_ComponentInfos[id] = info;
+    s_ComponentCount.store(id + 1, std::memory_order_release);
+    return id;
+}
+
+const ComponentInfo& GetComponentInfo(uint32_t id)
+{
+    return s_ComponentInfos[id];
+}
+
+void Archetype::Chunk::Free::operator()(std::byte* data) const
+{
+    ::operator delete[](data, std::align_val_t(s_ChunkAlignment));
+}
+
+Archetype::Archetype(ComponentMask mask) :
+    m_Mask(mask)
+{
+    m_Columns.fill(s_NoColumn);
+
+    size_t bytesPerEntity = sizeof(Entity);
+    size_t padding = 0;
+
+    for (uint32_t id = 0; id < s_MaxComponentTypes; ++id)
+    {
+        if (mask & (ComponentMask(1) << id))
+        {
+            m_Columns[id] = static_cast<uint8_t>(m_Components.size());
+            m_Components.push_back(id);
+
+            const ComponentInfo& info = GetComponentInfo(id);
+            bytesPerEntity += info.size;
+            padding += info.alignment;
+        }
+    }
+
+    // Padding is overestimated, every column may need a full alignment
+    m_Capacity = static_cast<uint32_t>(std::max<size_t>(1, (s_ChunkSize - padding) / bytesPerEntity));
+
+    // Entities first, then one array per component
+    size_t offset = sizeof(Entity) * m_Capacity;
+    for (uint32_t id : m_Components)
+    {
+        const ComponentInfo& info = GetComponentInfo(id);
+        offset = AlignUp(offset, info.alignment);
+        m_Offsets.push_back(offset);
+        m_Sizes.push_back(info.size);
+        offset += static_cast<size_t>(info.size) * m_Capacity;
+    }
+}
+
+void Archetype::Allocate(Entity entity, uint32_t& chunk, uint32_t& row)
+{
+    if (m_Chunks.empty() || m_Chunks.back().count == m_Capacity)
+    {
+        Chunk& added = m_Chunks.emplace_back();
+        added.data.reset(static_cast<std::byte*>(::operator new[](std::max(s_ChunkSize, m_Offsets.empty() ? 0 : m_Offsets.back() + m_Sizes.back() * m_Capacity), std::align_val_t(s_ChunkAlignment))));
+    }
+
+    chunk = static_cast<uint32_t>(m_Chunks.size() - 1);
+    row = m_Chunks.back().count++;
+    GetEntities(chunk)[row] = entity;
+    ++m_EntityCount;
+}
+
+bool Archetype::Remove(uint32_t chunk, uint32_t row, Entity& moved)
+{
+    const uint32_t lastChunk = static_cast<uint32_t>(m_Chunks.size() - 1);
+    const uint32_t lastRow = m_Chunks.back().count - 1;
+    const bool moves = chunk != lastChunk || row != lastRow;
+
+    if (moves)
+    {
+        moved = GetEntities(lastChunk)[lastRow];
+        GetEntities(chunk)[row] = moved;
+
+        for (uint32_t id : m_Components)
+        {
+            std::memcpy(GetComponent(chunk, row, id), GetComponent(lastChunk, lastRow, id), m_Sizes[m_Columns[id]]);
+        }
+    }
+
+    if (--m_Chunks.back().count == 0)
+    {
+        m_Chunks.pop_back();
+    }
+    --m_EntityCount;
+
+    return moves;
+}
+
+void Archetype::Clear()
+{
+    m_Chunks.clear();
+    m_EntityCount = 0;
+}
+
+Entity World::CreateEntity(ComponentMask mask)
+{
+    uint32_t index;
+    if (!m_FreeIndices.empty())
+    {
+        index = m_FreeIndices.back();
+        m_FreeIndices.pop_back();
+    }
+    else
+    {
+        index = static_cast<uint32_t>(m_Records.size());
+        m_Records.emplace_back();
+    }
+
+    EntityRecord& record = m_Records[index];
+    const Entity entity{ index, record.generation };
+
+    record.archetype = GetArchetype(mask);
+    m_Archetypes[record.archetype]->Allocate(entity, record.chunk, record.row);
+
+    return entity;
+}
+
+void World::Destroy(Entity entity)
+{
+    if (!IsAlive(entity))
+    {
+        return;
+    }
+
+    EntityRecord& record = m_Records[entity.index];
+    Entity moved;
+
+    if (m_Archetypes[record.archetype]->Remove(record.chunk, record.row, moved))
+    {
+        m_Records[moved.index].chunk = record.chunk;
+        m_Records[moved.index].row = record.row;
+    }
+
+    // A new generation makes the handles still around stale
+    ++record.generation;
+    m_FreeIndices.push_back(entity.index);
+}
+
+void World::Clear()
+{
+    for (std::unique_ptr<Archetype>& archetype : m_Archetypes)
+    {
+        archetype->Clear();
+    }
+
+    m_FreeIndices.clear();
+    for (uint32_t index = 0; index < m_Records.size(); ++index)
+    {
+        ++m_Records[index].generation;
+        m_FreeIndices.push_back(static_cast<uint32_t>(m_Records.size()) - 1 - index);
+    }
+}
+
+bool World::IsAlive(Entity entity) const
+{
+    // Freed records moved on to the next generation
+    return entity.index < m_Records.size() && m_Records[entity.index].generation == entity.generation;
+}
+
+ComponentMask World::GetMask(Entity entity) const
+{
+    return IsAlive(entity) ? m_Archetypes[m_Records[entity.index].archetype]->GetMask() : 0;
+}
+
+void World::SetMask(Entity entity, ComponentMask mask)
+{
+    if (!IsAlive(entity))
+    {
+        return;
+    }
+
+    EntityRecord& record = m_Records[entity.index];
+    Archetype& from = *m_Archetypes[record.archetype];
+
+    if (from.GetMask() == mask)
+    {
+        return;
+    }
+
+    const uint32_t target = GetArchetype(mask);
+    Archetype& to = *m_Archetypes[target];
+
+    uint32_t chunk, row;
+    to.Allocate(entity, chunk, row);
+
+    for (uint32_t id : to.GetComponents())
+    {
+        if (const std::byte* source = from.GetComponent(record.chunk, record.row, id))
+        {
+            std::memcpy(to.GetComponent(chunk, row, id), source, GetComponentInfo(id).size);
+        }
+    }
+
+    Entity moved;
+    if (from.Remove(record.chunk, record.row, moved))
+    {
+        m_Records[moved.index].chunk = record.chunk;
+        m_Records[moved.index].row = record.row;
+    }
+
+    record.archetype = target;
+    record.chunk = chunk;
+    record.row = row;
+}
+
+uint32_t World::GetArchetype(ComponentMask mask)
+{
+    auto it = m_ArchetypeIndices.find(mask);
+    if (it != m_ArchetypeIndices.end())
+    {
+        return it->second;
+    }
+
+    const uint32_t index = static_cast<uint32_t>(m_Archetypes.size());
+    m_Archetypes.push_back(std::make_unique<Archetype>(mask));
+    m_ArchetypeIndices.emplace(mask, index);
+    return index;
+}
+
+std::byte* World::GetComponent(Entity entity, uint32_t component) const
+{
+    if (!IsAlive(entity))
+    {
+        return nullptr;
+    }
+
+    const EntityRecord& record = m_Records[entity.index];
+    return m_Archetypes[record.archetype]->GetComponent(record.chunk, record.row, component);
+}
+
+void World::PrintReport(std::ostream& os) const
+{
+    os << "Entities: " << GetEntityCount() << " in " << m_Archetypes.size() << " archetypes\n";
+
+    for (const std::unique_ptr<Archetype>& archetype : m_Archetypes)
+    {
+        const size_t chunks = archetype->GetChunks().size();
+        const double fill = chunks > 0 ? 100.0 * static_cast<double>(archetype->GetEntityCount()) / static_cast<double>(chunks * archetype->GetCapacity()) : 0.0;
+
+        os << "  components 0x" << std::hex << std::setw(16) << std::setfill('0') << archetype->GetMask() << std::dec << std::setfill(' ') << ": "
+           << archetype->GetEntityCount() << " entities, " << chunks << " chunks of " << archetype->GetCapacity() << ", " << std::fixed
+           << std::setprecision(1) << fill << "% full\n";
+    }
+}
+
+void SystemScheduler::Add(std::string name, const SystemAccess& access, SystemFunction function)
+{
+    size_t stage = 0;
+    for (const System& earlier : m_Systems)
+    {
+        if (earlier.access.ConflictsWith(access))
+        {
+            stage = std::max(stage, earlier.stage + 1);
+        }
+    }
+
+    if (stage == m_Stages.size())
+    {
+        m_Stages.emplace_back();
+    }
+    m_Stages[stage].push_back(m_Systems.size());
+    m_Systems.push_back({ std::move(name), access, std::move(function), stage });
+}
+
+void SystemScheduler::Run(World& world, ThreadPool& pool)
+{
+    for (const std::vector<size_t>& stage : m_Stages)
+    {
+        if (stage.size() == 1)
+        {
+            m_Systems[stage[0]].function(world, pool);
+            continue;
+        }
+
+        pool.ParallelFor(stage.size(), [this, &stage, &world, &pool](size_t i)
+        {
+            m_Systems[stage[i]].function(world, pool);
+        });
+    }
+}
+
+void SystemScheduler::PrintSchedule(std::ostream& os) const
+{
+    for (size_t stage = 0; stage < m_Stages.size(); ++stage)
+    {
+        os << "Stage " << stage << ':';
+        for (size_t system : m_Stages[stage])
+        {
+            os << ' ' << m_Systems[system].name;
+        }
+        os << '\n';
+    }
+}
+
+END_VISUALIZER_NAMESPACE
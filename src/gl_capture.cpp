@@ -0,0 +1,801 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <utility>
+
+#define VISUALIZER_GL_CAPTURE_IMPLEMENTATION
+#include "gl_capture.hpp"
+#include "statistics.hpp"
+
+BEGIN_VISUALIZER_NAMESPACE
+
+namespace
+{
+    // Enough for a few hundred frames of the palm scene without growing
+    constexpr size_t s_ReservedStreamBytes = 16 << 20;
+    // glBlitNamedFramebuffer takes the most
+    constexpr size_t s_MaxArguments = 12;
+
+    template<typename T>
+    inline T DecodeGlArgument(uint64_t value)
+    {
+        if constexpr (std::is_pointer_v<T>)
+        {
+            return reinterpret_cast<T>(static_cast<uintptr_t>(value));
+        }
+        else if constexpr (std::is_same_v<T, float>)
+        {
+            return std::bit_cast<float>(static_cast<uint32_t>(value));
+        }
+        else if constexpr (std::is_same_v<T, double>)
+        {
+            return std::bit_cast<double>(value);
+        }
+        else if constexpr (std::is_signed_v<T>)
+        {
+            return static_cast<T>(static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1));
+        }
+        else
+        {
+            return static_cast<T>(value);
+        }
+    }
+
+    template<typename Function>
+    struct GlSignature;
+
+    template<typename R, typename... Args>
+    struct GlSignature<R(GLAPIENTRY*)(Args...)>
+    {
+        static constexpr uint8_t s_ArgumentCount = sizeof...(Args);
+
+        template<size_t... I>
+        static void Invoke(R(GLAPIENTRY* function)(Args...), const uint64_t* arguments, std::index_sequence<I...>)
+        {
+            function(DecodeGlArgument<Args>(arguments[I])...);
+        }
+
+        static void Invoke(R(GLAPIENTRY* function)(Args...), const uint64_t* arguments)
+        {
+            Invoke(function, arguments, std::index_sequence_for<Args...>{});
+        }
+    };
+
+    struct GlCallInfo
+    {
+        const char* name;
+        GlCallCategory category;
+        uint8_t argumentCount;
+    };
+
+    constexpr GlCallInfo s_CallInfos[] =
+    {
+#define VISUALIZER_GL_POINTER_INFO(name, category) { "gl" #name, GlCallCategory::category, GlSignature<decltype(__glew##name)>::s_ArgumentCount },
+#define VISUALIZER_GL_CORE_INFO(name, category) { "gl" #name, GlCallCategory::category, GlSignature<decltype(&::gl##name)>::s_ArgumentCount },
+        VISUALIZER_GL_POINTER_CALLS(VISUALIZER_GL_POINTER_INFO)
+        VISUALIZER_GL_CORE_CALLS(VISUALIZER_GL_CORE_INFO)
+#undef VISUALIZER_GL_POINTER_INFO
+#undef VISUALIZER_GL_CORE_INFO
+        { "frame end", GlCallCategory::Count, 0 }
+    };
+
+    static_assert(std::size(s_CallInfos) == s_GlCallCount);
+    // Replay decodes the arguments into an array of s_MaxArguments
+    static_assert(std::all_of(std::begin(s_CallInfos), std::end(s_CallInfos), [](const GlCallInfo& info) { return info.argumentCount <= s_MaxArguments; }));
+
+    // Calls followed by a payload in the stream: the bytes behind their
+    // data argument, or what was written through a mapping before a copy
+    // out of it or a flush of it
+    bool HasPayload(GlCall call)
+    {
+        switch (call)
+        {
+        case GlCall::NamedBufferSubData:
+        case GlCall::ProgramUniform3fv:
+        case GlCall::ClearNamedBufferData:
+        case GlCall::ClearNamedBufferSubData:
+        case GlCall::CopyNamedBufferSubData:
+        case GlCall::FlushMappedNamedBufferRange:
+            return true;
+        default:
+            return false;
+        }
+    }
+
+    // Argument pointing at the payload, if the call takes it from one
+    int32_t GetDataArgument(GlCall call)
+    {
+        switch (call)
+        {
+        case GlCall::NamedBufferSubData:
+        case GlCall::ProgramUniform3fv:
+            return 3;
+        case GlCall::ClearNamedBufferData:
+            return 4;
+        case GlCall::ClearNamedBufferSubData:
+            return 6;
+        default:
+            return -1;
+        }
+    }
+
+    // Argument the call writes its result to
+    int32_t GetResultArgument(GlCall call)
+    {
+        switch (call)
+        {
+        case GlCall::GetQueryObjectuiv:
+        case GlCall::GetQueryObjectui64v:
+            return 2;
+        case GlCall::GetNamedBufferSubData:
+            return 3;
+        default:
+            return -1;
+        }
+    }
+
+    // Size of one clear value, 0 for formats the renderer never clears with
+    size_t GetClearValueSize(GLenum format, GLenum type)
+    {
+        size_t components;
+        switch (format)
+        {
+        case GL_RED:
+        case GL_RED_INTEGER:
+            components = 1;
+            break;
+        case GL_RG:
+        case GL_RG_INTEGER:
+            components = 2;
+            break;
+        case GL_RGB:
+        case GL_RGB_INTEGER:
+            components = 3;
+            break;
+        case GL_RGBA:
+        case GL_RGBA_INTEGER:
+            components = 4;
+            break;
+        default:
+            return 0;
+        }
+
+        switch (type)
+        {
+        case GL_BYTE:
+        case GL_UNSIGNED_BYTE:
+            return components;
+        case GL_SHORT:
+        case GL_UNSIGNED_SHORT:
+            return components * 2;
+        case GL_INT:
+        case GL_UNSIGNED_INT:
+        case GL_FLOAT:
+            return components * 4;
+        default:
+            return 0;
+        }
+    }
+
+    // Where the buffer is mapped, with the offset the mapping starts at,
+    // nullptr when it is not mapped
+    char* GetMapping(GLuint buffer, GLintptr& mapOffset)
+    {
+        GLint mapped = GL_FALSE;
+        glGetNamedBufferParameteriv(buffer, GL_BUFFER_MAPPED, &mapped);
+
+        if (!mapped)
+        {
+            return nullptr;
+        }
+
+        GLint64 offset = 0;
+        void* data = nullptr;
+        glGetNamedBufferParameteri64v(buffer, GL_BUFFER_MAP_OFFSET, &offset);
+        glGetNamedBufferPointerv(buffer, GL_BUFFER_MAP_POINTER, &data);
+
+        mapOffset = static_cast<GLintptr>(offset);
+        return static_cast<char*>(data);
+    }
+
+    // Bytes of a mapping a copy or a flush is about to hand to the GPU
+    char* GetMappedSource(GlCall call, const uint64_t* arguments, size_t& size)
+    {
+        GLintptr mapOffset = 0;
+
+        if (call == GlCall::CopyNamedBufferSubData)
+        {
+            char* mapping = GetMapping(DecodeGlArgument<GLuint>(arguments[0]), mapOffset);
+            const GLintptr readOffset = DecodeGlArgument<GLintptr>(arguments[2]);
+
+            size = static_cast<size_t>(DecodeGlArgument<GLsizeiptr>(arguments[4]));
+            return mapping && readOffset >= mapOffset ? mapping + (readOffset - mapOffset) : nullptr;
+        }
+
+        char* mapping = GetMapping(DecodeGlArgument<GLuint>(arguments[0]), mapOffset);
+
+        size = static_cast<size_t>(DecodeGlArgument<GLsizeiptr>(arguments[2]));
+        return mapping ? mapping + DecodeGlArgument<GLintptr>(arguments[1]) : nullptr;
+    }
+
+    size_t GetPayloadSize(GlCall call, const uint64_t* arguments)
+    {
+        switch (call)
+        {
+        case GlCall::NamedBufferSubData:
+            return static_cast<size_t>(DecodeGlArgument<GLsizeiptr>(arguments[2]));
+        case GlCall::ProgramUniform3fv:
+            return static_cast<size_t>(DecodeGlArgument<GLsizei>(arguments[2])) * 3 * sizeof(GLfloat);
+        case GlCall::ClearNamedBufferData:
+            return GetClearValueSize(DecodeGlArgument<GLenum>(arguments[2]), DecodeGlArgument<GLenum>(arguments[3]));
+        case GlCall::ClearNamedBufferSubData:
+            return GetClearValueSize(DecodeGlArgument<GLenum>(arguments[4]), DecodeGlArgument<GLenum>(arguments[5]));
+        default:
+            return 0;
+        }
+    }
+
+    bool ReadVarint(std::span<const std::byte> data, size_t& offset, uint64_t& value)
+    {
+        value = 0;
+        for (uint32_t shift = 0; shift < 64 && offset < data.size(); shift += 7)
+        {
+            const uint8_t byte = std::to_integer<uint8_t>(data[offset++]);
+            value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+
+            if (!(byte & 0x80))
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+}
+
+const char* GetGlCallName(GlCall call)
+{
+    return call < GlCall::Count ? s_CallInfos[static_cast<size_t>(call)].name : "unknown";
+}
+
+const char* GetGlCallCategoryName(GlCallCategory category)
+{
+    switch (category)
+    {
+    case GlCallCategory::Bind:
+        return "bind";
+    case GlCallCategory::State:
+        return "state";
+    case GlCallCategory::Draw:
+        return "draw";
+    case GlCallCategory::Upload:
+        return "upload";
+    case GlCallCategory::Query:
+        return "query";
+    case GlCallCategory::Sync:
+        return "sync";
+    default:
+        return "unknown";
+    }
+}
+
+GlCallCategory GetGlCallCategory(GlCall call)
+{
+    return call < GlCall::Count ? s_CallInfos[static_cast<size_t>(call)].category : GlCallCategory::Count;
+}
+
+GlCapture& GlCapture::GetGlobal()
+{
+    static GlCapture capture;
+    return capture;
+}
+
+void GlCapture::StartCounting()
+{
+    m_Counting = true;
+    Install();
+}
+
+void GlCapture::StartWriting(const std::string& path, const std::string& launchArguments, uint32_t frameCount)
+{
+    m_Path = path;
+    m_Writing = frameCount > 0;
+    m_FramesLeft = frameCount;
+    m_FramesWritten = 0;
+    m_CallsWritten = 0;
+
+    m_Stream.clear();
+    m_Stream.reserve(s_ReservedStreamBytes);
+
+    const uint32_t header[] = { s_Magic, s_Version };
+    m_Stream.insert(m_Stream.end(), reinterpret_cast<const uint8_t*>(header), reinterpret_cast<const uint8_t*>(header) + sizeof(header));
+    WritePayload(launchArguments.data(), launchArguments.size());
+
+    Install();
+}
+
+bool GlCapture::Stop()
+{
+    bool succeeded = true;
+
+    if (m_Writing)
+    {
+        succeeded = Flush();
+        m_Writing = false;
+    }
+
+    m_Counting = false;
+    Uninstall();
+
+    return succeeded;
+}
+
+const GlFrameCalls& GlCapture::EndFrame()
+{
+    m_LastFrame = m_Frame;
+    m_Frame = GlFrameCalls{};
+
+    if (m_Writing)
+    {
+        WriteVarint(static_cast<uint64_t>(GlCall::FrameEnd));
+        ++m_FramesWritten;
+
+        if (--m_FramesLeft == 0)
+        {
+            if (!Flush())
+            {
+                std::cerr << "GL capture to " << m_Path << " failed\n";
+            }
+            m_Writing = false;
+
+            if (!m_Counting)
+            {
+                Uninstall();
+            }
+        }
+    }
+
+    return m_LastFrame;
+}
+
+void GlCapture::Record(GlCall call, const uint64_t* arguments, size_t count)
+{
+    ++m_Frame.calls[static_cast<size_t>(call)];
+    ++m_Frame.categories[static_cast<size_t>(GetGlCallCategory(call))];
+
+    if (!m_Writing)
+    {
+        return;
+    }
+
+    WriteVarint(static_cast<uint64_t>(call));
+    for (size_t i = 0; i < count; ++i)
+    {
+        WriteVarint(arguments[i]);
+    }
+    ++m_CallsWritten;
+
+    if (!HasPayload(call))
+    {
+        return;
+    }
+
+    const int32_t dataArgument = GetDataArgument(call);
+    size_t size = 0;
+    const void* data = nullptr;
+
+    if (dataArgument >= 0)
+    {
+        data = reinterpret_cast<const void*>(static_cast<uintptr_t>(arguments[dataArgument]));
+        size = data ? GetPayloadSize(call, arguments) : 0;
+    }
+    else
+    {
+        data = GetMappedSource(call, arguments, size);
+        size = data ? size : 0;
+    }
+
+    WritePayload(data, size);
+}
+
+void GlCapture::Install()
+{
+    if (m_Installed)
+    {
+        return;
+    }
+
+    // Entry points the context lacks stay null
+#define VISUALIZER_GL_INSTALL(name, category) \
+    if (__glew##name) \
+    { \
+        GlPointerHook<GlCall::name, decltype(__glew##name)>::s_Next = __glew##name; \
+        __glew##name = &GlPointerHook<GlCall::name, decltype(__glew##name)>::Invoke; \
+    }
+    VISUALIZER_GL_POINTER_CALLS(VISUALIZER_GL_INSTALL)
+#undef VISUALIZER_GL_INSTALL
+
+    m_Installed = true;
+    s_Active = true;
+}
+
+void GlCapture::Uninstall()
+{
+    if (!m_Installed)
+    {
+        return;
+    }
+
+#define VISUALIZER_GL_UNINSTALL(name, category) \
+    if (__glew##name) \
+    { \
+        __glew##name = GlPointerHook<GlCall::name, decltype(__glew##name)>::s_Next; \
+    }
+    VISUALIZER_GL_POINTER_CALLS(VISUALIZER_GL_UNINSTALL)
+#undef VISUALIZER_GL_UNINSTALL
+
+    m_Installed = false;
+    s_Active = false;
+}
+
+void GlCapture::WriteVarint(uint64_t value)
+{
+    while (value >= 0x80)
+    {
+        m_Stream.push_back(static_cast<uint8_t>(value) | 0x80);
+        value >>= 7;
+    }
+    m_Stream.push_back(static_cast<uint8_t>(value));
+}
+
+void GlCapture::WritePayload(const void* data, size_t size)
+{
+    WriteVarint(size);
+    if (size > 0)
+    {
+        m_Stream.insert(m_Stream.end(), static_cast<const uint8_t*>(data), static_cast<const uint8_t*>(data) + size);
+    }
+}
+
+bool GlCapture::Flush()
+{
+    std::ofstream ofs(m_Path, std::ios::binary | std::ios::trunc);
+
+    if (!ofs)
+    {
+        std::cerr << "Cannot open file : " << m_Path << '\n';
+        return false;
+    }
+
+    ofs.write(reinterpret_cast<const char*>(m_Stream.data()), static_cast<std::streamsize>(m_Stream.size()));
+
+    if (!ofs)
+    {
+        std::cerr << "Cannot write file : " << m_Path << '\n';
+        return false;
+    }
+
+    std::cout << "GL capture: " << m_FramesWritten << " frames, " << m_CallsWritten << " calls, " << m_Stream.size() << " bytes saved to " << m_Path << '\n';
+
+    m_Stream.clear();
+    m_Stream.shrink_to_fit();
+    return true;
+}
+
+GlCallBudget::GlCallBudget(uint32_t maxStateChanges, uint32_t warmupFrames) :
+    m_MaxStateChanges(maxStateChanges),
+    m_Warmup(warmupFrames)
+{}
+
+void GlCallBudget::EndFrame(const GlFrameCalls& calls)
+{
+    const uint32_t frame = m_Frame++;
+
+    if (frame < m_Warmup)
+    {
+        return;
+    }
+
+    const uint32_t stateChanges = calls.GetStateChanges();
+
+    ++m_FramesChecked;
+    if (stateChanges > m_MaxStateChanges)
+    {
+        ++m_FramesOver;
+    }
+    if (stateChanges > m_Worst)
+    {
+        m_Worst = stateChanges;
+        m_WorstFrame = frame;
+    }
+}
+
+void GlCallBudget::PrintReport(std::ostream& os) const
+{
+    os << "GL call budget: " << m_FramesOver << " of " << m_FramesChecked << " frames over " << m_MaxStateChanges << " state changes, worst " << m_Worst
+       << " at frame " << m_WorstFrame << (HasFailed() ? " - FAILED\n" : "\n");
+}
+
+bool GlCaptureFile::Load(const std::string& path)
+{
+    m_Data = {};
+    m_Frames.clear();
+
+    if (!m_File.Open(path, FileAccess::Repeated))
+    {
+        return false;
+    }
+    m_Data = m_File.GetBytes();
+
+    auto invalid = [&path](size_t offset)
+    {
+        std::cerr << "Invalid GL capture " << path << " at byte " << offset << '\n';
+        return false;
+    };
+
+    uint32_t header[2] = {};
+    if (m_Data.size() < sizeof(header))
+    {
+        return invalid(0);
+    }
+
+    std::memcpy(header, m_Data.data(), sizeof(header));
+    if (header[0] != GlCapture::s_Magic || header[1] != GlCapture::s_Version)
+    {
+        std::cerr << "Not a GL capture of version " << GlCapture::s_Version << ": " << path << '\n';
+        return false;
+    }
+
+    size_t offset = sizeof(header);
+    uint64_t size;
+
+    if (!ReadVarint(m_Data, offset, size) || size > m_Data.size() - offset)
+    {
+        return invalid(offset);
+    }
+    m_LaunchArguments.assign(reinterpret_cast<const char*>(m_Data.data() + offset), static_cast<size_t>(size));
+    offset += static_cast<size_t>(size);
+
+    Frame frame{ offset, offset, {} };
+
+    while (offset < m_Data.size())
+    {
+        uint64_t id;
+        if (!ReadVarint(m_Data, offset, id) || id >= s_GlCallCount)
+        {
+            return invalid(offset);
+        }
+
+        const GlCall call = static_cast<GlCall>(id);
+
+        if (call == GlCall::FrameEnd)
+        {
+            frame.end = offset;
+            m_Frames.push_back(frame);
+            frame = Frame{ offset, offset, {} };
+            continue;
+        }
+
+        uint64_t argument;
+        for (uint8_t i = 0; i < s_CallInfos[id].argumentCount; ++i)
+        {
+            if (!ReadVarint(m_Data, offset, argument))
+            {
+                return invalid(offset);
+            }
+        }
+
+        if (HasPayload(call))
+        {
+            if (!ReadVarint(m_Data, offset, size) || size > m_Data.size() - offset)
+            {
+                return invalid(offset);
+            }
+            offset += static_cast<size_t>(size);
+        }
+
+        ++frame.calls.calls[id];
+        ++frame.calls.categories[static_cast<size_t>(s_CallInfos[id].category)];
+    }
+
+    // Calls after the last frame end belong to a frame cut short, dropped
+    if (m_Frames.empty())
+    {
+        std::cerr << "No complete frame in GL capture " << path << '\n';
+        return false;
+    }
+
+    return true;
+}
+
+void GlCaptureFile::PrintReport(std::ostream& os) const
+{
+    const std::ios_base::fmtflags flags = os.flags();
+    const std::streamsize precision = os.precision();
+    const double frameCount = static_cast<double>(m_Frames.size());
+
+    os << std::fixed << std::setprecision(1) << "GL capture: " << m_Frames.size() << " frames\n";
+    os << "  " << std::left << std::setw(36) << "call" << std::setw(8) << "kind" << std::right << std::setw(10) << "per frame" << std::setw(8) << "min"
+       << std::setw(8) << "max\n";
+
+    for (size_t call = 0; call + 1 < s_GlCallCount; ++call)
+    {
+        uint64_t total = 0;
+        uint32_t min = UINT32_MAX;
+        uint32_t max = 0;
+
+        for (const Frame& frame : m_Frames)
+        {
+            total += frame.calls.calls[call];
+            min = std::min(min, frame.calls.calls[call]);
+            max = std::max(max, frame.calls.calls[call]);
+        }
+
+        if (total > 0)
+        {
+            os << "  " << std::left << std::setw(36) << s_CallInfos[call].name << std::setw(8) << GetGlCallCategoryName(s_CallInfos[call].category) << std::right
+               << std::setw(10) << total / frameCount << std::setw(8) << min << std::setw(8) << max << '\n';
+        }
+    }
+
+    for (size_t category = 0; category < s_GlCallCategoryCount; ++category)
+    {
+        std::vector<double> counts;
+        counts.reserve(m_Frames.size());
+
+        for (const Frame& frame : m_Frames)
+        {
+            counts.push_back(frame.calls.categories[category]);
+        }
+
+        const Summary summary = Summarize(counts);
+        os << "  " << GetGlCallCategoryName(static_cast<GlCallCategory>(category)) << " calls per frame: mean " << summary.mean << ", p50 " << summary.p50
+           << ", p95 " << summary.p95 << ", max " << summary.max << '\n';
+    }
+
+    std::vector<double> stateChanges;
+    stateChanges.reserve(m_Frames.size());
+
+    for (const Frame& frame : m_Frames)
+    {
+        stateChanges.push_back(frame.calls.GetStateChanges());
+    }
+
+    const Summary summary = Summarize(stateChanges);
+    os << "  state changes per frame: mean " << summary.mean << ", p50 " << summary.p50 << ", p95 " << summary.p95 << ", max " << summary.max << '\n';
+
+    os.flags(flags);
+    os.precision(precision);
+}
+
+void GlCaptureFile::ReplayFrame(size_t frameIndex) const
+{
+    const Frame& frame = m_Frames[frameIndex];
+    size_t offset = frame.begin;
+
+    while (offset < frame.end)
+    {
+        uint64_t id;
+        ReadVarint(m_Data, offset, id);
+
+        const GlCall call = static_cast<GlCall>(id);
+
+        if (call == GlCall::FrameEnd)
+        {
+            continue;
+        }
+
+        uint64_t arguments[s_MaxArguments];
+        for (uint8_t i = 0; i < s_CallInfos[id].argumentCount; ++i)
+        {
+            ReadVarint(m_Data, offset, arguments[i]);
+        }
+
+        const uint8_t* payload = nullptr;
+        uint64_t payloadSize = 0;
+
+        if (HasPayload(call))
+        {
+            ReadVarint(m_Data, offset, payloadSize);
+            payload = reinterpret_cast<const uint8_t*>(m_Data.data()) + offset;
+            offset += static_cast<size_t>(payloadSize);
+        }
+
+        // Sync objects of the capture do not exist here, nor does waiting
+        // on them change what the GPU is given
+        if (s_CallInfos[id].category == GlCallCategory::Sync)
+        {
+            continue;
+        }
+
+        const int32_t dataArgument = GetDataArgument(call);
+        const int32_t resultArgument = GetResultArgument(call);
+
+        if (dataArgument >= 0)
+        {
+            arguments[dataArgument] = payloadSize > 0 ? reinterpret_cast<uintptr_t>(payload) : 0;
+        }
+        else if (payloadSize > 0)
+        {
+            // Same buffers mapped the same way as in the capture, as the
+            // renderer set them up the same
+            size_t size;
+            if (char* mapped = GetMappedSource(call, arguments, size))
+            {
+                std::memcpy(mapped, payload, std::min<size_t>(size, static_cast<size_t>(payloadSize)));
+            }
+        }
+
+        if (resultArgument >= 0)
+        {
+            const size_t size = call == GlCall::GetNamedBufferSubData ? static_cast<size_t>(DecodeGlArgument<GLsizeiptr>(arguments[2])) : sizeof(GLuint64);
+            if (m_Scratch.size() < size)
+            {
+                m_Scratch.resize(size);
+            }
+            arguments[resultArgument] = reinterpret_cast<uintptr_t>(m_Scratch.data());
+        }
+
+        switch (call)
+        {
+#define VISUALIZER_GL_POINTER_REPLAY(name, category) \
+        case GlCall::name: \
+            GlSignature<decltype(__glew##name)>::Invoke(__glew##name, arguments); \
+            break;
+#define VISUALIZER_GL_CORE_REPLAY(name, category) \
+        case GlCall::name: \
+            GlSignature<decltype(&::gl##name)>::Invoke(&::gl##name, arguments); \
+            break;
+        VISUALIZER_GL_POINTER_CALLS(VISUALIZER_GL_POINTER_REPLAY)
+        VISUALIZER_GL_CORE_CALLS(VISUALIZER_GL_CORE_REPLAY)
+#undef VISUALIZER_GL_POINTER_REPLAY
+#undef VISUALIZER_GL_CORE_REPLAY
+        default:
+            break;
+        }
+    }
+}
+
+void GlCaptureFile::Replay(std::ostream& os, uint32_t iterations) const
+{
+    std::vector<double> submitMs;
+    std::vector<double> finishMs;
+    submitMs.reserve(m_Frames.size() * iterations);
+    finishMs.reserve(m_Frames.size() * iterations);
+
+    // Leave what setting the scene up queued out of the first frame
+    glFinish();
+
+    for (uint32_t iteration = 0; iteration < iterations; ++iteration)
+    {
+        for (size_t frame = 0; frame < m_Frames.size(); ++frame)
+        {
+            const auto start = std::chrono::steady_clock::now();
+            ReplayFrame(frame);
+            const auto submitted = std::chrono::steady_clock::now();
+            glFinish();
+            const auto finished = std::chrono::steady_clock::now();
+
+            submitMs.push_back(std::chrono::duration<double, std::milli>(submitted - start).count());
+            finishMs.push_back(std::chrono::duration<double, std::milli>(finished - start).count());
+        }
+    }
+
+    const Summary submit = Summarize(submitMs);
+    const Summary finish = Summarize(finishMs);
+    const std::ios_base::fmtflags flags = os.flags();
+    const std::streamsize precision = os.precision();
+
+    os << std::fixed << std::setprecision(3) << "GL replay: " << iterations << " iterations of " << m_Frames.size() << " frames\n  submit ms: mean "
+       << submit.mean << ", p50 " << submit.p50 << ", p95 " << submit.p95 << ", max " << submit.max << "\n  until finished ms: mean " << finish.mean << ", p50 "
+       << finish.p50 << ", p95 " << finish.p95 << ", max " << finish.max << '\n';
+
+    os.flags(flags);
+    os.precision(precision);
+}
+
+END_VISUALIZER_NAMESPACE
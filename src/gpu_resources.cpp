@@ -0,0 +1,292 @@
+#include <algorithm>
+#include <iomanip>
+
+#include "gpu_resources.hpp"
+
+BEGIN_VISUALIZER_NAMESPACE
+
+namespace
+{
+    size_t BytesPerTexel(GLenum internalFormat)
+    {
+        switch (internalFormat)
+        {
+        case GL_R8:
+            return 1;
+        case GL_R16F:
+        case GL_RG8:
+        case GL_DEPTH_COMPONENT16:
+            return 2;
+        case GL_RGBA16F:
+        case GL_RG32F:
+            return 8;
+        case GL_RGBA32F:
+            return 16;
+        default:
+            // RGBA8, RG16F, R32F, 32 bit depth formats and anything else
+            return 4;
+        }
+    }
+
+    void PrintBytes(std::ostream& os, size_t bytes)
+    {
+        os << std::fixed << std::setprecision(2) << static_cast<double>(bytes) / (1024.0 * 1024.0) << " MiB";
+    }
+}
+
+const char* GetCategoryName(GpuResourceCategory category)
+{
+    switch (category)
+    {
+    case GpuResourceCategory::MeshVertex:
+        return "mesh vertex";
+    case GpuResourceCategory::MeshIndex:
+        return "mesh index";
+    case GpuResourceCategory::Instance:
+        return "instance";
+    case GpuResourceCategory::Uniform:
+        return "uniform";
+    case GpuResourceCategory::Staging:
+        return "staging";
+    case GpuResourceCategory::Texture:
+        return "texture";
+    case GpuResourceCategory::Program:
+        return "program";
+    case GpuResourceCategory::Lighting:
+        return "lighting";
+    default:
+        return "unknown";
+    }
+}
+
+DriverMemoryInfo QueryDriverMemory()
+{
+    DriverMemoryInfo info;
+
+    if (GLEW_NVX_gpu_memory_info)
+    {
+        GLint available = 0;
+        GLint total = 0;
+
+        glGetIntegerv(GL_GPU_MEMORY_INFO_CURRENT_AVAILABLE_VIDMEM_NVX, &available);
+        glGetIntegerv(GL_GPU_MEMORY_INFO_DEDICATED_VIDMEM_NVX, &total);
+
+        info.source = "GL_NVX_gpu_memory_info";
+        info.availableKiB = available;
+        info.totalKiB = total;
+    }
+    else if (GLEW_ATI_meminfo)
+    {
+        // Total free, largest free block, total free auxiliary, largest auxiliary block
+        GLint free[4] = {};
+
+        glGetIntegerv(GL_VBO_FREE_MEMORY_ATI, free);
+
+        info.source = "GL_ATI_meminfo";
+        info.availableKiB = free[0];
+    }
+
+    return info;
+}
+
+GpuResourceTracker& GpuResourceTracker::GetGlobal()
+{
+    static GpuResourceTracker tracker;
+    return tracker;
+}
+
+GLuint GpuResourceTracker::CreateBuffer(GpuResourceCategory category, size_t size, const void* data, GLbitfield flags)
+{
+    GLuint buffer = 0;
+
+    glCreateBuffers(1, &buffer);
+    glNamedBufferStorage(buffer, static_cast<GLsizeiptr>(size), data, flags);
+
+    Track(Kind::Buffer, buffer, category, size);
+    return buffer;
+}
+
+GLuint GpuResourceTracker::CreateTexture2D(GLenum internalFormat, uint32_t width, uint32_t height, uint32_t levels)
+{
+    GLuint texture = 0;
+
+    glCreateTextures(GL_TEXTURE_2D, 1, &texture);
+    glTextureStorage2D(texture, static_cast<GLsizei>(levels), internalFormat, static_cast<GLsizei>(width), static_cast<GLsizei>(height));
+
+    size_t size = 0;
+    for (uint32_t level = 0; level < levels; ++level)
+    {
+        size += static_cast<size_t>(std::max(width >> level, 1u)) * std::max(height >> level, 1u) * BytesPerTexel(internalFormat);
+    }
+
+    Track(Kind::Texture, texture, GpuResourceCategory::Texture, size);
+    return texture;
+}
+
+void GpuResourceTracker::RegisterProgram(GLuint program)
+{
+    GLint length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+
+    Track(Kind::Program, program, GpuResourceCategory::Program, static_cast<size_t>(std::max(length, 0)));
+}
+
+void GpuResourceTracker::DeleteBuffer(GLuint& buffer)
+{
+    if (buffer)
+    {
+        Untrack(Kind::Buffer, buffer);
+        glDeleteBuffers(1, &buffer);
+        buffer = 0;
+    }
+}
+
+void GpuResourceTracker::DeleteTexture(GLuint& texture)
+{
+    if (texture)
+    {
+        Untrack(Kind::Texture, texture);
+        glDeleteTextures(1, &texture);
+        texture = 0;
+    }
+}
+
+void GpuResourceTracker::DeleteProgram(GLuint& program)
+{
+    if (program)
+    {
+        Untrack(Kind::Program, program);
+        glDeleteProgram(program);
+        program = 0;
+    }
+}
+
+void GpuResourceTracker::Track(Kind kind, GLuint name, GpuResourceCategory category, size_t size)
+{
+    m_Entries[MakeKey(kind, name)] = Entry{ category, size };
+
+    GpuCategoryStats& stats = m_Categories[static_cast<size_t>(category)];
+    ++stats.count;
+    stats.liveBytes += size;
+    stats.peakBytes = std::max(stats.peakBytes, stats.liveBytes);
+
+    m_LiveBytes += size;
+    m_PeakBytes = std::max(m_PeakBytes, m_LiveBytes);
+}
+
+void GpuResourceTracker::Untrack(Kind kind, GLuint name)
+{
+    const auto it = m_Entries.find(MakeKey(kind, name));
+
+    if (it == m_Entries.end())
+    {
+        return;
+    }
+
+    GpuCategoryStats& stats = m_Categories[static_cast<size_t>(it->second.category)];
+    --stats.count;
+    stats.liveBytes -= it->second.size;
+    m_LiveBytes -= it->second.size;
+
+    m_Entries.erase(it);
+}
+
+void GpuResourceTracker::CaptureDriverBaseline()
+{
+    m_DriverBaseline = QueryDriverMemory();
+}
+
+void GpuResourceTracker::PrintReport(std::ostream& os) const
+{
+    os << "GPU memory: ";
+    PrintBytes(os, m_LiveBytes);
+    os << " live, ";
+    PrintBytes(os, m_PeakBytes);
+    os << " peak\n";
+
+    for (size_t i = 0; i < m_Categories.size(); ++i)
+    {
+        const GpuCategoryStats& stats = m_Categories[i];
+
+        if (stats.peakBytes == 0 && stats.count == 0)
+        {
+            continue;
+        }
+
+        os << "  " << std::left << std::setw(12) << GetCategoryName(static_cast<GpuResourceCategory>(i)) << std::right << std::setw(6) << stats.count << "  ";
+        PrintBytes(os, stats.liveBytes);
+        os << " (peak ";
+        PrintBytes(os, stats.peakBytes);
+        os << ")\n";
+    }
+
+    const DriverMemoryInfo driver = QueryDriverMemory();
+
+    if (driver.IsValid())
+    {
+        os << "  driver (" << driver.source << "): ";
+        PrintBytes(os, static_cast<size_t>(driver.availableKiB) * 1024);
+        os << " available";
+
+        // Includes the framebuffer, driver internals and other processes,
+        // so it only bounds what we track from above
+        if (m_DriverBaseline.IsValid())
+        {
+            os << ", ";
+            PrintBytes(os, static_cast<size_t>(std::max<int64_t>(m_DriverBaseline.availableKiB - driver.availableKiB, 0)) * 1024);
+            os << " consumed since startup";
+        }
+        os << '\n';
+    }
+
+    os << std::defaultfloat;
+}
+
+void GpuQueryRing::Initialize(GLenum target)
+{
+    glCreateQueries(target, static_cast<GLsizei>(m_Queries.size()), m_Queries.data());
+    m_Target = target;
+    m_Next = 0;
+    m_Issued = 0;
+    m_Latest = -1;
+}
+
+void GpuQueryRing::Cleanup()
+{
+    if (m_Queries[0])
+    {
+        glDeleteQueries(static_cast<GLsizei>(m_Queries.size()), m_Queries.data());
+        m_Queries.fill(0);
+    }
+}
+
+void GpuQueryRing::Begin()
+{
+    const GLuint query = m_Queries[m_Next];
+    m_Latest = -1;
+
+    // Its last use, s_Latency frames ago, is the one about to be overwritten
+    if (m_Issued >= s_Latency)
+    {
+        GLuint available = GL_FALSE;
+        glGetQueryObjectuiv(query, GL_QUERY_RESULT_AVAILABLE, &available);
+
+        if (available)
+        {
+            GLuint64 result = 0;
+            glGetQueryObjectui64v(query, GL_QUERY_RESULT, &result);
+            m_Latest = static_cast<int64_t>(result);
+        }
+    }
+
+    glBeginQuery(m_Target, query);
+}
+
+void GpuQueryRing::End()
+{
+    glEndQuery(m_Target);
+    m_Next = (m_Next + 1) % s_Latency;
+    ++m_Issued;
+}
+
+END_VISUALIZER_NAMESPACE
@@ -0,0 +1,555 @@
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <iostream>
+#include <string>
+
+#include "gpu_resources.hpp"
+#include "hiz_culler.hpp"
+#include "stats_registry.hpp"
+
+BEGIN_VISUALIZER_NAMESPACE
+
+namespace
+{
+    constexpr uint32_t s_GroupSize2D = 8;
+    constexpr uint32_t s_GroupSize1D = 64;
+    constexpr size_t s_StatCount = 6;
+
+    // Uniform locations of the test shader
+    constexpr GLint s_CountLocation = 0;
+    constexpr GLint s_MeshMinLocation = 1;
+    constexpr GLint s_MeshMaxLocation = 2;
+    constexpr GLint s_LevelsLocation = 3;
+
+    char const* const s_CopyShader =
+        R"(#version 450 core
+
+layout(local_size_x = 8, local_size_y = 8) in;
+
+layout(binding = 0) uniform sampler2D u_Depth;
+layout(binding = 0, r32f) writeonly uniform image2D u_Destination;
+
+void main()
+{
+    ivec2 p = ivec2(gl_GlobalInvocationID.xy);
+
+    if (any(greaterThanEqual(p, imageSize(u_Destination))))
+    {
+        return;
+    }
+    imageStore(u_Destination, p, vec4(texelFetch(u_Depth, p, 0).r));
+}
+)";
+
+    char const* const s_ReduceShader =
+        R"(#version 450 core
+
+layout(local_size_x = 8, local_size_y = 8) in;
+
+layout(binding = 0, r32f) readonly uniform image2D u_Source;
+layout(binding = 1, r32f) writeonly uniform image2D u_Destination;
+
+void main()
+{
+    ivec2 p = ivec2(gl_GlobalInvocationID.xy);
+    ivec2 size = imageSize(u_Destination);
+
+    if (any(greaterThanEqual(p, size)))
+    {
+        return;
+    }
+
+    // Odd sizes leave a last row or column, taken in by the border texels
+    ivec2 sourceSize = imageSize(u_Source);
+    ivec2 last = min(p * 2 + 1 + ivec2(equal(p, size - 1)) * (sourceSize & 1), sourceSize - 1);
+    float depth = 0.0;
+
+    for (int y = p.y * 2; y <= last.y; ++y)
+    {
+        for (int x = p.x * 2; x <= last.x; ++x)
+        {
+            depth = max(depth, imageLoad(u_Source, ivec2(x, y)).r);
+        }
+    }
+    imageStore(u_Destination, p, vec4(depth));
+}
+)";
+
+    char const* const s_TestShader =
+        R"(#version 450 core
+
+layout(local_size_x = 64) in;
+
+layout(std140, binding = 0) uniform Matrix
+{
+    mat4 modelViewProjection;
+};
+
+// InstanceTransform, five floats each
+layout(std430, binding = 0) readonly buffer Instances { float instances[]; };
+layout(std430, binding = 1) buffer Visibility { uint visibility[]; };
+layout(std430, binding = 2) writeonly buffer Draw { float draw[]; };
+layout(std430, binding = 3) buffer Commands { uint commands[]; };
+layout(std430, binding = 4) buffer Stats { uint stats[]; };
+
+layout(binding = 0) uniform sampler2D u_Pyramid;
+
+layout(location = 0) uniform uint u_Count;
+layout(location = 1) uniform vec3 u_MeshMin;
+layout(location = 2) uniform vec3 u_MeshMax;
+layout(location = 3) uniform int u_Levels;
+
+void Append(uint command, uint base, uint i)
+{
+    uint slot = base + atomicAdd(commands[command * 5 + 1], 1u);
+
+    for (uint k = 0; k < 5; ++k)
+    {
+        draw[slot * 5 + k] = instances[i * 5 + k];
+    }
+}
+
+void main()
+{
+    uint i = gl_GlobalInvocationID.x;
+
+    if (i >= u_Count)
+    {
+        return;
+    }
+
+    // Same box as GetInstanceBounds()
+    vec3 position = vec3(instances[i * 5], instances[i * 5 + 1], instances[i * 5 + 2]);
+    float scale = instances[i * 5 + 3];
+    float radius = sqrt(max(u_MeshMin.x * u_MeshMin.x, u_MeshMax.x * u_MeshMax.x) + max(u_MeshMin.z * u_MeshMin.z, u_MeshMax.z * u_MeshMax.z));
+    vec3 a = vec3(-radius, u_MeshMin.y, -radius) * scale;
+    vec3 b = vec3(radius, u_MeshMax.y, radius) * scale;
+    vec3 boxMin = position + min(a, b);
+    vec3 boxMax = position + max(a, b);
+
+    int outside[6] = int[6](0, 0, 0, 0, 0, 0);
+    bool crossesCamera = false;
+    vec3 ndcMin = vec3(1.0);
+    vec3 ndcMax = vec3(-1.0);
+
+    for (int c = 0; c < 8; ++c)
+    {
+        vec3 corner = mix(boxMin, boxMax, vec3(c & 1, (c >> 1) & 1, (c >> 2) & 1));
+        vec4 clip = modelViewProjection * vec4(corner, 1.0);
+
+        outside[0] += int(clip.x < -clip.w);
+        outside[1] += int(clip.x > clip.w);
+        outside[2] += int(clip.y < -clip.w);
+        outside[3] += int(clip.y > clip.w);
+        outside[4] += int(clip.z < -clip.w);
+        outside[5] += int(clip.z > clip.w);
+
+        if (clip.w <= 0.0)
+        {
+            crossesCamera = true;
+        }
+        else
+        {
+            vec3 ndc = clip.xyz / clip.w;
+            ndcMin = min(ndcMin, ndc);
+            ndcMax = max(ndcMax, ndc);
+        }
+    }
+
+    bool frustumCulled = false;
+    for (int plane = 0; plane < 6; ++plane)
+    {
+        frustumCulled = frustumCulled || outside[plane] == 8;
+    }
+
+    // Boxes reaching behind the camera cannot be projected, keep them
+    bool occluded = false;
+    if (!frustumCulled && !crossesCamera)
+    {
+        vec2 size = vec2(textureSize(u_Pyramid, 0));
+        vec2 minPixel = clamp(ndcMin.xy * 0.5 + 0.5, 0.0, 1.0) * size;
+        vec2 maxPixel = clamp(ndcMax.xy * 0.5 + 0.5, 0.0, 1.0) * size;
+        vec2 extent = maxPixel - minPixel;
+
+        // Texels of this level are at least as wide as the box, which then
+        // covers two of them at most in each direction
+        int level = clamp(int(ceil(log2(max(max(extent.x, extent.y), 1.0)))), 0, u_Levels - 1);
+        ivec2 levelSize = textureSize(u_Pyramid, level);
+        ivec2 lo = min(ivec2(minPixel) >> level, levelSize - 1);
+        ivec2 hi = min(ivec2(maxPixel) >> level, levelSize - 1);
+
+        float farthest = max(max(texelFetch(u_Pyramid, lo, level).r, texelFetch(u_Pyramid, ivec2(hi.x, lo.y), level).r),
+                             max(texelFetch(u_Pyramid, ivec2(lo.x, hi.y), level).r, texelFetch(u_Pyramid, hi, level).r));
+
+        occluded = ndcMin.z * 0.5 + 0.5 > farthest;
+    }
+
+    bool visible = !frustumCulled && !occluded;
+    bool wasVisible = visibility[i] != 0u;
+    visibility[i] = visible ? 1u : 0u;
+
+    atomicAdd(stats[0], 1u);
+    if (frustumCulled)
+    {
+        atomicAdd(stats[1], 1u);
+    }
+    else if (occluded)
+    {
+        atomicAdd(stats[2], 1u);
+    }
+
+    if (wasVisible)
+    {
+        atomicAdd(stats[3], 1u);
+        if (!visible)
+        {
+            atomicAdd(stats[5], 1u);
+        }
+    }
+
+    if (visible)
+    {
+        // Drawn by next frame's first pass
+        Append(0u, 0u, i);
+
+        if (!wasVisible)
+        {
+            Append(1u, u_Count, i);
+            atomicAdd(stats[4], 1u);
+        }
+    }
+}
+)";
+
+    GLuint CreateComputeProgram(const char* source, const char* name)
+    {
+        GLuint shader = glCreateShader(GL_COMPUTE_SHADER);
+
+        glShaderSource(shader, 1, &source, nullptr);
+        glCompileShader(shader);
+
+        {
+            GLint length = 0;
+
+            glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &length);
+
+            if (length > 1)
+            {
+                std::string log(length, '\0');
+
+                glGetShaderInfoLog(shader, length, nullptr, log.data());
+
+                std::cerr << name << " shader log:\n" << log << '\n';
+            }
+        }
+
+        GLuint program = glCreateProgram();
+
+        glAttachShader(program, shader);
+        glLinkProgram(program);
+        glDetachShader(program, shader);
+        glDeleteShader(shader);
+
+        GLint linked = GL_FALSE;
+        glGetProgramiv(program, GL_LINK_STATUS, &linked);
+
+        if (linked != GL_TRUE)
+        {
+            std::cerr << "Cannot link the " << name << " shader\n";
+            glDeleteProgram(program);
+            return 0;
+        }
+
+        GpuResourceTracker::GetGlobal().RegisterProgram(program);
+        return program;
+    }
+
+    inline GLuint GroupCount(uint32_t size, uint32_t groupSize)
+    {
+        return (size + groupSize - 1) / groupSize;
+    }
+}
+
+bool HiZCuller::Initialize(uint32_t width, uint32_t height)
+{
+    m_CopyProgram = CreateComputeProgram(s_CopyShader, "Hi-Z copy");
+    m_ReduceProgram = CreateComputeProgram(s_ReduceShader, "Hi-Z reduce");
+    m_TestProgram = CreateComputeProgram(s_TestShader, "Hi-Z test");
+
+    if (!m_CopyProgram || !m_ReduceProgram || !m_TestProgram)
+    {
+        return false;
+    }
+
+    GpuResourceTracker& resources = GpuResourceTracker::GetGlobal();
+
+    m_StatsBuffer = resources.CreateBuffer(GpuResourceCategory::Staging, sizeof(uint32_t) * s_StatCount, nullptr, 0);
+    glClearNamedBufferData(m_StatsBuffer, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+
+    const GLbitfield readbackFlags = GL_MAP_READ_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    m_ReadbackBuffer = resources.CreateBuffer(GpuResourceCategory::Staging, sizeof(uint32_t) * s_StatCount * s_ReadbackFrames, nullptr, readbackFlags);
+    m_Readback = static_cast<const uint32_t*>(glMapNamedBufferRange(m_ReadbackBuffer, 0, sizeof(uint32_t) * s_StatCount * s_ReadbackFrames, readbackFlags));
+
+    if (!m_Readback)
+    {
+        std::cerr << "Cannot map the Hi-Z readback buffer\n";
+        return false;
+    }
+
+    m_Initialized = true;
+    m_Width = width;
+    m_Height = height;
+    CreateTargets();
+
+    return true;
+}
+
+void HiZCuller::Resize(uint32_t width, uint32_t height)
+{
+    if (width == m_Width && height == m_Height)
+    {
+        return;
+    }
+
+    m_Width = width;
+    m_Height = height;
+
+    if (m_Initialized)
+    {
+        DestroyTargets();
+        CreateTargets();
+    }
+}
+
+void HiZCuller::CreateTargets()
+{
+    if (m_Width == 0 || m_Height == 0)
+    {
+        return;
+    }
+
+    GpuResourceTracker& resources = GpuResourceTracker::GetGlobal();
+
+    // Same format as the window's depth buffer, blits need them to match
+    m_DepthTexture = resources.CreateTexture2D(GL_DEPTH_COMPONENT24, m_Width, m_Height, 1);
+    glCreateFramebuffers(1, &m_DepthFramebuffer);
+    glNamedFramebufferTexture(m_DepthFramebuffer, GL_DEPTH_ATTACHMENT, m_DepthTexture, 0);
+
+    if (glCheckNamedFramebufferStatus(m_DepthFramebuffer, GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+    {
+        std::cerr << "Hi-Z depth framebuffer is incomplete\n";
+    }
+
+    m_Levels = std::bit_width(std::max(m_Width, m_Height));
+    m_Pyramid = resources.CreateTexture2D(GL_R32F, m_Width, m_Height, m_Levels);
+    glTextureParameteri(m_Pyramid, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+    glTextureParameteri(m_Pyramid, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+}
+
+void HiZCuller::DestroyTargets()
+{
+    GpuResourceTracker& resources = GpuResourceTracker::GetGlobal();
+
+    glDeleteFramebuffers(1, &m_DepthFramebuffer);
+    m_DepthFramebuffer = 0;
+    resources.DeleteTexture(m_DepthTexture);
+    resources.DeleteTexture(m_Pyramid);
+}
+
+void HiZCuller::Cleanup()
+{
+    GpuResourceTracker& resources = GpuResourceTracker::GetGlobal();
+
+    for (GLsync& fence : m_ReadbackFences)
+    {
+        if (fence)
+        {
+            glDeleteSync(fence);
+            fence = nullptr;
+        }
+    }
+
+    if (m_Readback)
+    {
+        glUnmapNamedBuffer(m_ReadbackBuffer);
+        m_Readback = nullptr;
+    }
+    resources.DeleteBuffer(m_ReadbackBuffer);
+    resources.DeleteBuffer(m_StatsBuffer);
+
+    for (InstanceSet& set : m_Sets)
+    {
+        resources.DeleteBuffer(set.instanceBuffer);
+        resources.DeleteBuffer(set.visibilityBuffer);
+        resources.DeleteBuffer(set.drawBuffer);
+        resources.DeleteBuffer(set.commandBuffer);
+    }
+    m_Sets.clear();
+
+    DestroyTargets();
+
+    resources.DeleteProgram(m_CopyProgram);
+    resources.DeleteProgram(m_ReduceProgram);
+    resources.DeleteProgram(m_TestProgram);
+
+    m_Initialized = false;
+}
+
+size_t HiZCuller::AddInstanceSet(std::span<const InstanceTransform> instances, const glm::vec3& meshMin, const glm::vec3& meshMax, uint32_t indexCount)
+{
+    GpuResourceTracker& resources = GpuResourceTracker::GetGlobal();
+    InstanceSet set;
+
+    set.count = static_cast<uint32_t>(instances.size());
+    set.meshMin = meshMin;
+    set.meshMax = meshMax;
+    set.instanceBuffer = resources.CreateBuffer(GpuResourceCategory::Instance, std::max<size_t>(instances.size_bytes(), 1), instances.data(), 0);
+    set.visibilityBuffer = resources.CreateBuffer(GpuResourceCategory::Instance, sizeof(uint32_t) * std::max<size_t>(instances.size(), 1), nullptr, 0);
+    set.drawBuffer = resources.CreateBuffer(GpuResourceCategory::Instance, 2 * std::max<size_t>(instances.size_bytes(), 1), nullptr, 0);
+
+    // Nothing was visible before the first frame: it is all drawn by the second pass
+    glClearNamedBufferData(set.visibilityBuffer, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+
+    const DrawElementsIndirectCommand commands[2] = {
+        { indexCount, 0, 0, 0, 0 },
+        { indexCount, 0, 0, 0, set.count },
+    };
+    set.commandBuffer = resources.CreateBuffer(GpuResourceCategory::Instance, sizeof(commands), commands, 0);
+
+    m_Sets.push_back(set);
+    return m_Sets.size() - 1;
+}
+
+void HiZCuller::BuildPyramid()
+{
+    glBlitNamedFramebuffer(0, m_DepthFramebuffer, 0, 0, m_Width, m_Height, 0, 0, m_Width, m_Height, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+
+    glUseProgram(m_CopyProgram);
+    glBindTextureUnit(0, m_DepthTexture);
+    glBindImageTexture(0, m_Pyramid, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+    glDispatchCompute(GroupCount(m_Width, s_GroupSize2D), GroupCount(m_Height, s_GroupSize2D), 1);
+
+    glUseProgram(m_ReduceProgram);
+    for (uint32_t level = 1; level < m_Levels; ++level)
+    {
+        glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+
+        glBindImageTexture(0, m_Pyramid, level - 1, GL_FALSE, 0, GL_READ_ONLY, GL_R32F);
+        glBindImageTexture(1, m_Pyramid, level, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+        glDispatchCompute(GroupCount(std::max(m_Width >> level, 1u), s_GroupSize2D), GroupCount(std::max(m_Height >> level, 1u), s_GroupSize2D), 1);
+    }
+
+    glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+}
+
+void HiZCuller::Cull()
+{
+    if (!m_Initialized || !m_Pyramid || m_Sets.empty())
+    {
+        return;
+    }
+
+    ReadStats();
+    BuildPyramid();
+
+    glUseProgram(m_TestProgram);
+    glBindTextureUnit(0, m_Pyramid);
+    glProgramUniform1i(m_TestProgram, s_LevelsLocation, static_cast<GLint>(m_Levels));
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, m_StatsBuffer);
+
+    for (const InstanceSet& set : m_Sets)
+    {
+        if (set.count == 0)
+        {
+            continue;
+        }
+
+        // The first pass command was consumed already, both are refilled here
+        const uint32_t zero = 0;
+        glClearNamedBufferSubData(set.commandBuffer, GL_R32UI, GetFirstPassCommandOffset() + offsetof(DrawElementsIndirectCommand, instanceCount), sizeof(uint32_t), GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+        glClearNamedBufferSubData(set.commandBuffer, GL_R32UI, GetSecondPassCommandOffset() + offsetof(DrawElementsIndirectCommand, instanceCount), sizeof(uint32_t), GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+
+        glProgramUniform1ui(m_TestProgram, s_CountLocation, set.count);
+        glProgramUniform3fv(m_TestProgram, s_MeshMinLocation, 1, &set.meshMin.x);
+        glProgramUniform3fv(m_TestProgram, s_MeshMaxLocation, 1, &set.meshMax.x);
+
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, set.instanceBuffer);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, set.visibilityBuffer);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, set.drawBuffer);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, set.commandBuffer);
+        glDispatchCompute(GroupCount(set.count, s_GroupSize1D), 1, 1);
+    }
+
+    // Visibility is read again next frame, the commands and the instances
+    // right away, the counters by the copy below
+    glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+
+    GLsync& fence = m_ReadbackFences[m_NextReadback];
+
+    if (fence)
+    {
+        // The GPU is more than s_ReadbackFrames behind, lose this frame's counters rather than wait
+        ++m_SkippedReadbacks;
+    }
+    else
+    {
+        glCopyNamedBufferSubData(m_StatsBuffer, m_ReadbackBuffer, 0, sizeof(uint32_t) * s_StatCount * m_NextReadback, sizeof(uint32_t) * s_StatCount);
+        fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        m_NextReadback = (m_NextReadback + 1) % s_ReadbackFrames;
+    }
+    glClearNamedBufferData(m_StatsBuffer, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+
+    for (uint32_t binding = 0; binding < 5; ++binding)
+    {
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, binding, 0);
+    }
+    glBindTextureUnit(0, 0);
+    glUseProgram(0);
+}
+
+void HiZCuller::ReadStats()
+{
+    // Slots complete in the order they were written, oldest first
+    for (uint32_t i = 0; i < s_ReadbackFrames; ++i)
+    {
+        const uint32_t slot = (m_NextReadback + i) % s_ReadbackFrames;
+        GLsync& fence = m_ReadbackFences[slot];
+
+        if (!fence)
+        {
+            continue;
+        }
+
+        const GLenum status = glClientWaitSync(fence, 0, 0);
+        if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+        {
+            StatsRegistry::GetGlobal().Add(StatCounter::FenceWaits);
+            break;
+        }
+
+        glDeleteSync(fence);
+        fence = nullptr;
+
+        const uint32_t* counters = m_Readback + s_StatCount * slot;
+        m_FrameStats.tested = counters[0];
+        m_FrameStats.frustumCulled = counters[1];
+        m_FrameStats.occluded = counters[2];
+        m_FrameStats.drawnFirstPass = counters[3];
+        m_FrameStats.drawnSecondPass = counters[4];
+        m_FrameStats.drawnButOccluded = counters[5];
+
+        StatsRegistry::GetGlobal().Add(StatCounter::VisibleInstances, m_FrameStats.drawnFirstPass + m_FrameStats.drawnSecondPass);
+        StatsRegistry::GetGlobal().Add(StatCounter::CulledInstances, m_FrameStats.frustumCulled + m_FrameStats.occluded);
+
+        m_TotalStats.tested += m_FrameStats.tested;
+        m_TotalStats.frustumCulled += m_FrameStats.frustumCulled;
+        m_TotalStats.occluded += m_FrameStats.occluded;
+        m_TotalStats.drawnFirstPass += m_FrameStats.drawnFirstPass;
+        m_TotalStats.drawnSecondPass += m_FrameStats.drawnSecondPass;
+        m_TotalStats.drawnButOccluded += m_FrameStats.drawnButOccluded;
+        ++m_ReadFrames;
+    }
+}
+
+END_VISUALIZER_NAMESPACE
@@ -0,0 +1,338 @@
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+
+#include "instances.hpp"
+#include "mapped_file.hpp"
+#include "thread_pool.hpp"
+
+BEGIN_VISUALIZER_NAMESPACE
+
+namespace
+{
+    // Below this size a single thread parses faster than it takes to wake the pool
+    constexpr size_t s_ParallelParseThreshold = 4u << 20;
+    constexpr size_t s_ChunksPerThread = 4;
+    // Shortest plausible line, used to size the output up front
+    constexpr size_t s_MinBytesPerLine = 12;
+
+    inline const char* SkipBlanks(const char* p, const char* end)
+    {
+        while (p < end && (*p == ' ' || *p == '\t' || *p == '\r'))
+        {
+            ++p;
+        }
+        return p;
+    }
+
+    inline const char* FindLineEnd(const char* p, const char* end)
+    {
+        const void* newline = std::memchr(p, '\n', static_cast<size_t>(end - p));
+        return newline ? static_cast<const char*>(newline) : end;
+    }
+
+    // Returns the number of values read, or -1 if the line holds anything
+    // but up to five numbers
+    int32_t ParseLine(const char* p, const char* end, float (&values)[InstanceFileHeader::s_ColumnCount])
+    {
+        int32_t count = 0;
+
+        p = SkipBlanks(p, end);
+        while (p < end)
+        {
+            if (count == static_cast<int32_t>(InstanceFileHeader::s_ColumnCount))
+            {
+                return -1;
+            }
+
+            const auto [next, error] = std::from_chars(p, end, values[count]);
+            if (error != std::errc())
+            {
+                return -1;
+            }
+
+            ++count;
+            p = SkipBlanks(next, end);
+        }
+        return count;
+    }
+
+    // Parses the whole lines in [begin, end). On failure errorAt points at
+    // the start of the offending line.
+    bool ParseLines(const char* begin, const char* end, std::vector<InstanceTransform>& instances, const char*& errorAt)
+    {
+        constexpr float degreesToRadians = 3.14159265f / 180.f;
+
+        instances.reserve(instances.size() + static_cast<size_t>(end - begin) / s_MinBytesPerLine);
+
+        for (const char* line = begin; line < end;)
+        {
+            const char* lineEnd = FindLineEnd(line, end);
+            float values[InstanceFileHeader::s_ColumnCount];
+            const int32_t count = ParseLine(line, lineEnd, values);
+
+            if (count < 0 || (count > 0 && count < 3))
+            {
+                errorAt = line;
+                return false;
+            }
+
+            if (count > 0)
+            {
+                InstanceTransform& instance = instances.emplace_back();
+                instance.position = glm::vec3(values[0], values[1], values[2]);
+                instance.scale = count > 3 ? values[3] : 1.f;
+                instance.yaw = count > 4 ? values[4] * degreesToRadians : 0.f;
+            }
+
+            line = lineEnd + 1;
+        }
+        return true;
+    }
+
+    void ReportParseError(const std::string& path, const char* data, const char* errorAt)
+    {
+        const size_t line = 1 + static_cast<size_t>(std::count(data, errorAt, '\n'));
+        std::cerr << "Malformed instance at " << path << ':' << line << '\n';
+    }
+
+    bool LoadInstancesText(const std::string& path, std::span<const std::byte> bytes, std::vector<InstanceTransform>& instances, ThreadPool& pool)
+    {
+        if (bytes.empty())
+        {
+            return true;
+        }
+
+        const char* data = reinterpret_cast<const char*>(bytes.data());
+        const char* begin = data;
+        const char* end = data + bytes.size();
+
+        // Optional count header
+        {
+            const char* lineEnd = FindLineEnd(begin, end);
+            float values[InstanceFileHeader::s_ColumnCount];
+
+            if (ParseLine(begin, lineEnd, values) == 1)
+            {
+                begin = std::min(lineEnd + 1, end);
+            }
+        }
+
+        const size_t size = static_cast<size_t>(end - begin);
+        const char* errorAt = nullptr;
+
+        if (size < s_ParallelParseThreshold || pool.GetWorkerCount() == 0)
+        {
+            if (!ParseLines(begin, end, instances, errorAt))
+            {
+                ReportParseError(path, data, errorAt);
+                return false;
+            }
+            return true;
+        }
+
+        // Cut the buffer into chunks of whole lines, parse each on its own
+        // and stitch the results back together in file order
+        const size_t chunkCount = (pool.GetWorkerCount() + 1) * s_ChunksPerThread;
+        std::vector<const char*> bounds(chunkCount + 1, end);
+        bounds[0] = begin;
+
+        for (size_t c = 1; c < chunkCount; ++c)
+        {
+            const char* nominal = std::max(begin + size * c / chunkCount, bounds[c - 1]);
+            bounds[c] = nominal < end ? std::min(FindLineEnd(nominal, end) + 1, end) : end;
+        }
+
+        std::vector<std::vector<InstanceTransform>> chunks(chunkCount);
+        std::vector<const char*> errors(chunkCount, nullptr);
+
+        pool.ParallelFor(chunkCount, [&](size_t c)
+        {
+            const char* chunkError = nullptr;
+            if (!ParseLines(bounds[c], bounds[c + 1], chunks[c], chunkError))
+            {
+                errors[c] = chunkError;
+            }
+        });
+
+        for (const char* error : errors)
+        {
+            if (error)
+            {
+                ReportParseError(path, data, error);
+                return false;
+            }
+        }
+
+        size_t total = instances.size();
+        for (const std::vector<InstanceTransform>& chunk : chunks)
+        {
+            total += chunk.size();
+        }
+
+        instances.reserve(total);
+        for (const std::vector<InstanceTransform>& chunk : chunks)
+        {
+            instances.insert(instances.end(), chunk.begin(), chunk.end());
+        }
+        return true;
+    }
+
+    bool LoadInstancesBinary(const std::string& path, std::span<const std::byte> bytes, std::vector<InstanceTransform>& instances)
+    {
+        InstanceFileHeader header;
+
+        if (bytes.size() < sizeof(header))
+        {
+            std::cerr << "Truncated instance file : " << path << '\n';
+            return false;
+        }
+
+        std::memcpy(&header, bytes.data(), sizeof(header));
+
+        if (header.version != InstanceFileHeader::s_Version || header.columnCount < 3)
+        {
+            std::cerr << "Unsupported instance file : " << path << '\n';
+            return false;
+        }
+
+        const uint64_t available = (bytes.size() - sizeof(header)) / (static_cast<uint64_t>(header.columnCount) * sizeof(float));
+
+        if (header.count > available)
+        {
+            std::cerr << "Truncated instance file : " << path << '\n';
+            return false;
+        }
+
+        const size_t count = static_cast<size_t>(header.count);
+        const size_t first = instances.size();
+        instances.resize(first + count);
+
+        // The payload starts 24 bytes into a page aligned mapping or a heap
+        // block, so every column is float aligned
+        const float* columns = reinterpret_cast<const float*>(bytes.data() + sizeof(header));
+        const float* x = columns;
+        const float* y = columns + count;
+        const float* z = columns + count * 2;
+        const float* scale = header.columnCount > 3 ? columns + count * 3 : nullptr;
+        const float* yaw = header.columnCount > 4 ? columns + count * 4 : nullptr;
+
+        InstanceTransform* out = instances.data() + first;
+
+        for (size_t i = 0; i < count; ++i)
+        {
+            out[i].position = glm::vec3(x[i], y[i], z[i]);
+            out[i].scale = scale ? scale[i] : 1.f;
+            out[i].yaw = yaw ? yaw[i] : 0.f;
+        }
+        return true;
+    }
+}
+
+void GetInstanceBounds(const InstanceTransform& instance, const glm::vec3& meshMin, const glm::vec3& meshMax, glm::vec3& min, glm::vec3& max)
+{
+    // Farthest reach in XZ over every yaw
+    const float radius = std::sqrt(std::max(meshMin.x * meshMin.x, meshMax.x * meshMax.x) + std::max(meshMin.z * meshMin.z, meshMax.z * meshMax.z));
+    const glm::vec3 a = glm::vec3(-radius, meshMin.y, -radius) * instance.scale;
+    const glm::vec3 b = glm::vec3(radius, meshMax.y, radius) * instance.scale;
+
+    min = instance.position + glm::min(a, b);
+    max = instance.position + glm::max(a, b);
+}
+
+bool LoadInstances(const std::string& path, std::vector<InstanceTransform>& instances, ThreadPool& pool)
+{
+    MappedFile file;
+
+    if (!file.Open(path))
+    {
+        return false;
+    }
+
+    return LoadInstances(path, file.GetBytes(), instances, pool);
+}
+
+bool LoadInstances(const std::string& path, std::span<const std::byte> bytes, std::vector<InstanceTransform>& instances, ThreadPool& pool)
+{
+    if (bytes.size() >= sizeof(InstanceFileHeader::s_Magic) && std::memcmp(bytes.data(), InstanceFileHeader::s_Magic, sizeof(InstanceFileHeader::s_Magic)) == 0)
+    {
+        return LoadInstancesBinary(path, bytes, instances);
+    }
+
+    return LoadInstancesText(path, bytes, instances, pool);
+}
+
+bool SaveInstancesBinary(const std::string& path, const std::vector<InstanceTransform>& instances)
+{
+    std::ofstream ofs(path, std::ios::binary | std::ios::trunc);
+
+    if (!ofs)
+    {
+        std::cerr << "Cannot open file : " << path << '\n';
+        return false;
+    }
+
+    InstanceFileHeader header{};
+    std::memcpy(header.magic, InstanceFileHeader::s_Magic, sizeof(header.magic));
+    header.version = InstanceFileHeader::s_Version;
+    header.count = instances.size();
+    header.columnCount = InstanceFileHeader::s_ColumnCount;
+
+    ofs.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+    std::vector<float> column(instances.size());
+
+    auto writeColumn = [&](auto&& get)
+    {
+        std::transform(instances.begin(), instances.end(), column.begin(), get);
+        ofs.write(reinterpret_cast<const char*>(column.data()), static_cast<std::streamsize>(column.size() * sizeof(float)));
+    };
+
+    writeColumn([](const InstanceTransform& i) { return i.position.x; });
+    writeColumn([](const InstanceTransform& i) { return i.position.y; });
+    writeColumn([](const InstanceTransform& i) { return i.position.z; });
+    writeColumn([](const InstanceTransform& i) { return i.scale; });
+    writeColumn([](const InstanceTransform& i) { return i.yaw; });
+
+    if (!ofs)
+    {
+        std::cerr << "Cannot write file : " << path << '\n';
+        return false;
+    }
+    return true;
+}
+
+bool SaveInstancesText(const std::string& path, const std::vector<InstanceTransform>& instances)
+{
+    constexpr float radiansToDegrees = 180.f / 3.14159265f;
+
+    std::ofstream ofs(path, std::ios::trunc);
+
+    if (!ofs)
+    {
+        std::cerr << "Cannot open file : " << path << '\n';
+        return false;
+    }
+
+    // Enough digits for the positions to load back unchanged
+    ofs << std::setprecision(std::numeric_limits<float>::max_digits10);
+
+    for (const InstanceTransform& instance : instances)
+    {
+        ofs << instance.position.x << ' ' << instance.position.y << ' ' << instance.position.z << ' ' << instance.scale << ' ' << instance.yaw * radiansToDegrees << '\n';
+    }
+
+    if (!ofs)
+    {
+        std::cerr << "Cannot write file : " << path << '\n';
+        return false;
+    }
+    return true;
+}
+
+END_VISUALIZER_NAMESPACE
@@ -1,11 +1,36 @@
 #include <cstdlib>
+#include <iostream>
 
+#include "gl_capture.hpp"
+#include "options.hpp"
+#include "stats_registry.hpp"
 #include "window.hpp"
 
 int32_t main(int32_t argc, char** argv)
 {
-    (void)argc;
-    (void)argv;
+    visualizer::LaunchOptions options;
+
+    if (!visualizer::ParseLaunchOptions(argc, argv, options))
+    {
+        return EXIT_FAILURE;
+    }
+
+    if (options.readStats)
+    {
+        return visualizer::RunStatsReader(std::cout) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    if (!options.glReport.empty())
+    {
+        visualizer::GlCaptureFile capture;
+        if (!capture.Load(options.glReport))
+        {
+            return EXIT_FAILURE;
+        }
+
+        capture.PrintReport(std::cout);
+        return EXIT_SUCCESS;
+    }
 
     auto &window = visualizer::Window::GetInstance();
 
@@ -14,7 +39,18 @@ int32_t main(int32_t argc, char** argv)
         return EXIT_FAILURE;
     }
 
-    window.Run();
+    if (!options.glReplay.empty())
+    {
+        visualizer::GlCaptureFile capture;
+        visualizer::LaunchOptions captureOptions;
+
+        if (!capture.Load(options.glReplay) || !visualizer::ParseLaunchOptions(capture.GetLaunchArguments(), captureOptions))
+        {
+            return EXIT_FAILURE;
+        }
+
+        return window.Replay(capture, captureOptions, options.playIterations) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
 
-    return EXIT_SUCCESS;
+    return window.Run(options) ? EXIT_SUCCESS : EXIT_FAILURE;
 }
@@ -0,0 +1,248 @@
+#include <algorithm>
+#include <iostream>
+#include <utility>
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "mapped_file.hpp"
+#include "utils.hpp"
+
+BEGIN_VISUALIZER_NAMESPACE
+
+MappedFile::~MappedFile()
+{
+    Close();
+}
+
+MappedFile::MappedFile(MappedFile&& other) noexcept
+{
+    *this = std::move(other);
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept
+{
+    if (this != &other)
+    {
+        Close();
+
+        m_Data = std::exchange(other.m_Data, nullptr);
+        m_Size = std::exchange(other.m_Size, 0);
+        m_IsOpen = std::exchange(other.m_IsOpen, false);
+#ifdef _WIN32
+        m_File = std::exchange(other.m_File, nullptr);
+        m_Mapping = std::exchange(other.m_Mapping, nullptr);
+#endif
+    }
+    return *this;
+}
+
+#ifdef _WIN32
+
+bool MappedFile::Open(const std::string& path, FileAccess access)
+{
+    Close();
+
+    const DWORD flags = access == FileAccess::Sequential ? FILE_FLAG_SEQUENTIAL_SCAN : FILE_ATTRIBUTE_NORMAL;
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, flags, nullptr);
+
+    if (file == INVALID_HANDLE_VALUE)
+    {
+        std::cerr << "Cannot open file : " << path << '\n';
+        DisplayLastWinAPIError();
+        return false;
+    }
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size))
+    {
+        std::cerr << "Cannot get size of file : " << path << '\n';
+        DisplayLastWinAPIError();
+        CloseHandle(file);
+        return false;
+    }
+
+    m_File = file;
+    m_Size = static_cast<size_t>(size.QuadPart);
+    m_IsOpen = true;
+
+    // Empty files cannot be mapped, they simply have no data
+    if (m_Size == 0)
+    {
+        return true;
+    }
+
+    m_Mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+
+    if (!m_Mapping)
+    {
+        std::cerr << "Cannot create file mapping : " << path << '\n';
+        DisplayLastWinAPIError();
+        Close();
+        return false;
+    }
+
+    m_Data = static_cast<const char*>(MapViewOfFile(m_Mapping, FILE_MAP_READ, 0, 0, 0));
+
+    if (!m_Data)
+    {
+        std::cerr << "Cannot map file : " << path << '\n';
+        DisplayLastWinAPIError();
+        Close();
+        return false;
+    }
+
+    Prefetch(0, m_Size);
+    return true;
+}
+
+void MappedFile::Prefetch(size_t offset, size_t size) const
+{
+    if (offset >= m_Size)
+    {
+        return;
+    }
+
+    // Only a hint, failing is harmless
+    WIN32_MEMORY_RANGE_ENTRY range{ const_cast<char*>(m_Data + offset), std::min(size, m_Size - offset) };
+    PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+}
+
+void MappedFile::Close()
+{
+    if (m_Data)
+    {
+        UnmapViewOfFile(m_Data);
+    }
+    if (m_Mapping)
+    {
+        CloseHandle(m_Mapping);
+    }
+    if (m_File)
+    {
+        CloseHandle(m_File);
+    }
+
+    m_Data = nullptr;
+    m_Mapping = nullptr;
+    m_File = nullptr;
+    m_Size = 0;
+    m_IsOpen = false;
+}
+
+#else
+
+bool MappedFile::Open(const std::string& path, FileAccess access)
+{
+    Close();
+
+    const int fd = open(path.c_str(), O_RDONLY);
+
+    if (fd < 0)
+    {
+        std::cerr << "Cannot open file : " << path << '\n';
+        return false;
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) != 0)
+    {
+        std::cerr << "Cannot get size of file : " << path << '\n';
+        close(fd);
+        return false;
+    }
+
+    m_Size = static_cast<size_t>(info.st_size);
+    m_IsOpen = true;
+
+    if (m_Size > 0)
+    {
+        void* data = mmap(nullptr, m_Size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+        if (data == MAP_FAILED)
+        {
+            std::cerr << "Cannot map file : " << path << '\n';
+            close(fd);
+            m_Size = 0;
+            m_IsOpen = false;
+            return false;
+        }
+        m_Data = static_cast<const char*>(data);
+
+        madvise(data, m_Size, access == FileAccess::Sequential ? MADV_SEQUENTIAL : MADV_NORMAL);
+        Prefetch(0, m_Size);
+    }
+
+    // The mapping keeps its own reference to the file
+    close(fd);
+    return true;
+}
+
+void MappedFile::Prefetch(size_t offset, size_t size) const
+{
+    if (offset >= m_Size)
+    {
+        return;
+    }
+
+    // From the page holding offset, only a hint so failing is harmless
+    const size_t pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    const size_t first = offset - offset % pageSize;
+    madvise(const_cast<char*>(m_Data + first), std::min(size, m_Size - offset) + (offset - first), MADV_WILLNEED);
+}
+
+void MappedFile::Close()
+{
+    if (m_Data)
+    {
+        munmap(const_cast<char*>(m_Data), m_Size);
+    }
+
+    m_Data = nullptr;
+    m_Size = 0;
+    m_IsOpen = false;
+}
+
+#endif
+
+ByteStreamBuf::ByteStreamBuf(std::span<const std::byte> bytes)
+{
+    // Never written through, the get area just needs non-const pointers
+    char* begin = const_cast<char*>(reinterpret_cast<const char*>(bytes.data()));
+    setg(begin, begin, begin + bytes.size());
+}
+
+ByteStreamBuf::pos_type ByteStreamBuf::seekoff(off_type offset, std::ios_base::seekdir direction, std::ios_base::openmode mode)
+{
+    off_type base = 0;
+    if (direction == std::ios_base::cur)
+    {
+        base = gptr() - eback();
+    }
+    else if (direction == std::ios_base::end)
+    {
+        base = egptr() - eback();
+    }
+
+    const off_type position = base + offset;
+    if (!(mode & std::ios_base::in) || position < 0 || position > egptr() - eback())
+    {
+        return pos_type(off_type(-1));
+    }
+
+    setg(eback(), eback() + position, egptr());
+    return pos_type(position);
+}
+
+ByteStreamBuf::pos_type ByteStreamBuf::seekpos(pos_type position, std::ios_base::openmode mode)
+{
+    return seekoff(off_type(position), std::ios_base::beg, mode);
+}
+
+END_VISUALIZER_NAMESPACE
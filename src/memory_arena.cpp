@@ -0,0 +1,101 @@
+#include <algorithm>
+#include <cstdint>
+
+#include "memory_arena.hpp"
+
+BEGIN_VISUALIZER_NAMESPACE
+
+namespace
+{
+    constexpr size_t s_BlockAlignment = alignof(std::max_align_t);
+}
+
+LinearArena::LinearArena(size_t blockSize, std::pmr::memory_resource* upstream)
+    : m_Upstream(upstream)
+    , m_BlockSize(std::max<size_t>(blockSize, 1))
+{}
+
+LinearArena::~LinearArena()
+{
+    Release();
+}
+
+void* LinearArena::do_allocate(size_t bytes, size_t alignment)
+{
+    // Reuse the blocks kept by Reset() before asking upstream for more
+    while (m_CurrentBlock < m_Blocks.size())
+    {
+        const Block& block = m_Blocks[m_CurrentBlock];
+        // Blocks are only aligned to s_BlockAlignment, round the address
+        // itself for anything stricter
+        const uintptr_t base = reinterpret_cast<uintptr_t>(block.data);
+        const size_t offset = static_cast<size_t>(((base + m_Offset + alignment - 1) & ~(uintptr_t(alignment) - 1)) - base);
+
+        if (offset + bytes <= block.size)
+        {
+            m_Offset = offset + bytes;
+            m_Used += bytes;
+            m_Peak = std::max(m_Peak, m_Used);
+            return block.data + offset;
+        }
+
+        ++m_CurrentBlock;
+        m_Offset = 0;
+    }
+
+    const size_t lastSize = m_Blocks.empty() ? 0 : m_Blocks.back().size;
+    const size_t size = std::max({ m_BlockSize, lastSize * 2, bytes + alignment });
+
+    m_Blocks.push_back(Block{ static_cast<std::byte*>(m_Upstream->allocate(size, s_BlockAlignment)), size });
+    m_Capacity += size;
+    ++m_UpstreamAllocations;
+
+    m_CurrentBlock = m_Blocks.size() - 1;
+    m_Offset = 0;
+
+    return do_allocate(bytes, alignment);
+}
+
+void LinearArena::Reset()
+{
+    if (m_Blocks.size() > 1)
+    {
+        const size_t capacity = m_Capacity;
+
+        Release();
+
+        m_Blocks.push_back(Block{ static_cast<std::byte*>(m_Upstream->allocate(capacity, s_BlockAlignment)), capacity });
+        m_Capacity = capacity;
+        ++m_UpstreamAllocations;
+    }
+
+    m_CurrentBlock = 0;
+    m_Offset = 0;
+    m_Used = 0;
+}
+
+void LinearArena::Release()
+{
+    for (const Block& block : m_Blocks)
+    {
+        m_Upstream->deallocate(block.data, block.size, s_BlockAlignment);
+    }
+
+    m_Blocks.clear();
+    m_CurrentBlock = 0;
+    m_Offset = 0;
+    m_Used = 0;
+    m_Capacity = 0;
+}
+
+FrameAllocator::FrameAllocator(size_t blockSize)
+    : m_Arenas{ LinearArena(blockSize), LinearArena(blockSize) }
+{}
+
+void FrameAllocator::BeginFrame()
+{
+    m_Current ^= 1;
+    m_Arenas[m_Current].Reset();
+}
+
+END_VISUALIZER_NAMESPACE
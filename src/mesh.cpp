@@ -0,0 +1,278 @@
+#define TINYOBJLOADER_IMPLEMENTATION
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <istream>
+#include <numeric>
+
+#include "tinyobjloader/tiny_obj_loader.h"
+#include "mapped_file.hpp"
+#include "mesh.hpp"
+
+BEGIN_VISUALIZER_NAMESPACE
+
+float computeMagnitude(const glm::vec3 &v)
+{
+    return (std::sqrt(std::pow(v.x, 2) + std::pow(v.y, 2) + std::pow(v.z, 2)));
+}
+
+glm::vec3 computeNormal(const glm::vec3 &A, const glm::vec3 &B, const glm::vec3 &C)
+{
+    glm::vec3 N = glm::cross(A - B, B - C);
+
+    //if (computeMagnitude(N) > 0)
+    {
+        return (glm::normalize(N));
+    }
+    return (glm::vec3());
+}
+
+void computeBounds(std::span<const VertexDataPosition3fColor3f> vertices, glm::vec3 &min, glm::vec3 &max)
+{
+    if (vertices.empty())
+    {
+        min = max = glm::vec3(0.f);
+        return;
+    }
+
+    min = max = vertices[0].position;
+    for (const VertexDataPosition3fColor3f &vertex : vertices)
+    {
+        min = glm::min(min, vertex.position);
+        max = glm::max(max, vertex.position);
+    }
+}
+
+void translateVertices(std::span<VertexDataPosition3fColor3f> vertices, const glm::vec3 &translate)
+{
+    for (VertexDataPosition3fColor3f &vertex : vertices)
+    {
+        vertex.position += translate;
+    }
+}
+
+namespace
+{
+    bool LoadMeshBinary(std::pmr::vector<VertexDataPosition3fColor3f> &vertices, std::pmr::vector<uint32_t> &indices, const std::string &path, std::span<const std::byte> bytes)
+    {
+        MeshFileHeader header;
+
+        if (bytes.size() < sizeof(header))
+        {
+            std::cerr << "Truncated mesh file : " << path << '\n';
+            return false;
+        }
+
+        std::memcpy(&header, bytes.data(), sizeof(header));
+
+        if (header.version != MeshFileHeader::s_Version)
+        {
+            std::cerr << "Unsupported mesh file : " << path << '\n';
+            return false;
+        }
+
+        const uint64_t available = bytes.size() - sizeof(header);
+
+        if (header.vertexCount > available / sizeof(VertexDataPosition3fColor3f)
+            || header.indexCount > (available - header.vertexCount * sizeof(VertexDataPosition3fColor3f)) / sizeof(uint32_t))
+        {
+            std::cerr << "Truncated mesh file : " << path << '\n';
+            return false;
+        }
+
+        const size_t vertexCount = static_cast<size_t>(header.vertexCount);
+        const size_t indexCount = static_cast<size_t>(header.indexCount);
+        const std::byte* payload = bytes.data() + sizeof(header);
+
+        const size_t vertexBase = vertices.size();
+        vertices.resize(vertexBase + vertexCount);
+        std::memcpy(vertices.data() + vertexBase, payload, vertexCount * sizeof(VertexDataPosition3fColor3f));
+
+        const size_t first = indices.size();
+        indices.resize(first + indexCount);
+        std::memcpy(indices.data() + first, payload + vertexCount * sizeof(VertexDataPosition3fColor3f), indexCount * sizeof(uint32_t));
+
+        for (size_t i = first; i < indices.size(); ++i)
+        {
+            if (indices[i] >= vertexCount)
+            {
+                std::cerr << "Index out of range in mesh file : " << path << '\n';
+                vertices.resize(vertexBase);
+                indices.resize(first);
+                return false;
+            }
+            indices[i] += static_cast<uint32_t>(vertexBase);
+        }
+        return true;
+    }
+}
+
+bool LoadMesh(std::pmr::vector<VertexDataPosition3fColor3f> &vertices, std::pmr::vector<uint32_t> &indices, const std::string &path)
+{
+    MappedFile file;
+
+    if (!file.Open(path))
+    {
+        return false;
+    }
+
+    return LoadMesh(vertices, indices, path, file.GetBytes());
+}
+
+bool LoadMesh(std::pmr::vector<VertexDataPosition3fColor3f> &vertices, std::pmr::vector<uint32_t> &indices, const std::string &path, std::span<const std::byte> bytes)
+{
+    if (bytes.size() >= sizeof(MeshFileHeader::s_Magic) && std::memcmp(bytes.data(), MeshFileHeader::s_Magic, sizeof(MeshFileHeader::s_Magic)) == 0)
+    {
+        return LoadMeshBinary(vertices, indices, path, bytes);
+    }
+
+    // Parsed in place, materials looked up next to the file
+    ByteStreamBuf buffer(bytes);
+    std::istream stream(&buffer);
+    tinyobj::MaterialFileReader materialReader((std::filesystem::path(path).parent_path() / "").string());
+
+    tinyobj::attrib_t attrib;
+    std::vector<tinyobj::shape_t> shapes;
+    std::vector<tinyobj::material_t> materials;
+    std::string warning, error;
+
+    if (!tinyobj::LoadObj(&attrib, &shapes, &materials, &warning, &error, &stream, &materialReader))
+    {
+        if (!error.empty())
+        {
+            std::cerr << "TinyObjReader: " << error;
+        }
+        return false;
+    }
+
+    if (!warning.empty())
+    {
+        std::cout << "TinyObjReader: " << warning;
+    }
+    size_t indices_size = 0;
+
+    for (size_t s = 0; s < shapes.size(); ++s)
+    {
+        indices_size += shapes[s].mesh.indices.size();
+    }
+    const size_t vertex_base = vertices.size();
+    vertices.reserve(vertex_base + indices_size);
+    indices_size = 0;
+
+    for (size_t s = 0; s < shapes.size(); ++s)
+    {
+        size_t index_offset = 0;
+        for (size_t f = 0; f < shapes[s].mesh.num_face_vertices.size(); ++f)
+        {
+            size_t fv = size_t(shapes[s].mesh.num_face_vertices[f]);
+
+            if (fv != 3)
+            {
+                std::cerr << "Error: is not a triangle" << std::endl;
+                return false;
+            }
+            for (size_t v = 0; v < fv; ++v)
+            {
+                tinyobj::index_t idx = shapes[s].mesh.indices[index_offset + v];
+                tinyobj::real_t vx = attrib.vertices[fv * size_t(idx.vertex_index) + 0];
+                tinyobj::real_t vy = attrib.vertices[fv * size_t(idx.vertex_index) + 1];
+                tinyobj::real_t vz = attrib.vertices[fv * size_t(idx.vertex_index) + 2];
+                tinyobj::real_t vnx = attrib.normals.empty() ? 0.0 : attrib.normals[fv * size_t(idx.normal_index) + 0];
+                tinyobj::real_t vny = attrib.normals.empty() ? 0.0 : attrib.normals[fv * size_t(idx.normal_index) + 1];
+                tinyobj::real_t vnz = attrib.normals.empty() ? 0.0 : attrib.normals[fv * size_t(idx.normal_index) + 2];
+                glm::vec3 position(vx, vy, vz);
+                glm::vec3 normal(vnx, vny, vnz);
+                glm::vec3 color(0.8, 0.8, 0.8);
+                vertices.push_back(visualizer::VertexDataPosition3fColor3f{position, normal, color});
+            }
+            if (attrib.normals.empty())
+            {
+                visualizer::VertexDataPosition3fColor3f& A = vertices[vertices.size() - 3];
+                visualizer::VertexDataPosition3fColor3f& B = vertices[vertices.size() - 2];
+                visualizer::VertexDataPosition3fColor3f& C = vertices[vertices.size() - 1];
+                glm::vec3 normal = computeNormal(A.position, B.position, C.position);
+                A.normal = normal;
+                B.normal = normal;
+                C.normal = normal;
+            }
+            index_offset += fv;
+            indices_size += fv;
+        }
+    }
+    const size_t first = indices.size();
+    indices.resize(first + indices_size);
+    std::iota(indices.begin() + first, indices.end(), static_cast<uint32_t>(vertex_base));
+
+    return true;
+}
+
+bool SaveMeshBinary(const std::string &path, std::span<const VertexDataPosition3fColor3f> vertices, std::span<const uint32_t> indices)
+{
+    std::ofstream ofs(path, std::ios::binary | std::ios::trunc);
+
+    if (!ofs)
+    {
+        std::cerr << "Cannot open file : " << path << '\n';
+        return false;
+    }
+
+    MeshFileHeader header{};
+    std::memcpy(header.magic, MeshFileHeader::s_Magic, sizeof(header.magic));
+    header.version = MeshFileHeader::s_Version;
+    header.vertexCount = vertices.size();
+    header.indexCount = indices.size();
+
+    ofs.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    ofs.write(reinterpret_cast<const char*>(vertices.data()), static_cast<std::streamsize>(vertices.size_bytes()));
+    ofs.write(reinterpret_cast<const char*>(indices.data()), static_cast<std::streamsize>(indices.size_bytes()));
+
+    if (!ofs)
+    {
+        std::cerr << "Cannot write file : " << path << '\n';
+        return false;
+    }
+    return true;
+}
+
+bool SaveMeshObj(const std::string &path, std::span<const VertexDataPosition3fColor3f> vertices, std::span<const uint32_t> indices)
+{
+    std::ofstream ofs(path, std::ios::trunc);
+
+    if (!ofs)
+    {
+        std::cerr << "Cannot open file : " << path << '\n';
+        return false;
+    }
+
+    for (const VertexDataPosition3fColor3f &vertex : vertices)
+    {
+        ofs << "v " << vertex.position.x << ' ' << vertex.position.y << ' ' << vertex.position.z << '\n';
+    }
+    for (const VertexDataPosition3fColor3f &vertex : vertices)
+    {
+        ofs << "vn " << vertex.normal.x << ' ' << vertex.normal.y << ' ' << vertex.normal.z << '\n';
+    }
+
+    // OBJ indices are 1-based, each corner reuses its vertex's normal
+    for (size_t i = 0; i + 2 < indices.size(); i += 3)
+    {
+        ofs << 'f';
+        for (size_t c = 0; c < 3; ++c)
+        {
+            const uint32_t index = indices[i + c] + 1;
+            ofs << ' ' << index << "//" << index;
+        }
+        ofs << '\n';
+    }
+
+    if (!ofs)
+    {
+        std::cerr << "Cannot write file : " << path << '\n';
+        return false;
+    }
+    return true;
+}
+
+END_VISUALIZER_NAMESPACE
@@ -0,0 +1,305 @@
+#pragma warning(push, 0)
+#include <glm/gtc/matrix_transform.hpp>
+#pragma warning(pop, 0)
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <iomanip>
+#include <numeric>
+
+#include "meshlet.hpp"
+
+BEGIN_VISUALIZER_NAMESPACE
+
+namespace
+{
+    // Narrower cones than this are not worth testing
+    constexpr float s_MinConeDot = 0.1f;
+
+    // Adding zero turns -0 into +0 so both weld together
+    inline uint64_t HashPosition(const glm::vec3& p)
+    {
+        const uint64_t x = std::bit_cast<uint32_t>(p.x + 0.f);
+        const uint64_t y = std::bit_cast<uint32_t>(p.y + 0.f);
+        const uint64_t z = std::bit_cast<uint32_t>(p.z + 0.f);
+        const uint64_t h = (x * 0x9e3779b97f4a7c15ull) ^ (y * 0xc2b2ae3d27d4eb4full) ^ (z * 0x165667b19e3779f9ull);
+        return h ^ (h >> 29);
+    }
+
+    // Spreads the low 10 bits of v so that two zero bits follow each one
+    inline uint32_t SpreadBits(uint32_t v)
+    {
+        v &= 0x3ff;
+        v = (v | (v << 16)) & 0x030000ff;
+        v = (v | (v << 8)) & 0x0300f00f;
+        v = (v | (v << 4)) & 0x030c30c3;
+        v = (v | (v << 2)) & 0x09249249;
+        return v;
+    }
+
+    void ComputeBounds(Meshlet& meshlet, std::span<const VertexDataPosition3fColor3f> vertices, std::span<const uint32_t> indices)
+    {
+        const std::span<const uint32_t> triangles = indices.subspan(meshlet.firstIndex, meshlet.triangleCount * 3);
+
+        glm::vec3 min = vertices[triangles[0]].position;
+        glm::vec3 max = min;
+        for (uint32_t index : triangles)
+        {
+            min = glm::min(min, vertices[index].position);
+            max = glm::max(max, vertices[index].position);
+        }
+
+        meshlet.center = (min + max) * 0.5f;
+        meshlet.radius = 0.f;
+        for (uint32_t index : triangles)
+        {
+            meshlet.radius = std::max(meshlet.radius, glm::length(vertices[index].position - meshlet.center));
+        }
+
+        // Area weighted average of the face normals
+        glm::vec3 axis(0.f);
+        for (size_t t = 0; t < triangles.size(); t += 3)
+        {
+            const glm::vec3& a = vertices[triangles[t]].position;
+            axis += glm::cross(vertices[triangles[t + 1]].position - a, vertices[triangles[t + 2]].position - a);
+        }
+
+        const float axisLength = glm::length(axis);
+        meshlet.coneAxis = axisLength > 0.f ? axis / axisLength : glm::vec3(0.f, 1.f, 0.f);
+        meshlet.coneCutoff = 1.f;
+
+        if (axisLength == 0.f)
+        {
+            return;
+        }
+
+        float minDot = 1.f;
+        for (size_t t = 0; t < triangles.size(); t += 3)
+        {
+            const glm::vec3& a = vertices[triangles[t]].position;
+            const glm::vec3 normal = glm::cross(vertices[triangles[t + 1]].position - a, vertices[triangles[t + 2]].position - a);
+            const float length = glm::length(normal);
+
+            // Degenerate triangles cover no pixel, whatever their facing
+            if (length > 0.f)
+            {
+                minDot = std::min(minDot, glm::dot(normal / length, meshlet.coneAxis));
+            }
+        }
+
+        if (minDot > s_MinConeDot)
+        {
+            meshlet.coneCutoff = std::sqrt(1.f - minDot * minDot);
+        }
+    }
+}
+
+MeshletMesh BuildMeshlets(std::span<const VertexDataPosition3fColor3f> vertices, std::span<const uint32_t> indices, uint32_t maxVertices, uint32_t maxTriangles)
+{
+    MeshletMesh mesh;
+    const size_t triangleCount = indices.size() / 3;
+
+    if (triangleCount == 0)
+    {
+        return mesh;
+    }
+
+    glm::vec3 min = vertices[indices[0]].position;
+    glm::vec3 max = min;
+    for (uint32_t index : indices)
+    {
+        min = glm::min(min, vertices[index].position);
+        max = glm::max(max, vertices[index].position);
+    }
+
+    const glm::vec3 scale = 1023.f / glm::max(max - min, glm::vec3(1e-6f));
+
+    std::vector<uint32_t> codes(triangleCount);
+    for (size_t t = 0; t < triangleCount; ++t)
+    {
+        const glm::vec3 centroid = (vertices[indices[t * 3]].position + vertices[indices[t * 3 + 1]].position + vertices[indices[t * 3 + 2]].position) / 3.f;
+        const glm::uvec3 cell = glm::uvec3((centroid - min) * scale);
+
+        codes[t] = SpreadBits(cell.x) | (SpreadBits(cell.y) << 1) | (SpreadBits(cell.z) << 2);
+    }
+
+    std::vector<uint32_t> order(triangleCount);
+    std::iota(order.begin(), order.end(), 0u);
+    std::stable_sort(order.begin(), order.end(), [&codes](uint32_t a, uint32_t b) { return codes[a] < codes[b]; });
+
+    // Corners at the same position count as one vertex: loaded OBJ meshes
+    // give every triangle its own three, which would fill a meshlet after
+    // about 21 triangles
+    std::vector<uint32_t> welded(vertices.size());
+    {
+        // Open addressing, at most half full, holding the first vertex seen
+        // at each position
+        const size_t mask = std::bit_ceil(std::max<size_t>(vertices.size() * 2, 16)) - 1;
+        std::vector<uint32_t> firstAt(mask + 1, UINT32_MAX);
+
+        for (uint32_t v = 0; v < vertices.size(); ++v)
+        {
+            const glm::vec3& position = vertices[v].position;
+            size_t slot = HashPosition(position) & mask;
+
+            while (firstAt[slot] != UINT32_MAX && vertices[firstAt[slot]].position != position)
+            {
+                slot = (slot + 1) & mask;
+            }
+
+            if (firstAt[slot] == UINT32_MAX)
+            {
+                firstAt[slot] = v;
+            }
+            welded[v] = firstAt[slot];
+        }
+    }
+
+    // Stamp of the meshlet that last took each welded vertex
+    std::vector<uint32_t> owner(vertices.size(), UINT32_MAX);
+    mesh.indices.reserve(indices.size());
+
+    Meshlet current{};
+
+    for (uint32_t t : order)
+    {
+        const uint32_t* source = &indices[t * 3];
+        const uint32_t triangle[3] = { welded[source[0]], welded[source[1]], welded[source[2]] };
+        const uint32_t stamp = static_cast<uint32_t>(mesh.meshlets.size());
+
+        uint32_t newVertices = 0;
+        for (uint32_t k = 0; k < 3; ++k)
+        {
+            // Repeated corners of a degenerate triangle count once
+            newVertices += owner[triangle[k]] != stamp && (k == 0 || triangle[k] != triangle[0]) && (k < 2 || triangle[k] != triangle[1]);
+        }
+
+        if (current.triangleCount > 0 && (current.vertexCount + newVertices > maxVertices || current.triangleCount + 1 > maxTriangles))
+        {
+            mesh.meshlets.push_back(current);
+
+            current = Meshlet{};
+            current.firstIndex = static_cast<uint32_t>(mesh.indices.size());
+
+            // Every corner is new to the next meshlet
+            newVertices = 0;
+            for (uint32_t k = 0; k < 3; ++k)
+            {
+                newVertices += (k == 0 || triangle[k] != triangle[0]) && (k < 2 || triangle[k] != triangle[1]);
+            }
+        }
+
+        const uint32_t owningStamp = static_cast<uint32_t>(mesh.meshlets.size());
+        for (uint32_t k = 0; k < 3; ++k)
+        {
+            owner[triangle[k]] = owningStamp;
+            mesh.indices.push_back(source[k]);
+        }
+
+        current.vertexCount += newVertices;
+        ++current.triangleCount;
+    }
+    mesh.meshlets.push_back(current);
+
+    for (Meshlet& meshlet : mesh.meshlets)
+    {
+        ComputeBounds(meshlet, vertices, mesh.indices);
+    }
+
+    return mesh;
+}
+
+size_t CullMeshlets(const MeshletMesh& mesh, const glm::mat4& viewProjection, const glm::vec3& cameraPosition,
+                    std::span<DrawElementsIndirectCommand> out, MeshletStats& stats)
+{
+    // Side, near and far planes, normalized so that distances are in world units
+    glm::vec4 planes[6];
+    for (int32_t axis = 0; axis < 3; ++axis)
+    {
+        const glm::vec4 row(viewProjection[0][axis], viewProjection[1][axis], viewProjection[2][axis], viewProjection[3][axis]);
+        const glm::vec4 w(viewProjection[0][3], viewProjection[1][3], viewProjection[2][3], viewProjection[3][3]);
+
+        planes[axis * 2] = w + row;
+        planes[axis * 2 + 1] = w - row;
+    }
+    for (glm::vec4& plane : planes)
+    {
+        plane /= glm::length(glm::vec3(plane));
+    }
+
+    stats.meshlets += mesh.meshlets.size();
+
+    size_t count = 0;
+
+    for (const Meshlet& meshlet : mesh.meshlets)
+    {
+        stats.triangles += meshlet.triangleCount;
+
+        bool outside = false;
+        for (const glm::vec4& plane : planes)
+        {
+            outside = outside || glm::dot(glm::vec3(plane), meshlet.center) + plane.w < -meshlet.radius;
+        }
+
+        if (outside)
+        {
+            ++stats.frustumCulled;
+            stats.culledTriangles += meshlet.triangleCount;
+            continue;
+        }
+
+        // Backfacing when the camera sees the whole sphere from behind the cone
+        const glm::vec3 toCenter = meshlet.center - cameraPosition;
+        if (glm::dot(toCenter, meshlet.coneAxis) >= meshlet.coneCutoff * glm::length(toCenter) + meshlet.radius)
+        {
+            ++stats.backfaceCulled;
+            stats.culledTriangles += meshlet.triangleCount;
+            continue;
+        }
+
+        // Runs of survivors are contiguous in the index buffer
+        if (count > 0 && out[count - 1].firstIndex + out[count - 1].count == meshlet.firstIndex)
+        {
+            out[count - 1].count += meshlet.triangleCount * 3;
+            continue;
+        }
+
+        out[count++] = DrawElementsIndirectCommand{ meshlet.triangleCount * 3, 1, meshlet.firstIndex, 0, 0 };
+    }
+
+    stats.commands += count;
+    return count;
+}
+
+void PrintMeshletReport(std::ostream& os, const char* name, const MeshletMesh& mesh, const glm::mat4& projection, std::span<const MeshletViewpoint> viewpoints)
+{
+    std::vector<DrawElementsIndirectCommand> commands(mesh.meshlets.size());
+    MeshletStats total;
+    const std::ios_base::fmtflags flags = os.flags();
+    const std::streamsize precision = os.precision();
+
+    os << name << ": " << mesh.meshlets.size() << " meshlets, " << mesh.indices.size() / 3 << " triangles\n";
+
+    for (const MeshletViewpoint& viewpoint : viewpoints)
+    {
+        MeshletStats stats;
+        const glm::mat4 view = glm::lookAt(viewpoint.eye, viewpoint.target, glm::vec3(0.f, 1.f, 0.f));
+
+        CullMeshlets(mesh, projection * view, viewpoint.eye, commands, stats);
+
+        os << std::fixed << std::setprecision(1) << "  from (" << viewpoint.eye.x << ", " << viewpoint.eye.y << ", " << viewpoint.eye.z << "): "
+           << 100.f * stats.culledTriangles / std::max<uint64_t>(stats.triangles, 1) << "% of triangles culled (" << stats.frustumCulled << " meshlets outside, "
+           << stats.backfaceCulled << " backfacing), " << stats.commands << " draws\n";
+
+        total.triangles += stats.triangles;
+        total.culledTriangles += stats.culledTriangles;
+    }
+
+    os << "  average " << 100.f * total.culledTriangles / std::max<uint64_t>(total.triangles, 1) << "% culled\n";
+
+    os.flags(flags);
+    os.precision(precision);
+}
+
+END_VISUALIZER_NAMESPACE
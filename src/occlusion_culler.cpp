@@ -0,0 +1,644 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <limits>
+
+#include "occlusion_culler.hpp"
+#include "simd.hpp"
+#include "terrain.hpp"
+#include "thread_pool.hpp"
+
+BEGIN_VISUALIZER_NAMESPACE
+
+namespace
+{
+    // Below these a frame stays on the calling thread, waking the pool costs more
+    constexpr size_t s_TrianglesPerChunk = 2048;
+    constexpr size_t s_ParallelTriangleThreshold = 4096;
+    constexpr size_t s_InstancesPerChunk = 4096;
+    constexpr size_t s_ParallelInstanceThreshold = 16384;
+    // Triangles thinner than this cover no pixel center worth the setup
+    constexpr float s_MinArea = 1e-6f;
+
+    using Clock = std::chrono::steady_clock;
+
+    inline float ElapsedMs(Clock::time_point start)
+    {
+        return std::chrono::duration<float, std::milli>(Clock::now() - start).count();
+    }
+
+    inline glm::vec4 Row(const glm::mat4& m, int32_t r)
+    {
+        return glm::vec4(m[0][r], m[1][r], m[2][r], m[3][r]);
+    }
+
+    // Range of dot(row, (p, 1)) over the box center +- extent
+    inline glm::vec2 Interval(const glm::vec4& row, const glm::vec3& center, const glm::vec3& extent)
+    {
+        const float mid = row.x * center.x + row.y * center.y + row.z * center.z + row.w;
+        const float radius = std::abs(row.x) * extent.x + std::abs(row.y) * extent.y + std::abs(row.z) * extent.z;
+        return glm::vec2(mid - radius, mid + radius);
+    }
+
+    Visibility Classify(const glm::mat4& viewProjection, const glm::vec3& min, const glm::vec3& max, float nearClip,
+                        const float* tileDepth, uint32_t tilesX, uint32_t tilesY, uint32_t width, uint32_t height)
+    {
+        const glm::vec3 center = (min + max) * 0.5f;
+        const glm::vec3 extent = (max - min) * 0.5f;
+
+        if (!IntersectsFrustum(viewProjection, min, max, nearClip))
+        {
+            return Visibility::FrustumCulled;
+        }
+
+        const glm::vec4 rowX = Row(viewProjection, 0);
+        const glm::vec4 rowY = Row(viewProjection, 1);
+        const glm::vec4 rowW = Row(viewProjection, 3);
+        const glm::vec2 w = Interval(rowW, center, extent);
+
+        // Too close to project, it cannot be behind anything anyway
+        if (w.x <= nearClip)
+        {
+            return Visibility::Visible;
+        }
+
+        const glm::vec2 x = Interval(rowX, center, extent);
+        const glm::vec2 y = Interval(rowY, center, extent);
+
+        const float minX = std::min(x.x / w.x, x.x / w.y);
+        const float maxX = std::max(x.y / w.x, x.y / w.y);
+        const float minY = std::min(y.x / w.x, y.x / w.y);
+        const float maxY = std::max(y.y / w.x, y.y / w.y);
+        const float nearest = 1.f / w.x;
+
+        auto toTile = [](float ndc, uint32_t pixels, uint32_t tiles)
+        {
+            const float pixel = (ndc * 0.5f + 0.5f) * static_cast<float>(pixels);
+            return std::clamp(static_cast<int32_t>(std::floor(pixel / static_cast<float>(OcclusionCuller::s_TileSize))), 0, static_cast<int32_t>(tiles) - 1);
+        };
+
+        const int32_t tileMinX = toTile(minX, width, tilesX);
+        const int32_t tileMaxX = toTile(maxX, width, tilesX);
+        const int32_t tileMinY = toTile(minY, height, tilesY);
+        const int32_t tileMaxY = toTile(maxY, height, tilesY);
+
+        for (int32_t ty = tileMinY; ty <= tileMaxY; ++ty)
+        {
+            const float* row = tileDepth + static_cast<size_t>(ty) * tilesX;
+
+            for (int32_t tx = tileMinX; tx <= tileMaxX; ++tx)
+            {
+                if (row[tx] <= nearest)
+                {
+                    return Visibility::Visible;
+                }
+            }
+        }
+
+        return Visibility::Occluded;
+    }
+
+    // Keeps the part of the polygon with w >= nearClip; returns the new vertex count
+    uint32_t ClipNear(const glm::vec4 (&in)[3], glm::vec4 (&out)[4], float nearClip)
+    {
+        uint32_t count = 0;
+
+        for (uint32_t i = 0; i < 3; ++i)
+        {
+            const glm::vec4& a = in[i];
+            const glm::vec4& b = in[(i + 1) % 3];
+            const bool aInside = a.w >= nearClip;
+            const bool bInside = b.w >= nearClip;
+
+            if (aInside)
+            {
+                out[count++] = a;
+            }
+            if (aInside != bInside)
+            {
+                const float t = (nearClip - a.w) / (b.w - a.w);
+                out[count++] = a + (b - a) * t;
+            }
+        }
+        return count;
+    }
+}
+
+bool IntersectsFrustum(const glm::mat4& viewProjection, const glm::vec3& min, const glm::vec3& max, float nearClip)
+{
+    const glm::vec3 center = (min + max) * 0.5f;
+    const glm::vec3 extent = (max - min) * 0.5f;
+
+    const glm::vec4 rowX = Row(viewProjection, 0);
+    const glm::vec4 rowY = Row(viewProjection, 1);
+    const glm::vec4 rowW = Row(viewProjection, 3);
+
+    // A plane rejects the box when even its best corner is outside
+    return Interval(rowW + rowX, center, extent).y >= 0.f && Interval(rowW - rowX, center, extent).y >= 0.f &&
+           Interval(rowW + rowY, center, extent).y >= 0.f && Interval(rowW - rowY, center, extent).y >= 0.f &&
+           Interval(rowW, center, extent).y >= nearClip;
+}
+
+OccluderMesh BuildTerrainOccluder(const Terrain& terrain, uint32_t resolution)
+{
+    OccluderMesh mesh;
+
+    if (terrain.IsEmpty() || resolution == 0)
+    {
+        return mesh;
+    }
+
+    const glm::vec3 min = terrain.GetMin();
+    const glm::vec3 max = terrain.GetMax();
+    const uint32_t side = resolution + 1;
+    const glm::vec2 step((max.x - min.x) / static_cast<float>(resolution), (max.z - min.z) / static_cast<float>(resolution));
+
+    // Lowest terrain point over each quad; off the mesh counts as the
+    // bottom of the terrain
+    std::vector<float> quadLowest(static_cast<size_t>(resolution) * resolution);
+
+    for (uint32_t z = 0; z < resolution; ++z)
+    {
+        for (uint32_t x = 0; x < resolution; ++x)
+        {
+            const glm::vec2 quadMin(min.x + static_cast<float>(x) * step.x, min.z + static_cast<float>(z) * step.y);
+            const glm::vec2 quadMax(x + 1 == resolution ? max.x : quadMin.x + step.x, z + 1 == resolution ? max.z : quadMin.y + step.y);
+
+            float lowest;
+            quadLowest[static_cast<size_t>(z) * resolution + x] = terrain.LowestIn(quadMin, quadMax, lowest) ? lowest : min.y;
+        }
+    }
+
+    // Holes are only seen where they reach a vertex
+    std::vector<glm::vec2> xz;
+    xz.reserve(static_cast<size_t>(side) * side);
+
+    for (uint32_t z = 0; z < side; ++z)
+    {
+        for (uint32_t x = 0; x < side; ++x)
+        {
+            xz.emplace_back(x == resolution ? max.x : min.x + static_cast<float>(x) * step.x, z == resolution ? max.z : min.z + static_cast<float>(z) * step.y);
+        }
+    }
+
+    std::vector<float> heights(xz.size());
+    terrain.HeightAt(xz, heights);
+
+    mesh.vertices.reserve(xz.size());
+
+    for (uint32_t z = 0; z < side; ++z)
+    {
+        for (uint32_t x = 0; x < side; ++x)
+        {
+            const size_t v = static_cast<size_t>(z) * side + x;
+            float lowest = std::isnan(heights[v]) ? min.y : max.y;
+
+            // Every quad touching the vertex, so both triangles of a quad
+            // stay under the terrain it covers
+            for (uint32_t qz = std::max(z, 1u) - 1; qz <= std::min(z, resolution - 1); ++qz)
+            {
+                for (uint32_t qx = std::max(x, 1u) - 1; qx <= std::min(x, resolution - 1); ++qx)
+                {
+                    lowest = std::min(lowest, quadLowest[static_cast<size_t>(qz) * resolution + qx]);
+                }
+            }
+
+            mesh.vertices.emplace_back(xz[v].x, lowest, xz[v].y);
+        }
+    }
+
+    mesh.indices.reserve(static_cast<size_t>(resolution) * resolution * 6);
+
+    for (uint32_t z = 0; z < resolution; ++z)
+    {
+        for (uint32_t x = 0; x < resolution; ++x)
+        {
+            const uint32_t i0 = z * side + x;
+            const uint32_t i1 = i0 + 1;
+            const uint32_t i2 = i0 + side;
+            const uint32_t i3 = i2 + 1;
+
+            mesh.indices.insert(mesh.indices.end(), { i0, i2, i1, i1, i2, i3 });
+        }
+    }
+
+    return mesh;
+}
+
+OcclusionCuller::OcclusionCuller(uint32_t width, uint32_t height, ThreadPool* pool, float nearClip)
+    : m_Width((std::max(width, s_BinWidth) + s_BinWidth - 1) / s_BinWidth * s_BinWidth)
+    , m_Height((std::max(height, s_BinHeight) + s_BinHeight - 1) / s_BinHeight * s_BinHeight)
+    , m_TilesX(m_Width / s_TileSize)
+    , m_TilesY(m_Height / s_TileSize)
+    , m_BinsX(m_Width / s_BinWidth)
+    , m_BinsY(m_Height / s_BinHeight)
+    , m_Pool(pool)
+    , m_NearClip(nearClip)
+    , m_Depth(static_cast<size_t>(m_Width) * m_Height, 0.f)
+    , m_TileDepth(static_cast<size_t>(m_TilesX) * m_TilesY, 0.f)
+{}
+
+void OcclusionCuller::BeginFrame(const glm::mat4& viewProjection)
+{
+    if (m_FrameStarted)
+    {
+        AccumulateFrameStats();
+        ++m_FrameCount;
+    }
+    m_FrameStarted = true;
+
+    m_ViewProjection = viewProjection;
+    m_Occluders.clear();
+    m_FrameStats = {};
+
+    std::fill(m_Depth.begin(), m_Depth.end(), 0.f);
+    std::fill(m_TileDepth.begin(), m_TileDepth.end(), 0.f);
+}
+
+void OcclusionCuller::AddOccluder(const OccluderMesh& mesh)
+{
+    m_Occluders.push_back(&mesh);
+}
+
+void OcclusionCuller::AccumulateFrameStats()
+{
+    m_TotalStats.occluderTriangles += m_FrameStats.occluderTriangles;
+    m_TotalStats.rasterizedTriangles += m_FrameStats.rasterizedTriangles;
+    m_TotalStats.tested += m_FrameStats.tested;
+    m_TotalStats.frustumCulled += m_FrameStats.frustumCulled;
+    m_TotalStats.occluded += m_FrameStats.occluded;
+    m_TotalStats.rasterizeMs += m_FrameStats.rasterizeMs;
+    m_TotalStats.testMs += m_FrameStats.testMs;
+}
+
+void OcclusionCuller::RasterizeOccluders()
+{
+    const Clock::time_point start = Clock::now();
+
+    m_Chunks.clear();
+    size_t triangleCount = 0;
+
+    for (const OccluderMesh* mesh : m_Occluders)
+    {
+        const size_t count = mesh->indices.size() / 3;
+
+        for (size_t first = 0; first < count; first += s_TrianglesPerChunk)
+        {
+            m_Chunks.push_back({ mesh, first, std::min(s_TrianglesPerChunk, count - first) });
+        }
+        triangleCount += count;
+    }
+
+    const size_t binCount = static_cast<size_t>(m_BinsX) * m_BinsY;
+
+    if (m_ChunkTriangles.size() < m_Chunks.size())
+    {
+        m_ChunkTriangles.resize(m_Chunks.size());
+        m_ChunkBins.resize(m_Chunks.size() * binCount);
+    }
+
+    const bool parallel = m_Pool && m_Pool->GetWorkerCount() > 0 && triangleCount >= s_ParallelTriangleThreshold;
+
+    if (parallel)
+    {
+        m_Pool->ParallelFor(m_Chunks.size(), [this](size_t chunk) { SetupTriangles(chunk); });
+        m_Pool->ParallelFor(binCount, [this](size_t bin) { RasterizeBin(bin); });
+    }
+    else
+    {
+        for (size_t chunk = 0; chunk < m_Chunks.size(); ++chunk)
+        {
+            SetupTriangles(chunk);
+        }
+        for (size_t bin = 0; bin < binCount; ++bin)
+        {
+            RasterizeBin(bin);
+        }
+    }
+
+    m_FrameStats.occluderTriangles = static_cast<uint32_t>(triangleCount);
+    for (size_t chunk = 0; chunk < m_Chunks.size(); ++chunk)
+    {
+        m_FrameStats.rasterizedTriangles += static_cast<uint32_t>(m_ChunkTriangles[chunk].size());
+    }
+    m_FrameStats.rasterizeMs = ElapsedMs(start);
+}
+
+void OcclusionCuller::SetupTriangles(size_t chunk)
+{
+    const TriangleChunk& range = m_Chunks[chunk];
+    const size_t binCount = static_cast<size_t>(m_BinsX) * m_BinsY;
+
+    m_ChunkTriangles[chunk].clear();
+    for (size_t bin = 0; bin < binCount; ++bin)
+    {
+        m_ChunkBins[chunk * binCount + bin].clear();
+    }
+
+    const std::vector<glm::vec3>& vertices = range.mesh->vertices;
+    const std::vector<uint32_t>& indices = range.mesh->indices;
+
+    for (size_t t = range.first; t < range.first + range.count; ++t)
+    {
+        glm::vec4 clip[3];
+        for (uint32_t v = 0; v < 3; ++v)
+        {
+            clip[v] = m_ViewProjection * glm::vec4(vertices[indices[t * 3 + v]], 1.f);
+        }
+
+        // Entirely outside one of the side or near planes
+        if ((clip[0].x > clip[0].w && clip[1].x > clip[1].w && clip[2].x > clip[2].w) ||
+            (clip[0].x < -clip[0].w && clip[1].x < -clip[1].w && clip[2].x < -clip[2].w) ||
+            (clip[0].y > clip[0].w && clip[1].y > clip[1].w && clip[2].y > clip[2].w) ||
+            (clip[0].y < -clip[0].w && clip[1].y < -clip[1].w && clip[2].y < -clip[2].w) ||
+            (clip[0].w < m_NearClip && clip[1].w < m_NearClip && clip[2].w < m_NearClip))
+        {
+            continue;
+        }
+
+        if (clip[0].w >= m_NearClip && clip[1].w >= m_NearClip && clip[2].w >= m_NearClip)
+        {
+            EmitTriangle(chunk, clip[0], clip[1], clip[2]);
+            continue;
+        }
+
+        glm::vec4 clipped[4];
+        const uint32_t count = ClipNear(clip, clipped, m_NearClip);
+
+        for (uint32_t v = 2; v < count; ++v)
+        {
+            EmitTriangle(chunk, clipped[0], clipped[v - 1], clipped[v]);
+        }
+    }
+}
+
+void OcclusionCuller::EmitTriangle(size_t chunk, const glm::vec4& a, const glm::vec4& b, const glm::vec4& c)
+{
+    ScreenTriangle triangle;
+    const glm::vec4* vertices[3] = { &a, &b, &c };
+
+    for (uint32_t v = 0; v < 3; ++v)
+    {
+        const float invW = 1.f / vertices[v]->w;
+        triangle.x[v] = (vertices[v]->x * invW * 0.5f + 0.5f) * static_cast<float>(m_Width);
+        triangle.y[v] = (vertices[v]->y * invW * 0.5f + 0.5f) * static_cast<float>(m_Height);
+        triangle.z[v] = invW;
+    }
+
+    const float area = (triangle.x[1] - triangle.x[0]) * (triangle.y[2] - triangle.y[0]) - (triangle.x[2] - triangle.x[0]) * (triangle.y[1] - triangle.y[0]);
+
+    if (std::abs(area) < s_MinArea)
+    {
+        return;
+    }
+
+    // Occluders are drawn from both sides, store them counter-clockwise
+    if (area < 0.f)
+    {
+        std::swap(triangle.x[1], triangle.x[2]);
+        std::swap(triangle.y[1], triangle.y[2]);
+        std::swap(triangle.z[1], triangle.z[2]);
+    }
+
+    const float minX = std::min({ triangle.x[0], triangle.x[1], triangle.x[2] });
+    const float maxX = std::max({ triangle.x[0], triangle.x[1], triangle.x[2] });
+    const float minY = std::min({ triangle.y[0], triangle.y[1], triangle.y[2] });
+    const float maxY = std::max({ triangle.y[0], triangle.y[1], triangle.y[2] });
+
+    if (maxX < 0.f || maxY < 0.f || minX >= static_cast<float>(m_Width) || minY >= static_cast<float>(m_Height))
+    {
+        return;
+    }
+
+    triangle.minX = std::max(static_cast<int32_t>(minX), 0);
+    triangle.minY = std::max(static_cast<int32_t>(minY), 0);
+    triangle.maxX = std::min(static_cast<int32_t>(maxX), static_cast<int32_t>(m_Width) - 1);
+    triangle.maxY = std::min(static_cast<int32_t>(maxY), static_cast<int32_t>(m_Height) - 1);
+
+    std::vector<ScreenTriangle>& triangles = m_ChunkTriangles[chunk];
+    const uint32_t index = static_cast<uint32_t>(triangles.size());
+    triangles.push_back(triangle);
+
+    const size_t binCount = static_cast<size_t>(m_BinsX) * m_BinsY;
+
+    for (int32_t by = triangle.minY / static_cast<int32_t>(s_BinHeight); by <= triangle.maxY / static_cast<int32_t>(s_BinHeight); ++by)
+    {
+        for (int32_t bx = triangle.minX / static_cast<int32_t>(s_BinWidth); bx <= triangle.maxX / static_cast<int32_t>(s_BinWidth); ++bx)
+        {
+            m_ChunkBins[chunk * binCount + static_cast<size_t>(by) * m_BinsX + bx].push_back(index);
+        }
+    }
+}
+
+void OcclusionCuller::RasterizeBin(size_t bin)
+{
+    const size_t binCount = static_cast<size_t>(m_BinsX) * m_BinsY;
+    const int32_t binMinX = static_cast<int32_t>(bin % m_BinsX * s_BinWidth);
+    const int32_t binMinY = static_cast<int32_t>(bin / m_BinsX * s_BinHeight);
+    const int32_t binMaxX = binMinX + static_cast<int32_t>(s_BinWidth) - 1;
+    const int32_t binMaxY = binMinY + static_cast<int32_t>(s_BinHeight) - 1;
+
+    for (size_t chunk = 0; chunk < m_Chunks.size(); ++chunk)
+    {
+        const std::vector<ScreenTriangle>& triangles = m_ChunkTriangles[chunk];
+
+        for (uint32_t index : m_ChunkBins[chunk * binCount + bin])
+        {
+            RasterizeTriangle(triangles[index], binMinX, binMinY, binMaxX, binMaxY);
+        }
+    }
+
+    // Reduce the bin's tiles to their farthest depth
+    for (int32_t ty = binMinY / static_cast<int32_t>(s_TileSize); ty <= binMaxY / static_cast<int32_t>(s_TileSize); ++ty)
+    {
+        for (int32_t tx = binMinX / static_cast<int32_t>(s_TileSize); tx <= binMaxX / static_cast<int32_t>(s_TileSize); ++tx)
+        {
+            float farthest = std::numeric_limits<float>::max();
+
+            for (uint32_t y = 0; y < s_TileSize; ++y)
+            {
+                const float* row = m_Depth.data() + (static_cast<size_t>(ty) * s_TileSize + y) * m_Width + static_cast<size_t>(tx) * s_TileSize;
+                for (uint32_t x = 0; x < s_TileSize; ++x)
+                {
+                    farthest = std::min(farthest, row[x]);
+                }
+            }
+
+            m_TileDepth[static_cast<size_t>(ty) * m_TilesX + tx] = farthest;
+        }
+    }
+}
+
+void OcclusionCuller::RasterizeTriangle(const ScreenTriangle& t, int32_t binMinX, int32_t binMinY, int32_t binMaxX, int32_t binMaxY)
+{
+    const int32_t minX = std::max(t.minX, binMinX) & ~3;
+    const int32_t maxX = std::min(t.maxX, binMaxX);
+    const int32_t minY = std::max(t.minY, binMinY);
+    const int32_t maxY = std::min(t.maxY, binMaxY);
+
+    if (minX > maxX || minY > maxY)
+    {
+        return;
+    }
+
+    // Edge i runs from vertex i to vertex i + 1, positive inside
+    float a[3], b[3], c[3];
+    for (uint32_t i = 0; i < 3; ++i)
+    {
+        const uint32_t j = (i + 1) % 3;
+        a[i] = t.y[i] - t.y[j];
+        b[i] = t.x[j] - t.x[i];
+        c[i] = t.x[i] * t.y[j] - t.x[j] * t.y[i];
+    }
+
+    // 1/w as a plane over the screen, from the barycentrics: the weight of
+    // a vertex is the edge opposite to it over the doubled area
+    const float area = c[0] + c[1] + c[2];
+    const float invArea = 1.f / area;
+    const float dzdx = (a[1] * t.z[0] + a[2] * t.z[1] + a[0] * t.z[2]) * invArea;
+    const float dzdy = (b[1] * t.z[0] + b[2] * t.z[1] + b[0] * t.z[2]) * invArea;
+    const float z0 = (c[1] * t.z[0] + c[2] * t.z[1] + c[0] * t.z[2]) * invArea;
+
+#if VISUALIZER_SSE2
+    const __m128 laneX = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 a0 = _mm_set1_ps(a[0]), a1 = _mm_set1_ps(a[1]), a2 = _mm_set1_ps(a[2]);
+    const __m128 zdx = _mm_set1_ps(dzdx);
+
+    for (int32_t y = minY; y <= maxY; ++y)
+    {
+        const float py = static_cast<float>(y) + 0.5f;
+        const __m128 rowE0 = _mm_set1_ps(b[0] * py + c[0]);
+        const __m128 rowE1 = _mm_set1_ps(b[1] * py + c[1]);
+        const __m128 rowE2 = _mm_set1_ps(b[2] * py + c[2]);
+        const __m128 rowZ = _mm_set1_ps(dzdy * py + z0);
+        float* depth = m_Depth.data() + static_cast<size_t>(y) * m_Width;
+
+        for (int32_t x = minX; x <= maxX; x += 4)
+        {
+            const __m128 px = _mm_add_ps(_mm_set1_ps(static_cast<float>(x)), laneX);
+            const __m128 e0 = _mm_add_ps(_mm_mul_ps(a0, px), rowE0);
+            const __m128 e1 = _mm_add_ps(_mm_mul_ps(a1, px), rowE1);
+            const __m128 e2 = _mm_add_ps(_mm_mul_ps(a2, px), rowE2);
+            const __m128 inside = _mm_and_ps(_mm_cmpge_ps(e0, zero), _mm_and_ps(_mm_cmpge_ps(e1, zero), _mm_cmpge_ps(e2, zero)));
+
+            if (_mm_movemask_ps(inside) == 0)
+            {
+                continue;
+            }
+
+            const __m128 z = _mm_add_ps(_mm_mul_ps(zdx, px), rowZ);
+            const __m128 old = _mm_loadu_ps(depth + x);
+            const __m128 nearest = _mm_max_ps(old, z);
+            _mm_storeu_ps(depth + x, _mm_or_ps(_mm_and_ps(inside, nearest), _mm_andnot_ps(inside, old)));
+        }
+    }
+#else
+    for (int32_t y = minY; y <= maxY; ++y)
+    {
+        const float py = static_cast<float>(y) + 0.5f;
+        float* depth = m_Depth.data() + static_cast<size_t>(y) * m_Width;
+
+        for (int32_t x = minX; x <= maxX; ++x)
+        {
+            const float px = static_cast<float>(x) + 0.5f;
+
+            if (a[0] * px + b[0] * py + c[0] >= 0.f && a[1] * px + b[1] * py + c[1] >= 0.f && a[2] * px + b[2] * py + c[2] >= 0.f)
+            {
+                depth[x] = std::max(depth[x], dzdx * px + dzdy * py + z0);
+            }
+        }
+    }
+#endif
+}
+
+Visibility OcclusionCuller::TestBox(const glm::vec3& min, const glm::vec3& max)
+{
+    const Visibility visibility = Classify(m_ViewProjection, min, max, m_NearClip, m_TileDepth.data(), m_TilesX, m_TilesY, m_Width, m_Height);
+
+    ++m_FrameStats.tested;
+    m_FrameStats.frustumCulled += visibility == Visibility::FrustumCulled;
+    m_FrameStats.occluded += visibility == Visibility::Occluded;
+
+    return visibility;
+}
+
+Visibility OcclusionCuller::ClassifyBox(const glm::vec3& min, const glm::vec3& max) const
+{
+    return Classify(m_ViewProjection, min, max, m_NearClip, m_TileDepth.data(), m_TilesX, m_TilesY, m_Width, m_Height);
+}
+
+void OcclusionCuller::AddTestResults(uint64_t tested, uint64_t frustumCulled, uint64_t occluded, float testMs)
+{
+    m_FrameStats.tested += tested;
+    m_FrameStats.frustumCulled += frustumCulled;
+    m_FrameStats.occluded += occluded;
+    m_FrameStats.testMs += testMs;
+}
+
+void OcclusionCuller::CullInstanceRange(size_t chunk)
+{
+    const size_t first = chunk * s_InstancesPerChunk;
+    const size_t last = std::min(first + s_InstancesPerChunk, m_CullInstances.size());
+
+    for (size_t i = first; i < last; ++i)
+    {
+        glm::vec3 min, max;
+        GetInstanceBounds(m_CullInstances[i], m_CullLocalMin, m_CullLocalMax, min, max);
+
+        m_InstanceVisibility[i] = Classify(m_ViewProjection, min, max, m_NearClip, m_TileDepth.data(), m_TilesX, m_TilesY, m_Width, m_Height);
+    }
+}
+
+size_t OcclusionCuller::CullInstances(std::span<const InstanceTransform> instances, const glm::vec3& localMin, const glm::vec3& localMax, InstanceTransform* out)
+{
+    const Clock::time_point start = Clock::now();
+
+    m_CullInstances = instances;
+    m_CullLocalMin = localMin;
+    m_CullLocalMax = localMax;
+    if (m_InstanceVisibility.size() < instances.size())
+    {
+        m_InstanceVisibility.resize(instances.size());
+    }
+
+    const size_t chunkCount = (instances.size() + s_InstancesPerChunk - 1) / s_InstancesPerChunk;
+
+    if (m_Pool && m_Pool->GetWorkerCount() > 0 && instances.size() >= s_ParallelInstanceThreshold)
+    {
+        m_Pool->ParallelFor(chunkCount, [this](size_t chunk) { CullInstanceRange(chunk); });
+    }
+    else
+    {
+        for (size_t chunk = 0; chunk < chunkCount; ++chunk)
+        {
+            CullInstanceRange(chunk);
+        }
+    }
+
+    size_t visible = 0;
+
+    for (size_t i = 0; i < instances.size(); ++i)
+    {
+        switch (m_InstanceVisibility[i])
+        {
+        case Visibility::Visible:
+            out[visible++] = instances[i];
+            break;
+        case Visibility::FrustumCulled:
+            ++m_FrameStats.frustumCulled;
+            break;
+        case Visibility::Occluded:
+            ++m_FrameStats.occluded;
+            break;
+        }
+    }
+
+    m_FrameStats.tested += instances.size();
+    m_FrameStats.testMs += ElapsedMs(start);
+    m_CullInstances = {};
+
+    return visible;
+}
+
+END_VISUALIZER_NAMESPACE
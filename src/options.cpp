@@ -0,0 +1,289 @@
+#include <charconv>
+#include <iostream>
+#include <sstream>
+#include <string_view>
+#include <vector>
+
+#include "alloc_tracking.hpp"
+#include "options.hpp"
+
+BEGIN_VISUALIZER_NAMESPACE
+
+namespace
+{
+    template<typename T>
+    bool ParseValue(int32_t& i, int32_t argc, char** argv, T& value)
+    {
+        if (i + 1 >= argc)
+        {
+            std::cerr << "Missing value after " << argv[i] << '\n';
+            return false;
+        }
+
+        const std::string_view text(argv[++i]);
+        const auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), value);
+
+        if (error != std::errc() || end != text.data() + text.size())
+        {
+            std::cerr << "Invalid value for " << argv[i - 1] << ": " << text << '\n';
+            return false;
+        }
+        return true;
+    }
+
+    bool ParseString(int32_t& i, int32_t argc, char** argv, std::string& value)
+    {
+        if (i + 1 >= argc)
+        {
+            std::cerr << "Missing value after " << argv[i] << '\n';
+            return false;
+        }
+
+        value = argv[++i];
+        return true;
+    }
+}
+
+bool ParseLaunchOptions(int32_t argc, char** argv, LaunchOptions& options)
+{
+    options.launchArguments.clear();
+
+    for (int32_t i = 1; i < argc; ++i)
+    {
+        options.launchArguments.append(argv[i]).append(i + 1 < argc ? "\n" : "");
+    }
+
+    for (int32_t i = 1; i < argc; ++i)
+    {
+        const std::string_view arg(argv[i]);
+
+        if (arg == "--scene")
+        {
+            if (!ParseString(i, argc, argv, options.sceneManifest))
+            {
+                return false;
+            }
+        }
+        else if (arg == "--scatter")
+        {
+            options.scatterPalms = true;
+        }
+        else if (arg == "--scatter-seed")
+        {
+            options.scatterPalms = true;
+            if (!ParseValue(i, argc, argv, options.scatterSeed))
+            {
+                return false;
+            }
+        }
+        else if (arg == "--world")
+        {
+            if (i + 1 >= argc)
+            {
+                std::cerr << "Missing value after " << arg << '\n';
+                return false;
+            }
+            options.worldManifest = argv[++i];
+        }
+        else if (arg == "--no-occlusion")
+        {
+            options.occlusionCulling = false;
+        }
+        else if (arg == "--hiz")
+        {
+            options.gpuOcclusion = true;
+        }
+        else if (arg == "--queries")
+        {
+            options.occlusionQueries = true;
+        }
+        else if (arg == "--wind")
+        {
+            options.wind = true;
+        }
+        else if (arg == "--bvh-cache")
+        {
+            if (!ParseString(i, argc, argv, options.bvhCache))
+            {
+                return false;
+            }
+        }
+        else if (arg == "--meshlets")
+        {
+            options.meshlets = true;
+        }
+        else if (arg == "--lights")
+        {
+            if (!ParseValue(i, argc, argv, options.pointLights))
+            {
+                return false;
+            }
+        }
+        else if (arg == "--light-benchmark")
+        {
+            options.lightBenchmark = true;
+        }
+        else if (arg == "--prepass")
+        {
+            const std::string_view mode = i + 1 < argc ? argv[++i] : "";
+
+            if (mode == "off")
+            {
+                options.prepass = PrepassMode::Off;
+            }
+            else if (mode == "on")
+            {
+                options.prepass = PrepassMode::On;
+            }
+            else if (mode == "auto")
+            {
+                options.prepass = PrepassMode::Auto;
+            }
+            else
+            {
+                std::cerr << "Expected off, on or auto after " << arg << '\n';
+                return false;
+            }
+        }
+        else if (arg == "--overdraw-view")
+        {
+            options.overdrawView = true;
+        }
+        else if (arg == "--record-path")
+        {
+            if (!ParseString(i, argc, argv, options.recordPath))
+            {
+                return false;
+            }
+        }
+        else if (arg == "--play-path")
+        {
+            if (!ParseString(i, argc, argv, options.playPath))
+            {
+                return false;
+            }
+        }
+        else if (arg == "--benchmark-json")
+        {
+            if (!ParseString(i, argc, argv, options.benchmarkJson))
+            {
+                return false;
+            }
+        }
+        else if (arg == "--publish-stats")
+        {
+            options.publishStats = true;
+        }
+        else if (arg == "--read-stats")
+        {
+            options.readStats = true;
+        }
+        else if (arg == "--gl-capture")
+        {
+            if (!ParseString(i, argc, argv, options.glCapture))
+            {
+                return false;
+            }
+        }
+        else if (arg == "--gl-capture-frames")
+        {
+            if (!ParseValue(i, argc, argv, options.glCaptureFrames))
+            {
+                return false;
+            }
+        }
+        else if (arg == "--gl-replay")
+        {
+            if (!ParseString(i, argc, argv, options.glReplay))
+            {
+                return false;
+            }
+        }
+        else if (arg == "--gl-report")
+        {
+            if (!ParseString(i, argc, argv, options.glReport))
+            {
+                return false;
+            }
+        }
+        else if (arg == "--gl-budget")
+        {
+            options.checkGlBudget = true;
+            if (!ParseValue(i, argc, argv, options.glStateChangeBudget))
+            {
+                return false;
+            }
+        }
+        else if (arg == "--iterations")
+        {
+            if (!ParseValue(i, argc, argv, options.playIterations))
+            {
+                return false;
+            }
+            if (options.playIterations == 0)
+            {
+                std::cerr << arg << " needs at least one iteration\n";
+                return false;
+            }
+        }
+        else if (arg == "--check-allocations")
+        {
+            if (!AllocationTracker::s_Enabled)
+            {
+                std::cerr << arg << " needs a build with VISUALIZER_TRACK_ALLOCATIONS=1 (the Profile configuration)\n";
+                return false;
+            }
+            options.checkAllocations = true;
+            if (!ParseValue(i, argc, argv, options.allocationWarmupFrames))
+            {
+                return false;
+            }
+        }
+        else
+        {
+            std::cerr << "Unknown option: " << arg << '\n';
+            return false;
+        }
+    }
+
+    if (options.gpuOcclusion && options.occlusionQueries)
+    {
+        std::cerr << "--hiz and --queries cannot be combined\n";
+        return false;
+    }
+
+    if (!options.recordPath.empty() && !options.playPath.empty())
+    {
+        std::cerr << "--record-path and --play-path cannot be combined\n";
+        return false;
+    }
+
+    if (!options.glCapture.empty() && !options.glReplay.empty())
+    {
+        std::cerr << "--gl-capture and --gl-replay cannot be combined\n";
+        return false;
+    }
+
+    return true;
+}
+
+bool ParseLaunchOptions(const std::string& arguments, LaunchOptions& options)
+{
+    std::vector<std::string> args{ "" };
+    std::istringstream ss(arguments);
+
+    for (std::string arg; std::getline(ss, arg);)
+    {
+        args.push_back(arg);
+    }
+
+    std::vector<char*> argv;
+    for (std::string& arg : args)
+    {
+        argv.push_back(arg.data());
+    }
+
+    return ParseLaunchOptions(static_cast<int32_t>(argv.size()), argv.data(), options);
+}
+
+END_VISUALIZER_NAMESPACE
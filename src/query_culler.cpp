@@ -0,0 +1,326 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <string>
+
+#include "gl_capture.hpp"
+#include "gpu_resources.hpp"
+#include "occlusion_culler.hpp"
+#include "query_culler.hpp"
+
+BEGIN_VISUALIZER_NAMESPACE
+
+namespace
+{
+    // Boxes are grown by this much, and a camera this close to one skips
+    // its query: the near plane would clip the box and hide the cluster
+    constexpr float s_BoxMargin = 0.5f;
+
+    char const* const s_BoxVertexShader =
+        R"(#version 450 core
+
+layout(std140, binding = 0) uniform Matrix
+{
+    mat4 modelViewProjection;
+};
+
+layout(location = 0) uniform vec3 u_BoxMin;
+layout(location = 1) uniform vec3 u_BoxMax;
+
+// Two triangles per face of the unit cube, counter-clockwise from outside
+const int s_Indices[36] = int[36](
+    0, 2, 1, 1, 2, 3,
+    4, 5, 6, 5, 7, 6,
+    0, 1, 4, 1, 5, 4,
+    2, 6, 3, 3, 6, 7,
+    0, 4, 2, 2, 4, 6,
+    1, 3, 5, 3, 7, 5);
+
+void main()
+{
+    int corner = s_Indices[gl_VertexID];
+    vec3 position = mix(u_BoxMin, u_BoxMax, vec3(corner & 1, (corner >> 1) & 1, (corner >> 2) & 1));
+
+    gl_Position = modelViewProjection * vec4(position, 1.0);
+}
+)";
+
+    char const* const s_BoxFragmentShader =
+        R"(#version 450 core
+
+void main()
+{
+}
+)";
+
+    using Clock = std::chrono::steady_clock;
+
+    GLuint CompileShader(GLenum type, const char* source, const char* name)
+    {
+        GLuint shader = glCreateShader(type);
+
+        glShaderSource(shader, 1, &source, nullptr);
+        glCompileShader(shader);
+
+        GLint length = 0;
+
+        glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &length);
+
+        if (length > 1)
+        {
+            std::string log(length, '\0');
+
+            glGetShaderInfoLog(shader, length, nullptr, log.data());
+
+            std::cerr << name << " shader log:\n" << log << '\n';
+        }
+        return shader;
+    }
+}
+
+bool OcclusionQueryCuller::Initialize()
+{
+    GLuint vShader = CompileShader(GL_VERTEX_SHADER, s_BoxVertexShader, "Query box vertex");
+    GLuint fShader = CompileShader(GL_FRAGMENT_SHADER, s_BoxFragmentShader, "Query box fragment");
+
+    m_BoxProgram = glCreateProgram();
+
+    glAttachShader(m_BoxProgram, vShader);
+    glAttachShader(m_BoxProgram, fShader);
+    glLinkProgram(m_BoxProgram);
+    glDetachShader(m_BoxProgram, vShader);
+    glDetachShader(m_BoxProgram, fShader);
+    glDeleteShader(vShader);
+    glDeleteShader(fShader);
+
+    GLint linked = GL_FALSE;
+    glGetProgramiv(m_BoxProgram, GL_LINK_STATUS, &linked);
+
+    if (linked != GL_TRUE)
+    {
+        std::cerr << "Cannot link the query box shader\n";
+        glDeleteProgram(m_BoxProgram);
+        m_BoxProgram = 0;
+        return false;
+    }
+
+    GpuResourceTracker::GetGlobal().RegisterProgram(m_BoxProgram);
+
+    // The cube comes from gl_VertexID, the vertex array stays empty
+    glCreateVertexArrays(1, &m_BoxVAO);
+
+    return true;
+}
+
+void OcclusionQueryCuller::Cleanup()
+{
+    for (Cluster& cluster : m_Clusters)
+    {
+        glDeleteQueries(1, &cluster.query);
+    }
+    m_Clusters.clear();
+    m_VisibleClusters.clear();
+    m_HiddenClusters.clear();
+
+    if (m_BoxVAO)
+    {
+        glDeleteVertexArrays(1, &m_BoxVAO);
+        m_BoxVAO = 0;
+    }
+    GpuResourceTracker::GetGlobal().DeleteProgram(m_BoxProgram);
+}
+
+void OcclusionQueryCuller::Build(std::vector<InstanceTransform>& instances, const glm::vec3& meshMin, const glm::vec3& meshMax, float clusterSize)
+{
+    for (Cluster& cluster : m_Clusters)
+    {
+        glDeleteQueries(1, &cluster.query);
+    }
+    m_Clusters.clear();
+
+    if (instances.empty())
+    {
+        return;
+    }
+
+    auto cellOf = [clusterSize](const InstanceTransform& instance)
+    {
+        return std::make_pair(static_cast<int32_t>(std::floor(instance.position.x / clusterSize)), static_cast<int32_t>(std::floor(instance.position.z / clusterSize)));
+    };
+
+    std::stable_sort(instances.begin(), instances.end(), [&cellOf](const InstanceTransform& a, const InstanceTransform& b)
+    {
+        return cellOf(a) < cellOf(b);
+    });
+
+    for (size_t i = 0; i < instances.size(); ++i)
+    {
+        glm::vec3 min, max;
+        GetInstanceBounds(instances[i], meshMin, meshMax, min, max);
+
+        if (i == 0 || cellOf(instances[i]) != cellOf(instances[i - 1]))
+        {
+            Cluster cluster;
+            cluster.min = min;
+            cluster.max = max;
+            cluster.first = static_cast<uint32_t>(i);
+            cluster.count = 0;
+            cluster.query = 0;
+            cluster.visible = true;
+            cluster.queryPending = false;
+            // Staggered so that the checks of visible clusters spread over frames
+            cluster.nextCheckFrame = m_Clusters.size() % s_VisibleCheckInterval;
+            m_Clusters.push_back(cluster);
+        }
+
+        Cluster& cluster = m_Clusters.back();
+        cluster.min = glm::min(cluster.min, min);
+        cluster.max = glm::max(cluster.max, max);
+        ++cluster.count;
+    }
+
+    for (Cluster& cluster : m_Clusters)
+    {
+        glCreateQueries(GL_ANY_SAMPLES_PASSED_CONSERVATIVE, 1, &cluster.query);
+    }
+
+    m_VisibleClusters.reserve(m_Clusters.size());
+    m_HiddenClusters.reserve(m_Clusters.size());
+}
+
+void OcclusionQueryCuller::AccumulateFrameStats()
+{
+    m_TotalStats.clustersDrawn += m_FrameStats.clustersDrawn;
+    m_TotalStats.geometryQueries += m_FrameStats.geometryQueries;
+    m_TotalStats.boxQueries += m_FrameStats.boxQueries;
+    m_TotalStats.resultsRead += m_FrameStats.resultsRead;
+    m_TotalStats.resultsNotReady += m_FrameStats.resultsNotReady;
+    m_TotalStats.waitMs += m_FrameStats.waitMs;
+}
+
+void OcclusionQueryCuller::ReadResults()
+{
+    const Clock::time_point start = Clock::now();
+
+    for (Cluster& cluster : m_Clusters)
+    {
+        if (!cluster.queryPending)
+        {
+            continue;
+        }
+
+        GLuint available = GL_FALSE;
+        glGetQueryObjectuiv(cluster.query, GL_QUERY_RESULT_AVAILABLE, &available);
+
+        if (!available)
+        {
+            ++m_FrameStats.resultsNotReady;
+            continue;
+        }
+
+        // Available already, this does not wait
+        GLuint samplesPassed = GL_FALSE;
+        glGetQueryObjectuiv(cluster.query, GL_QUERY_RESULT, &samplesPassed);
+
+        cluster.queryPending = false;
+        cluster.visible = samplesPassed != GL_FALSE;
+        ++m_FrameStats.resultsRead;
+    }
+
+    m_FrameStats.waitMs = std::chrono::duration<float, std::milli>(Clock::now() - start).count();
+}
+
+void OcclusionQueryCuller::BeginFrame(const glm::mat4& viewProjection, const glm::vec3& cameraPosition)
+{
+    if (m_FrameStarted)
+    {
+        AccumulateFrameStats();
+        ++m_FrameCount;
+    }
+    m_FrameStarted = true;
+    m_FrameStats = {};
+
+    ReadResults();
+
+    m_VisibleClusters.clear();
+    m_HiddenClusters.clear();
+
+    for (uint32_t i = 0; i < m_Clusters.size(); ++i)
+    {
+        Cluster& cluster = m_Clusters[i];
+
+        if (!IntersectsFrustum(viewProjection, cluster.min, cluster.max))
+        {
+            continue;
+        }
+
+        const bool cameraInside = glm::all(glm::greaterThanEqual(cameraPosition, cluster.min - s_BoxMargin)) &&
+                                  glm::all(glm::lessThanEqual(cameraPosition, cluster.max + s_BoxMargin));
+
+        if (cameraInside && !cluster.visible)
+        {
+            cluster.visible = true;
+            cluster.nextCheckFrame = m_FrameCount + s_VisibleCheckInterval;
+        }
+
+        if (cluster.visible)
+        {
+            m_VisibleClusters.push_back(i);
+        }
+        else
+        {
+            m_HiddenClusters.push_back(i);
+        }
+    }
+}
+
+void OcclusionQueryCuller::BeginQuery(Cluster& cluster)
+{
+    glBeginQuery(GL_ANY_SAMPLES_PASSED_CONSERVATIVE, cluster.query);
+
+    cluster.queryPending = true;
+    cluster.nextCheckFrame = m_FrameCount + s_VisibleCheckInterval;
+}
+
+void OcclusionQueryCuller::IssueBoxQueries()
+{
+    if (m_HiddenClusters.empty())
+    {
+        return;
+    }
+
+    // Test against the depth buffer without touching it
+    glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+    glDepthMask(GL_FALSE);
+    glUseProgram(m_BoxProgram);
+    glBindVertexArray(m_BoxVAO);
+
+    for (uint32_t index : m_HiddenClusters)
+    {
+        Cluster& cluster = m_Clusters[index];
+
+        // Still waiting on the last box, DrawRevealed() goes by that one
+        if (cluster.queryPending)
+        {
+            continue;
+        }
+
+        const glm::vec3 min = cluster.min - s_BoxMargin;
+        const glm::vec3 max = cluster.max + s_BoxMargin;
+        glProgramUniform3fv(m_BoxProgram, 0, 1, &min.x);
+        glProgramUniform3fv(m_BoxProgram, 1, 1, &max.x);
+
+        BeginQuery(cluster);
+        glDrawArrays(GL_TRIANGLES, 0, 36);
+        glEndQuery(GL_ANY_SAMPLES_PASSED_CONSERVATIVE);
+        ++m_FrameStats.boxQueries;
+    }
+
+    glBindVertexArray(0);
+    glUseProgram(0);
+    glDepthMask(GL_TRUE);
+    glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+}
+
+END_VISUALIZER_NAMESPACE
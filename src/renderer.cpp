@@ -1,139 +1,234 @@
 #include <GL/glew.h>
 
-#define TINYOBJLOADER_IMPLEMENTATION
-
 #pragma warning(push, 0)
 #include <glm/glm.hpp>
 #include <glm/gtc/type_ptr.hpp>
 #include <glm/gtc/constants.hpp>
 #pragma warning(pop, 0)
 
+#include <chrono>
+#include <cstddef>
+#include <filesystem>
+#include <memory_resource>
 #include <vector>
 #include <string>
+#include <cmath>
 #include <iostream>
-#include <sstream>
 
-#include "tinyobjloader/tiny_obj_loader.h"
 #include "camera.hpp"
+#include "depth_prepass.hpp"
+#include "gl_capture.hpp"
+#include "gpu_resources.hpp"
+#include "mesh.hpp"
+#include "meshlet.hpp"
+#include "occlusion_culler.hpp"
 #include "renderer.hpp"
+#include "scatter.hpp"
+#include "scene_manifest.hpp"
+#include "stats_registry.hpp"
+#include "thread_pool.hpp"
+#include "world_streaming.hpp"
 
 BEGIN_VISUALIZER_NAMESPACE
 
-struct VertexDataPosition3fColor3f
+namespace
 {
-    glm::vec3 position;
-    glm::vec3 normal;
-    glm::vec3 color;
-};
+    // Largest swing of the palms in the wind, in radians, and its pace
+    constexpr float s_WindAmplitude = 0.15f;
+    constexpr float s_WindFrequency = 1.3f;
+    // Phase change per unit of X + Z, the gusts rolling across the terrain
+    constexpr float s_WindPhaseScale = 0.05f;
+    // Instances a set's buffer holds at least once it has to grow
+    constexpr size_t s_MinInstanceCapacity = 64;
+    // MoveSphere() stops this far short of what it runs into, and slides
+    // along at most this many surfaces
+    constexpr float s_CollisionSkin = 0.01f;
+    constexpr uint32_t s_MaxSlides = 3;
+
+    // Same position math as the scene vertex shader, both invariant so that
+    // the color pass matches the pre-pass depths under GL_EQUAL
+    char const* const s_DepthVertexShader =
+        R"(#version 450 core
 
-float computeMagnitude(const glm::vec3 &v)
-{
-    return (std::sqrt(std::pow(v.x, 2) + std::pow(v.y, 2) + std::pow(v.z, 2)));
-}
+layout(location = 0) in vec3 inWorldPos;
+layout(location = 3) in vec4 inInstancePositionScale;
+layout(location = 4) in float inInstanceYaw;
 
-glm::vec3 computeNormal(const glm::vec3 &A, const glm::vec3 &B, const glm::vec3 &C)
+layout(std140, binding = 0) uniform Matrix
 {
-    glm::vec3 N = glm::cross(A - B, B - C);
+    mat4 modelViewProjection;
+};
 
-    //if (computeMagnitude(N) > 0)
-    {
-        return (glm::normalize(N));
-    }
-    return (glm::vec3());
-}
+invariant gl_Position;
 
-void LoadMesh(std::vector<VertexDataPosition3fColor3f> &vertices, std::vector<uint32_t> &indices, const std::string &path)
+void main()
 {
-    tinyobj::ObjReader reader;
-    tinyobj::ObjReaderConfig reader_config;
+    float c = cos(inInstanceYaw);
+    float s = sin(inInstanceYaw);
+    mat3 yaw = mat3(c, 0.0, -s, 0.0, 1.0, 0.0, s, 0.0, c);
+    vec3 worldPos = yaw * inWorldPos * inInstancePositionScale.w + inInstancePositionScale.xyz;
 
-    if (!reader.ParseFromFile(path, reader_config))
+    gl_Position = modelViewProjection*vec4(worldPos, 1.);
+}
+)";
+
+    GLuint CompileShader(GLenum type, const char* source, const char* name)
     {
-        if (!reader.Error().empty())
+        GLuint shader = glCreateShader(type);
+
+        glShaderSource(shader, 1, &source, nullptr);
+        glCompileShader(shader);
+
+        GLint length = 0;
+
+        glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &length);
+
+        if (length > 1)
         {
-            std::cerr << "TinyObjReader: " << reader.Error();
+            std::string log(length, '\0');
+
+            glGetShaderInfoLog(shader, length, nullptr, log.data());
+
+            std::cerr << name << " shader log:\n" << log << '\n';
         }
-        exit(1);
+        return shader;
     }
 
-    if (!reader.Warning().empty())
+    // The shaders stay owned by the caller; returns 0 if linking fails
+    GLuint LinkProgram(std::initializer_list<GLuint> shaders, const char* name)
     {
-        std::cout << "TinyObjReader: " << reader.Warning();
-    }
+        GLuint program = glCreateProgram();
+
+        for (GLuint shader : shaders)
+        {
+            glAttachShader(program, shader);
+        }
+        glLinkProgram(program);
+        for (GLuint shader : shaders)
+        {
+            glDetachShader(program, shader);
+        }
+
+        GLint linked = GL_FALSE;
+        glGetProgramiv(program, GL_LINK_STATUS, &linked);
 
-    const std::vector<tinyobj::shape_t> &shapes = reader.GetShapes();
-    const tinyobj::attrib_t &attrib = reader.GetAttrib();
-    size_t indices_size = 0;
+        if (linked != GL_TRUE)
+        {
+            std::cerr << "Cannot link the " << name << " program\n";
+            glDeleteProgram(program);
+            return 0;
+        }
+
+        GpuResourceTracker::GetGlobal().RegisterProgram(program);
+        return program;
+    }
 
-    for (size_t s = 0; s < shapes.size(); ++s)
+    // Walking on the terrain and looking around, then from high above
+    std::vector<MeshletViewpoint> GetTerrainViewpoints(const Terrain& terrain, const glm::vec3& min, const glm::vec3& max)
     {
-        size_t index_offset = 0;
-        for (size_t f = 0; f < shapes[s].mesh.num_face_vertices.size(); ++f)
+        const glm::vec3 center = (min + max) * 0.5f;
+        const glm::vec3 extent = max - min;
+        std::vector<MeshletViewpoint> viewpoints;
+
+        for (int32_t i = 0; i < 4; ++i)
         {
-            size_t fv = size_t(shapes[s].mesh.num_face_vertices[f]);
+            const float angle = glm::half_pi<float>() * static_cast<float>(i);
+            const glm::vec3 direction(std::cos(angle), -0.1f, std::sin(angle));
+            glm::vec3 eye = center + glm::vec3(extent.x * 0.25f * std::cos(angle), 0.f, extent.z * 0.25f * std::sin(angle));
 
-            if (fv != 3)
-            {
-                std::cerr << "Error: is not a triangle" << std::endl;
-                exit(1);
-            }
-            for (size_t v = 0; v < fv; ++v)
-            {
-                tinyobj::index_t idx = shapes[s].mesh.indices[index_offset + v];
-                tinyobj::real_t vx = attrib.vertices[fv * size_t(idx.vertex_index) + 0];
-                tinyobj::real_t vy = attrib.vertices[fv * size_t(idx.vertex_index) + 1];
-                tinyobj::real_t vz = attrib.vertices[fv * size_t(idx.vertex_index) + 2];
-                tinyobj::real_t vnx = attrib.normals.empty() ? 0.0 : attrib.normals[fv * size_t(idx.normal_index) + 0];
-                tinyobj::real_t vny = attrib.normals.empty() ? 0.0 : attrib.normals[fv * size_t(idx.normal_index) + 1];
-                tinyobj::real_t vnz = attrib.normals.empty() ? 0.0 : attrib.normals[fv * size_t(idx.normal_index) + 2];
-                glm::vec3 position(vx, vy, vz);
-                glm::vec3 normal(vnx, vny, vnz);
-                glm::vec3 color(0.8, 0.8, 0.8);
-                vertices.push_back(visualizer::VertexDataPosition3fColor3f{position, normal, color});
-            }
-            if (attrib.normals.empty())
-            {
-                visualizer::VertexDataPosition3fColor3f& A = vertices[vertices.size() - 3];
-                visualizer::VertexDataPosition3fColor3f& B = vertices[vertices.size() - 2];
-                visualizer::VertexDataPosition3fColor3f& C = vertices[vertices.size() - 1];
-                glm::vec3 normal = computeNormal(A.position, B.position, C.position);
-                A.normal = normal;
-                B.normal = normal;
-                C.normal = normal;
-            }
-            index_offset += fv;
-            indices_size += fv;
+            float height = center.y;
+            terrain.HeightAt(eye.x, eye.z, height);
+            eye.y = height + 2.f;
+
+            viewpoints.push_back({ eye, eye + direction });
         }
+        viewpoints.push_back({ center + glm::vec3(0.f, extent.x * 0.5f, -extent.z * 0.5f), center });
+
+        return viewpoints;
     }
-    for (size_t i = 0; i < indices_size; ++i)
+
+    // Around an object, slightly from above
+    std::vector<MeshletViewpoint> GetOrbitViewpoints(const glm::vec3& min, const glm::vec3& max)
     {
-        indices.push_back((uint32_t)i);
+        const glm::vec3 center = (min + max) * 0.5f;
+        const float distance = glm::length(max - min) * 1.5f;
+        std::vector<MeshletViewpoint> viewpoints;
+
+        for (int32_t i = 0; i < 4; ++i)
+        {
+            const float angle = glm::half_pi<float>() * static_cast<float>(i);
+            viewpoints.push_back({ center + distance * glm::vec3(std::cos(angle), 0.3f, std::sin(angle)), center });
+        }
+
+        return viewpoints;
     }
 }
 
-Object Renderer::InitObj(std::vector<VertexDataPosition3fColor3f> vertices, const std::vector<uint32_t> &indices, const glm::vec3 &translate)
+Renderer::Renderer(const std::shared_ptr<Camera>& camera, const LaunchOptions& options)
+    : m_Options(options)
+    , m_Camera(camera)
+    , m_Occlusion(320, 192, &ThreadPool::GetGlobal())
+{}
+
+Renderer::~Renderer() = default;
+
+Object Renderer::InitObj(std::span<const VertexDataPosition3fColor3f> vertices, std::span<const uint32_t> indices, std::pmr::memory_resource* scratch, const glm::vec3 &translate)
 {
     Object obj;
+    // The translated copy only has to live until the buffers are created
+    std::pmr::vector<VertexDataPosition3fColor3f> translated(scratch);
     if (translate != glm::vec3(0))
     {
-        for (size_t i = 0; i < vertices.size(); ++i)
-        {
-            vertices[i].position.x += translate.x;
-            vertices[i].position.y += translate.y;
-            vertices[i].position.z += translate.z;
-        }
+        translated.assign(vertices.begin(), vertices.end());
+        translateVertices(translated, translate);
+        vertices = translated;
     }
     const uint32_t vertexCount = vertices.size();
     const uint32_t indexCount = indices.size();
 
     obj.m_IndexCount = indexCount;
+    computeBounds(vertices, obj.m_MeshMin, obj.m_MeshMax);
+    obj.m_BoundsMin = obj.m_MeshMin;
+    obj.m_BoundsMax = obj.m_MeshMax;
+
+    GpuResourceTracker& resources = GpuResourceTracker::GetGlobal();
+    obj.m_VBO = resources.CreateBuffer(GpuResourceCategory::MeshVertex, sizeof(VertexDataPosition3fColor3f) * vertexCount, vertices.data(), 0);
+    obj.m_IBO = resources.CreateBuffer(GpuResourceCategory::MeshIndex, sizeof(uint32_t) * indexCount, indices.data(), 0);
+
+    // Packed positions, all the depth pre-pass fetches
+    std::pmr::vector<glm::vec3> positions(scratch);
+    positions.reserve(vertexCount);
+    for (const VertexDataPosition3fColor3f& vertex : vertices)
+    {
+        positions.push_back(vertex.position);
+    }
+    obj.m_PositionVBO = resources.CreateBuffer(GpuResourceCategory::MeshVertex, sizeof(glm::vec3) * vertexCount, positions.data(), 0);
+
+    SetupVertexArray(obj);
+
+    return (obj);
+}
+
+Object Renderer::ShareObj(const Object& prototype)
+{
+    Object obj;
+
+    obj.m_IndexCount = prototype.m_IndexCount;
+    obj.m_VBO = prototype.m_VBO;
+    obj.m_PositionVBO = prototype.m_PositionVBO;
+    obj.m_IBO = prototype.m_IBO;
+    obj.m_MeshMin = prototype.m_MeshMin;
+    obj.m_MeshMax = prototype.m_MeshMax;
+    obj.m_BoundsMin = prototype.m_BoundsMin;
+    obj.m_BoundsMax = prototype.m_BoundsMax;
 
-    glCreateBuffers(1, &obj.m_VBO);
-    glNamedBufferStorage(obj.m_VBO, sizeof(VertexDataPosition3fColor3f) * vertexCount, vertices.data(), 0);
+    SetupVertexArray(obj);
 
-    glCreateBuffers(1, &obj.m_IBO);
-    glNamedBufferStorage(obj.m_IBO, sizeof(uint32_t) * indexCount, indices.data(), 0);
+    return (obj);
+}
 
+void Renderer::SetupVertexArray(Object& obj)
+{
     glCreateVertexArrays(1, &obj.m_VAO);
     glBindVertexArray(obj.m_VAO);
 
@@ -156,47 +251,362 @@ Object Renderer::InitObj(std::vector<VertexDataPosition3fColor3f> vertices, cons
     glDisableVertexAttribArray(1);
     glDisableVertexAttribArray(2);
 
+    // Objects filled by GPU copies have no packed positions, their depth
+    // pass reads the interleaved vertices
+    glCreateVertexArrays(1, &obj.m_DepthVAO);
+    glBindVertexArray(obj.m_DepthVAO);
+
+    glBindBuffer(GL_ARRAY_BUFFER, obj.m_PositionVBO ? obj.m_PositionVBO : obj.m_VBO);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, obj.m_IBO);
+
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, obj.m_PositionVBO ? sizeof(glm::vec3) : sizeof(VertexDataPosition3fColor3f), nullptr);
+
+    glBindVertexArray(0);
+
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+}
+
+void Renderer::AttachInstances(Object& obj, std::span<const InstanceTransform> instances, GLbitfield storageFlags)
+{
+    obj.m_InstanceCount = static_cast<uint32_t>(instances.size());
+
+    if (instances.empty())
+    {
+        return;
+    }
+
+    GetInstanceBounds(instances[0], obj.m_MeshMin, obj.m_MeshMax, obj.m_BoundsMin, obj.m_BoundsMax);
+    for (const InstanceTransform& instance : instances)
+    {
+        glm::vec3 min, max;
+        GetInstanceBounds(instance, obj.m_MeshMin, obj.m_MeshMax, min, max);
+        obj.m_BoundsMin = glm::min(obj.m_BoundsMin, min);
+        obj.m_BoundsMax = glm::max(obj.m_BoundsMax, max);
+    }
+
+    obj.m_InstanceBuffer = GpuResourceTracker::GetGlobal().CreateBuffer(GpuResourceCategory::Instance, sizeof(InstanceTransform) * instances.size(), instances.data(), storageFlags);
+
+    SetupInstanceAttributes(obj);
+}
+
+Object Renderer::CreateObj(uint32_t vertexCount, uint32_t indexCount)
+{
+    Object obj;
+
+    obj.m_IndexCount = indexCount;
+
+    GpuResourceTracker& resources = GpuResourceTracker::GetGlobal();
+    obj.m_VBO = resources.CreateBuffer(GpuResourceCategory::MeshVertex, sizeof(VertexDataPosition3fColor3f) * vertexCount, nullptr, 0);
+    obj.m_IBO = resources.CreateBuffer(GpuResourceCategory::MeshIndex, sizeof(uint32_t) * indexCount, nullptr, 0);
+
+    SetupVertexArray(obj);
+
     return (obj);
 }
 
+void Renderer::CreateInstanceBuffer(Object& obj, uint32_t instanceCount)
+{
+    obj.m_InstanceCount = instanceCount;
+
+    if (instanceCount == 0)
+    {
+        return;
+    }
+
+    obj.m_InstanceBuffer = GpuResourceTracker::GetGlobal().CreateBuffer(GpuResourceCategory::Instance, sizeof(InstanceTransform) * instanceCount, nullptr, 0);
+
+    SetupInstanceAttributes(obj);
+}
+
+void Renderer::SetupInstanceAttributes(Object& obj)
+{
+    for (GLuint vao : { obj.m_VAO, obj.m_DepthVAO })
+    {
+        glBindVertexArray(vao);
+        glBindBuffer(GL_ARRAY_BUFFER, obj.m_InstanceBuffer);
+
+        glEnableVertexAttribArray(3);
+        glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceTransform), nullptr);
+        glVertexAttribDivisor(3, 1);
+        glEnableVertexAttribArray(4);
+        glVertexAttribPointer(4, 1, GL_FLOAT, GL_FALSE, sizeof(InstanceTransform), reinterpret_cast<GLvoid*>(offsetof(InstanceTransform, yaw)));
+        glVertexAttribDivisor(4, 1);
+    }
+
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
 void Renderer::Initialize()
 {
-    //Object desert;
+    GpuResourceTracker::GetGlobal().CaptureDriverBaseline();
+
+    // The default viewport still covers the whole window
+    {
+        GLint viewport[4] = {};
+        glGetIntegerv(GL_VIEWPORT, viewport);
+
+        m_ViewportWidth = static_cast<uint32_t>(viewport[2]);
+        m_ViewportHeight = static_cast<uint32_t>(viewport[3]);
+    }
+
+    SceneManifest scene = SceneManifest::GetDefault();
+
+    if (!m_Options.sceneManifest.empty())
+    {
+        scene = SceneManifest();
+
+        if (!scene.Load(m_Options.sceneManifest))
+        {
+            exit(1);
+        }
+    }
+
+    // Load-time scratch lives in m_LoadArena, which is reset after each asset
+    {
+        std::pmr::vector<VertexDataPosition3fColor3f> vertices(&m_LoadArena);
+        std::pmr::vector<uint32_t> indices(&m_LoadArena);
+
+        if (!LoadMesh(vertices, indices, scene.GetTerrain()))
+        {
+            exit(1);
+        }
+        m_Terrain.Build(vertices, indices);
+        BuildMeshBvh(m_TerrainBvh, scene.GetTerrain(), vertices, indices);
 
-    std::vector<VertexDataPosition3fColor3f> vertices;
-    std::vector<uint32_t> indices;
+        if (m_Options.meshlets)
+        {
+            MeshletMesh meshlets = BuildMeshlets(vertices, indices);
+            Object desert = InitObj(vertices, meshlets.indices, &m_LoadArena);
+
+            PrintMeshletReport(std::cout, "Terrain meshlets", meshlets, m_Camera->GetProjectionMatrix(), GetTerrainViewpoints(m_Terrain, desert.m_MeshMin, desert.m_MeshMax));
+
+            const size_t count = meshlets.meshlets.size();
+            const GLuint commandBuffer = GpuResourceTracker::GetGlobal().CreateBuffer(GpuResourceCategory::Instance, sizeof(DrawElementsIndirectCommand) * count, nullptr, GL_DYNAMIC_STORAGE_BIT);
+
+            m_MeshletObjects.push_back({ m_objects.size(), std::move(meshlets), std::vector<DrawElementsIndirectCommand>(count), commandBuffer });
+            m_objects.push_back(desert);
+        }
+        else
+        {
+            Object desert = InitObj(vertices, indices, &m_LoadArena);
+            m_objects.push_back(desert);
+        }
+    }
+    m_LoadArena.Reset();
+
+    if (m_Options.gpuOcclusion)
+    {
+        if (!m_HiZ.Initialize(m_ViewportWidth, m_ViewportHeight))
+        {
+            std::cerr << "Hi-Z culling unavailable, the palms are culled on the CPU\n";
+            m_HiZ.Cleanup();
+            m_Options.gpuOcclusion = false;
+        }
+    }
+    else if (m_Options.occlusionQueries && !m_Queries.Initialize())
+    {
+        std::cerr << "Occlusion queries unavailable, the palms are culled on the CPU\n";
+        m_Queries.Cleanup();
+        m_Options.occlusionQueries = false;
+    }
+
+    for (uint32_t prototype = 0; prototype < scene.GetPrototypes().size(); ++prototype)
+    {
+        // Every instance of a prototype, whichever set it comes from, shares
+        // one mesh and is drawn in a single instanced call
+        std::vector<InstanceTransform> instances;
+
+        if (prototype == 0 && m_Options.scatterPalms)
+        {
+            ScatterSettings settings;
+            settings.seed = m_Options.scatterSeed;
+
+            instances = ScatterInstances(m_Terrain, settings, ThreadPool::GetGlobal());
+        }
+        else
+        {
+            for (const SceneManifest::InstanceSet& set : scene.GetInstanceSets())
+            {
+                if (set.prototype != prototype)
+                {
+                    continue;
+                }
+
+                // Loaded apart so that a failing file adds none of its rows
+                std::vector<InstanceTransform> loaded;
+
+                if (!LoadInstances(set.path, loaded, ThreadPool::GetGlobal()))
+                {
+                    std::cerr << "Cannot load instance set : " << set.path << '\n';
+                    continue;
+                }
+                instances.insert(instances.end(), loaded.begin(), loaded.end());
+            }
+
+            std::pmr::vector<glm::vec2> xz(instances.size(), &m_LoadArena);
+            std::pmr::vector<float> heights(instances.size(), &m_LoadArena);
+
+            for (size_t i = 0; i < instances.size(); ++i)
+            {
+                xz[i] = glm::vec2(instances[i].position.x, instances[i].position.z);
+            }
+
+            m_Terrain.HeightAt(xz, heights);
+
+            // Off-terrain instances keep the height from the file
+            for (size_t i = 0; i < instances.size(); ++i)
+            {
+                if (!std::isnan(heights[i]))
+                {
+                    instances[i].position.y = heights[i];
+                }
+            }
+        }
+
+        std::pmr::vector<VertexDataPosition3fColor3f> vertices(&m_LoadArena);
+        std::pmr::vector<uint32_t> indices(&m_LoadArena);
+
+        if (!LoadMesh(vertices, indices, scene.GetPrototypes()[prototype]))
+        {
+            exit(1);
+        }
+
+        Object obj = InitObj(vertices, indices, &m_LoadArena);
+
+        // Instances are not split, the prototype is only reported on
+        if (m_Options.meshlets)
+        {
+            const std::string title = "Prototype " + std::to_string(prototype) + " meshlets";
+            PrintMeshletReport(std::cout, title.c_str(), BuildMeshlets(vertices, indices), m_Camera->GetProjectionMatrix(), GetOrbitViewpoints(obj.m_MeshMin, obj.m_MeshMax));
+        }
+
+        if (m_Options.gpuOcclusion)
+        {
+            // Drawn straight from the culler's output
+            const size_t set = m_HiZ.AddInstanceSet(instances, obj.m_MeshMin, obj.m_MeshMax, obj.m_IndexCount);
+            obj.m_InstanceCount = static_cast<uint32_t>(instances.size());
+            obj.m_InstanceBuffer = m_HiZ.GetDrawBuffer(set);
+            SetupInstanceAttributes(obj);
+            m_HiZObjects.push_back(obj);
+        }
+        else if (m_Options.occlusionQueries && !m_QueryObject.m_VAO)
+        {
+            // Clusters are contiguous ranges of the instance buffer. Only
+            // the first prototype is queried, the others are culled on the
+            // CPU below.
+            m_Queries.Build(instances, obj.m_MeshMin, obj.m_MeshMax);
+            AttachInstances(obj, instances);
+            m_QueryObject = obj;
+        }
+        else
+        {
+            AttachInstances(obj, instances, GL_DYNAMIC_STORAGE_BIT);
+
+            // The instance buffer starts out with every instance in order
+            const uint32_t set = static_cast<uint32_t>(m_CulledInstances.size());
+            const uint32_t instanceCount = static_cast<uint32_t>(instances.size());
+            m_CulledInstances.push_back({ m_objects.size(), m_Transforms.Create(LocalTransform{}), instanceCount,
+                                          std::vector<InstanceTransform>(instances.begin(), instances.end()), instanceCount, instanceCount, DirtyRanges{} });
+            m_objects.push_back(obj);
+
+            m_InstanceMeshBvhs.emplace_back();
+            BuildMeshBvh(m_InstanceMeshBvhs.back(), scene.GetPrototypes()[prototype], vertices, indices);
+
+            for (const InstanceTransform& instance : instances)
+            {
+                CreateInstance(set, instance);
+            }
+        }
+
+        // Nothing reads the scratch vectors past here, and the arena
+        // ignores their deallocations
+        m_LoadArena.Reset();
+    }
+
+    m_InstanceBvh.Rebuild();
+    m_TerrainOccluder = BuildTerrainOccluder(m_Terrain);
+    m_OcclusionCulling = m_Options.occlusionCulling;
+
+    // The BVH mirrors the bounds, and is read by entity index
+    m_CullSystems.Add("ClassifyInstances", SystemAccess::Of<const InstanceBounds, Visibility>(), [this](World& scene, ThreadPool& pool)
+    {
+        ClassifyInstanceBvh(pool);
+
+        scene.ParallelForEachChunk<Visibility>(pool, [this](const ChunkView& chunk)
+        {
+            const std::span<const Entity> entities = chunk.GetEntities();
+            const std::span<Visibility> visibility = chunk.Get<Visibility>();
+
+            for (uint32_t i = 0; i < chunk.GetCount(); ++i)
+            {
+                visibility[i] = m_InstanceVisibility[entities[i].index];
+            }
+        });
+    });
+    m_CullSystems.Add("GatherVisibleInstances", SystemAccess::Of<const InstanceTransform, const InstanceSetIndex, const Visibility>(), [this](World& scene, ThreadPool&)
+    {
+        uint64_t frustumCulled = 0;
+        uint64_t occluded = 0;
 
-    LoadMesh(vertices, indices, "desert.obj");
+        scene.ForEachChunk<const InstanceTransform, const InstanceSetIndex, const Visibility>([&](const ChunkView& chunk)
+        {
+            const std::span<const InstanceTransform> transforms = chunk.Get<const InstanceTransform>();
+            const std::span<const InstanceSetIndex> sets = chunk.Get<const InstanceSetIndex>();
+            const std::span<const Visibility> visibility = chunk.Get<const Visibility>();
+
+            for (uint32_t i = 0; i < chunk.GetCount(); ++i)
+            {
+                switch (visibility[i])
+                {
+                case Visibility::Visible:
+                    m_CulledInstances[sets[i].set].Push(transforms[i]);
+                    break;
+                case Visibility::FrustumCulled:
+                    ++frustumCulled;
+                    break;
+                case Visibility::Occluded:
+                    ++occluded;
+                    break;
+                }
+            }
+        });
+
+        m_Occlusion.AddTestResults(scene.GetEntityCount(), frustumCulled, occluded, 0.f);
+    });
+
+    m_Lighting.SetLights(ScatterLights(m_Terrain, m_Options.pointLights, m_Options.scatterSeed));
+    m_Lighting.Initialize();
+    m_SceneTimer.Initialize();
+    m_ScenePrimitives.Initialize(GL_PRIMITIVES_GENERATED);
+
+    if (m_Options.lightBenchmark)
     {
-        Object desert = InitObj(vertices, indices);
-        m_objects.push_back(desert);
+        static constexpr uint32_t s_BenchmarkLightCounts[] = { 0, 1, 10, 100, 1000, 10000 };
+        m_LightBenchmark.Start(s_BenchmarkLightCounts);
     }
 
-    vertices.clear();
-    indices.clear();
-    LoadMesh(vertices, indices, "palm.obj");
+    if (!m_Uploads.Initialize())
+    {
+        exit(1);
+    }
 
-    std::string line;
-    std::ifstream stream;
-    std::stringstream ss;
-    float x, y, z, a;
-    int i = 0;
-    stream.open("palmTransfo.txt");
-    std::getline(stream, line);
-    Object palm0[1541];
-    while (std::getline(stream, line))
+    if (!m_Options.worldManifest.empty())
     {
-        ss << line;
-        ss >> x >> y >> z >> a;
-        palm0[i] = InitObj(vertices, indices, glm::vec3(x, y, z));
-        m_objects.push_back(palm0[i]);
-        i++;
+        WorldPartition partition;
+
+        if (partition.Load(m_Options.worldManifest))
+        {
+            m_Streaming = std::make_unique<StreamingManager>(std::move(partition), ThreadPool::GetGlobal(), m_Uploads);
+            m_Streaming->LoadPrototypes(*this);
+        }
     }
-    
-    stream.close();
 
-    glCreateBuffers(1, &m_UBO);
-    glNamedBufferStorage(m_UBO, sizeof(glm::mat4), glm::value_ptr(m_Camera->GetViewProjectionMatrix()), GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT);
+    m_LastCameraPosition = m_Camera->GetPosition();
+
+    m_UBO = GpuResourceTracker::GetGlobal().CreateBuffer(GpuResourceCategory::Uniform, sizeof(glm::mat4), glm::value_ptr(m_Camera->GetViewProjectionMatrix()), GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT);
     m_UBOData = reinterpret_cast<glm::mat4*>(glMapNamedBufferRange(m_UBO, 0, sizeof(glm::mat4), GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_FLUSH_EXPLICIT_BIT));
 
     GLuint vShader = glCreateShader(GL_VERTEX_SHADER);
@@ -214,22 +624,35 @@ void Renderer::Initialize()
 layout(location = 0) in vec3 inWorldPos;
 layout(location = 1) in vec3 inNormal;
 layout(location = 2) in vec3 inColor;
+// Left disabled for non-instanced objects, which then read the default
+// (0, 0, 0, 1): no translation, unit scale and no rotation
+layout(location = 3) in vec4 inInstancePositionScale;
+layout(location = 4) in float inInstanceYaw;
 
 layout(location = 0) out vec3 FragPos;
 layout(location = 1) out vec3 normal;
 layout(location = 2) out vec3 color;
+layout(location = 3) out vec3 FragWorldPos;
 
 layout(std140, binding = 0) uniform Matrix
 {
     mat4 modelViewProjection;
 };
 
+invariant gl_Position;
+
 void main()
 {
+    float c = cos(inInstanceYaw);
+    float s = sin(inInstanceYaw);
+    mat3 yaw = mat3(c, 0.0, -s, 0.0, 1.0, 0.0, s, 0.0, c);
+    vec3 worldPos = yaw * inWorldPos * inInstancePositionScale.w + inInstancePositionScale.xyz;
+
     color = inColor;
-    normal = inNormal;
-    FragPos = vec3(modelViewProjection * vec4(inWorldPos, 1.0));
-    gl_Position = modelViewProjection*vec4(inWorldPos, 1.);
+    normal = yaw * inNormal;
+    FragWorldPos = worldPos;
+    FragPos = vec3(modelViewProjection * vec4(worldPos, 1.0));
+    gl_Position = modelViewProjection*vec4(worldPos, 1.);
 }
 )";
 
@@ -252,14 +675,15 @@ void main()
             }
         }
 
+        // Follows the version line and the clustered lighting declarations
         char const* const fragmentShader =
-            R"(#version 450 core
-
+            R"(
 layout(location = 0) out vec4 outColor;
 
 layout(location = 0) in vec3 FragPos;
 layout(location = 1) in vec3 normal;
 layout(location = 2) in vec3 color;
+layout(location = 3) in vec3 FragWorldPos;
 
 vec3 normalize(vec3 vec)
 {
@@ -276,11 +700,13 @@ void main()
     float diff = max(dot(normal, lightDir), 0.0);
     vec3 ambient = color * 0.1;
     vec3 diffuse = diff * lightColor;
-    vec3 result = (ambient + diffuse) * color;
+    vec3 result = (ambient + diffuse) * color + ShadePointLights(FragWorldPos, normal, color);
     outColor = vec4(result, 1.0);}
 )";
 
-        glShaderSource(fShader, 1, &fragmentShader, nullptr);
+        char const* const fragmentSources[] = { "#version 450 core\n", ClusteredLighting::GetShaderSource(), fragmentShader };
+
+        glShaderSource(fShader, 3, fragmentSources, nullptr);
 
         glCompileShader(fShader);
 
@@ -317,41 +743,889 @@ void main()
         }
     }
 
+    GpuResourceTracker::GetGlobal().RegisterProgram(m_ShaderProgram);
+
     glDetachShader(m_ShaderProgram, vShader);
     glDetachShader(m_ShaderProgram, fShader);
+    m_PassProgram = m_ShaderProgram;
+
+    // Vertex stage only, depth needs no fragment shader
+    GLuint depthShader = CompileShader(GL_VERTEX_SHADER, s_DepthVertexShader, "Depth vertex");
+    m_DepthProgram = LinkProgram({ depthShader }, "depth pre-pass");
+    glDeleteShader(depthShader);
+
+    // The scene's vertex stage, counting fragments instead of shading them
+    GLuint overdrawShader = CompileShader(GL_FRAGMENT_SHADER, OverdrawCounter::GetFragmentShaderSource(), "Overdraw fragment");
+    m_OverdrawProgram = LinkProgram({ vShader, overdrawShader }, "overdraw");
+    glDeleteShader(overdrawShader);
 
     glDeleteShader(vShader);
     glDeleteShader(fShader);
+
+    if (!m_DepthProgram && m_Options.prepass != PrepassMode::Off)
+    {
+        std::cerr << "Depth pre-pass unavailable\n";
+        m_Options.prepass = PrepassMode::Off;
+    }
+    m_Prepass.Initialize(m_Options.prepass);
+    m_OverdrawCounter.Initialize();
+    m_OverdrawView = m_Options.overdrawView && m_OverdrawProgram;
 }
 
-void Renderer::Render()
+void Renderer::Update(float dt)
 {
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    m_FrameAllocator.BeginFrame();
 
-    glBindBufferRange(GL_UNIFORM_BUFFER, 0, m_UBO, 0, sizeof(glm::mat4));
-    for (size_t i = 0; i < m_objects.size(); ++i)
+    const glm::vec3& position = m_Camera->GetPosition();
+    const glm::vec3 velocity = dt > 0.f ? (position - m_LastCameraPosition) / dt : glm::vec3(0.f);
+
+    m_LastCameraPosition = position;
+
+    if (m_Streaming)
     {
-        glUseProgram(m_ShaderProgram);
-        glBindVertexArray(m_objects[i].m_VAO);
-        glDrawElements(GL_TRIANGLES, m_objects[i].m_IndexCount, GL_UNSIGNED_INT, nullptr);
-        glBindVertexArray(0);
-        glUseProgram(0);
+        m_Streaming->Update(*this, position, velocity);
     }
-    glBindBufferRange(GL_UNIFORM_BUFFER, 0, 0, 0, 0);
+
+    if (m_Options.wind)
+    {
+        m_WindTime += dt;
+        m_Scene.Each<const InstanceNode, const WindSway>([this](const InstanceNode& instance, const WindSway& sway)
+        {
+            LocalTransform local = m_Transforms.GetLocal(instance.node);
+            local.rotation = glm::angleAxis(sway.yaw + s_WindAmplitude * std::sin(s_WindFrequency * m_WindTime + sway.phase), glm::vec3(0.f, 1.f, 0.f));
+            m_Transforms.SetLocal(instance.node, local);
+        });
+    }
+
+    // Moved instances take their new world transform and bounds
+    ThreadPool& pool = ThreadPool::GetGlobal();
+    if (m_Transforms.Update(pool) > 0)
+    {
+        m_Scene.ParallelForEachChunk<const InstanceNode, const InstanceSetIndex, InstanceTransform, InstanceBounds>(pool, [this](const ChunkView& chunk)
+        {
+            const std::span<const InstanceNode> nodes = chunk.Get<const InstanceNode>();
+            const std::span<const InstanceSetIndex> sets = chunk.Get<const InstanceSetIndex>();
+            const std::span<InstanceTransform> transforms = chunk.Get<InstanceTransform>();
+            const std::span<InstanceBounds> bounds = chunk.Get<InstanceBounds>();
+            const std::span<const Entity> entities = chunk.GetEntities();
+
+            for (uint32_t i = 0; i < chunk.GetCount(); ++i)
+            {
+                if (!m_Transforms.WasUpdated(nodes[i].node))
+                {
+                    continue;
+                }
+
+                const Object& obj = m_objects[m_CulledInstances[sets[i].set].object];
+                const InstanceBounds previous = bounds[i];
+
+                transforms[i] = ToInstanceTransform(m_Transforms.GetWorld(nodes[i].node));
+                GetInstanceBounds(transforms[i], obj.m_MeshMin, obj.m_MeshMax, bounds[i].min, bounds[i].max);
+
+                // Turning about Y leaves the bounds as they were
+                if (bounds[i].min != previous.min || bounds[i].max != previous.max)
+                {
+                    m_InstanceBvh.Move(entities[i].index, bounds[i].min, bounds[i].max);
+                }
+            }
+        });
+        m_InstancesMoved = true;
+    }
+    m_InstanceBvh.Update(pool);
+
+    m_Uploads.Flush();
 }
 
-void Renderer::Cleanup()
+void Renderer::DrawObject(const Object& obj)
 {
-    glUnmapNamedBuffer(m_UBO);
+    DrawObject(obj, obj.m_InstanceCount);
+}
 
-    glDeleteBuffers(1, &m_UBO);
-    for (size_t i = 0; i < m_objects.size(); ++i)
+void Renderer::DrawObject(const Object& obj, uint32_t instanceCount, uint32_t baseInstance)
+{
+    // Every instance culled
+    if (obj.m_InstanceCount > 0 && instanceCount == 0)
     {
-        glDeleteBuffers(1, &m_objects[i].m_VBO);
-        glDeleteBuffers(1, &m_objects[i].m_IBO);
-        glDeleteVertexArrays(1, &m_objects[i].m_VAO);
-        glDeleteProgram(m_ShaderProgram);
+        return;
+    }
+
+    ++m_FrameCounters.drawCommands;
+
+    glUseProgram(m_PassProgram);
+    glBindVertexArray(GetPassVertexArray(obj));
+    if (obj.m_InstanceCount > 0)
+    {
+        glDrawElementsInstancedBaseInstance(GL_TRIANGLES, obj.m_IndexCount, GL_UNSIGNED_INT, nullptr, instanceCount, baseInstance);
+    }
+    else
+    {
+        glDrawElements(GL_TRIANGLES, obj.m_IndexCount, GL_UNSIGNED_INT, nullptr);
     }
+    glBindVertexArray(0);
+    glUseProgram(0);
+}
+
+void Renderer::DrawObjectIndirect(const Object& obj, GLuint commandBuffer, size_t commandOffset)
+{
+    ++m_FrameCounters.drawCommands;
+
+    glUseProgram(m_PassProgram);
+    glBindVertexArray(GetPassVertexArray(obj));
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+    glDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, reinterpret_cast<const void*>(commandOffset));
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    glBindVertexArray(0);
+    glUseProgram(0);
+}
+
+void Renderer::CullMeshlets(MeshletObject& meshlets)
+{
+    meshlets.commandCount = visualizer::CullMeshlets(meshlets.mesh, m_Camera->GetViewProjectionMatrix(), m_Camera->GetPosition(), meshlets.commands, m_MeshletStats);
+
+    if (meshlets.commandCount > 0)
+    {
+        glNamedBufferSubData(meshlets.commandBuffer, 0, sizeof(DrawElementsIndirectCommand) * meshlets.commandCount, meshlets.commands.data());
+    }
+}
+
+void Renderer::DrawMeshlets(const MeshletObject& meshlets)
+{
+    if (meshlets.commandCount == 0)
+    {
+        return;
+    }
+
+    m_FrameCounters.drawCommands += static_cast<uint32_t>(meshlets.commandCount);
+
+    glUseProgram(m_PassProgram);
+    glBindVertexArray(GetPassVertexArray(m_objects[meshlets.object]));
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, meshlets.commandBuffer);
+    glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, nullptr, static_cast<GLsizei>(meshlets.commandCount), 0);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    glBindVertexArray(0);
+    glUseProgram(0);
+}
+
+void Renderer::CollectSceneDraws()
+{
+    m_SceneDraws.clear();
+
+    for (size_t i = 0; i < m_objects.size(); ++i)
+    {
+        if (!IsVisible(m_objects[i]))
+        {
+            continue;
+        }
+
+        MeshletObject* meshlets = nullptr;
+        for (MeshletObject& candidate : m_MeshletObjects)
+        {
+            if (candidate.object == i)
+            {
+                meshlets = &candidate;
+            }
+        }
+
+        if (meshlets)
+        {
+            CullMeshlets(*meshlets);
+            m_SceneDraws.push_back({ &m_objects[i], 0, meshlets });
+            continue;
+        }
+
+        uint32_t instanceCount = m_objects[i].m_InstanceCount;
+        for (const CulledInstances& set : m_CulledInstances)
+        {
+            if (set.object == i)
+            {
+                instanceCount = set.visibleCount;
+            }
+        }
+
+        m_SceneDraws.push_back({ &m_objects[i], instanceCount, nullptr });
+    }
+    if (m_Streaming)
+    {
+        m_Streaming->ForEachResidentObject([this](const Object& obj)
+        {
+            if (IsVisible(obj))
+            {
+                m_SceneDraws.push_back({ &obj, obj.m_InstanceCount, nullptr });
+            }
+        });
+    }
+}
+
+void Renderer::DrawScene()
+{
+    for (const SceneDraw& draw : m_SceneDraws)
+    {
+        if (draw.meshlets)
+        {
+            DrawMeshlets(*draw.meshlets);
+        }
+        else
+        {
+            DrawObject(*draw.object, draw.instanceCount);
+        }
+    }
+}
+
+void Renderer::CullObjects()
+{
+    if (!m_OcclusionCulling)
+    {
+        // Put every instance back once after culling is turned off, and
+        // again whenever they move
+        bool culled = false;
+        for (CulledInstances& set : m_CulledInstances)
+        {
+            culled |= set.visibleCount != set.instanceCount;
+            set.visibleCount = 0;
+        }
+
+        if (culled || m_InstancesMoved)
+        {
+            m_Scene.ForEachChunk<const InstanceTransform, const InstanceSetIndex>([this](const ChunkView& chunk)
+            {
+                const std::span<const InstanceTransform> transforms = chunk.Get<const InstanceTransform>();
+                const std::span<const InstanceSetIndex> sets = chunk.Get<const InstanceSetIndex>();
+
+                for (uint32_t i = 0; i < chunk.GetCount(); ++i)
+                {
+                    m_CulledInstances[sets[i].set].Push(transforms[i]);
+                }
+            });
+
+            for (CulledInstances& set : m_CulledInstances)
+            {
+                UploadInstances(set);
+            }
+        }
+        else
+        {
+            for (CulledInstances& set : m_CulledInstances)
+            {
+                set.visibleCount = set.instanceCount;
+            }
+        }
+        m_InstancesMoved = false;
+        return;
+    }
+
+    // The visible ones are gathered again below whether they moved or not
+    m_InstancesMoved = false;
+
+    m_Occlusion.BeginFrame(m_Camera->GetViewProjectionMatrix());
+    m_Occlusion.AddOccluder(m_TerrainOccluder);
+    m_Occlusion.RasterizeOccluders();
+
+    for (CulledInstances& set : m_CulledInstances)
+    {
+        set.visibleCount = 0;
+    }
+
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    m_CullSystems.Run(m_Scene, ThreadPool::GetGlobal());
+    m_Occlusion.AddTestResults(0, 0, 0, std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count());
+
+    for (CulledInstances& set : m_CulledInstances)
+    {
+        UploadInstances(set);
+
+        StatsRegistry::GetGlobal().Add(StatCounter::VisibleInstances, set.visibleCount);
+        StatsRegistry::GetGlobal().Add(StatCounter::CulledInstances, set.instanceCount - set.visibleCount);
+    }
+}
+
+bool Renderer::IsVisible(const Object& obj)
+{
+    return !m_OcclusionCulling || m_Occlusion.TestBox(obj.m_BoundsMin, obj.m_BoundsMax) == Visibility::Visible;
+}
+
+Entity Renderer::CreateInstance(uint32_t set, const InstanceTransform& instance)
+{
+    const CulledInstances& instances = m_CulledInstances[set];
+    const Object& obj = m_objects[instances.object];
+
+    InstanceBounds bounds;
+    GetInstanceBounds(instance, obj.m_MeshMin, obj.m_MeshMax, bounds.min, bounds.max);
+
+    const InstanceNode node{ m_Transforms.Create(ToLocalTransform(instance), instances.root) };
+    const Entity entity = m_Scene.Create(instance, bounds, InstanceSetIndex{ set }, Visibility::Visible, node);
+
+    if (m_Options.wind)
+    {
+        m_Scene.Add(entity, WindSway{ instance.yaw, s_WindPhaseScale * (instance.position.x + instance.position.z) });
+    }
+
+    m_InstanceBvh.Insert(entity.index, bounds.min, bounds.max);
+    return entity;
+}
+
+void Renderer::GrowInstanceBuffer(CulledInstances& set)
+{
+    Object& obj = m_objects[set.object];
+    const size_t capacity = std::max<size_t>(s_MinInstanceCapacity, 2 * set.visible.size());
+
+    GpuResourceTracker& resources = GpuResourceTracker::GetGlobal();
+    if (obj.m_InstanceBuffer)
+    {
+        resources.DeleteBuffer(obj.m_InstanceBuffer);
+    }
+    obj.m_InstanceBuffer = resources.CreateBuffer(GpuResourceCategory::Instance, sizeof(InstanceTransform) * capacity, nullptr, GL_DYNAMIC_STORAGE_BIT);
+    SetupInstanceAttributes(obj);
+
+    // Everything is written again at the next upload
+    set.visible.resize(capacity);
+    set.bufferedCount = 0;
+    m_InstancesMoved = true;
+}
+
+void Renderer::ClassifyInstanceBvh(ThreadPool& pool)
+{
+    m_InstanceVisibility.resize(m_InstanceBvh.GetItemCapacity());
+
+    const BoundsBvh& tree = m_InstanceBvh.GetTree();
+    auto classify = [this, &tree](uint32_t root)
+    {
+        tree.Traverse(root, [this, &tree](uint32_t index, const BvhNode& node)
+        {
+            const Visibility visibility = m_Occlusion.ClassifyBox(node.min, node.max);
+            if (visibility == Visibility::Visible)
+            {
+                return true;
+            }
+
+            // Hidden as a whole, so is everything below
+            tree.ForEachItem(index, [this, visibility](uint32_t item) { m_InstanceVisibility[item] = visibility; });
+            return false;
+        },
+        [this](uint32_t item)
+        {
+            if (m_InstanceBvh.IsAlive(item))
+            {
+                m_InstanceVisibility[item] = m_Occlusion.ClassifyBox(m_InstanceBvh.GetMin(item), m_InstanceBvh.GetMax(item));
+            }
+        });
+    };
+
+    if (pool.GetWorkerCount() == 0 || m_InstanceBvh.GetItemCapacity() < s_ParallelEntityThreshold)
+    {
+        classify(0);
+    }
+    else
+    {
+        tree.CollectSubtrees(4 * (static_cast<size_t>(pool.GetWorkerCount()) + 1), m_BvhSubtrees);
+        pool.ParallelFor(m_BvhSubtrees.size(), [this, &classify](size_t task) { classify(m_BvhSubtrees[task]); });
+    }
+
+    // Inserted since the last rebuild
+    for (uint32_t item : m_InstanceBvh.GetPendingItems())
+    {
+        m_InstanceVisibility[item] = m_Occlusion.ClassifyBox(m_InstanceBvh.GetMin(item), m_InstanceBvh.GetMax(item));
+    }
+}
+
+void Renderer::UploadInstances(CulledInstances& set)
+{
+    size_t bytes = 0;
+    for (const DirtyRanges::Range& range : set.dirty.Coalesce())
+    {
+        const size_t offset = sizeof(InstanceTransform) * range.first;
+        const size_t size = sizeof(InstanceTransform) * range.count;
+        glNamedBufferSubData(m_objects[set.object].m_InstanceBuffer, offset, size, set.visible.data() + range.first);
+        bytes += size;
+    }
+
+    set.dirty.Clear();
+    set.bufferedCount = std::max(set.bufferedCount, set.visibleCount);
+    StatsRegistry::GetGlobal().Add(StatCounter::UploadBytes, bytes);
+}
+
+Entity Renderer::AddInstance(size_t set, const InstanceTransform& instance)
+{
+    if (set >= m_CulledInstances.size())
+    {
+        return {};
+    }
+
+    CulledInstances& instances = m_CulledInstances[set];
+    if (instances.instanceCount == instances.visible.size())
+    {
+        GrowInstanceBuffer(instances);
+    }
+
+    Object& obj = m_objects[instances.object];
+    glm::vec3 min, max;
+    GetInstanceBounds(instance, obj.m_MeshMin, obj.m_MeshMax, min, max);
+    obj.m_BoundsMin = obj.m_InstanceCount ? glm::min(obj.m_BoundsMin, min) : min;
+    obj.m_BoundsMax = obj.m_InstanceCount ? glm::max(obj.m_BoundsMax, max) : max;
+
+    ++instances.instanceCount;
+    ++obj.m_InstanceCount;
+    m_InstancesMoved = true;
+
+    return CreateInstance(static_cast<uint32_t>(set), instance);
+}
+
+void Renderer::MoveInstance(Entity instance, const InstanceTransform& transform)
+{
+    const InstanceNode* node = m_Scene.Get<InstanceNode>(instance);
+    const InstanceSetIndex* set = m_Scene.Get<InstanceSetIndex>(instance);
+    if (!node || !set)
+    {
+        return;
+    }
+
+    // Picked up by the next Update(), bounds and all
+    m_Transforms.SetLocal(node->node, ToLocalTransform(transform));
+    if (WindSway* sway = m_Scene.Get<WindSway>(instance))
+    {
+        sway->yaw = transform.yaw;
+    }
+
+    // The set's bounds only grow
+    Object& obj = m_objects[m_CulledInstances[set->set].object];
+    glm::vec3 min, max;
+    GetInstanceBounds(transform, obj.m_MeshMin, obj.m_MeshMax, min, max);
+    obj.m_BoundsMin = glm::min(obj.m_BoundsMin, min);
+    obj.m_BoundsMax = glm::max(obj.m_BoundsMax, max);
+}
+
+void Renderer::RemoveInstance(Entity instance)
+{
+    const InstanceNode* node = m_Scene.Get<InstanceNode>(instance);
+    const InstanceSetIndex* set = m_Scene.Get<InstanceSetIndex>(instance);
+    if (!node || !set)
+    {
+        return;
+    }
+
+    CulledInstances& instances = m_CulledInstances[set->set];
+    --instances.instanceCount;
+    --m_objects[instances.object].m_InstanceCount;
+
+    m_Transforms.Destroy(node->node);
+    m_InstanceBvh.Remove(instance.index);
+    m_Scene.Destroy(instance);
+    m_InstancesMoved = true;
+}
+
+void Renderer::BuildMeshBvh(TriangleBvh& bvh, const std::string& meshPath, std::span<const VertexDataPosition3fColor3f> vertices, std::span<const uint32_t> indices)
+{
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    bool cached = false;
+
+    if (m_Options.bvhCache.empty())
+    {
+        bvh.Build(vertices, indices, ThreadPool::GetGlobal());
+    }
+    else
+    {
+        std::filesystem::create_directories(m_Options.bvhCache);
+        const std::filesystem::path path = std::filesystem::path(m_Options.bvhCache) / (std::filesystem::path(meshPath).filename().string() + ".bvh");
+        cached = bvh.BuildCached(path.string(), vertices, indices, ThreadPool::GetGlobal());
+    }
+
+    std::cout << meshPath << ": BVH over " << bvh.GetTriangleCount() << " triangles " << (cached ? "loaded" : "built") << " in "
+              << std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count() << " ms\n";
+}
+
+bool Renderer::IntersectScene(const Ray& ray, float radius, float maxDistance, PickResult& result) const
+{
+    bool found = false;
+    RayHit hit;
+
+    if (radius > 0.f ? m_TerrainBvh.SweepSphere(ray, radius, maxDistance, hit) : m_TerrainBvh.Raycast(ray, maxDistance, hit))
+    {
+        maxDistance = hit.distance;
+        result = { Entity(), glm::vec3(0.f), hit.normal, hit.distance };
+        found = true;
+    }
+
+    // The instances' entity indices are the items of m_InstanceBvh
+    auto getMesh = [this](uint32_t item, InstanceTransform& transform) -> const TriangleBvh*
+    {
+        if (!m_InstanceBvh.IsAlive(item))
+        {
+            return nullptr;
+        }
+
+        const Entity entity = m_Scene.GetEntity(item);
+        const InstanceTransform* instance = m_Scene.Get<InstanceTransform>(entity);
+        const InstanceSetIndex* set = m_Scene.Get<InstanceSetIndex>(entity);
+        if (!instance || !set)
+        {
+            return nullptr;
+        }
+
+        transform = *instance;
+        return &m_InstanceMeshBvhs[set->set];
+    };
+
+    InstanceHit instanceHit;
+    if (IntersectInstances(m_InstanceBvh.GetTree(), ray, radius, maxDistance, getMesh, instanceHit))
+    {
+        maxDistance = instanceHit.hit.distance;
+        result = { m_Scene.GetEntity(instanceHit.item), glm::vec3(0.f), instanceHit.hit.normal, instanceHit.hit.distance };
+        found = true;
+    }
+
+    // Added since the last rebuild
+    for (uint32_t item : m_InstanceBvh.GetPendingItems())
+    {
+        InstanceTransform transform;
+        const TriangleBvh* mesh = getMesh(item, transform);
+
+        if (mesh && IntersectInstance(*mesh, transform, ray, radius, maxDistance, hit))
+        {
+            maxDistance = hit.distance;
+            result = { m_Scene.GetEntity(item), glm::vec3(0.f), hit.normal, hit.distance };
+            found = true;
+        }
+    }
+
+    if (found)
+    {
+        result.position = ray.origin + result.distance * ray.direction;
+    }
+    return found;
+}
+
+bool Renderer::Pick(const Ray& ray, float maxDistance, PickResult& result) const
+{
+    return IntersectScene(ray, 0.f, maxDistance, result);
+}
+
+glm::vec3 Renderer::MoveSphere(const glm::vec3& from, const glm::vec3& to, float radius) const
+{
+    glm::vec3 position = from;
+    glm::vec3 motion = to - from;
+
+    for (uint32_t slide = 0; slide < s_MaxSlides; ++slide)
+    {
+        const float length = glm::length(motion);
+        PickResult contact;
+
+        // Distances along the motion are fractions of it
+        if (length == 0.f || !IntersectScene({ position, motion }, radius, 1.f, contact))
+        {
+            return position + motion;
+        }
+
+        const float travel = std::max(0.f, contact.distance - s_CollisionSkin / length);
+        position += travel * motion;
+
+        // What is left, less what goes into the surface
+        motion *= 1.f - travel;
+        motion -= std::min(0.f, glm::dot(motion, contact.normal)) * contact.normal;
+    }
+    return position;
+}
+
+void Renderer::Render()
+{
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+    m_FrameCounters.drawCommands = 0;
+
+    CullObjects();
+
+    uint32_t benchmarkLights = 0;
+    if (m_LightBenchmark.BeginFrame(benchmarkLights))
+    {
+        m_Lighting.SetLights(ScatterLights(m_Terrain, benchmarkLights, m_Options.scatterSeed));
+    }
+    m_Lighting.Update(m_Camera->GetViewMatrix(), m_Camera->GetProjectionMatrix(), m_Camera->GetNear(), m_Camera->GetFar(), m_ViewportWidth, m_ViewportHeight);
+    m_Lighting.Bind();
+
+    const bool prepass = m_Prepass.BeginFrame();
+    if (m_OverdrawView)
+    {
+        m_OverdrawCounter.BeginFrame();
+    }
+
+    m_SceneTimer.Begin();
+    m_ScenePrimitives.Begin();
+    m_FrameCounters.sceneGpuMs = m_SceneTimer.GetLatestMs();
+    m_FrameCounters.triangles = m_ScenePrimitives.GetLatest();
+
+    glBindBufferRange(GL_UNIFORM_BUFFER, 0, m_UBO, 0, sizeof(glm::mat4));
+    CollectSceneDraws();
+
+    if (prepass)
+    {
+        m_PassProgram = m_DepthProgram;
+        m_DepthOnlyPass = true;
+        glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+
+        m_Prepass.BeginDepthPass();
+        DrawScene();
+        m_Prepass.EndDepthPass();
+
+        m_DepthOnlyPass = false;
+
+        // Only the nearest surface of each pixel is shaded
+        glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+        glDepthMask(GL_FALSE);
+        glDepthFunc(GL_EQUAL);
+    }
+
+    m_PassProgram = m_OverdrawView ? m_OverdrawProgram : m_ShaderProgram;
+    if (m_OverdrawView)
+    {
+        glEnable(GL_BLEND);
+        glBlendFunc(GL_ONE, GL_ONE);
+    }
+
+    if (prepass)
+    {
+        m_Prepass.BeginColorPass();
+        DrawScene();
+        m_Prepass.EndColorPass();
+
+        glDepthFunc(GL_LEQUAL);
+        glDepthMask(GL_TRUE);
+    }
+    else
+    {
+        DrawScene();
+    }
+
+    // Last frame's visible palms go with the rest of the scene, those the
+    // depth pyramid of this frame reveals follow
+    if (!m_HiZObjects.empty())
+    {
+        for (size_t i = 0; i < m_HiZObjects.size(); ++i)
+        {
+            DrawObjectIndirect(m_HiZObjects[i], m_HiZ.GetCommandBuffer(i), HiZCuller::GetFirstPassCommandOffset());
+        }
+
+        m_HiZ.Cull();
+
+        for (size_t i = 0; i < m_HiZObjects.size(); ++i)
+        {
+            DrawObjectIndirect(m_HiZObjects[i], m_HiZ.GetCommandBuffer(i), HiZCuller::GetSecondPassCommandOffset());
+        }
+    }
+
+    if (!m_Queries.IsEmpty())
+    {
+        auto drawClusters = [this](uint32_t firstInstance, uint32_t instanceCount) { DrawObject(m_QueryObject, instanceCount, firstInstance); };
+
+        m_Queries.BeginFrame(m_Camera->GetViewProjectionMatrix(), m_Camera->GetPosition());
+        m_Queries.DrawVisible(drawClusters);
+        m_Queries.IssueBoxQueries();
+        m_Queries.DrawRevealed(drawClusters);
+    }
+    glBindBufferRange(GL_UNIFORM_BUFFER, 0, 0, 0, 0);
+
+    m_ScenePrimitives.End();
+    m_SceneTimer.End();
+
+    {
+        StatsRegistry& stats = StatsRegistry::GetGlobal();
+
+        stats.Add(StatCounter::DrawCommands, m_FrameCounters.drawCommands);
+        if (m_FrameCounters.triangles >= 0)
+        {
+            stats.Add(StatCounter::Triangles, static_cast<uint64_t>(m_FrameCounters.triangles));
+        }
+        if (m_FrameCounters.sceneGpuMs >= 0.f)
+        {
+            stats.Set(StatGauge::GpuFrameMs, m_FrameCounters.sceneGpuMs);
+            stats.Record(StatHistogram::GpuFrameTime, m_FrameCounters.sceneGpuMs);
+        }
+        stats.Set(StatGauge::GpuLiveBytes, static_cast<double>(GpuResourceTracker::GetGlobal().GetLiveBytes()));
+    }
+
+    if (m_OverdrawView)
+    {
+        glDisable(GL_BLEND);
+        m_OverdrawCounter.EndFrame();
+
+        // Once a second at 60 frames per second
+        const int64_t fragments = m_OverdrawCounter.GetLatestFragments();
+        if (fragments >= 0 && ++m_OverdrawFrames % 60 == 0)
+        {
+            std::cout << "Overdraw: " << static_cast<double>(fragments) / (static_cast<double>(m_ViewportWidth) * m_ViewportHeight)
+                      << " shaded fragments per pixel, pre-pass " << (prepass ? "on" : "off") << '\n';
+        }
+    }
+
+    if (m_LightBenchmark.IsRunning())
+    {
+        m_LightBenchmark.EndFrame(m_Lighting.GetFrameStats(), m_SceneTimer.GetLatestMs());
+
+        if (!m_LightBenchmark.IsRunning())
+        {
+            m_LightBenchmark.PrintReport(std::cout);
+            m_Lighting.SetLights(ScatterLights(m_Terrain, m_Options.pointLights, m_Options.scatterSeed));
+        }
+    }
+
+    if (!m_MeshletObjects.empty())
+    {
+        ++m_MeshletFrames;
+    }
+}
+
+void Renderer::Cleanup()
+{
+    GpuResourceTracker& resources = GpuResourceTracker::GetGlobal();
+
+    resources.PrintReport(std::cout);
+
+    if (m_Streaming)
+    {
+        m_Streaming->PrintStats();
+        m_Streaming->Cleanup();
+    }
+
+    {
+        const UploadStats stats = m_Uploads.GetStats();
+        std::cout << "Uploads: " << stats.copiesIssued << " copies, staging peak " << stats.peakBytesInUse / 1024 << " KiB of " << stats.capacity / 1024
+                  << " KiB, " << stats.failedAllocations << " allocations retried\n";
+    }
+    m_Uploads.Cleanup();
+
+    if (m_Occlusion.GetFrameCount() > 0)
+    {
+        const OcclusionStats& stats = m_Occlusion.GetTotalStats();
+        const double frames = static_cast<double>(m_Occlusion.GetFrameCount());
+        std::cout << "Occlusion: " << stats.tested / frames << " tests per frame, " << stats.frustumCulled / frames << " outside the frustum, "
+                  << stats.occluded / frames << " occluded; " << stats.rasterizedTriangles / frames << " occluder triangles drawn in "
+                  << stats.rasterizeMs / frames << " ms, tests " << stats.testMs / frames << " ms\n";
+    }
+
+    if (m_Scene.GetEntityCount() > 0)
+    {
+        m_Scene.PrintReport(std::cout);
+        m_CullSystems.PrintSchedule(std::cout);
+
+        const BoundsBvh& tree = m_InstanceBvh.GetTree();
+        std::cout << "Instance BVH: " << tree.GetNodes().size() << " nodes, cost " << tree.GetCost() << " against " << tree.GetBuildCost()
+                  << " when built, " << m_InstanceBvh.GetRebuildCount() << " builds, " << m_InstanceBvh.GetPendingItems().size() << " instances outside\n";
+    }
+    m_Scene.Clear();
+    m_Transforms.Clear();
+    m_InstanceBvh.Clear();
+    m_InstanceMeshBvhs.clear();
+    m_TerrainBvh.Clear();
+
+    if (m_HiZ.GetFrameCount() > 0)
+    {
+        const HiZStats& stats = m_HiZ.GetTotalStats();
+        const double frames = static_cast<double>(m_HiZ.GetFrameCount());
+        std::cout << "Hi-Z: " << stats.tested / frames << " tests per frame, " << stats.frustumCulled / frames << " outside the frustum, "
+                  << stats.occluded / frames << " occluded; drawn " << stats.drawnFirstPass / frames << " from the last frame, "
+                  << stats.drawnSecondPass / frames << " newly visible, " << stats.drawnButOccluded / frames << " while hidden; "
+                  << m_HiZ.GetSkippedReadbacks() << " readbacks skipped\n";
+    }
+    m_HiZ.Cleanup();
+
+    if (m_Queries.GetFrameCount() > 0)
+    {
+        const QueryStats& stats = m_Queries.GetTotalStats();
+        const double frames = static_cast<double>(m_Queries.GetFrameCount());
+        std::cout << "Occlusion queries: " << m_Queries.GetClusterCount() << " clusters, " << stats.clustersDrawn / frames << " drawn per frame; "
+                  << (stats.geometryQueries + stats.boxQueries) / frames << " queries per frame (" << stats.boxQueries / frames << " boxes), "
+                  << stats.resultsNotReady / frames << " results not ready, " << stats.waitMs / frames << " ms reading results\n";
+    }
+    m_Queries.Cleanup();
+
+    if (m_MeshletFrames > 0)
+    {
+        const double frames = static_cast<double>(m_MeshletFrames);
+        std::cout << "Meshlets: " << 100.0 * m_MeshletStats.culledTriangles / std::max<uint64_t>(m_MeshletStats.triangles, 1) << "% of triangles culled, "
+                  << m_MeshletStats.frustumCulled / frames << " meshlets outside the frustum and " << m_MeshletStats.backfaceCulled / frames
+                  << " backfacing per frame, " << m_MeshletStats.commands / frames << " draws per frame\n";
+    }
+    for (MeshletObject& meshlets : m_MeshletObjects)
+    {
+        resources.DeleteBuffer(meshlets.commandBuffer);
+    }
+    m_MeshletObjects.clear();
+
+    m_Lighting.Cleanup();
+    m_SceneTimer.Cleanup();
+    m_ScenePrimitives.Cleanup();
+
+    if (m_Prepass.GetFrameCount() > 0 && m_Prepass.GetMode() != PrepassMode::Off)
+    {
+        std::cout << "Depth pre-pass: " << m_Prepass.GetPrepassFrames() << " of " << m_Prepass.GetFrameCount() << " frames, "
+                  << m_Prepass.GetSwitchCount() << " automatic switches, last overdraw " << m_Prepass.GetOverdraw() << '\n';
+    }
+    m_Prepass.Cleanup();
+    m_OverdrawCounter.Cleanup();
+
+    glUnmapNamedBuffer(m_UBO);
+
+    resources.DeleteBuffer(m_UBO);
+    for (size_t i = 0; i < m_objects.size(); ++i)
+    {
+        resources.DeleteBuffer(m_objects[i].m_VBO);
+        resources.DeleteBuffer(m_objects[i].m_PositionVBO);
+        resources.DeleteBuffer(m_objects[i].m_IBO);
+        resources.DeleteBuffer(m_objects[i].m_InstanceBuffer);
+        glDeleteVertexArrays(1, &m_objects[i].m_VAO);
+        glDeleteVertexArrays(1, &m_objects[i].m_DepthVAO);
+    }
+    if (m_QueryObject.m_VAO)
+    {
+        resources.DeleteBuffer(m_QueryObject.m_VBO);
+        resources.DeleteBuffer(m_QueryObject.m_PositionVBO);
+        resources.DeleteBuffer(m_QueryObject.m_IBO);
+        resources.DeleteBuffer(m_QueryObject.m_InstanceBuffer);
+        glDeleteVertexArrays(1, &m_QueryObject.m_VAO);
+        glDeleteVertexArrays(1, &m_QueryObject.m_DepthVAO);
+    }
+    // Their instance buffers belonged to the culler
+    for (Object& obj : m_HiZObjects)
+    {
+        resources.DeleteBuffer(obj.m_VBO);
+        resources.DeleteBuffer(obj.m_PositionVBO);
+        resources.DeleteBuffer(obj.m_IBO);
+        glDeleteVertexArrays(1, &obj.m_VAO);
+        glDeleteVertexArrays(1, &obj.m_DepthVAO);
+    }
+    resources.DeleteProgram(m_ShaderProgram);
+    resources.DeleteProgram(m_DepthProgram);
+    resources.DeleteProgram(m_OverdrawProgram);
+
+    if (resources.GetLiveBytes() > 0)
+    {
+        std::cerr << "GPU resources leaked: " << resources.GetLiveBytes() << " bytes\n";
+    }
+}
+
+void Renderer::PrintResourceReport() const
+{
+    GpuResourceTracker::GetGlobal().PrintReport(std::cout);
+}
+
+void Renderer::SetOcclusionCulling(bool enabled)
+{
+    m_OcclusionCulling = enabled;
+    std::cout << "Occlusion culling " << (enabled ? "on" : "off") << '\n';
+}
+
+void Renderer::SetPrepassMode(PrepassMode mode)
+{
+    if (!m_DepthProgram)
+    {
+        return;
+    }
+
+    m_Prepass.SetMode(mode);
+    std::cout << "Depth pre-pass " << GetPrepassModeName(mode) << '\n';
+}
+
+void Renderer::SetOverdrawView(bool enabled)
+{
+    m_OverdrawView = enabled && m_OverdrawProgram;
+    std::cout << "Overdraw view " << (m_OverdrawView ? "on" : "off") << '\n';
 }
 
 void Renderer::UpdateViewport(uint32_t width, uint32_t height)
@@ -360,13 +1634,17 @@ void Renderer::UpdateViewport(uint32_t width, uint32_t height)
     (void)height;
 
     glViewport(0, 0, width, height);
+    m_ViewportWidth = width;
+    m_ViewportHeight = height;
+    m_HiZ.Resize(width, height);
     UpdateCamera();
 }
 
 void Renderer::UpdateCamera()
 {
     std::memcpy(m_UBOData, glm::value_ptr(m_Camera->GetViewProjectionMatrix()), sizeof(glm::mat4));
-    //glFlushMappedNamedBufferRange(m_UBO, 0, sizeof(glm::mat4));
+    // The mapping is flushed explicitly, which also shows GL captures the write
+    glFlushMappedNamedBufferRange(m_UBO, 0, sizeof(glm::mat4));
 }
 
 END_VISUALIZER_NAMESPACE
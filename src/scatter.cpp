@@ -0,0 +1,235 @@
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "random.hpp"
+#include "scatter.hpp"
+#include "terrain.hpp"
+#include "thread_pool.hpp"
+
+BEGIN_VISUALIZER_NAMESPACE
+
+namespace
+{
+    uint64_t TileSeed(uint64_t seed, uint32_t tileX, uint32_t tileZ)
+    {
+        return SplitMix64(seed ^ SplitMix64((static_cast<uint64_t>(tileX) << 32) | tileZ));
+    }
+
+    // Bridson's algorithm over [0, extent]^2
+    void PoissonDisk(Random& random, float extent, float radius, uint32_t attempts, std::vector<glm::vec2>& points)
+    {
+        const float cellSize = radius / std::sqrt(2.f);
+        const float invCellSize = 1.f / cellSize;
+        // Two cells of padding on every side let isFree skip bounds checks
+        const int32_t gridSize = static_cast<int32_t>(std::ceil(extent * invCellSize)) + 5;
+        const float radius2 = radius * radius;
+        const float stepAngle = 6.2831853f / static_cast<float>(std::max(1u, attempts));
+        const glm::vec2 step(std::cos(stepAngle), std::sin(stepAngle));
+
+        // Each cell holds at most one sample; empty cells hold NaN, which
+        // fails the distance test without a branch
+        std::vector<glm::vec2> grid(static_cast<size_t>(gridSize) * gridSize, glm::vec2(std::numeric_limits<float>::quiet_NaN()));
+        std::vector<uint32_t> active;
+
+        // The 5x5 block around a cell without its corners, which lie at
+        // least radius away. Nearest cells first, they conflict most often.
+        int32_t neighbours[21];
+        {
+            uint32_t n = 0;
+            for (int32_t ring = 0; ring <= 2; ++ring)
+            {
+                for (int32_t y = -2; y <= 2; ++y)
+                {
+                    for (int32_t x = -2; x <= 2; ++x)
+                    {
+                        if (std::max(std::abs(x), std::abs(y)) == ring && !(std::abs(x) == 2 && std::abs(y) == 2))
+                        {
+                            neighbours[n++] = y * gridSize + x;
+                        }
+                    }
+                }
+            }
+        }
+
+        auto cellOf = [&](const glm::vec2& p)
+        {
+            const int32_t gx = static_cast<int32_t>(p.x * invCellSize) + 2;
+            const int32_t gy = static_cast<int32_t>(p.y * invCellSize) + 2;
+            return static_cast<size_t>(gy) * gridSize + gx;
+        };
+
+        auto insert = [&](const glm::vec2& p)
+        {
+            grid[cellOf(p)] = p;
+            active.push_back(static_cast<uint32_t>(points.size()));
+            points.push_back(p);
+        };
+
+        auto isFree = [&](const glm::vec2& p)
+        {
+            const glm::vec2* cell = grid.data() + cellOf(p);
+
+            for (int32_t offset : neighbours)
+            {
+                const glm::vec2 d = cell[offset] - p;
+                if (glm::dot(d, d) < radius2)
+                {
+                    return false;
+                }
+            }
+            return true;
+        };
+
+        insert(glm::vec2(random.NextFloat(0.f, extent), random.NextFloat(0.f, extent)));
+
+        while (!active.empty())
+        {
+            const size_t slot = static_cast<size_t>(random.Next() % active.size());
+            const glm::vec2 origin = points[active[slot]];
+            bool placed = false;
+
+            // Candidates go round the origin from a random start angle, one
+            // rotation step at a time instead of a sin/cos per attempt
+            const float angle = random.NextFloat(0.f, 6.2831853f);
+            glm::vec2 direction(std::cos(angle), std::sin(angle));
+
+            for (uint32_t a = 0; a < attempts; ++a)
+            {
+                const float distance = radius * (1.f + random.NextFloat());
+                const glm::vec2 candidate = origin + distance * direction;
+
+                direction = glm::vec2(direction.x * step.x - direction.y * step.y, direction.x * step.y + direction.y * step.x);
+
+                if (candidate.x < 0.f || candidate.y < 0.f || candidate.x > extent || candidate.y > extent)
+                {
+                    continue;
+                }
+
+                if (isFree(candidate))
+                {
+                    insert(candidate);
+                    placed = true;
+                    break;
+                }
+            }
+
+            if (!placed)
+            {
+                active[slot] = active.back();
+                active.pop_back();
+            }
+        }
+    }
+}
+
+float DensityMask::Sample(float u, float v) const
+{
+    if (width == 0 || height == 0 || values.size() < static_cast<size_t>(width) * height)
+    {
+        return 1.f;
+    }
+
+    const float x = std::clamp(u, 0.f, 1.f) * static_cast<float>(width - 1);
+    const float y = std::clamp(v, 0.f, 1.f) * static_cast<float>(height - 1);
+    const uint32_t x0 = static_cast<uint32_t>(x);
+    const uint32_t y0 = static_cast<uint32_t>(y);
+    const uint32_t x1 = std::min(x0 + 1, width - 1);
+    const uint32_t y1 = std::min(y0 + 1, height - 1);
+    const float fx = x - static_cast<float>(x0);
+    const float fy = y - static_cast<float>(y0);
+
+    const float top = glm::mix(values[y0 * width + x0], values[y0 * width + x1], fx);
+    const float bottom = glm::mix(values[y1 * width + x0], values[y1 * width + x1], fx);
+
+    return glm::mix(top, bottom, fy);
+}
+
+std::vector<InstanceTransform> ScatterInstances(const Terrain& terrain, const ScatterSettings& settings, ThreadPool& pool)
+{
+    std::vector<InstanceTransform> result;
+
+    if (terrain.IsEmpty() || settings.tileSize <= 0.f || settings.minDistance <= 0.f)
+    {
+        return result;
+    }
+
+    const glm::vec3& min = terrain.GetMin();
+    const glm::vec3& max = terrain.GetMax();
+    const glm::vec2 size(max.x - min.x, max.z - min.z);
+
+    const uint32_t tilesX = std::max(1u, static_cast<uint32_t>(std::ceil(size.x / settings.tileSize)));
+    const uint32_t tilesZ = std::max(1u, static_cast<uint32_t>(std::ceil(size.y / settings.tileSize)));
+
+    // Leaving a minDistance band free at the far edges keeps samples of
+    // neighbouring tiles at least minDistance apart
+    const float extent = std::max(0.f, settings.tileSize - settings.minDistance);
+    const float minSlopeCos = std::cos(glm::radians(settings.maxSlopeDegrees));
+
+    std::vector<std::vector<InstanceTransform>> tiles(static_cast<size_t>(tilesX) * tilesZ);
+
+    pool.ParallelFor(tiles.size(), [&](size_t tile)
+    {
+        const uint32_t tileX = static_cast<uint32_t>(tile % tilesX);
+        const uint32_t tileZ = static_cast<uint32_t>(tile / tilesX);
+        const glm::vec2 origin(min.x + tileX * settings.tileSize, min.z + tileZ * settings.tileSize);
+
+        Random random(TileSeed(settings.seed, tileX, tileZ));
+
+        std::vector<glm::vec2> samples;
+        PoissonDisk(random, extent, settings.minDistance, settings.attemptsPerSample, samples);
+
+        size_t kept = 0;
+        for (const glm::vec2& sample : samples)
+        {
+            const glm::vec2 p = origin + sample;
+            const float keep = random.NextFloat();
+
+            if (settings.densityMask && keep >= settings.densityMask->Sample((p.x - min.x) / size.x, (p.y - min.z) / size.y))
+            {
+                continue;
+            }
+            samples[kept++] = p;
+        }
+        samples.resize(kept);
+
+        std::vector<float> heights(samples.size());
+        std::vector<glm::vec3> normals(samples.size());
+
+        terrain.SampleAt(samples, heights, normals);
+
+        std::vector<InstanceTransform>& instances = tiles[tile];
+        instances.reserve(samples.size());
+
+        for (size_t i = 0; i < samples.size(); ++i)
+        {
+            // Misses come back as NaN and fail both comparisons
+            if (!(heights[i] >= settings.minHeight && heights[i] <= settings.maxHeight) || normals[i].y < minSlopeCos)
+            {
+                continue;
+            }
+
+            InstanceTransform instance;
+            instance.position = glm::vec3(samples[i].x, heights[i], samples[i].y);
+            instance.scale = random.NextFloat(settings.minScale, settings.maxScale);
+            instance.yaw = random.NextFloat(settings.minYaw, settings.maxYaw);
+            instances.push_back(instance);
+        }
+    });
+
+    size_t total = 0;
+    for (const std::vector<InstanceTransform>& tile : tiles)
+    {
+        total += tile.size();
+    }
+
+    result.reserve(total);
+    for (const std::vector<InstanceTransform>& tile : tiles)
+    {
+        result.insert(result.end(), tile.begin(), tile.end());
+    }
+
+    return result;
+}
+
+END_VISUALIZER_NAMESPACE
@@ -0,0 +1,321 @@
+#include <algorithm>
+#include <cmath>
+
+#include "random.hpp"
+#include "scene_generator.hpp"
+
+BEGIN_VISUALIZER_NAMESPACE
+
+namespace
+{
+    constexpr float s_Pi = 3.14159265f;
+    constexpr uint32_t s_MinTrunkSides = 3;
+    constexpr uint32_t s_MinFrondColumns = 1;
+
+    const glm::vec3 s_SandColor(0.84f, 0.72f, 0.5f);
+    const glm::vec3 s_BarkColor(0.45f, 0.32f, 0.2f);
+    const glm::vec3 s_LeafColor(0.24f, 0.5f, 0.16f);
+
+    // Lattice value in [-1, 1], a pure function of its inputs
+    inline float LatticeValue(uint64_t seed, int32_t x, int32_t z)
+    {
+        const uint64_t key = (static_cast<uint64_t>(static_cast<uint32_t>(x)) << 32) | static_cast<uint32_t>(z);
+        return static_cast<float>(SplitMix64(seed ^ SplitMix64(key)) >> 40) * (2.f / 16777216.f) - 1.f;
+    }
+
+    float ValueNoise(uint64_t seed, float x, float z)
+    {
+        const float fx = std::floor(x);
+        const float fz = std::floor(z);
+        const int32_t ix = static_cast<int32_t>(fx);
+        const int32_t iz = static_cast<int32_t>(fz);
+
+        // Smoothstep weights keep the slope continuous across cells
+        const float tx = x - fx;
+        const float tz = z - fz;
+        const float wx = tx * tx * (3.f - 2.f * tx);
+        const float wz = tz * tz * (3.f - 2.f * tz);
+
+        const float a = LatticeValue(seed, ix, iz);
+        const float b = LatticeValue(seed, ix + 1, iz);
+        const float c = LatticeValue(seed, ix, iz + 1);
+        const float d = LatticeValue(seed, ix + 1, iz + 1);
+
+        return glm::mix(glm::mix(a, b, wx), glm::mix(c, d, wx), wz);
+    }
+
+    // Appends a rows x columns grid of quads over vertices [first, first +
+    // (rows + 1) * (columns + 1)), laid out row by row. Counter-clockwise
+    // seen from where the cross product of the column and row directions
+    // points, or from the other side when flipped.
+    void AppendGridIndices(std::vector<uint32_t>& indices, uint32_t first, uint32_t rows, uint32_t columns, bool flip)
+    {
+        for (uint32_t r = 0; r < rows; ++r)
+        {
+            for (uint32_t c = 0; c < columns; ++c)
+            {
+                const uint32_t a = first + r * (columns + 1) + c;
+                const uint32_t b = a + 1;
+                const uint32_t d = a + columns + 1;
+                const uint32_t e = d + 1;
+
+                if (flip)
+                {
+                    indices.insert(indices.end(), { a, d, b, b, d, e });
+                }
+                else
+                {
+                    indices.insert(indices.end(), { a, b, d, b, e, d });
+                }
+            }
+        }
+    }
+
+    // Box-Muller, one of the pair is dropped
+    glm::vec2 NextGaussian(Random& random)
+    {
+        const float u = std::max(random.NextFloat(), 1e-7f);
+        const float v = random.NextFloat();
+        const float r = std::sqrt(-2.f * std::log(u));
+        return glm::vec2(r * std::cos(2.f * s_Pi * v), r * std::sin(2.f * s_Pi * v));
+    }
+}
+
+GeneratedMesh GenerateNoiseTerrain(const NoiseTerrainSettings& settings)
+{
+    const uint32_t quads = std::max(1u, static_cast<uint32_t>(std::lround(std::sqrt(static_cast<double>(settings.triangleCount) / 2.0))));
+    const uint32_t side = quads + 1;
+    const float step = settings.size / static_cast<float>(quads);
+    const float origin = -0.5f * settings.size;
+
+    float amplitudeSum = 0.f;
+    for (uint32_t o = 0, amplitude = 1; o < settings.octaves; ++o)
+    {
+        amplitudeSum += 1.f / static_cast<float>(amplitude);
+        amplitude *= 2;
+    }
+
+    std::vector<float> heights(static_cast<size_t>(side) * side);
+
+    for (uint32_t z = 0; z < side; ++z)
+    {
+        for (uint32_t x = 0; x < side; ++x)
+        {
+            float frequency = settings.frequency / settings.size;
+            float amplitude = 1.f;
+            float height = 0.f;
+
+            for (uint32_t o = 0; o < settings.octaves; ++o)
+            {
+                height += amplitude * ValueNoise(settings.seed + o, (origin + x * step) * frequency, (origin + z * step) * frequency);
+                frequency *= 2.f;
+                amplitude *= 0.5f;
+            }
+
+            heights[static_cast<size_t>(z) * side + x] = settings.baseHeight + settings.amplitude * height / std::max(amplitudeSum, 1.f);
+        }
+    }
+
+    GeneratedMesh mesh;
+    mesh.vertices.reserve(heights.size());
+    mesh.indices.reserve(static_cast<size_t>(quads) * quads * 6);
+
+    auto heightAt = [&](int32_t x, int32_t z)
+    {
+        x = std::clamp(x, 0, static_cast<int32_t>(quads));
+        z = std::clamp(z, 0, static_cast<int32_t>(quads));
+        return heights[static_cast<size_t>(z) * side + x];
+    };
+
+    for (uint32_t z = 0; z < side; ++z)
+    {
+        for (uint32_t x = 0; x < side; ++x)
+        {
+            const int32_t ix = static_cast<int32_t>(x);
+            const int32_t iz = static_cast<int32_t>(z);
+
+            // Central differences, one-sided on the border
+            const float dx = (heightAt(ix + 1, iz) - heightAt(ix - 1, iz)) / (static_cast<float>(std::min<int32_t>(ix + 1, quads) - std::max(ix - 1, 0)) * step);
+            const float dz = (heightAt(ix, iz + 1) - heightAt(ix, iz - 1)) / (static_cast<float>(std::min<int32_t>(iz + 1, quads) - std::max(iz - 1, 0)) * step);
+
+            const glm::vec3 position(origin + x * step, heightAt(ix, iz), origin + z * step);
+            mesh.vertices.push_back({ position, glm::normalize(glm::vec3(-dx, 1.f, -dz)), s_SandColor });
+        }
+    }
+
+    // Rows run along +Z and columns along +X, whose cross product points
+    // down, so the grid is flipped to face up
+    AppendGridIndices(mesh.indices, 0, quads, quads, true);
+
+    return mesh;
+}
+
+GeneratedMesh GenerateTree(const TreeSettings& settings)
+{
+    Random random(settings.seed);
+
+    // The trunk is a grid of sides x (2 * sides) quads, each frond one of
+    // (4 * columns) x columns quads drawn from both sides
+    const double half = static_cast<double>(settings.triangleCount) / 2.0;
+    const uint32_t fronds = std::max(1u, settings.fronds);
+    const uint32_t sides = std::max(s_MinTrunkSides, static_cast<uint32_t>(std::lround(std::sqrt(half / 4.0))));
+    const uint32_t rings = sides * 2;
+    const uint32_t columns = std::max(s_MinFrondColumns, static_cast<uint32_t>(std::lround(std::sqrt(half / (16.0 * fronds)))));
+    const uint32_t rows = columns * 4;
+
+    GeneratedMesh mesh;
+    mesh.vertices.reserve(static_cast<size_t>(rings + 1) * (sides + 1) + static_cast<size_t>(fronds) * (rows + 1) * (columns + 1) * 2);
+    mesh.indices.reserve((static_cast<size_t>(rings) * sides + static_cast<size_t>(fronds) * rows * columns * 2) * 6);
+
+    // Trunk axis bends towards +X as a parabola, tapering to 60% of its radius
+    auto trunkCenter = [&](float t)
+    {
+        return glm::vec3(settings.bend * t * t, settings.height * t, 0.f);
+    };
+
+    for (uint32_t ring = 0; ring <= rings; ++ring)
+    {
+        const float t = static_cast<float>(ring) / static_cast<float>(rings);
+        const float radius = settings.trunkRadius * (1.f - 0.4f * t);
+        const glm::vec3 center = trunkCenter(t);
+
+        // The seam is duplicated, closing the ring without wrapping indices
+        for (uint32_t s = 0; s <= sides; ++s)
+        {
+            const float angle = 2.f * s_Pi * static_cast<float>(s % sides) / static_cast<float>(sides);
+            const glm::vec3 normal(std::cos(angle), 0.f, std::sin(angle));
+            mesh.vertices.push_back({ center + radius * normal, normal, s_BarkColor });
+        }
+    }
+
+    // Columns turn from +X towards +Z and rows go up, which faces inwards
+    // unflipped
+    AppendGridIndices(mesh.indices, 0, rings, sides, true);
+
+    const glm::vec3 crown = trunkCenter(1.f);
+
+    for (uint32_t f = 0; f < fronds; ++f)
+    {
+        const float heading = 2.f * s_Pi * (static_cast<float>(f) + random.NextFloat(-0.25f, 0.25f)) / static_cast<float>(fronds);
+        const float length = settings.frondLength * random.NextFloat(0.8f, 1.2f);
+        const float lift = random.NextFloat(0.2f, 0.5f);
+
+        const glm::vec3 direction(std::cos(heading), 0.f, std::sin(heading));
+        const glm::vec3 across(-direction.z, 0.f, direction.x);
+
+        // Two copies, one per side, so back-face culling keeps the frond
+        for (uint32_t copy = 0; copy < 2; ++copy)
+        {
+            const uint32_t first = static_cast<uint32_t>(mesh.vertices.size());
+            const float facing = copy == 0 ? 1.f : -1.f;
+
+            for (uint32_t row = 0; row <= rows; ++row)
+            {
+                // Rises then droops below the crown, widest halfway and
+                // never quite closed, which would leave slivers
+                const float s = static_cast<float>(row) / static_cast<float>(rows);
+                const glm::vec3 spine = crown + length * (s * direction + glm::vec3(0.f, lift * s - s * s, 0.f));
+                const glm::vec3 tangent = glm::normalize(direction + glm::vec3(0.f, lift - 2.f * s, 0.f));
+                const glm::vec3 normal = facing * glm::normalize(glm::cross(across, tangent));
+                const float width = settings.frondWidth * std::sin(s_Pi * std::clamp(s, 0.05f, 0.95f));
+
+                for (uint32_t column = 0; column <= columns; ++column)
+                {
+                    const float u = static_cast<float>(column) / static_cast<float>(columns) - 0.5f;
+                    mesh.vertices.push_back({ spine + across * (width * u), normal, s_LeafColor });
+                }
+            }
+
+            // Columns go across and rows along the frond, whose cross
+            // product points up
+            AppendGridIndices(mesh.indices, first, rows, columns, copy != 0);
+        }
+    }
+
+    return mesh;
+}
+
+std::vector<InstanceTransform> GenerateInstances(const InstanceSettings& settings)
+{
+    Random random(settings.seed);
+    std::vector<InstanceTransform> instances(settings.count);
+
+    const glm::vec2 extent = settings.max - settings.min;
+
+    switch (settings.distribution)
+    {
+    case InstanceDistribution::Uniform:
+        for (InstanceTransform& instance : instances)
+        {
+            instance.position = glm::vec3(random.NextFloat(settings.min.x, settings.max.x), 0.f, random.NextFloat(settings.min.y, settings.max.y));
+        }
+        break;
+
+    case InstanceDistribution::Clustered:
+    {
+        std::vector<glm::vec2> centers(std::max(1u, settings.clusterCount));
+        for (glm::vec2& center : centers)
+        {
+            center = glm::vec2(random.NextFloat(settings.min.x, settings.max.x), random.NextFloat(settings.min.y, settings.max.y));
+        }
+
+        for (InstanceTransform& instance : instances)
+        {
+            const glm::vec2& center = centers[random.Next() % centers.size()];
+            const glm::vec2 p = glm::clamp(center + settings.clusterRadius * NextGaussian(random), settings.min, settings.max);
+            instance.position = glm::vec3(p.x, 0.f, p.y);
+        }
+        break;
+    }
+
+    case InstanceDistribution::Grid:
+    {
+        // Cells as square as the rectangle allows
+        const double aspect = extent.y > 0.f ? static_cast<double>(extent.x) / extent.y : 1.0;
+        const uint64_t columns = std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(std::sqrt(static_cast<double>(settings.count) * aspect))));
+        const uint64_t rows = std::max<uint64_t>(1, (settings.count + columns - 1) / columns);
+        const glm::vec2 cell = extent / glm::vec2(static_cast<float>(columns), static_cast<float>(rows));
+
+        for (uint64_t i = 0; i < instances.size(); ++i)
+        {
+            const glm::vec2 p = settings.min + cell * glm::vec2(static_cast<float>(i % columns) + 0.5f, static_cast<float>(i / columns) + 0.5f);
+            instances[i].position = glm::vec3(p.x, 0.f, p.y);
+        }
+        break;
+    }
+    }
+
+    for (InstanceTransform& instance : instances)
+    {
+        instance.scale = random.NextFloat(settings.minScale, settings.maxScale);
+        instance.yaw = random.NextFloat(0.f, 2.f * s_Pi);
+    }
+
+    return instances;
+}
+
+bool ParseInstanceDistribution(const std::string& name, InstanceDistribution& distribution)
+{
+    for (InstanceDistribution candidate : { InstanceDistribution::Uniform, InstanceDistribution::Clustered, InstanceDistribution::Grid })
+    {
+        if (name == GetInstanceDistributionName(candidate))
+        {
+            distribution = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+const char* GetInstanceDistributionName(InstanceDistribution distribution)
+{
+    switch (distribution)
+    {
+    case InstanceDistribution::Uniform: return "uniform";
+    case InstanceDistribution::Clustered: return "clustered";
+    case InstanceDistribution::Grid: return "grid";
+    }
+    return "unknown";
+}
+
+END_VISUALIZER_NAMESPACE
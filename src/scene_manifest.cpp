@@ -0,0 +1,141 @@
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <istream>
+#include <sstream>
+
+#include "mapped_file.hpp"
+#include "scene_manifest.hpp"
+
+BEGIN_VISUALIZER_NAMESPACE
+
+SceneManifest SceneManifest::GetDefault()
+{
+    SceneManifest scene;
+    scene.SetTerrain("desert.obj");
+    scene.AddInstances(scene.AddPrototype("palm.obj"), "palmTransfo.txt");
+    return scene;
+}
+
+bool SceneManifest::Load(const std::string& manifestPath)
+{
+    MappedFile file;
+
+    if (!file.Open(manifestPath))
+    {
+        return false;
+    }
+
+    ByteStreamBuf buffer(file.GetBytes());
+    std::istream stream(&buffer);
+
+    const std::filesystem::path directory = std::filesystem::path(manifestPath).parent_path();
+    auto resolve = [&directory](const std::string& path)
+    {
+        const std::filesystem::path p(path);
+        return (p.is_absolute() ? p : directory / p).string();
+    };
+
+    std::string line;
+    size_t lineNumber = 0;
+
+    while (std::getline(stream, line))
+    {
+        ++lineNumber;
+
+        std::istringstream ss(line);
+        std::string keyword;
+
+        if (!(ss >> keyword) || keyword[0] == '#')
+        {
+            continue;
+        }
+
+        bool valid = true;
+
+        if (keyword == "terrain")
+        {
+            std::string path;
+            valid = static_cast<bool>(ss >> path) && m_Terrain.empty();
+            if (valid)
+            {
+                m_Terrain = resolve(path);
+            }
+        }
+        else if (keyword == "prototype")
+        {
+            std::string path;
+            valid = static_cast<bool>(ss >> path);
+            if (valid)
+            {
+                m_Prototypes.push_back(resolve(path));
+            }
+        }
+        else if (keyword == "instances")
+        {
+            uint32_t prototype;
+            std::string path;
+            valid = static_cast<bool>(ss >> prototype >> path) && prototype < m_Prototypes.size();
+            if (valid)
+            {
+                m_InstanceSets.push_back({ prototype, resolve(path) });
+            }
+        }
+        else
+        {
+            valid = false;
+        }
+
+        if (!valid)
+        {
+            std::cerr << "Invalid scene manifest entry at " << manifestPath << ':' << lineNumber << '\n';
+            return false;
+        }
+    }
+
+    if (m_Terrain.empty())
+    {
+        std::cerr << "Scene manifest without terrain : " << manifestPath << '\n';
+        return false;
+    }
+
+    return true;
+}
+
+bool SceneManifest::Save(const std::string& manifestPath) const
+{
+    std::ofstream ofs(manifestPath, std::ios::trunc);
+
+    if (!ofs)
+    {
+        std::cerr << "Cannot open file : " << manifestPath << '\n';
+        return false;
+    }
+
+    ofs << "terrain " << m_Terrain << '\n';
+
+    for (const std::string& prototype : m_Prototypes)
+    {
+        ofs << "prototype " << prototype << '\n';
+    }
+
+    for (const InstanceSet& set : m_InstanceSets)
+    {
+        ofs << "instances " << set.prototype << ' ' << set.path << '\n';
+    }
+
+    return static_cast<bool>(ofs);
+}
+
+uint32_t SceneManifest::AddPrototype(const std::string& meshPath)
+{
+    m_Prototypes.push_back(meshPath);
+    return static_cast<uint32_t>(m_Prototypes.size() - 1);
+}
+
+void SceneManifest::AddInstances(uint32_t prototype, const std::string& path)
+{
+    m_InstanceSets.push_back({ prototype, path });
+}
+
+END_VISUALIZER_NAMESPACE
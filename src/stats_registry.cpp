@@ -0,0 +1,397 @@
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#include "stats_registry.hpp"
+#include "utils.hpp"
+
+BEGIN_VISUALIZER_NAMESPACE
+
+namespace
+{
+    // A reader racing a publisher every frame gets through in a few tries
+    constexpr uint32_t s_ReadAttempts = 64;
+    // Seconds without a new snapshot before the reader gives up
+    constexpr uint32_t s_StaleSeconds = 5;
+
+    // Upper bound of a bucket in milliseconds, the last one has none
+    inline double GetBucketLimitMs(size_t bucket)
+    {
+        return (64ull << bucket) * 1e-3;
+    }
+
+    double GetPercentileMs(const std::array<uint64_t, s_StatHistogramBuckets>& buckets, double p)
+    {
+        uint64_t total = 0;
+        for (uint64_t count : buckets)
+        {
+            total += count;
+        }
+
+        const uint64_t rank = std::max<uint64_t>(static_cast<uint64_t>(p * total + 0.5), 1);
+        uint64_t seen = 0;
+        for (size_t bucket = 0; bucket < buckets.size(); ++bucket)
+        {
+            seen += buckets[bucket];
+            if (seen >= rank)
+            {
+                return GetBucketLimitMs(bucket);
+            }
+        }
+        return GetBucketLimitMs(buckets.size() - 1);
+    }
+}
+
+const char* GetStatName(StatCounter counter)
+{
+    switch (counter)
+    {
+    case StatCounter::Frames:
+        return "frames";
+    case StatCounter::DrawCommands:
+        return "draw commands";
+    case StatCounter::Triangles:
+        return "triangles";
+    case StatCounter::VisibleInstances:
+        return "visible instances";
+    case StatCounter::CulledInstances:
+        return "culled instances";
+    case StatCounter::UploadBytes:
+        return "upload bytes";
+    case StatCounter::FenceWaits:
+        return "fence waits";
+    default:
+        return "unknown";
+    }
+}
+
+const char* GetStatName(StatGauge gauge)
+{
+    switch (gauge)
+    {
+    case StatGauge::CpuFrameMs:
+        return "CPU frame ms";
+    case StatGauge::GpuFrameMs:
+        return "GPU frame ms";
+    case StatGauge::StagingBytesInUse:
+        return "staging bytes in use";
+    case StatGauge::GpuLiveBytes:
+        return "GPU live bytes";
+    default:
+        return "unknown";
+    }
+}
+
+const char* GetStatName(StatHistogram histogram)
+{
+    switch (histogram)
+    {
+    case StatHistogram::CpuFrameTime:
+        return "CPU frame time";
+    case StatHistogram::GpuFrameTime:
+        return "GPU frame time";
+    default:
+        return "unknown";
+    }
+}
+
+StatsRegistry& StatsRegistry::GetGlobal()
+{
+    static StatsRegistry registry;
+    return registry;
+}
+
+void StatsRegistry::Record(StatHistogram histogram, float ms)
+{
+    const uint64_t microseconds = ms > 0.f ? static_cast<uint64_t>(ms * 1000.f) : 0;
+    const size_t bucket = std::min<size_t>(std::bit_width(microseconds >> 6), s_StatHistogramBuckets - 1);
+
+    m_Histograms[static_cast<size_t>(histogram)][bucket].fetch_add(1, std::memory_order_relaxed);
+}
+
+void StatsRegistry::Snapshot(StatsSnapshot& snapshot) const
+{
+    for (size_t i = 0; i < s_StatCounterCount; ++i)
+    {
+        snapshot.counters[i] = m_Counters[i].load(std::memory_order_relaxed);
+    }
+    for (size_t i = 0; i < s_StatGaugeCount; ++i)
+    {
+        snapshot.gauges[i] = m_Gauges[i].load(std::memory_order_relaxed);
+    }
+    for (size_t i = 0; i < s_StatHistogramCount; ++i)
+    {
+        for (size_t bucket = 0; bucket < s_StatHistogramBuckets; ++bucket)
+        {
+            snapshot.histograms[i][bucket] = m_Histograms[i][bucket].load(std::memory_order_relaxed);
+        }
+    }
+}
+
+SharedStats::~SharedStats()
+{
+    Close();
+}
+
+bool SharedStats::Create(const char* name)
+{
+    if (!Map(name, true))
+    {
+        return false;
+    }
+
+    m_Segment->sequence.store(0, std::memory_order_relaxed);
+    m_Segment->snapshot = StatsSnapshot{};
+    m_Segment->magic = s_Magic;
+    m_Segment->version = s_Version;
+    m_Segment->snapshotSize = sizeof(StatsSnapshot);
+    m_Owner = true;
+    m_Scratch = StatsSnapshot{};
+
+    return true;
+}
+
+void SharedStats::Publish(const StatsRegistry& registry)
+{
+    registry.Snapshot(m_Scratch);
+    ++m_Scratch.publishCount;
+    m_Scratch.publishTimeNs = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+
+    const uint32_t sequence = m_Segment->sequence.load(std::memory_order_relaxed);
+
+    m_Segment->sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    std::memcpy(&m_Segment->snapshot, &m_Scratch, sizeof(StatsSnapshot));
+    m_Segment->sequence.store(sequence + 2, std::memory_order_release);
+}
+
+bool SharedStats::Open(const char* name)
+{
+    if (!Map(name, false))
+    {
+        return false;
+    }
+
+    if (m_Segment->magic != s_Magic || m_Segment->version != s_Version || m_Segment->snapshotSize != sizeof(StatsSnapshot))
+    {
+        std::cerr << "Stats segment " << name << " has another layout (version " << m_Segment->version << ")\n";
+        Close();
+        return false;
+    }
+
+    return true;
+}
+
+bool SharedStats::Read(StatsSnapshot& snapshot) const
+{
+    for (uint32_t attempt = 0; attempt < s_ReadAttempts; ++attempt)
+    {
+        const uint32_t before = m_Segment->sequence.load(std::memory_order_acquire);
+        if (before & 1)
+        {
+            std::this_thread::yield();
+            continue;
+        }
+
+        std::memcpy(&snapshot, &m_Segment->snapshot, sizeof(StatsSnapshot));
+        std::atomic_thread_fence(std::memory_order_acquire);
+
+        if (m_Segment->sequence.load(std::memory_order_relaxed) == before)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+#ifdef _WIN32
+
+bool SharedStats::Map(const char* name, bool create)
+{
+    Close();
+
+    const std::string fullName = std::string("Local\\") + name;
+
+    m_Mapping = create ? CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, 0, sizeof(Segment), fullName.c_str())
+                       : OpenFileMappingA(FILE_MAP_READ, FALSE, fullName.c_str());
+
+    if (!m_Mapping)
+    {
+        std::cerr << "Cannot " << (create ? "create" : "open") << " stats segment : " << fullName << '\n';
+        DisplayLastWinAPIError();
+        return false;
+    }
+
+    m_Segment = static_cast<Segment*>(MapViewOfFile(m_Mapping, create ? FILE_MAP_WRITE : FILE_MAP_READ, 0, 0, sizeof(Segment)));
+
+    if (!m_Segment)
+    {
+        std::cerr << "Cannot map stats segment : " << fullName << '\n';
+        DisplayLastWinAPIError();
+        Close();
+        return false;
+    }
+
+    return true;
+}
+
+void SharedStats::Close()
+{
+    if (m_Segment)
+    {
+        UnmapViewOfFile(m_Segment);
+    }
+    if (m_Mapping)
+    {
+        CloseHandle(m_Mapping);
+    }
+
+    m_Segment = nullptr;
+    m_Mapping = nullptr;
+    m_Owner = false;
+}
+
+#else
+
+bool SharedStats::Map(const char* name, bool create)
+{
+    Close();
+
+    std::snprintf(m_Name, sizeof(m_Name), "/%s", name);
+
+    const int fd = create ? shm_open(m_Name, O_CREAT | O_RDWR, 0644) : shm_open(m_Name, O_RDONLY, 0);
+
+    if (fd < 0)
+    {
+        std::cerr << "Cannot " << (create ? "create" : "open") << " stats segment : " << m_Name << '\n';
+        return false;
+    }
+
+    if (create && ftruncate(fd, sizeof(Segment)) != 0)
+    {
+        std::cerr << "Cannot size stats segment : " << m_Name << '\n';
+        close(fd);
+        return false;
+    }
+
+    void* data = mmap(nullptr, sizeof(Segment), create ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+
+    // The mapping keeps its own reference to the segment
+    close(fd);
+
+    if (data == MAP_FAILED)
+    {
+        std::cerr << "Cannot map stats segment : " << m_Name << '\n';
+        return false;
+    }
+
+    m_Segment = static_cast<Segment*>(data);
+    return true;
+}
+
+void SharedStats::Close()
+{
+    if (m_Segment)
+    {
+        munmap(m_Segment, sizeof(Segment));
+    }
+    // Segments outlive their processes here, unlike Windows mappings
+    if (m_Owner)
+    {
+        shm_unlink(m_Name);
+    }
+
+    m_Segment = nullptr;
+    m_Owner = false;
+}
+
+#endif
+
+bool RunStatsReader(std::ostream& os, const char* name)
+{
+    SharedStats stats;
+
+    if (!stats.Open(name))
+    {
+        return false;
+    }
+
+    StatsSnapshot previous;
+    StatsSnapshot current;
+    uint32_t staleSeconds = 0;
+
+    if (!stats.Read(previous))
+    {
+        std::cerr << "Stats segment " << name << " is busy\n";
+        return false;
+    }
+
+    os << std::fixed << std::setprecision(1);
+
+    while (staleSeconds < s_StaleSeconds)
+    {
+        std::this_thread::sleep_for(std::chrono::seconds(1));
+
+        if (!stats.Read(current) || current.publishCount == previous.publishCount)
+        {
+            ++staleSeconds;
+            continue;
+        }
+        staleSeconds = 0;
+
+        // Nothing to take a rate against before the first publish
+        if (previous.publishCount == 0)
+        {
+            previous = current;
+            continue;
+        }
+
+        const double seconds = (current.publishTimeNs - previous.publishTimeNs) * 1e-9;
+
+        for (size_t i = 0; i < s_StatCounterCount; ++i)
+        {
+            os << GetStatName(static_cast<StatCounter>(i)) << ' ' << (current.counters[i] - previous.counters[i]) / seconds << "/s"
+               << (i + 1 < s_StatCounterCount ? ", " : "\n");
+        }
+
+        for (size_t i = 0; i < s_StatGaugeCount; ++i)
+        {
+            os << GetStatName(static_cast<StatGauge>(i)) << ' ' << current.gauges[i] << (i + 1 < s_StatGaugeCount ? ", " : "\n");
+        }
+
+        // Over the last interval only
+        for (size_t i = 0; i < s_StatHistogramCount; ++i)
+        {
+            std::array<uint64_t, s_StatHistogramBuckets> buckets;
+            for (size_t bucket = 0; bucket < s_StatHistogramBuckets; ++bucket)
+            {
+                buckets[bucket] = current.histograms[i][bucket] - previous.histograms[i][bucket];
+            }
+
+            os << GetStatName(static_cast<StatHistogram>(i)) << " p50 < " << GetPercentileMs(buckets, 0.5) << " ms, p99 < " << GetPercentileMs(buckets, 0.99)
+               << " ms" << (i + 1 < s_StatHistogramCount ? ", " : "\n");
+        }
+        os << std::flush;
+
+        previous = current;
+    }
+
+    os << "No new stats for " << s_StaleSeconds << " s, stopping\n";
+    return true;
+}
+
+END_VISUALIZER_NAMESPACE
@@ -0,0 +1,547 @@
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "mesh.hpp"
+#include "simd.hpp"
+#include "terrain.hpp"
+
+BEGIN_VISUALIZER_NAMESPACE
+
+namespace
+{
+    // Slack on the barycentric test so points on shared edges never fall
+    // through the crack between two triangles
+    constexpr float s_BarycentricEpsilon = 1e-5f;
+    constexpr uint32_t s_MaxCellsPerAxis = 4096;
+    constexpr float s_MinDeterminant = 1e-12f;
+
+    uint32_t ToCell(float v, float origin, float invSize, uint32_t count)
+    {
+        const float c = std::floor((v - origin) * invSize);
+        return static_cast<uint32_t>(std::clamp(c, 0.f, static_cast<float>(count - 1)));
+    }
+
+    // Keeps the part of the polygon on one side of an axis aligned line,
+    // interpolating height along the cut edges. Returns the new corner count.
+    uint32_t ClipPolygon(const glm::vec3* in, uint32_t count, glm::vec3* out, glm::length_t axis, float bound, float side)
+    {
+        uint32_t written = 0;
+
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            const glm::vec3& a = in[i];
+            const glm::vec3& b = in[(i + 1) % count];
+            const float da = side * (a[axis] - bound);
+            const float db = side * (b[axis] - bound);
+
+            if (da >= 0.f)
+            {
+                out[written++] = a;
+            }
+
+            if ((da < 0.f) != (db < 0.f))
+            {
+                glm::vec3 cut = a + (b - a) * (da / (da - db));
+                cut[axis] = bound;
+                out[written++] = cut;
+            }
+        }
+
+        return written;
+    }
+}
+
+void Terrain::Clear()
+{
+    m_Packs.clear();
+    m_CellPackStart.clear();
+    m_Normals.clear();
+    m_Corners.clear();
+    m_Min = m_Max = glm::vec3(0.f);
+    m_CellCountX = m_CellCountZ = 0;
+    m_TriangleCount = 0;
+}
+
+void Terrain::Build(std::span<const VertexDataPosition3fColor3f> vertices, std::span<const uint32_t> indices, float cellSize)
+{
+    Clear();
+
+    struct Triangle
+    {
+        uint32_t i0, i1, i2;
+        float det;
+    };
+
+    std::vector<Triangle> triangles;
+    triangles.reserve(indices.size() / 3);
+
+    glm::vec3 minPos(std::numeric_limits<float>::max());
+    glm::vec3 maxPos(std::numeric_limits<float>::lowest());
+    double footprint = 0.0;
+
+    for (size_t i = 0; i + 2 < indices.size(); i += 3)
+    {
+        const glm::vec3& p0 = vertices[indices[i]].position;
+        const glm::vec3& p1 = vertices[indices[i + 1]].position;
+        const glm::vec3& p2 = vertices[indices[i + 2]].position;
+
+        const float det = (p1.x - p0.x) * (p2.z - p0.z) - (p2.x - p0.x) * (p1.z - p0.z);
+
+        // Walls have no height to offer
+        if (std::abs(det) < s_MinDeterminant)
+        {
+            continue;
+        }
+
+        triangles.push_back({ indices[i], indices[i + 1], indices[i + 2], det });
+        footprint += 0.5 * std::abs(det);
+
+        minPos = glm::min(minPos, glm::min(p0, glm::min(p1, p2)));
+        maxPos = glm::max(maxPos, glm::max(p0, glm::max(p1, p2)));
+    }
+
+    if (triangles.empty())
+    {
+        return;
+    }
+
+    m_Min = minPos;
+    m_Max = maxPos;
+    m_TriangleCount = triangles.size();
+
+    if (cellSize <= 0.f)
+    {
+        // Roughly two triangles per cell on a regular height field
+        cellSize = static_cast<float>(std::sqrt(footprint / static_cast<double>(triangles.size())));
+    }
+
+    const float extent = std::max(m_Max.x - m_Min.x, m_Max.z - m_Min.z);
+    cellSize = std::max(cellSize, extent / static_cast<float>(s_MaxCellsPerAxis));
+    cellSize = std::max(cellSize, std::numeric_limits<float>::min());
+
+    m_CellSize = cellSize;
+    m_InvCellSize = 1.f / cellSize;
+    m_CellCountX = std::max(1u, static_cast<uint32_t>(std::ceil((m_Max.x - m_Min.x) * m_InvCellSize)));
+    m_CellCountZ = std::max(1u, static_cast<uint32_t>(std::ceil((m_Max.z - m_Min.z) * m_InvCellSize)));
+    m_CellCountX = std::min(m_CellCountX, s_MaxCellsPerAxis);
+    m_CellCountZ = std::min(m_CellCountZ, s_MaxCellsPerAxis);
+
+    const size_t cellCount = static_cast<size_t>(m_CellCountX) * m_CellCountZ;
+
+    auto cellRange = [&](const Triangle& t, uint32_t& x0, uint32_t& z0, uint32_t& x1, uint32_t& z1)
+    {
+        const glm::vec3& p0 = vertices[t.i0].position;
+        const glm::vec3& p1 = vertices[t.i1].position;
+        const glm::vec3& p2 = vertices[t.i2].position;
+
+        x0 = ToCell(std::min(p0.x, std::min(p1.x, p2.x)), m_Min.x, m_InvCellSize, m_CellCountX);
+        x1 = ToCell(std::max(p0.x, std::max(p1.x, p2.x)), m_Min.x, m_InvCellSize, m_CellCountX);
+        z0 = ToCell(std::min(p0.z, std::min(p1.z, p2.z)), m_Min.z, m_InvCellSize, m_CellCountZ);
+        z1 = ToCell(std::max(p0.z, std::max(p1.z, p2.z)), m_Min.z, m_InvCellSize, m_CellCountZ);
+    };
+
+    // Counting pass then fill pass, so the per-cell lists end up in one array
+    std::vector<uint32_t> cellStart(cellCount + 1, 0);
+
+    for (const Triangle& t : triangles)
+    {
+        uint32_t x0, z0, x1, z1;
+        cellRange(t, x0, z0, x1, z1);
+
+        for (uint32_t z = z0; z <= z1; ++z)
+        {
+            for (uint32_t x = x0; x <= x1; ++x)
+            {
+                ++cellStart[static_cast<size_t>(z) * m_CellCountX + x + 1];
+            }
+        }
+    }
+
+    for (size_t c = 0; c < cellCount; ++c)
+    {
+        cellStart[c + 1] += cellStart[c];
+    }
+
+    std::vector<uint32_t> cellTriangles(cellStart.back());
+    std::vector<uint32_t> cursor(cellStart.begin(), cellStart.end() - 1);
+
+    for (uint32_t i = 0; i < triangles.size(); ++i)
+    {
+        uint32_t x0, z0, x1, z1;
+        cellRange(triangles[i], x0, z0, x1, z1);
+
+        for (uint32_t z = z0; z <= z1; ++z)
+        {
+            for (uint32_t x = x0; x <= x1; ++x)
+            {
+                cellTriangles[cursor[static_cast<size_t>(z) * m_CellCountX + x]++] = i;
+            }
+        }
+    }
+
+    m_Normals.resize(triangles.size());
+    m_Corners.resize(triangles.size());
+
+    for (size_t i = 0; i < triangles.size(); ++i)
+    {
+        const Triangle& t = triangles[i];
+        const glm::vec3& p0 = vertices[t.i0].position;
+        const glm::vec3& p1 = vertices[t.i1].position;
+        const glm::vec3& p2 = vertices[t.i2].position;
+
+        glm::vec3 faceNormal = glm::normalize(glm::cross(p1 - p0, p2 - p0));
+        if (faceNormal.y < 0.f)
+        {
+            faceNormal = -faceNormal;
+        }
+
+        auto vertexNormal = [&faceNormal](const glm::vec3& n)
+        {
+            return glm::dot(n, n) > 0.f ? glm::normalize(n) : faceNormal;
+        };
+
+        m_Normals[i] = { vertexNormal(vertices[t.i0].normal), vertexNormal(vertices[t.i1].normal), vertexNormal(vertices[t.i2].normal) };
+        m_Corners[i] = { p0, p1, p2 };
+    }
+
+    m_CellPackStart.resize(cellCount + 1);
+    m_CellPackStart[0] = 0;
+
+    for (size_t c = 0; c < cellCount; ++c)
+    {
+        const uint32_t count = cellStart[c + 1] - cellStart[c];
+        m_CellPackStart[c + 1] = m_CellPackStart[c] + (count + s_PackWidth - 1) / s_PackWidth;
+    }
+
+    m_Packs.resize(m_CellPackStart.back());
+
+    for (size_t c = 0; c < cellCount; ++c)
+    {
+        for (uint32_t slot = 0; slot < (m_CellPackStart[c + 1] - m_CellPackStart[c]) * s_PackWidth; ++slot)
+        {
+            TrianglePack& pack = m_Packs[m_CellPackStart[c] + slot / s_PackWidth];
+            const uint32_t lane = slot % s_PackWidth;
+            const uint32_t entry = cellStart[c] + slot;
+
+            if (entry >= cellStart[c + 1])
+            {
+                // NaN origin makes every comparison of the padding lanes fail
+                pack.x0[lane] = std::numeric_limits<float>::quiet_NaN();
+                pack.z0[lane] = std::numeric_limits<float>::quiet_NaN();
+                pack.m00[lane] = pack.m01[lane] = pack.m10[lane] = pack.m11[lane] = 0.f;
+                pack.y0[lane] = pack.dy1[lane] = pack.dy2[lane] = 0.f;
+                pack.triangle[lane] = s_InvalidTriangle;
+                continue;
+            }
+
+            const uint32_t index = cellTriangles[entry];
+            const Triangle& t = triangles[index];
+            const glm::vec3& p0 = vertices[t.i0].position;
+            const glm::vec3& p1 = vertices[t.i1].position;
+            const glm::vec3& p2 = vertices[t.i2].position;
+            const float invDet = 1.f / t.det;
+
+            pack.x0[lane] = p0.x;
+            pack.z0[lane] = p0.z;
+            pack.m00[lane] = (p2.z - p0.z) * invDet;
+            pack.m01[lane] = -(p2.x - p0.x) * invDet;
+            pack.m10[lane] = -(p1.z - p0.z) * invDet;
+            pack.m11[lane] = (p1.x - p0.x) * invDet;
+            pack.y0[lane] = p0.y;
+            pack.dy1[lane] = p1.y - p0.y;
+            pack.dy2[lane] = p2.y - p0.y;
+            pack.triangle[lane] = index;
+        }
+    }
+}
+
+bool Terrain::Locate(float x, float z, Hit& hit) const
+{
+    if (m_TriangleCount == 0)
+    {
+        return false;
+    }
+
+    const float fx = std::floor((x - m_Min.x) * m_InvCellSize);
+    const float fz = std::floor((z - m_Min.z) * m_InvCellSize);
+
+    // Points exactly on the max border belong to the last cell
+    const float maxX = static_cast<float>(m_CellCountX);
+    const float maxZ = static_cast<float>(m_CellCountZ);
+
+    if (!(fx >= 0.f && fz >= 0.f && fx <= maxX && fz <= maxZ))
+    {
+        return false;
+    }
+
+    const size_t cell = static_cast<size_t>(std::min(fz, maxZ - 1.f)) * m_CellCountX + static_cast<size_t>(std::min(fx, maxX - 1.f));
+    const uint32_t first = m_CellPackStart[cell];
+    const uint32_t last = m_CellPackStart[cell + 1];
+
+#if VISUALIZER_SSE2
+    const __m128 px = _mm_set1_ps(x);
+    const __m128 pz = _mm_set1_ps(z);
+    const __m128 lower = _mm_set1_ps(-s_BarycentricEpsilon);
+    const __m128 upper = _mm_set1_ps(1.f + s_BarycentricEpsilon);
+
+    __m128 bestHeight = _mm_set1_ps(-std::numeric_limits<float>::infinity());
+    __m128 bestU = _mm_setzero_ps();
+    __m128 bestV = _mm_setzero_ps();
+    __m128i bestSlot = _mm_set1_epi32(-1);
+    __m128i slot = _mm_setr_epi32(0, 1, 2, 3);
+    __m128i found = _mm_setzero_si128();
+
+    slot = _mm_add_epi32(slot, _mm_set1_epi32(static_cast<int>(first * s_PackWidth)));
+
+    for (uint32_t p = first; p < last; ++p)
+    {
+        const TrianglePack& pack = m_Packs[p];
+
+        const __m128 dx = _mm_sub_ps(px, _mm_load_ps(pack.x0));
+        const __m128 dz = _mm_sub_ps(pz, _mm_load_ps(pack.z0));
+        const __m128 u = _mm_add_ps(_mm_mul_ps(_mm_load_ps(pack.m00), dx), _mm_mul_ps(_mm_load_ps(pack.m01), dz));
+        const __m128 v = _mm_add_ps(_mm_mul_ps(_mm_load_ps(pack.m10), dx), _mm_mul_ps(_mm_load_ps(pack.m11), dz));
+        const __m128 h = _mm_add_ps(_mm_load_ps(pack.y0), _mm_add_ps(_mm_mul_ps(u, _mm_load_ps(pack.dy1)), _mm_mul_ps(v, _mm_load_ps(pack.dy2))));
+
+        __m128 mask = _mm_and_ps(_mm_cmpge_ps(u, lower), _mm_cmpge_ps(v, lower));
+        mask = _mm_and_ps(mask, _mm_cmple_ps(_mm_add_ps(u, v), upper));
+        mask = _mm_and_ps(mask, _mm_cmpgt_ps(h, bestHeight));
+
+        bestHeight = _mm_or_ps(_mm_and_ps(mask, h), _mm_andnot_ps(mask, bestHeight));
+        bestU = _mm_or_ps(_mm_and_ps(mask, u), _mm_andnot_ps(mask, bestU));
+        bestV = _mm_or_ps(_mm_and_ps(mask, v), _mm_andnot_ps(mask, bestV));
+
+        const __m128i imask = _mm_castps_si128(mask);
+        bestSlot = _mm_or_si128(_mm_and_si128(imask, slot), _mm_andnot_si128(imask, bestSlot));
+        found = _mm_or_si128(found, imask);
+
+        slot = _mm_add_epi32(slot, _mm_set1_epi32(s_PackWidth));
+    }
+
+    if (_mm_movemask_ps(_mm_castsi128_ps(found)) == 0)
+    {
+        return false;
+    }
+
+    alignas(16) float heights[s_PackWidth];
+    alignas(16) float us[s_PackWidth];
+    alignas(16) float vs[s_PackWidth];
+    alignas(16) int32_t slots[s_PackWidth];
+
+    _mm_store_ps(heights, bestHeight);
+    _mm_store_ps(us, bestU);
+    _mm_store_ps(vs, bestV);
+    _mm_store_si128(reinterpret_cast<__m128i*>(slots), bestSlot);
+
+    uint32_t bestLane = 0;
+    for (uint32_t lane = 1; lane < s_PackWidth; ++lane)
+    {
+        if (heights[lane] > heights[bestLane])
+        {
+            bestLane = lane;
+        }
+    }
+
+    const uint32_t bestPack = static_cast<uint32_t>(slots[bestLane]) / s_PackWidth;
+
+    hit.triangle = m_Packs[bestPack].triangle[slots[bestLane] % s_PackWidth];
+    hit.u = us[bestLane];
+    hit.v = vs[bestLane];
+    hit.height = heights[bestLane];
+#else
+    hit.triangle = s_InvalidTriangle;
+    hit.height = -std::numeric_limits<float>::infinity();
+
+    for (uint32_t p = first; p < last; ++p)
+    {
+        const TrianglePack& pack = m_Packs[p];
+
+        for (uint32_t lane = 0; lane < s_PackWidth; ++lane)
+        {
+            const float dx = x - pack.x0[lane];
+            const float dz = z - pack.z0[lane];
+            const float u = pack.m00[lane] * dx + pack.m01[lane] * dz;
+            const float v = pack.m10[lane] * dx + pack.m11[lane] * dz;
+            const float h = pack.y0[lane] + u * pack.dy1[lane] + v * pack.dy2[lane];
+
+            if (u >= -s_BarycentricEpsilon && v >= -s_BarycentricEpsilon && u + v <= 1.f + s_BarycentricEpsilon && h > hit.height)
+            {
+                hit.triangle = pack.triangle[lane];
+                hit.u = u;
+                hit.v = v;
+                hit.height = h;
+            }
+        }
+    }
+
+    if (hit.triangle == s_InvalidTriangle)
+    {
+        return false;
+    }
+#endif
+
+    return true;
+}
+
+glm::vec3 Terrain::InterpolateNormal(const Hit& hit) const
+{
+    const TriangleNormals& n = m_Normals[hit.triangle];
+    const glm::vec3 normal = (1.f - hit.u - hit.v) * n.n0 + hit.u * n.n1 + hit.v * n.n2;
+    const float length = glm::length(normal);
+
+    return length > 0.f ? normal / length : glm::vec3(0.f, 1.f, 0.f);
+}
+
+bool Terrain::HeightAt(float x, float z, float& height) const
+{
+    Hit hit;
+    if (!Locate(x, z, hit))
+    {
+        return false;
+    }
+
+    height = hit.height;
+    return true;
+}
+
+bool Terrain::NormalAt(float x, float z, glm::vec3& normal) const
+{
+    Hit hit;
+    if (!Locate(x, z, hit))
+    {
+        return false;
+    }
+
+    normal = InterpolateNormal(hit);
+    return true;
+}
+
+size_t Terrain::HeightAt(std::span<const glm::vec2> xz, std::span<float> heights) const
+{
+    const size_t count = std::min(xz.size(), heights.size());
+    size_t hits = 0;
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        Hit hit;
+        if (Locate(xz[i].x, xz[i].y, hit))
+        {
+            heights[i] = hit.height;
+            ++hits;
+        }
+        else
+        {
+            heights[i] = std::numeric_limits<float>::quiet_NaN();
+        }
+    }
+
+    return hits;
+}
+
+size_t Terrain::NormalAt(std::span<const glm::vec2> xz, std::span<glm::vec3> normals) const
+{
+    const size_t count = std::min(xz.size(), normals.size());
+    size_t hits = 0;
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        Hit hit;
+        if (Locate(xz[i].x, xz[i].y, hit))
+        {
+            normals[i] = InterpolateNormal(hit);
+            ++hits;
+        }
+        else
+        {
+            normals[i] = glm::vec3(0.f);
+        }
+    }
+
+    return hits;
+}
+
+size_t Terrain::SampleAt(std::span<const glm::vec2> xz, std::span<float> heights, std::span<glm::vec3> normals) const
+{
+    const size_t count = std::min(xz.size(), std::min(heights.size(), normals.size()));
+    size_t hits = 0;
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        Hit hit;
+        if (Locate(xz[i].x, xz[i].y, hit))
+        {
+            heights[i] = hit.height;
+            normals[i] = InterpolateNormal(hit);
+            ++hits;
+        }
+        else
+        {
+            heights[i] = std::numeric_limits<float>::quiet_NaN();
+            normals[i] = glm::vec3(0.f);
+        }
+    }
+
+    return hits;
+}
+
+bool Terrain::LowestIn(const glm::vec2& min, const glm::vec2& max, float& height) const
+{
+    if (m_TriangleCount == 0 || max.x < m_Min.x || max.y < m_Min.z || min.x > m_Max.x || min.y > m_Max.z)
+    {
+        return false;
+    }
+
+    const uint32_t x0 = ToCell(min.x, m_Min.x, m_InvCellSize, m_CellCountX);
+    const uint32_t x1 = ToCell(max.x, m_Min.x, m_InvCellSize, m_CellCountX);
+    const uint32_t z0 = ToCell(min.y, m_Min.z, m_InvCellSize, m_CellCountZ);
+    const uint32_t z1 = ToCell(max.y, m_Min.z, m_InvCellSize, m_CellCountZ);
+
+    float lowest = std::numeric_limits<float>::infinity();
+
+    for (uint32_t z = z0; z <= z1; ++z)
+    {
+        for (uint32_t x = x0; x <= x1; ++x)
+        {
+            const size_t cell = static_cast<size_t>(z) * m_CellCountX + x;
+
+            for (uint32_t p = m_CellPackStart[cell]; p < m_CellPackStart[cell + 1]; ++p)
+            {
+                for (uint32_t triangle : m_Packs[p].triangle)
+                {
+                    if (triangle == s_InvalidTriangle)
+                    {
+                        continue;
+                    }
+
+                    // A plane is lowest at a corner of the clipped polygon;
+                    // four cuts leave at most seven corners
+                    const TriangleCorners& t = m_Corners[triangle];
+                    glm::vec3 polygon[8] = { t.p0, t.p1, t.p2 };
+                    glm::vec3 clipped[8];
+                    uint32_t count = 3;
+
+                    count = ClipPolygon(polygon, count, clipped, 0, min.x, 1.f);
+                    count = ClipPolygon(clipped, count, polygon, 0, max.x, -1.f);
+                    count = ClipPolygon(polygon, count, clipped, 2, min.y, 1.f);
+                    count = ClipPolygon(clipped, count, polygon, 2, max.y, -1.f);
+
+                    for (uint32_t i = 0; i < count; ++i)
+                    {
+                        lowest = std::min(lowest, polygon[i].y);
+                    }
+                }
+            }
+        }
+    }
+
+    if (lowest == std::numeric_limits<float>::infinity())
+    {
+        return false;
+    }
+
+    height = lowest;
+    return true;
+}
+
+END_VISUALIZER_NAMESPACE
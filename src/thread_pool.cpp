@@ -0,0 +1,137 @@
+#include <algorithm>
+#include <atomic>
+#include <memory>
+
+#include "thread_pool.hpp"
+
+BEGIN_VISUALIZER_NAMESPACE
+
+namespace
+{
+    thread_local const ThreadPool* t_CurrentPool = nullptr;
+}
+
+ThreadPool::ThreadPool(uint32_t workerCount)
+{
+    if (workerCount == s_HardwareWorkers)
+    {
+        workerCount = std::max(1u, std::thread::hardware_concurrency()) - 1;
+    }
+
+    m_Workers.reserve(workerCount);
+    for (uint32_t i = 0; i < workerCount; ++i)
+    {
+        m_Workers.emplace_back(&ThreadPool::WorkerLoop, this);
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        m_Stop = true;
+    }
+    m_Condition.notify_all();
+
+    for (std::thread& worker : m_Workers)
+    {
+        worker.join();
+    }
+}
+
+ThreadPool& ThreadPool::GetGlobal()
+{
+    static ThreadPool pool;
+    return pool;
+}
+
+void ThreadPool::Submit(std::function<void()> task)
+{
+    if (m_Workers.empty())
+    {
+        task();
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        m_Tasks.push_back(std::move(task));
+    }
+    m_Condition.notify_one();
+}
+
+void ThreadPool::ParallelFor(size_t count, const std::function<void(size_t)>& fn)
+{
+    if (count == 0)
+    {
+        return;
+    }
+
+    struct Batch
+    {
+        std::atomic<size_t> next{ 0 };
+        size_t pendingHelpers = 0;
+        std::mutex mutex;
+        std::condition_variable done;
+    };
+
+    // Shared so that helpers which only start after the work ran out can
+    // still touch it safely
+    auto batch = std::make_shared<Batch>();
+
+    auto drain = [batch, count, &fn]()
+    {
+        for (size_t i = batch->next.fetch_add(1, std::memory_order_relaxed); i < count; i = batch->next.fetch_add(1, std::memory_order_relaxed))
+        {
+            fn(i);
+        }
+    };
+
+    const size_t helperCount = t_CurrentPool == this ? 0 : std::min(count - 1, m_Workers.size());
+    batch->pendingHelpers = helperCount;
+
+    for (size_t h = 0; h < helperCount; ++h)
+    {
+        Submit([batch, drain]()
+        {
+            drain();
+
+            std::lock_guard<std::mutex> lock(batch->mutex);
+            if (--batch->pendingHelpers == 0)
+            {
+                batch->done.notify_one();
+            }
+        });
+    }
+
+    drain();
+
+    // fn lives on our stack, so wait for every helper to let go of it
+    std::unique_lock<std::mutex> lock(batch->mutex);
+    batch->done.wait(lock, [&batch]() { return batch->pendingHelpers == 0; });
+}
+
+void ThreadPool::WorkerLoop()
+{
+    t_CurrentPool = this;
+
+    for (;;)
+    {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(m_Mutex);
+            m_Condition.wait(lock, [this]() { return m_Stop || !m_Tasks.empty(); });
+
+            if (m_Stop && m_Tasks.empty())
+            {
+                return;
+            }
+
+            task = std::move(m_Tasks.front());
+            m_Tasks.pop_front();
+        }
+        task();
+    }
+}
+
+END_VISUALIZER_NAMESPACE
@@ -0,0 +1,359 @@
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+
+#include "simd.hpp"
+#include "thread_pool.hpp"
+#include "transform_hierarchy.hpp"
+
+BEGIN_VISUALIZER_NAMESPACE
+
+namespace
+{
+    constexpr uint32_t s_NoSlot = ~0u;
+    // Per task when a level is split over the pool
+    constexpr size_t s_NodesPerTask = 4096;
+
+    constexpr int32_t s_UnknownDepth = -2;
+    constexpr int32_t s_DeadDepth = -1;
+
+    // parent * [rotationScale | position], the local matrix's last row
+    // being (0, 0, 0, 1)
+    inline void Compose(const glm::mat4& parent, const glm::mat3& rotationScale, const glm::vec3& position, glm::mat4& out)
+    {
+#if VISUALIZER_SSE2
+        const __m128 p0 = _mm_loadu_ps(&parent[0][0]);
+        const __m128 p1 = _mm_loadu_ps(&parent[1][0]);
+        const __m128 p2 = _mm_loadu_ps(&parent[2][0]);
+        const __m128 p3 = _mm_loadu_ps(&parent[3][0]);
+
+        for (int32_t column = 0; column < 3; ++column)
+        {
+            const __m128 x = _mm_mul_ps(p0, _mm_set1_ps(rotationScale[column][0]));
+            const __m128 y = _mm_mul_ps(p1, _mm_set1_ps(rotationScale[column][1]));
+            const __m128 z = _mm_mul_ps(p2, _mm_set1_ps(rotationScale[column][2]));
+            _mm_storeu_ps(&out[column][0], _mm_add_ps(_mm_add_ps(x, y), z));
+        }
+
+        const __m128 x = _mm_mul_ps(p0, _mm_set1_ps(position.x));
+        const __m128 y = _mm_mul_ps(p1, _mm_set1_ps(position.y));
+        const __m128 z = _mm_mul_ps(p2, _mm_set1_ps(position.z));
+        _mm_storeu_ps(&out[3][0], _mm_add_ps(_mm_add_ps(x, y), _mm_add_ps(z, p3)));
+#else
+        out = parent * glm::mat4(glm::vec4(rotationScale[0], 0.f), glm::vec4(rotationScale[1], 0.f), glm::vec4(rotationScale[2], 0.f), glm::vec4(position, 1.f));
+#endif
+    }
+}
+
+LocalTransform ToLocalTransform(const InstanceTransform& instance)
+{
+    return { instance.position, glm::angleAxis(instance.yaw, glm::vec3(0.f, 1.f, 0.f)), instance.scale };
+}
+
+InstanceTransform ToInstanceTransform(const glm::mat4& world)
+{
+    // The yaw turns +X towards -Z, as in the vertex shaders
+    InstanceTransform instance;
+    instance.position = glm::vec3(world[3]);
+    instance.scale = glm::length(glm::vec3(world[0]));
+    instance.yaw = std::atan2(-world[0].z, world[0].x);
+    return instance;
+}
+
+NodeId TransformHierarchy::Create(const LocalTransform& local, NodeId parent)
+{
+    NodeId node;
+    if (!m_FreeNodes.empty())
+    {
+        node = m_FreeNodes.back();
+        m_FreeNodes.pop_back();
+    }
+    else
+    {
+        node = static_cast<NodeId>(m_Parents.size());
+        m_Parents.push_back(s_NoNode);
+        m_Slots.push_back(s_NoSlot);
+        m_Alive.push_back(0);
+    }
+
+    m_Parents[node] = parent;
+    m_Alive[node] = 1;
+
+    // Appended out of order until the next Sort()
+    m_Slots[node] = static_cast<uint32_t>(m_SlotNodes.size());
+    m_SlotNodes.push_back(node);
+    m_ParentSlots.push_back(s_NoSlot);
+    m_Positions.push_back(local.position);
+    m_Rotations.push_back(local.rotation);
+    m_Scales.push_back(local.scale);
+    m_World.emplace_back(1.f);
+    m_Dirty.push_back(1);
+    m_Updated.push_back(0);
+
+    m_NeedsSort = true;
+    m_HasChanges = true;
+    return node;
+}
+
+void TransformHierarchy::Destroy(NodeId node)
+{
+    if (!IsAlive(node))
+    {
+        return;
+    }
+
+    // The subtree goes at the next Sort()
+    m_Alive[node] = 0;
+    m_NeedsSort = true;
+    m_HasChanges = true;
+}
+
+void TransformHierarchy::SetParent(NodeId node, NodeId parent)
+{
+    if (!IsAlive(node) || m_Parents[node] == parent)
+    {
+        return;
+    }
+
+    m_Parents[node] = parent;
+    m_Dirty[m_Slots[node]] = 1;
+    m_NeedsSort = true;
+    m_HasChanges = true;
+}
+
+void TransformHierarchy::Clear()
+{
+    *this = TransformHierarchy();
+}
+
+void TransformHierarchy::SetLocal(NodeId node, const LocalTransform& local)
+{
+    const uint32_t slot = m_Slots[node];
+
+    m_Positions[slot] = local.position;
+    m_Rotations[slot] = local.rotation;
+    m_Scales[slot] = local.scale;
+    m_Dirty[slot] = 1;
+    m_HasChanges = true;
+}
+
+LocalTransform TransformHierarchy::GetLocal(NodeId node) const
+{
+    const uint32_t slot = m_Slots[node];
+    return { m_Positions[slot], m_Rotations[slot], m_Scales[slot] };
+}
+
+void TransformHierarchy::Sort()
+{
+    const size_t nodeCount = m_Parents.size();
+
+    // Depth of every node, or dead when it or a node above it was destroyed
+    std::vector<int32_t> depths(nodeCount, s_UnknownDepth);
+    std::vector<NodeId> chain;
+    int32_t maxDepth = -1;
+
+    for (NodeId node = 0; node < nodeCount; ++node)
+    {
+        for (NodeId up = node; depths[up] == s_UnknownDepth; up = m_Parents[up])
+        {
+            chain.push_back(up);
+            if (!m_Alive[up] || m_Parents[up] == s_NoNode)
+            {
+                break;
+            }
+        }
+
+        // Resolved from the top, whose parent is known or absent
+        while (!chain.empty())
+        {
+            const NodeId top = chain.back();
+            const NodeId parent = m_Parents[top];
+            chain.pop_back();
+
+            if (!m_Alive[top])
+            {
+                depths[top] = s_DeadDepth;
+            }
+            else if (parent == s_NoNode)
+            {
+                depths[top] = 0;
+            }
+            else
+            {
+                depths[top] = depths[parent] == s_DeadDepth ? s_DeadDepth : depths[parent] + 1;
+            }
+            maxDepth = std::max(maxDepth, depths[top]);
+        }
+    }
+
+    // Counting sort of the live nodes by depth
+    m_LevelStarts.assign(static_cast<size_t>(maxDepth) + 2, 0);
+    for (NodeId node = 0; node < nodeCount; ++node)
+    {
+        if (depths[node] >= 0)
+        {
+            ++m_LevelStarts[depths[node] + 1];
+        }
+        else if (m_Slots[node] != s_NoSlot)
+        {
+            m_Alive[node] = 0;
+            m_Slots[node] = s_NoSlot;
+            m_FreeNodes.push_back(node);
+        }
+    }
+    for (size_t level = 1; level < m_LevelStarts.size(); ++level)
+    {
+        m_LevelStarts[level] += m_LevelStarts[level - 1];
+    }
+
+    const size_t count = m_LevelStarts.back();
+    std::vector<uint32_t> next(m_LevelStarts.begin(), m_LevelStarts.end() - 1);
+    std::vector<NodeId> slotNodes(count);
+    std::vector<glm::vec3> positions(count);
+    std::vector<glm::quat> rotations(count);
+    std::vector<float> scales(count);
+    std::vector<glm::mat4> world(count);
+    std::vector<uint8_t> dirty(count);
+
+    // Walking the old slots keeps siblings in the order they were created
+    for (uint32_t oldSlot = 0; oldSlot < m_SlotNodes.size(); ++oldSlot)
+    {
+        const NodeId node = m_SlotNodes[oldSlot];
+        if (m_Slots[node] != oldSlot || depths[node] < 0)
+        {
+            continue;
+        }
+
+        const uint32_t slot = next[depths[node]]++;
+        slotNodes[slot] = node;
+        positions[slot] = m_Positions[oldSlot];
+        rotations[slot] = m_Rotations[oldSlot];
+        scales[slot] = m_Scales[oldSlot];
+        world[slot] = m_World[oldSlot];
+        dirty[slot] = m_Dirty[oldSlot];
+    }
+
+    m_SlotNodes = std::move(slotNodes);
+    m_Positions = std::move(positions);
+    m_Rotations = std::move(rotations);
+    m_Scales = std::move(scales);
+    m_World = std::move(world);
+    m_Dirty = std::move(dirty);
+
+    m_ParentSlots.resize(count);
+    for (uint32_t slot = 0; slot < count; ++slot)
+    {
+        m_Slots[m_SlotNodes[slot]] = slot;
+    }
+    for (uint32_t slot = 0; slot < count; ++slot)
+    {
+        const NodeId parent = m_Parents[m_SlotNodes[slot]];
+        m_ParentSlots[slot] = parent == s_NoNode ? s_NoSlot : m_Slots[parent];
+    }
+
+    // World matrices moved along, only new and reparented nodes are dirty
+    m_Updated.assign(count, 0);
+    m_NeedsSort = false;
+}
+
+size_t TransformHierarchy::UpdateRange(size_t first, size_t last)
+{
+    size_t updated = 0;
+
+    for (size_t slot = first; slot < last; ++slot)
+    {
+        const uint32_t parent = m_ParentSlots[slot];
+        const bool changed = m_Dirty[slot] != 0 || (parent != s_NoSlot && m_Updated[parent] != 0);
+
+        m_Dirty[slot] = 0;
+        m_Updated[slot] = changed;
+
+        if (!changed)
+        {
+            continue;
+        }
+
+        const glm::mat3 rotationScale = glm::mat3_cast(m_Rotations[slot]) * m_Scales[slot];
+        if (parent == s_NoSlot)
+        {
+            m_World[slot] = glm::mat4(glm::vec4(rotationScale[0], 0.f), glm::vec4(rotationScale[1], 0.f), glm::vec4(rotationScale[2], 0.f), glm::vec4(m_Positions[slot], 1.f));
+        }
+        else
+        {
+            Compose(m_World[parent], rotationScale, m_Positions[slot], m_World[slot]);
+        }
+        ++updated;
+    }
+    return updated;
+}
+
+size_t TransformHierarchy::Update(ThreadPool& pool)
+{
+    if (m_NeedsSort)
+    {
+        Sort();
+    }
+
+    if (!m_HasChanges)
+    {
+        // Clear what the last update reported, once
+        if (m_HasUpdated)
+        {
+            std::fill(m_Updated.begin(), m_Updated.end(), uint8_t(0));
+            m_HasUpdated = false;
+        }
+        return 0;
+    }
+
+    size_t updated = 0;
+
+    for (size_t level = 0; level + 1 < m_LevelStarts.size(); ++level)
+    {
+        const size_t first = m_LevelStarts[level];
+        const size_t last = m_LevelStarts[level + 1];
+        const size_t tasks = (last - first + s_NodesPerTask - 1) / s_NodesPerTask;
+
+        if (tasks < 2 || pool.GetWorkerCount() == 0)
+        {
+            updated += UpdateRange(first, last);
+            continue;
+        }
+
+        std::atomic<size_t> levelUpdated{ 0 };
+        pool.ParallelFor(tasks, [this, first, last, &levelUpdated](size_t task)
+        {
+            const size_t begin = first + task * s_NodesPerTask;
+            levelUpdated.fetch_add(UpdateRange(begin, std::min(begin + s_NodesPerTask, last)), std::memory_order_relaxed);
+        });
+        updated += levelUpdated.load(std::memory_order_relaxed);
+    }
+
+    m_HasChanges = false;
+    m_HasUpdated = updated > 0;
+    return updated;
+}
+
+void TransformHierarchy::WriteInstances(std::span<const NodeId> nodes, InstanceTransform* out, ThreadPool& pool) const
+{
+    const size_t tasks = (nodes.size() + s_NodesPerTask - 1) / s_NodesPerTask;
+
+    if (tasks < 2 || pool.GetWorkerCount() == 0)
+    {
+        for (size_t i = 0; i < nodes.size(); ++i)
+        {
+            out[i] = ToInstanceTransform(GetWorld(nodes[i]));
+        }
+        return;
+    }
+
+    pool.ParallelFor(tasks, [this, nodes, out](size_t task)
+    {
+        const size_t end = std::min((task + 1) * s_NodesPerTask, nodes.size());
+        for (size_t i = task * s_NodesPerTask; i < end; ++i)
+        {
+            out[i] = ToInstanceTransform(GetWorld(nodes[i]));
+        }
+    });
+}
+
+END_VISUALIZER_NAMESPACE
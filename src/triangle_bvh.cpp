@@ -0,0 +1,690 @@
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <numeric>
+
+#include "mapped_file.hpp"
+#include "mesh.hpp"
+#include "simd.hpp"
+#include "thread_pool.hpp"
+#include "triangle_bvh.hpp"
+
+BEGIN_VISUALIZER_NAMESPACE
+
+namespace
+{
+    // Per task when the triangle bounds are split over the pool
+    constexpr size_t s_TrianglesPerTask = 16384;
+    // Leaves of the wide tree address their first triangle with the bits
+    // left above the count
+    constexpr size_t s_MaxWideTriangles = size_t(1) << 27;
+
+    uint64_t HashMesh(std::span<const VertexDataPosition3fColor3f> vertices, std::span<const uint32_t> indices)
+    {
+        // FNV-1a over what the tree depends on
+        uint64_t hash = 1469598103934665603ull;
+        auto add = [&hash](const void* data, size_t size)
+        {
+            const unsigned char* bytes = static_cast<const unsigned char*>(data);
+            for (size_t i = 0; i < size; ++i)
+            {
+                hash = (hash ^ bytes[i]) * 1099511628211ull;
+            }
+        };
+
+        for (const VertexDataPosition3fColor3f& vertex : vertices)
+        {
+            add(&vertex.position, sizeof(vertex.position));
+        }
+        add(indices.data(), indices.size_bytes());
+        return hash;
+    }
+
+    // Moller-Trumbore, both faces
+    inline bool IntersectTriangle(const Ray& ray, const glm::vec3& v0, const glm::vec3& edge1, const glm::vec3& edge2, float maxDistance, float& distance)
+    {
+        const glm::vec3 p = glm::cross(ray.direction, edge2);
+        const float determinant = glm::dot(edge1, p);
+
+        if (determinant == 0.f)
+        {
+            return false;
+        }
+
+        const float inverse = 1.f / determinant;
+        const glm::vec3 s = ray.origin - v0;
+        const float u = glm::dot(s, p) * inverse;
+        if (u < 0.f || u > 1.f)
+        {
+            return false;
+        }
+
+        const glm::vec3 q = glm::cross(s, edge1);
+        const float v = glm::dot(ray.direction, q) * inverse;
+        if (v < 0.f || u + v > 1.f)
+        {
+            return false;
+        }
+
+        const float t = glm::dot(edge2, q) * inverse;
+        if (t < 0.f || t > maxDistance)
+        {
+            return false;
+        }
+
+        distance = t;
+        return true;
+    }
+
+    inline bool IsInsideTriangle(const glm::vec3& point, const glm::vec3& v0, const glm::vec3& edge1, const glm::vec3& edge2)
+    {
+        const glm::vec3 w = point - v0;
+        const float d00 = glm::dot(edge1, edge1);
+        const float d01 = glm::dot(edge1, edge2);
+        const float d11 = glm::dot(edge2, edge2);
+        const float d20 = glm::dot(w, edge1);
+        const float d21 = glm::dot(w, edge2);
+        const float denominator = d00 * d11 - d01 * d01;
+
+        if (denominator <= 0.f)
+        {
+            return false;
+        }
+
+        const float v = (d11 * d20 - d01 * d21) / denominator;
+        const float u = (d00 * d21 - d01 * d20) / denominator;
+        return v >= 0.f && u >= 0.f && v + u <= 1.f;
+    }
+
+    // The sphere's center reaching radius from the point. A sphere already
+    // touching it only counts when moving closer.
+    inline bool SweepSpherePoint(const Ray& ray, float radius, const glm::vec3& point, float maxDistance, float& distance)
+    {
+        const glm::vec3 m = ray.origin - point;
+        const float a = glm::dot(ray.direction, ray.direction);
+        const float b = glm::dot(m, ray.direction);
+        const float c = glm::dot(m, m) - radius * radius;
+
+        if (b >= 0.f)
+        {
+            return false;
+        }
+        if (c <= 0.f)
+        {
+            distance = 0.f;
+            return true;
+        }
+
+        const float discriminant = b * b - a * c;
+        if (discriminant < 0.f)
+        {
+            return false;
+        }
+
+        const float t = (-b - std::sqrt(discriminant)) / a;
+        if (t > maxDistance)
+        {
+            return false;
+        }
+
+        distance = t;
+        return true;
+    }
+
+    // Same against the cylinder around the segment, without its caps
+    inline bool SweepSphereEdge(const Ray& ray, float radius, const glm::vec3& a, const glm::vec3& b, float maxDistance, float& distance)
+    {
+        const glm::vec3 edge = b - a;
+        const glm::vec3 m = ray.origin - a;
+        const float ee = glm::dot(edge, edge);
+        const float em = glm::dot(edge, m);
+        const float ed = glm::dot(edge, ray.direction);
+
+        const float qa = ee * glm::dot(ray.direction, ray.direction) - ed * ed;
+        const float qb = ee * glm::dot(m, ray.direction) - em * ed;
+        const float qc = ee * (glm::dot(m, m) - radius * radius) - em * em;
+
+        // Moving along the edge, or away from it: the ends catch the rest
+        if (qa <= 0.f || qb >= 0.f)
+        {
+            return false;
+        }
+
+        float t = 0.f;
+        if (qc > 0.f)
+        {
+            const float discriminant = qb * qb - qa * qc;
+            if (discriminant < 0.f)
+            {
+                return false;
+            }
+            t = (-qb - std::sqrt(discriminant)) / qa;
+        }
+
+        const float along = em + t * ed;
+        if (t > maxDistance || along < 0.f || along > ee)
+        {
+            return false;
+        }
+
+        distance = t;
+        return true;
+    }
+
+    // Face first, which when touched is always the first contact, then the
+    // edges and vertices
+    bool SweepSphereTriangle(const Ray& ray, float radius, const glm::vec3& v0, const glm::vec3& edge1, const glm::vec3& edge2, float maxDistance, float& distance, glm::vec3& normal)
+    {
+        glm::vec3 faceNormal = glm::cross(edge1, edge2);
+        const float length = glm::length(faceNormal);
+        if (length == 0.f)
+        {
+            return false;
+        }
+        faceNormal /= length;
+
+        float offset = glm::dot(ray.origin - v0, faceNormal);
+        float speed = glm::dot(ray.direction, faceNormal);
+        if (offset < 0.f)
+        {
+            faceNormal = -faceNormal;
+            offset = -offset;
+            speed = -speed;
+        }
+
+        if (speed >= 0.f)
+        {
+            return false;
+        }
+
+        const float planeDistance = offset > radius ? (offset - radius) / -speed : 0.f;
+        if (planeDistance > maxDistance)
+        {
+            return false;
+        }
+
+        const glm::vec3 center = ray.origin + planeDistance * ray.direction;
+        if (IsInsideTriangle(center - (offset + planeDistance * speed) * faceNormal, v0, edge1, edge2))
+        {
+            distance = planeDistance;
+            normal = faceNormal;
+            return true;
+        }
+
+        const glm::vec3 vertices[3] = { v0, v0 + edge1, v0 + edge2 };
+        bool found = false;
+        glm::vec3 contact;
+
+        for (uint32_t i = 0; i < 3; ++i)
+        {
+            const glm::vec3& a = vertices[i];
+            const glm::vec3& b = vertices[(i + 1) % 3];
+            float t;
+
+            if (SweepSphereEdge(ray, radius, a, b, maxDistance, t))
+            {
+                const glm::vec3 edge = b - a;
+                maxDistance = distance = t;
+                contact = a + edge * (glm::dot(ray.origin + t * ray.direction - a, edge) / glm::dot(edge, edge));
+                found = true;
+            }
+            if (SweepSpherePoint(ray, radius, a, maxDistance, t))
+            {
+                maxDistance = distance = t;
+                contact = a;
+                found = true;
+            }
+        }
+
+        if (found)
+        {
+            const glm::vec3 away = ray.origin + distance * ray.direction - contact;
+            const float awayLength = glm::length(away);
+            normal = awayLength > 0.f ? away / awayLength : faceNormal;
+        }
+        return found;
+    }
+}
+
+void TriangleBvh::Build(std::span<const VertexDataPosition3fColor3f> vertices, std::span<const uint32_t> indices, ThreadPool& pool, const TriangleBvhSettings& settings)
+{
+    Clear();
+
+    const size_t triangleCount = indices.size() / 3;
+    if (triangleCount == 0)
+    {
+        return;
+    }
+
+    std::vector<glm::vec3> mins(triangleCount);
+    std::vector<glm::vec3> maxs(triangleCount);
+
+    pool.ParallelFor((triangleCount + s_TrianglesPerTask - 1) / s_TrianglesPerTask, [&](size_t task)
+    {
+        const size_t last = std::min(triangleCount, (task + 1) * s_TrianglesPerTask);
+        for (size_t triangle = task * s_TrianglesPerTask; triangle < last; ++triangle)
+        {
+            const glm::vec3& a = vertices[indices[3 * triangle]].position;
+            const glm::vec3& b = vertices[indices[3 * triangle + 1]].position;
+            const glm::vec3& c = vertices[indices[3 * triangle + 2]].position;
+
+            mins[triangle] = glm::min(a, glm::min(b, c));
+            maxs[triangle] = glm::max(a, glm::max(b, c));
+        }
+    });
+
+    std::vector<uint32_t> triangles(triangleCount);
+    std::iota(triangles.begin(), triangles.end(), 0u);
+
+    m_Tree.Build(triangles, mins, maxs, settings.build, pool);
+    m_MeshHash = HashMesh(vertices, indices);
+    Finish(vertices, indices, settings.wide);
+}
+
+bool TriangleBvh::BuildCached(const std::string& path, std::span<const VertexDataPosition3fColor3f> vertices, std::span<const uint32_t> indices, ThreadPool& pool, const TriangleBvhSettings& settings)
+{
+    if (std::filesystem::exists(path) && Load(path, vertices, indices, settings))
+    {
+        return true;
+    }
+
+    Build(vertices, indices, pool, settings);
+    Save(path);
+    return false;
+}
+
+bool TriangleBvh::Save(const std::string& path) const
+{
+    std::ofstream ofs(path, std::ios::binary | std::ios::trunc);
+
+    if (!ofs)
+    {
+        std::cerr << "Cannot open file : " << path << '\n';
+        return false;
+    }
+
+    const std::span<const BvhNode> nodes = m_Tree.GetNodes();
+    const std::span<const uint32_t> triangles = m_Tree.GetItems();
+
+    TriangleBvhFileHeader header{};
+    std::memcpy(header.magic, TriangleBvhFileHeader::s_Magic, sizeof(header.magic));
+    header.version = TriangleBvhFileHeader::s_Version;
+    header.meshHash = m_MeshHash;
+    header.triangleCount = triangles.size();
+    header.nodeCount = nodes.size();
+
+    ofs.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    ofs.write(reinterpret_cast<const char*>(nodes.data()), static_cast<std::streamsize>(nodes.size_bytes()));
+    ofs.write(reinterpret_cast<const char*>(triangles.data()), static_cast<std::streamsize>(triangles.size_bytes()));
+
+    if (!ofs)
+    {
+        std::cerr << "Cannot write file : " << path << '\n';
+        return false;
+    }
+    return true;
+}
+
+bool TriangleBvh::Load(const std::string& path, std::span<const VertexDataPosition3fColor3f> vertices, std::span<const uint32_t> indices, const TriangleBvhSettings& settings)
+{
+    Clear();
+
+    MappedFile file;
+    if (!file.Open(path))
+    {
+        return false;
+    }
+
+    const std::span<const std::byte> bytes = file.GetBytes();
+    TriangleBvhFileHeader header;
+    if (bytes.size() < sizeof(header))
+    {
+        std::cerr << "Truncated BVH file : " << path << '\n';
+        return false;
+    }
+    std::memcpy(&header, bytes.data(), sizeof(header));
+
+    if (std::memcmp(header.magic, TriangleBvhFileHeader::s_Magic, sizeof(header.magic)) != 0 || header.version != TriangleBvhFileHeader::s_Version)
+    {
+        std::cerr << "Unsupported BVH file : " << path << '\n';
+        return false;
+    }
+
+    const size_t triangleCount = indices.size() / 3;
+    const uint64_t meshHash = HashMesh(vertices, indices);
+    if (header.triangleCount != triangleCount || header.meshHash != meshHash)
+    {
+        std::cerr << "BVH file of another mesh : " << path << '\n';
+        return false;
+    }
+
+    const uint64_t available = bytes.size() - sizeof(header);
+    if (header.nodeCount > available / sizeof(BvhNode) || header.triangleCount > (available - header.nodeCount * sizeof(BvhNode)) / sizeof(uint32_t))
+    {
+        std::cerr << "Truncated BVH file : " << path << '\n';
+        return false;
+    }
+
+    const std::byte* payload = bytes.data() + sizeof(header);
+    std::vector<BvhNode> nodes(static_cast<size_t>(header.nodeCount));
+    std::vector<uint32_t> triangles(triangleCount);
+    std::memcpy(nodes.data(), payload, nodes.size() * sizeof(BvhNode));
+    std::memcpy(triangles.data(), payload + nodes.size() * sizeof(BvhNode), triangles.size() * sizeof(uint32_t));
+
+    if (!m_Tree.Assign(std::move(nodes), std::move(triangles), triangleCount))
+    {
+        std::cerr << "Corrupt BVH file : " << path << '\n';
+        return false;
+    }
+
+    m_MeshHash = meshHash;
+    Finish(vertices, indices, settings.wide);
+    return true;
+}
+
+void TriangleBvh::Clear()
+{
+    m_Tree.Clear();
+    m_Triangles.clear();
+    m_WideNodes.clear();
+    m_MeshHash = 0;
+}
+
+void TriangleBvh::Finish(std::span<const VertexDataPosition3fColor3f> vertices, std::span<const uint32_t> indices, bool wide)
+{
+    const std::span<const uint32_t> triangles = m_Tree.GetItems();
+
+    m_Triangles.resize(triangles.size());
+    for (size_t i = 0; i < triangles.size(); ++i)
+    {
+        const glm::vec3& v0 = vertices[indices[3 * triangles[i]]].position;
+        m_Triangles[i] = { v0, vertices[indices[3 * triangles[i] + 1]].position - v0, vertices[indices[3 * triangles[i] + 2]].position - v0 };
+    }
+
+    if (wide && !m_Tree.IsEmpty() && triangles.size() < s_MaxWideTriangles)
+    {
+        m_WideNodes.reserve(m_Tree.GetNodes().size() / 2 + 1);
+        Collapse(0);
+    }
+}
+
+uint32_t TriangleBvh::Collapse(uint32_t node)
+{
+    const std::span<const BvhNode> nodes = m_Tree.GetNodes();
+
+    // The children, then the children of the widest inner one among them
+    // while there is room
+    std::array<uint32_t, s_WideWidth> candidates;
+    uint32_t count = 0;
+
+    if (nodes[node].IsLeaf())
+    {
+        candidates[count++] = node;
+    }
+    else
+    {
+        candidates[count++] = nodes[node].first;
+        candidates[count++] = nodes[node].first + 1;
+    }
+
+    while (count < s_WideWidth)
+    {
+        uint32_t widest = count;
+        float widestArea = -1.f;
+
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            const BvhNode& candidate = nodes[candidates[i]];
+            const glm::vec3 extent = candidate.max - candidate.min;
+            const float area = extent.x * extent.y + extent.y * extent.z + extent.z * extent.x;
+
+            if (!candidate.IsLeaf() && area > widestArea)
+            {
+                widest = i;
+                widestArea = area;
+            }
+        }
+
+        if (widest == count)
+        {
+            break;
+        }
+
+        const uint32_t first = nodes[candidates[widest]].first;
+        candidates[widest] = first;
+        candidates[count++] = first + 1;
+    }
+
+    // Children recurse below, which may move the array
+    const uint32_t index = static_cast<uint32_t>(m_WideNodes.size());
+    m_WideNodes.emplace_back();
+
+    for (uint32_t slot = 0; slot < s_WideWidth; ++slot)
+    {
+        WideNode& wide = m_WideNodes[index];
+        if (slot >= count)
+        {
+            wide.minX[slot] = wide.minY[slot] = wide.minZ[slot] = 0.f;
+            wide.maxX[slot] = wide.maxY[slot] = wide.maxZ[slot] = 0.f;
+            wide.children[slot] = s_EmptyChild;
+            continue;
+        }
+
+        const BvhNode& child = nodes[candidates[slot]];
+        wide.minX[slot] = child.min.x;
+        wide.minY[slot] = child.min.y;
+        wide.minZ[slot] = child.min.z;
+        wide.maxX[slot] = child.max.x;
+        wide.maxY[slot] = child.max.y;
+        wide.maxZ[slot] = child.max.z;
+
+        const uint32_t code = child.IsLeaf() ? s_LeafBit | (child.first << s_LeafCountBits) | (child.count - 1) : Collapse(candidates[slot]);
+        m_WideNodes[index].children[slot] = code;
+    }
+    return index;
+}
+
+template<typename LeafFn>
+void TriangleBvh::TraverseWide(const Ray& ray, float maxDistance, float margin, LeafFn&& leaf) const
+{
+    struct Entry
+    {
+        uint32_t child;
+        float distance;
+    };
+
+    // Four children pushed per level, one popped
+    std::array<Entry, (s_WideWidth - 1) * BoundsBvh::s_MaxDepth + 1> stack;
+    uint32_t depth = 0;
+    stack[depth++] = { 0, 0.f };
+
+    const glm::vec3 inverseDirection = 1.f / ray.direction;
+
+#if VISUALIZER_SSE2
+    const __m128 originX = _mm_set1_ps(ray.origin.x);
+    const __m128 originY = _mm_set1_ps(ray.origin.y);
+    const __m128 originZ = _mm_set1_ps(ray.origin.z);
+    const __m128 inverseX = _mm_set1_ps(inverseDirection.x);
+    const __m128 inverseY = _mm_set1_ps(inverseDirection.y);
+    const __m128 inverseZ = _mm_set1_ps(inverseDirection.z);
+    const __m128 grow = _mm_set1_ps(margin);
+#endif
+
+    while (depth > 0)
+    {
+        const Entry entry = stack[--depth];
+        if (entry.distance > maxDistance)
+        {
+            continue;
+        }
+
+        if (entry.child & s_LeafBit)
+        {
+            leaf((entry.child & ~s_LeafBit) >> s_LeafCountBits, (entry.child & ((1u << s_LeafCountBits) - 1)) + 1, maxDistance);
+            continue;
+        }
+
+        const WideNode& node = m_WideNodes[entry.child];
+        alignas(16) float entries[s_WideWidth];
+        uint32_t hits = 0;
+
+#if VISUALIZER_SSE2
+        const __m128 x0 = _mm_mul_ps(_mm_sub_ps(_mm_sub_ps(_mm_load_ps(node.minX), grow), originX), inverseX);
+        const __m128 x1 = _mm_mul_ps(_mm_sub_ps(_mm_add_ps(_mm_load_ps(node.maxX), grow), originX), inverseX);
+        const __m128 y0 = _mm_mul_ps(_mm_sub_ps(_mm_sub_ps(_mm_load_ps(node.minY), grow), originY), inverseY);
+        const __m128 y1 = _mm_mul_ps(_mm_sub_ps(_mm_add_ps(_mm_load_ps(node.maxY), grow), originY), inverseY);
+        const __m128 z0 = _mm_mul_ps(_mm_sub_ps(_mm_sub_ps(_mm_load_ps(node.minZ), grow), originZ), inverseZ);
+        const __m128 z1 = _mm_mul_ps(_mm_sub_ps(_mm_add_ps(_mm_load_ps(node.maxZ), grow), originZ), inverseZ);
+
+        const __m128 enter = _mm_max_ps(_mm_max_ps(_mm_min_ps(x0, x1), _mm_min_ps(y0, y1)), _mm_max_ps(_mm_min_ps(z0, z1), _mm_setzero_ps()));
+        const __m128 leave = _mm_min_ps(_mm_min_ps(_mm_max_ps(x0, x1), _mm_max_ps(y0, y1)), _mm_min_ps(_mm_max_ps(z0, z1), _mm_set1_ps(maxDistance)));
+
+        _mm_store_ps(entries, enter);
+        hits = static_cast<uint32_t>(_mm_movemask_ps(_mm_cmple_ps(enter, leave)));
+#else
+        for (uint32_t slot = 0; slot < s_WideWidth; ++slot)
+        {
+            const glm::vec3 min(node.minX[slot], node.minY[slot], node.minZ[slot]);
+            const glm::vec3 max(node.maxX[slot], node.maxY[slot], node.maxZ[slot]);
+            hits |= IntersectBox(ray.origin, inverseDirection, min, max, margin, maxDistance, entries[slot]) ? 1u << slot : 0u;
+        }
+#endif
+
+        // Nearest on top of the stack
+        Entry children[s_WideWidth];
+        uint32_t count = 0;
+        for (uint32_t slot = 0; slot < s_WideWidth; ++slot)
+        {
+            if ((hits & (1u << slot)) == 0 || node.children[slot] == s_EmptyChild)
+            {
+                continue;
+            }
+
+            uint32_t i = count++;
+            for (; i > 0 && children[i - 1].distance < entries[slot]; --i)
+            {
+                children[i] = children[i - 1];
+            }
+            children[i] = { node.children[slot], entries[slot] };
+        }
+
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            stack[depth++] = children[i];
+        }
+    }
+}
+
+template<typename TriangleFn>
+void TriangleBvh::Traverse(const Ray& ray, float maxDistance, float margin, TriangleFn&& test) const
+{
+    if (m_Triangles.empty())
+    {
+        return;
+    }
+
+    if (IsWide())
+    {
+        TraverseWide(ray, maxDistance, margin, [&test](uint32_t first, uint32_t count, float& distance)
+        {
+            for (uint32_t i = first; i < first + count; ++i)
+            {
+                test(i, distance);
+            }
+        });
+        return;
+    }
+
+    m_Tree.Raycast(ray, maxDistance, [&test](const BvhNode& leaf, float& distance)
+    {
+        for (uint32_t i = leaf.first; i < leaf.first + leaf.count; ++i)
+        {
+            test(i, distance);
+        }
+    }, margin);
+}
+
+bool TriangleBvh::Raycast(const Ray& ray, float maxDistance, RayHit& hit) const
+{
+    uint32_t nearest = ~0u;
+
+    Traverse(ray, maxDistance, 0.f, [this, &ray, &hit, &nearest](uint32_t i, float& distance)
+    {
+        const Triangle& triangle = m_Triangles[i];
+        float t;
+
+        if (IntersectTriangle(ray, triangle.v0, triangle.edge1, triangle.edge2, distance, t))
+        {
+            distance = hit.distance = t;
+            nearest = i;
+        }
+    });
+
+    if (nearest == ~0u)
+    {
+        return false;
+    }
+
+    const Triangle& triangle = m_Triangles[nearest];
+    const glm::vec3 normal = glm::normalize(glm::cross(triangle.edge1, triangle.edge2));
+    hit.triangle = m_Tree.GetItems()[nearest];
+    hit.normal = glm::dot(normal, ray.direction) > 0.f ? -normal : normal;
+    return true;
+}
+
+bool TriangleBvh::SweepSphere(const Ray& ray, float radius, float maxDistance, RayHit& hit) const
+{
+    uint32_t nearest = ~0u;
+
+    Traverse(ray, maxDistance, radius, [this, &ray, radius, &hit, &nearest](uint32_t i, float& distance)
+    {
+        const Triangle& triangle = m_Triangles[i];
+        float t;
+        glm::vec3 normal;
+
+        if (SweepSphereTriangle(ray, radius, triangle.v0, triangle.edge1, triangle.edge2, distance, t, normal))
+        {
+            distance = hit.distance = t;
+            hit.normal = normal;
+            nearest = i;
+        }
+    });
+
+    if (nearest == ~0u)
+    {
+        return false;
+    }
+
+    hit.triangle = m_Tree.GetItems()[nearest];
+    return true;
+}
+
+bool IntersectInstance(const TriangleBvh& mesh, const InstanceTransform& instance, const Ray& ray, float radius, float maxDistance, RayHit& hit)
+{
+    // Undoes position + scale * yaw, the yaw turning +X towards -Z. Distances
+    // along the ray stay the same, its direction being scaled along.
+    const float cosine = std::cos(instance.yaw);
+    const float sine = std::sin(instance.yaw);
+    const float inverseScale = 1.f / instance.scale;
+
+    auto toLocal = [cosine, sine, inverseScale](const glm::vec3& v)
+    {
+        return glm::vec3(cosine * v.x - sine * v.z, v.y, sine * v.x + cosine * v.z) * inverseScale;
+    };
+
+    const Ray local{ toLocal(ray.origin - instance.position), toLocal(ray.direction) };
+    const bool found = radius > 0.f ? mesh.SweepSphere(local, radius * inverseScale, maxDistance, hit) : mesh.Raycast(local, maxDistance, hit);
+
+    if (found)
+    {
+        hit.normal = glm::vec3(cosine * hit.normal.x + sine * hit.normal.z, hit.normal.y, -sine * hit.normal.x + cosine * hit.normal.z);
+    }
+    return found;
+}
+
+END_VISUALIZER_NAMESPACE
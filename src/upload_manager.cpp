@@ -0,0 +1,280 @@
+#include <algorithm>
+#include <iostream>
+
+#include "gpu_resources.hpp"
+#include "stats_registry.hpp"
+#include "upload_manager.hpp"
+
+BEGIN_VISUALIZER_NAMESPACE
+
+namespace
+{
+    inline size_t AlignUp(size_t value, size_t alignment)
+    {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+}
+
+bool UploadManager::Initialize(size_t capacity, size_t frameBudgetBytes)
+{
+    constexpr GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+    m_Buffer = GpuResourceTracker::GetGlobal().CreateBuffer(GpuResourceCategory::Staging, capacity, nullptr, flags);
+    m_Mapped = static_cast<char*>(glMapNamedBufferRange(m_Buffer, 0, static_cast<GLsizeiptr>(capacity), flags));
+
+    if (!m_Mapped)
+    {
+        std::cerr << "Cannot map staging buffer of " << capacity << " bytes\n";
+        GpuResourceTracker::GetGlobal().DeleteBuffer(m_Buffer);
+        return false;
+    }
+
+    m_Capacity = capacity;
+    m_FrameBudget = frameBudgetBytes;
+    m_Stats = {};
+    m_Stats.capacity = capacity;
+    return true;
+}
+
+StagingAllocation UploadManager::Allocate(size_t size, size_t alignment)
+{
+    StagingAllocation allocation;
+
+    std::lock_guard lock(m_Mutex);
+
+    if (!m_Mapped || size == 0 || size > m_Capacity)
+    {
+        return allocation;
+    }
+
+    // Free space is [head, capacity) + [0, tail) until the ring wraps,
+    // then [head, tail)
+    size_t offset = 0;
+    bool found = false;
+
+    if (m_Regions.empty())
+    {
+        found = true;
+    }
+    else
+    {
+        const Region& front = m_Regions.front();
+        const Region& back = m_Regions.back();
+        const size_t head = AlignUp(back.offset + back.size, alignment);
+        const bool wrapped = back.offset < front.offset;
+
+        if (!wrapped && head + size <= m_Capacity)
+        {
+            offset = head;
+            found = true;
+        }
+        else if (!wrapped && size <= front.offset)
+        {
+            offset = 0;
+            found = true;
+        }
+        else if (wrapped && head + size <= front.offset)
+        {
+            offset = head;
+            found = true;
+        }
+    }
+
+    if (!found)
+    {
+        ++m_Stats.failedAllocations;
+        return allocation;
+    }
+
+    allocation.data = m_Mapped + offset;
+    allocation.offset = offset;
+    allocation.size = size;
+    allocation.id = m_FrontRegionId + m_Regions.size();
+
+    m_Regions.push_back(Region{ offset, size, RegionState::Allocated, 0, 0 });
+
+    m_Stats.bytesInUse += size;
+    m_Stats.peakBytesInUse = std::max(m_Stats.peakBytesInUse, m_Stats.bytesInUse);
+    return allocation;
+}
+
+UploadManager::Region* UploadManager::FindRegion(uint64_t id)
+{
+    // Allocations made before Cleanup() are gone
+    if (id < m_FrontRegionId || id - m_FrontRegionId >= m_Regions.size())
+    {
+        return nullptr;
+    }
+    return &m_Regions[static_cast<size_t>(id - m_FrontRegionId)];
+}
+
+uint64_t UploadManager::Submit(const StagingAllocation& allocation, std::span<const UploadCopy> copies)
+{
+    std::lock_guard lock(m_Mutex);
+
+    Region* region = allocation ? FindRegion(allocation.id) : nullptr;
+
+    if (!region)
+    {
+        return m_SubmitCount;
+    }
+
+    region->state = copies.empty() ? RegionState::Cancelled : RegionState::Submitted;
+    region->remainingCopies = static_cast<uint32_t>(copies.size());
+
+    for (const UploadCopy& copy : copies)
+    {
+        m_PendingCopies.push_back(Copy{ allocation.id, copy.destination, copy.destinationOffset, allocation.offset + copy.offset, copy.size });
+        m_Stats.bytesPending += copy.size;
+    }
+
+    m_SubmitCount += copies.size();
+    return m_SubmitCount;
+}
+
+uint64_t UploadManager::Submit(const StagingAllocation& allocation, GLuint destination, size_t destinationOffset)
+{
+    const UploadCopy copy{ 0, allocation.size, destination, destinationOffset };
+    return Submit(allocation, std::span<const UploadCopy>(&copy, 1));
+}
+
+void UploadManager::Cancel(const StagingAllocation& allocation)
+{
+    if (!allocation)
+    {
+        return;
+    }
+
+    std::lock_guard lock(m_Mutex);
+
+    if (Region* region = FindRegion(allocation.id))
+    {
+        region->state = RegionState::Cancelled;
+    }
+}
+
+bool UploadManager::IsIssued(uint64_t ticket) const
+{
+    return ticket <= m_IssuedCount.load(std::memory_order_acquire);
+}
+
+void UploadManager::Flush()
+{
+    // Copies are issued in submission order; the first one always goes
+    // through so a single upload larger than the budget cannot stall
+    size_t copied = 0;
+    uint64_t issued = 0;
+    const uint64_t batch = m_NextBatch;
+
+    {
+        std::lock_guard lock(m_Mutex);
+
+        while (!m_PendingCopies.empty())
+        {
+            const Copy& copy = m_PendingCopies.front();
+
+            if (copied > 0 && copied + copy.size > m_FrameBudget)
+            {
+                break;
+            }
+
+            glCopyNamedBufferSubData(m_Buffer, copy.destination, static_cast<GLintptr>(copy.sourceOffset), static_cast<GLintptr>(copy.destinationOffset), static_cast<GLsizeiptr>(copy.size));
+
+            Region& region = *FindRegion(copy.region);
+            region.batch = batch;
+            if (--region.remainingCopies == 0)
+            {
+                region.state = RegionState::Copied;
+            }
+
+            copied += copy.size;
+            ++issued;
+            m_PendingCopies.pop_front();
+        }
+
+        m_Stats.bytesPending -= copied;
+        m_Stats.bytesCopiedLastFrame = copied;
+        m_Stats.copiesIssued += issued;
+    }
+
+    if (issued > 0)
+    {
+        StatsRegistry::GetGlobal().Add(StatCounter::UploadBytes, copied);
+        m_Fences.push_back(FenceBatch{ batch, glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0) });
+        ++m_NextBatch;
+        m_IssuedCount.fetch_add(issued, std::memory_order_release);
+    }
+
+    // Fences signal in order, stop at the first one still pending
+    while (!m_Fences.empty())
+    {
+        const GLenum status = glClientWaitSync(m_Fences.front().fence, 0, 0);
+
+        if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+        {
+            StatsRegistry::GetGlobal().Add(StatCounter::FenceWaits);
+            break;
+        }
+
+        m_CompletedBatch = m_Fences.front().serial;
+        glDeleteSync(m_Fences.front().fence);
+        m_Fences.pop_front();
+    }
+
+    RetireRegions();
+}
+
+void UploadManager::RetireRegions()
+{
+    std::lock_guard lock(m_Mutex);
+
+    while (!m_Regions.empty())
+    {
+        const Region& region = m_Regions.front();
+
+        const bool done = region.state == RegionState::Cancelled || (region.state == RegionState::Copied && region.batch <= m_CompletedBatch);
+        if (!done)
+        {
+            break;
+        }
+
+        m_Stats.bytesInUse -= region.size;
+        m_Regions.pop_front();
+        ++m_FrontRegionId;
+    }
+
+    StatsRegistry::GetGlobal().Set(StatGauge::StagingBytesInUse, static_cast<double>(m_Stats.bytesInUse));
+}
+
+void UploadManager::Cleanup()
+{
+    for (const FenceBatch& batch : m_Fences)
+    {
+        glDeleteSync(batch.fence);
+    }
+    m_Fences.clear();
+
+    if (m_Buffer)
+    {
+        glUnmapNamedBuffer(m_Buffer);
+        GpuResourceTracker::GetGlobal().DeleteBuffer(m_Buffer);
+    }
+
+    std::lock_guard lock(m_Mutex);
+
+    m_Mapped = nullptr;
+    m_Capacity = 0;
+    m_FrontRegionId += m_Regions.size();
+    m_Regions.clear();
+    m_PendingCopies.clear();
+    m_Stats.bytesInUse = 0;
+    m_Stats.bytesPending = 0;
+}
+
+UploadStats UploadManager::GetStats() const
+{
+    std::lock_guard lock(m_Mutex);
+    return m_Stats;
+}
+
+END_VISUALIZER_NAMESPACE
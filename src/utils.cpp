@@ -1,30 +1,21 @@
-#include <fstream>
 #include <Windows.h>
 #include <iostream>
 
+#include "mapped_file.hpp"
 #include "utils.hpp"
 
 BEGIN_VISUALIZER_NAMESPACE
 
 bool LoadFile(const std::string& fileName, std::string& result)
 {
-    std::ifstream ifs(fileName, std::ios::binary);
+    MappedFile file;
 
-    if (ifs)
+    if (!file.Open(fileName))
     {
-        result = std::move(std::string(std::istreambuf_iterator<char>(ifs), {}));
-
-        if (!ifs)
-        {
-            std::cerr << "Error: only " << ifs.gcount() << " could be read\n";
-        }
-    }
-    else
-    {
-        std::cerr << "Cannot open file : " << fileName << '\n';
         return false;
     }
 
+    result.assign(file.GetData(), file.GetSize());
     return true;
 }
 
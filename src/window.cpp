@@ -1,12 +1,17 @@
 #include <chrono>
+#include <fstream>
 #include <iostream>
 #include <GL/glew.h>
 #include <GL/wglew.h>
 
+#include "alloc_tracking.hpp"
 #include "utils.hpp"
 #include "window.hpp"
 #include "camera.hpp"
+#include "camera_path.hpp"
+#include "gl_capture.hpp"
 #include "renderer.hpp"
+#include "stats_registry.hpp"
 
 BEGIN_VISUALIZER_NAMESPACE
 
@@ -77,6 +82,31 @@ static LRESULT CALLBACK WindowEvenHandler(HWND hWnd, UINT uMsg, WPARAM wParam, L
             window->SetMustMoveCameraBackward(true);
             break;
         }
+        case 'I':
+        {
+            window->PlantInstance();
+            break;
+        }
+        case 'M':
+        {
+            window->PrintResourceReport();
+            break;
+        }
+        case 'O':
+        {
+            window->ToggleOcclusionCulling();
+            break;
+        }
+        case 'P':
+        {
+            window->CyclePrepassMode();
+            break;
+        }
+        case 'V':
+        {
+            window->ToggleOverdrawView();
+            break;
+        }
         }
         break;
     }
@@ -119,6 +149,11 @@ static LRESULT CALLBACK WindowEvenHandler(HWND hWnd, UINT uMsg, WPARAM wParam, L
         window->SetMouseButtonDown(false);
         break;
     }
+    case WM_RBUTTONDOWN:
+    {
+        window->PickAt(LOWORD(lParam), HIWORD(lParam));
+        break;
+    }
     case WM_MOUSEMOVE:
     {
         if (window->GetMouseButtonDown())
@@ -524,24 +559,33 @@ bool Window::Update() const
     return m_WindowShouldRun;
 }
 
-void Window::Run()
+bool Window::Run(const LaunchOptions& options)
 {
     if (!m_IsInitialized)
-        return;
+        return false;
 
     ShowWindow(m_hWnd, SW_SHOW);
 
-    glEnable(GL_CULL_FACE);
-    glCullFace(GL_BACK);
+    CreateRenderer(options);
 
-    glEnable(GL_DEPTH_TEST);
-    glDepthFunc(GL_LEQUAL);
+    CameraPath path;
+    FlythroughBenchmark flythrough;
 
-    m_Camera = std::make_shared<Camera>(m_Width, m_Height, glm::vec3(0., 0., -2.5f));
+    if (!options.playPath.empty())
+    {
+        if (!path.Load(options.playPath))
+        {
+            m_Renderer->Cleanup();
+            return false;
+        }
 
-    m_Renderer = std::make_unique<Renderer>(m_Camera);
+        // Frame times are the point, not the display's refresh rate
+        wglSwapIntervalEXT(0);
+        flythrough.Start(path, options.playIterations);
+    }
 
-    m_Renderer->Initialize();
+    SharedStats sharedStats;
+    const bool publishStats = options.publishStats && sharedStats.Create();
 
     std::chrono::duration<float> dt;
     std::chrono::duration<float> totalElapsedTime;
@@ -549,20 +593,172 @@ void Window::Run()
     std::chrono::time_point<std::chrono::steady_clock> start, lastFrame;
     start = lastFrame = std::chrono::steady_clock::now();
 
+    FrameAllocationCheck allocationCheck(options.allocationWarmupFrames);
+
+    GlCapture& glCapture = GlCapture::GetGlobal();
+    GlCallBudget glBudget(options.glStateChangeBudget);
+
+    if (!options.glCapture.empty())
+    {
+        glCapture.StartWriting(options.glCapture, options.launchArguments, options.glCaptureFrames);
+    }
+    if (options.checkGlBudget)
+    {
+        glCapture.StartCounting();
+    }
+
     while (Update())
     {
+        if (options.checkAllocations)
+        {
+            allocationCheck.BeginFrame();
+        }
+
         std::chrono::time_point<std::chrono::steady_clock> end = std::chrono::steady_clock::now();
         dt = end - lastFrame;
         totalElapsedTime = end - start;
         lastFrame = end;
-        HandleCameraMovement(dt.count());
 
+        if (flythrough.IsRunning())
+        {
+            const CameraKey key = flythrough.BeginFrame();
+            m_Camera->SetPosition(key.position);
+            m_Camera->SetOrientation(key.horizontalAngle, key.verticalAngle);
+            m_Renderer->UpdateCamera();
+
+            m_Renderer->Update(FlythroughBenchmark::s_TimeStep);
+        }
+        else
+        {
+            HandleCameraMovement(dt.count());
+            if (!options.recordPath.empty())
+            {
+                path.Record(totalElapsedTime.count(), m_Camera->GetPosition(), m_Camera->GetHorizontalAngle(), m_Camera->GetVerticalAngle());
+            }
+
+            m_Renderer->Update(dt.count());
+        }
         m_Renderer->Render();
 
         SwapBuffers(m_hDC);
+
+        if (GlCapture::IsActive())
+        {
+            const GlFrameCalls& calls = glCapture.EndFrame();
+            if (options.checkGlBudget)
+            {
+                glBudget.EndFrame(calls);
+            }
+        }
+
+        {
+            StatsRegistry& stats = StatsRegistry::GetGlobal();
+            const float frameMs = dt.count() * 1000.f;
+
+            // The time of the previous frame, measured as this one started
+            stats.Add(StatCounter::Frames);
+            stats.Set(StatGauge::CpuFrameMs, frameMs);
+            stats.Record(StatHistogram::CpuFrameTime, frameMs);
+
+            if (publishStats)
+            {
+                sharedStats.Publish(stats);
+            }
+        }
+
+        if (flythrough.IsRunning())
+        {
+            // Without V-Sync, SwapBuffers only blocks once the driver queues
+            // too many frames, so this settles on the GPU's pace
+            const std::chrono::duration<float, std::milli> frameTime = std::chrono::steady_clock::now() - end;
+            const FrameCounters& counters = m_Renderer->GetFrameCounters();
+
+            flythrough.EndFrame(frameTime.count(), counters.sceneGpuMs, counters.drawCommands, counters.triangles);
+
+            if (!flythrough.IsRunning())
+            {
+                Close();
+            }
+        }
+
+        if (options.checkAllocations)
+        {
+            allocationCheck.EndFrame();
+        }
     }
 
+    bool succeeded = glCapture.Stop();
+
     m_Renderer->Cleanup();
+
+    if (!options.recordPath.empty() && !path.IsEmpty())
+    {
+        const bool saved = path.Save(options.recordPath);
+        succeeded = succeeded && saved;
+        if (saved)
+        {
+            std::cout << "Camera path: " << path.GetKeyCount() << " keys over " << path.GetDuration() << " s saved to " << options.recordPath << '\n';
+        }
+    }
+
+    if (!options.playPath.empty())
+    {
+        flythrough.PrintReport(std::cout);
+
+        if (!options.benchmarkJson.empty())
+        {
+            std::ofstream ofs(options.benchmarkJson, std::ios::trunc);
+            flythrough.WriteJson(ofs, options);
+
+            if (!ofs)
+            {
+                std::cerr << "Cannot write file : " << options.benchmarkJson << '\n';
+                succeeded = false;
+            }
+        }
+    }
+
+    if (options.checkAllocations)
+    {
+        allocationCheck.PrintReport(std::cout);
+        succeeded = succeeded && !allocationCheck.HasFailed();
+    }
+
+    if (options.checkGlBudget)
+    {
+        glBudget.PrintReport(std::cout);
+        succeeded = succeeded && !glBudget.HasFailed();
+    }
+    return succeeded;
+}
+
+bool Window::Replay(const GlCaptureFile& capture, const LaunchOptions& options, uint32_t iterations)
+{
+    if (!m_IsInitialized)
+        return false;
+
+    // The same objects get the same names as while capturing
+    CreateRenderer(options);
+
+    capture.Replay(std::cout, iterations);
+
+    m_Renderer->Cleanup();
+    return true;
+}
+
+void Window::CreateRenderer(const LaunchOptions& options)
+{
+    glEnable(GL_CULL_FACE);
+    glCullFace(GL_BACK);
+
+    glEnable(GL_DEPTH_TEST);
+    glDepthFunc(GL_LEQUAL);
+
+    m_Camera = std::make_shared<Camera>(m_Width, m_Height, glm::vec3(0., 0., -2.5f));
+
+    m_Renderer = std::make_unique<Renderer>(m_Camera, options);
+
+    m_Renderer->Initialize();
 }
 
 void Window::Close()
@@ -591,6 +787,91 @@ void Window::SetCameraMovement(long horizontalMovement, long verticalMovement)
     m_Renderer->UpdateCamera();
 }
 
+void Window::PrintResourceReport() const
+{
+    if (m_Renderer)
+    {
+        m_Renderer->PrintResourceReport();
+    }
+}
+
+void Window::ToggleOcclusionCulling()
+{
+    if (m_Renderer)
+    {
+        m_Renderer->SetOcclusionCulling(!m_Renderer->IsOcclusionCullingEnabled());
+    }
+}
+
+void Window::CyclePrepassMode()
+{
+    if (m_Renderer)
+    {
+        // Off, on, auto, then off again
+        m_Renderer->SetPrepassMode(static_cast<PrepassMode>((static_cast<uint8_t>(m_Renderer->GetPrepassMode()) + 1) % 3));
+    }
+}
+
+void Window::ToggleOverdrawView()
+{
+    if (m_Renderer)
+    {
+        m_Renderer->SetOverdrawView(!m_Renderer->IsOverdrawViewEnabled());
+    }
+}
+
+void Window::PlantInstance()
+{
+    if (!m_Renderer || m_Renderer->GetInstanceSetCount() == 0)
+    {
+        return;
+    }
+
+    InstanceTransform instance;
+    instance.position = m_Camera->GetPosition() + s_PlantDistance * glm::normalize(glm::vec3(m_Camera->GetDirection().x, 0.f, m_Camera->GetDirection().z));
+
+    float groundHeight;
+    if (!m_Renderer->GetTerrain().HeightAt(instance.position.x, instance.position.z, groundHeight))
+    {
+        return;
+    }
+    instance.position.y = groundHeight;
+
+    m_Renderer->AddInstance(0, instance);
+}
+
+void Window::PickAt(uint32_t x, uint32_t y)
+{
+    if (!m_Renderer)
+    {
+        return;
+    }
+
+    // The cursor on the far plane, back in world space
+    const glm::vec2 ndc(2.f * (static_cast<float>(x) + 0.5f) / m_Width - 1.f, 1.f - 2.f * (static_cast<float>(y) + 0.5f) / m_Height);
+    const glm::vec4 target = glm::inverse(m_Camera->GetViewProjectionMatrix()) * glm::vec4(ndc, 1.f, 1.f);
+
+    const Ray ray{ m_Camera->GetPosition(), glm::normalize(glm::vec3(target) / target.w - m_Camera->GetPosition()) };
+
+    Renderer::PickResult pick;
+    if (!m_Renderer->Pick(ray, s_PickDistance, pick))
+    {
+        std::cout << "Picked nothing\n";
+        return;
+    }
+
+    const glm::vec3& p = pick.position;
+    if (!(pick.instance == Entity()))
+    {
+        std::cout << "Picked instance " << pick.instance.index;
+    }
+    else
+    {
+        std::cout << "Picked terrain";
+    }
+    std::cout << " at (" << p.x << ", " << p.y << ", " << p.z << "), " << pick.distance << " away\n";
+}
+
 void Window::MoveCameraForward(float dt)
 {
     m_Camera->MoveForward(dt);
@@ -613,6 +894,7 @@ void Window::MoveCameraRight(float dt)
 
 void Window::HandleCameraMovement(float dt)
 {
+    const glm::vec3 start = m_Camera->GetPosition();
     bool anyMovement = false;
 
     if (m_MustMoveCameraForward)
@@ -641,8 +923,22 @@ void Window::HandleCameraMovement(float dt)
 
     if (anyMovement)
     {
+        m_Camera->SetPosition(m_Renderer->MoveSphere(start, m_Camera->GetPosition(), s_CameraRadius));
+        ClampCameraToGround();
         m_Renderer->UpdateCamera();
     }
 }
 
+void Window::ClampCameraToGround()
+{
+    glm::vec3 position = m_Camera->GetPosition();
+    float groundHeight;
+
+    if (m_Renderer->GetTerrain().HeightAt(position.x, position.z, groundHeight) && position.y < groundHeight + s_CameraGroundOffset)
+    {
+        position.y = groundHeight + s_CameraGroundOffset;
+        m_Camera->SetPosition(position);
+    }
+}
+
 END_VISUALIZER_NAMESPACE
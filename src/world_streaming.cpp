@@ -0,0 +1,722 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <istream>
+#include <limits>
+#include <sstream>
+#include <thread>
+
+#include "gpu_resources.hpp"
+#include "mapped_file.hpp"
+#include "memory_arena.hpp"
+#include "thread_pool.hpp"
+#include "world_streaming.hpp"
+
+BEGIN_VISUALIZER_NAMESPACE
+
+bool WorldPartition::Load(const std::string& manifestPath)
+{
+    MappedFile file;
+
+    if (!file.Open(manifestPath))
+    {
+        return false;
+    }
+
+    ByteStreamBuf buffer(file.GetBytes());
+    std::istream stream(&buffer);
+
+    const std::filesystem::path directory = std::filesystem::path(manifestPath).parent_path();
+    auto resolve = [&directory](const std::string& path)
+    {
+        const std::filesystem::path p(path);
+        return (p.is_absolute() ? p : directory / p).string();
+    };
+
+    std::string line;
+    size_t lineNumber = 0;
+
+    while (std::getline(stream, line))
+    {
+        ++lineNumber;
+
+        std::istringstream ss(line);
+        std::string keyword;
+
+        if (!(ss >> keyword) || keyword[0] == '#')
+        {
+            continue;
+        }
+
+        bool valid = true;
+
+        if (keyword == "cellsize")
+        {
+            valid = static_cast<bool>(ss >> m_CellSize) && m_CellSize > 0.f;
+        }
+        else if (keyword == "prototype")
+        {
+            std::string path;
+            valid = static_cast<bool>(ss >> path);
+            if (valid)
+            {
+                m_Prototypes.push_back(resolve(path));
+            }
+        }
+        else if (keyword == "mesh")
+        {
+            CellCoord cell;
+            std::string path;
+            valid = static_cast<bool>(ss >> cell.x >> cell.z >> path);
+            if (valid)
+            {
+                m_Cells[cell].meshes.push_back(resolve(path));
+            }
+        }
+        else if (keyword == "instances")
+        {
+            CellCoord cell;
+            uint32_t prototype;
+            std::string path;
+            valid = static_cast<bool>(ss >> cell.x >> cell.z >> prototype >> path) && prototype < m_Prototypes.size();
+            if (valid)
+            {
+                m_Cells[cell].instanceSets.push_back({ prototype, resolve(path) });
+            }
+        }
+        else
+        {
+            valid = false;
+        }
+
+        if (!valid)
+        {
+            std::cerr << "Invalid world manifest entry at " << manifestPath << ':' << lineNumber << '\n';
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool WorldPartition::Save(const std::string& manifestPath) const
+{
+    std::ofstream ofs(manifestPath, std::ios::trunc);
+
+    if (!ofs)
+    {
+        std::cerr << "Cannot open file : " << manifestPath << '\n';
+        return false;
+    }
+
+    ofs << "cellsize " << m_CellSize << '\n';
+
+    for (const std::string& prototype : m_Prototypes)
+    {
+        ofs << "prototype " << prototype << '\n';
+    }
+
+    for (const auto& [cell, desc] : m_Cells)
+    {
+        for (const std::string& mesh : desc.meshes)
+        {
+            ofs << "mesh " << cell.x << ' ' << cell.z << ' ' << mesh << '\n';
+        }
+        for (const WorldCellDesc::InstanceSet& set : desc.instanceSets)
+        {
+            ofs << "instances " << cell.x << ' ' << cell.z << ' ' << set.prototype << ' ' << set.path << '\n';
+        }
+    }
+
+    return static_cast<bool>(ofs);
+}
+
+uint32_t WorldPartition::AddPrototype(const std::string& meshPath)
+{
+    m_Prototypes.push_back(meshPath);
+    return static_cast<uint32_t>(m_Prototypes.size() - 1);
+}
+
+void WorldPartition::AddMesh(const CellCoord& cell, const std::string& meshPath)
+{
+    m_Cells[cell].meshes.push_back(meshPath);
+}
+
+bool WorldPartition::PartitionInstances(const std::vector<InstanceTransform>& instances, uint32_t prototype, const std::string& directory)
+{
+    std::unordered_map<CellCoord, std::vector<InstanceTransform>, CellCoordHash> buckets;
+
+    for (const InstanceTransform& instance : instances)
+    {
+        buckets[CellAt(instance.position)].push_back(instance);
+    }
+
+    for (const auto& [cell, bucket] : buckets)
+    {
+        const std::string path = (std::filesystem::path(directory) / ("instances_" + std::to_string(prototype) + '_' + std::to_string(cell.x) + '_' + std::to_string(cell.z) + ".vins")).string();
+
+        if (!SaveInstancesBinary(path, bucket))
+        {
+            return false;
+        }
+
+        m_Cells[cell].instanceSets.push_back({ prototype, path });
+    }
+
+    return true;
+}
+
+CellCoord WorldPartition::CellAt(const glm::vec3& position) const
+{
+    return { static_cast<int32_t>(std::floor(position.x / m_CellSize)), static_cast<int32_t>(std::floor(position.z / m_CellSize)) };
+}
+
+glm::vec3 WorldPartition::CellCenter(const CellCoord& cell) const
+{
+    return glm::vec3((static_cast<float>(cell.x) + 0.5f) * m_CellSize, 0.f, (static_cast<float>(cell.z) + 0.5f) * m_CellSize);
+}
+
+const WorldCellDesc* WorldPartition::FindCell(const CellCoord& cell) const
+{
+    const auto it = m_Cells.find(cell);
+    return it != m_Cells.end() ? &it->second : nullptr;
+}
+
+StreamingManager::StreamingManager(WorldPartition partition, ThreadPool& pool, UploadManager& uploads, const StreamingSettings& settings)
+    : m_Partition(std::move(partition))
+    , m_Pool(pool)
+    , m_Uploads(uploads)
+    , m_Settings(settings)
+    , m_Reader(pool)
+{
+    m_Settings.unloadDistance = std::max(m_Settings.unloadDistance, m_Settings.loadDistance);
+}
+
+StreamingManager::~StreamingManager()
+{
+    Cleanup();
+}
+
+void StreamingManager::LoadPrototypes(Renderer& renderer)
+{
+    LinearArena scratch(1u << 20);
+
+    for (const std::string& path : m_Partition.GetPrototypes())
+    {
+        {
+            std::pmr::vector<VertexDataPosition3fColor3f> vertices(&scratch);
+            std::pmr::vector<uint32_t> indices(&scratch);
+
+            // A failed prototype keeps its index as an empty object, and
+            // the instance sets drawn with it are never loaded
+            if (!LoadMesh(vertices, indices, path) || indices.empty())
+            {
+                std::cerr << "Cannot load prototype : " << path << '\n';
+                m_Prototypes.push_back(Object{});
+            }
+            else
+            {
+                m_Prototypes.push_back(renderer.InitObj(vertices, indices, &scratch));
+            }
+        }
+        scratch.Reset();
+    }
+}
+
+float StreamingManager::DistanceToCell(const glm::vec3& position, const CellCoord& cell) const
+{
+    const glm::vec3 center = m_Partition.CellCenter(cell);
+    return glm::length(glm::vec2(position.x - center.x, position.z - center.z));
+}
+
+void StreamingManager::Update(Renderer& renderer, const glm::vec3& cameraPosition, const glm::vec3& cameraVelocity)
+{
+    const glm::vec3 predictedPosition = cameraPosition + cameraVelocity * m_Settings.prefetchSeconds;
+
+    UnloadDistantCells(cameraPosition, predictedPosition);
+    PromoteUploaded();
+    UploadCompleted(renderer);
+    RequestLoads(cameraPosition, predictedPosition, renderer.GetFrameAllocator().GetResource());
+
+    m_Stats.residentCells = 0;
+    m_Stats.loadingCells = 0;
+    for (const auto& [coord, cell] : m_Cells)
+    {
+        ++(cell.state == CellState::Resident ? m_Stats.residentCells : m_Stats.loadingCells);
+    }
+}
+
+void StreamingManager::RequestLoads(const glm::vec3& cameraPosition, const glm::vec3& predictedPosition, std::pmr::memory_resource* frame)
+{
+    if (m_LoadsInFlight >= m_Settings.maxLoadsInFlight)
+    {
+        return;
+    }
+
+    std::pmr::vector<LoadRequest> requests(frame);
+
+    // Cells around the camera come first; cells only wanted because of
+    // where we are heading are pushed behind them
+    auto gather = [&](const glm::vec3& center, float penalty, IoPriority ioPriority)
+    {
+        const int32_t radius = static_cast<int32_t>(std::ceil(m_Settings.loadDistance / m_Partition.GetCellSize()));
+        const CellCoord origin = m_Partition.CellAt(center);
+
+        for (int32_t z = origin.z - radius; z <= origin.z + radius; ++z)
+        {
+            for (int32_t x = origin.x - radius; x <= origin.x + radius; ++x)
+            {
+                const CellCoord coord{ x, z };
+                const float distance = DistanceToCell(center, coord);
+
+                if (distance <= m_Settings.loadDistance && !m_Cells.contains(coord) && m_Partition.FindCell(coord))
+                {
+                    requests.push_back({ coord, distance + penalty, ioPriority });
+                }
+            }
+        }
+    };
+
+    gather(cameraPosition, 0.f, IoPriority::Visible);
+    gather(predictedPosition, m_Settings.loadDistance, IoPriority::Prefetch);
+
+    std::sort(requests.begin(), requests.end(), [](const LoadRequest& a, const LoadRequest& b) { return a.priority < b.priority; });
+
+    for (const LoadRequest& request : requests)
+    {
+        if (m_LoadsInFlight >= m_Settings.maxLoadsInFlight)
+        {
+            break;
+        }
+
+        // The same cell can be gathered twice
+        if (m_Cells.contains(request.coord))
+        {
+            continue;
+        }
+
+        Cell& cell = m_Cells[request.coord];
+        cell.state = CellState::Loading;
+        cell.requestTime = Clock::now();
+        cell.payload = std::make_shared<CellPayload>();
+        cell.payload->coord = request.coord;
+        cell.payload->desc = *m_Partition.FindCell(request.coord);
+        std::erase_if(cell.payload->desc.instanceSets, [this](const WorldCellDesc::InstanceSet& set) { return !IsPrototypeLoaded(set.prototype); });
+        ++m_LoadsInFlight;
+
+        const std::shared_ptr<CellPayload>& payload = cell.payload;
+        const WorldCellDesc& desc = payload->desc;
+        const size_t fileCount = desc.meshes.size() + desc.instanceSets.size();
+
+        // Decoded on the pool once the last file is in, dropped right away
+        // if the cell was unloaded meanwhile
+        auto decode = [payload, mailbox = m_Mailbox, &uploads = m_Uploads, &pool = m_Pool]()
+        {
+            if (!payload->cancelled.load(std::memory_order_relaxed))
+            {
+                LoadCell(*payload, uploads, pool);
+            }
+
+            std::lock_guard<std::mutex> lock(mailbox->mutex);
+            mailbox->completed.push_back(payload);
+        };
+
+        if (fileCount == 0)
+        {
+            m_Pool.Submit(decode);
+            continue;
+        }
+
+        payload->files.resize(fileCount);
+        payload->reads.resize(fileCount);
+        payload->readsLeft.store(static_cast<uint32_t>(fileCount), std::memory_order_relaxed);
+
+        std::pmr::vector<ReadRequest> reads(frame);
+        reads.reserve(fileCount);
+
+        for (size_t i = 0; i < fileCount; ++i)
+        {
+            const std::string& path = i < desc.meshes.size() ? desc.meshes[i] : desc.instanceSets[i - desc.meshes.size()].path;
+
+            reads.push_back({ path, 0, s_ReadToEnd, request.ioPriority, [payload, i, decode, &pool = m_Pool](ReadResult&& result)
+            {
+                payload->files[i] = std::move(result);
+
+                if (payload->readsLeft.fetch_sub(1, std::memory_order_acq_rel) == 1)
+                {
+                    // Callbacks run on the reader's thread, keep it free
+                    pool.Submit(decode);
+                }
+            } });
+        }
+
+        m_Reader.ReadBatch(reads, payload->reads.data());
+    }
+}
+
+void StreamingManager::LoadCell(CellPayload& payload, UploadManager& uploads, ThreadPool& pool)
+{
+    const WorldCellDesc& desc = payload.desc;
+    constexpr size_t alignment = 16;
+
+    // Everything decoded here is dropped once copied into the staging ring
+    LinearArena scratch(1u << 20);
+    std::pmr::vector<std::pmr::vector<VertexDataPosition3fColor3f>> meshVertices(&scratch);
+    std::pmr::vector<std::pmr::vector<uint32_t>> meshIndices(&scratch);
+    std::vector<std::vector<InstanceTransform>> instanceTransforms;
+    size_t stagingSize = 0;
+
+    auto reserve = [&stagingSize](size_t bytes)
+    {
+        const size_t offset = (stagingSize + alignment - 1) / alignment * alignment;
+        stagingSize = offset + bytes;
+        return offset;
+    };
+
+    for (size_t i = 0; i < desc.meshes.size(); ++i)
+    {
+        if (payload.cancelled.load(std::memory_order_relaxed))
+        {
+            return;
+        }
+
+        const std::string& path = desc.meshes[i];
+        ReadResult& file = payload.files[i];
+        std::pmr::vector<VertexDataPosition3fColor3f> vertices(&scratch);
+        std::pmr::vector<uint32_t> indices(&scratch);
+
+        const bool loaded = file.status == IoStatus::Completed && LoadMesh(vertices, indices, path, file.GetBytes());
+        file = ReadResult();
+
+        if (!loaded)
+        {
+            std::cerr << "Cannot load cell mesh : " << path << '\n';
+            continue;
+        }
+        if (indices.empty())
+        {
+            continue;
+        }
+
+        CellPayload::Mesh& mesh = payload.meshes.emplace_back();
+        mesh.vertexCount = static_cast<uint32_t>(vertices.size());
+        mesh.vertexOffset = reserve(vertices.size() * sizeof(VertexDataPosition3fColor3f));
+        mesh.indexCount = static_cast<uint32_t>(indices.size());
+        mesh.indexOffset = reserve(indices.size() * sizeof(uint32_t));
+        computeBounds(vertices, mesh.min, mesh.max);
+
+        meshVertices.push_back(std::move(vertices));
+        meshIndices.push_back(std::move(indices));
+    }
+
+    for (size_t i = 0; i < desc.instanceSets.size(); ++i)
+    {
+        if (payload.cancelled.load(std::memory_order_relaxed))
+        {
+            return;
+        }
+
+        const WorldCellDesc::InstanceSet& set = desc.instanceSets[i];
+        ReadResult& file = payload.files[desc.meshes.size() + i];
+        std::vector<InstanceTransform> transforms;
+
+        const bool loaded = file.status == IoStatus::Completed && LoadInstances(set.path, file.GetBytes(), transforms, pool);
+        file = ReadResult();
+
+        if (!loaded || transforms.empty())
+        {
+            continue;
+        }
+
+        CellPayload::Instances& instances = payload.instanceSets.emplace_back();
+        instances.prototype = set.prototype;
+        instances.count = static_cast<uint32_t>(transforms.size());
+        instances.offset = reserve(transforms.size() * sizeof(InstanceTransform));
+        instances.positionMin = instances.positionMax = transforms[0].position;
+        instances.minScale = instances.maxScale = transforms[0].scale;
+        for (const InstanceTransform& transform : transforms)
+        {
+            instances.positionMin = glm::min(instances.positionMin, transform.position);
+            instances.positionMax = glm::max(instances.positionMax, transform.position);
+            instances.minScale = std::min(instances.minScale, transform.scale);
+            instances.maxScale = std::max(instances.maxScale, transform.scale);
+        }
+
+        instanceTransforms.push_back(std::move(transforms));
+    }
+
+    payload.byteSize = stagingSize;
+
+    if (stagingSize == 0)
+    {
+        return;
+    }
+
+    if (stagingSize > uploads.GetCapacity())
+    {
+        std::cerr << "Cell " << payload.coord.x << ' ' << payload.coord.z << " does not fit the staging buffer (" << stagingSize << " bytes)\n";
+        payload.meshes.clear();
+        payload.instanceSets.clear();
+        return;
+    }
+
+    // The GL thread frees ring space every frame
+    while (!(payload.staging = uploads.Allocate(stagingSize, alignment)))
+    {
+        if (payload.cancelled.load(std::memory_order_relaxed))
+        {
+            return;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    char* data = static_cast<char*>(payload.staging.data);
+
+    for (size_t i = 0; i < payload.meshes.size(); ++i)
+    {
+        std::memcpy(data + payload.meshes[i].vertexOffset, meshVertices[i].data(), meshVertices[i].size() * sizeof(VertexDataPosition3fColor3f));
+        std::memcpy(data + payload.meshes[i].indexOffset, meshIndices[i].data(), meshIndices[i].size() * sizeof(uint32_t));
+    }
+    for (size_t i = 0; i < payload.instanceSets.size(); ++i)
+    {
+        std::memcpy(data + payload.instanceSets[i].offset, instanceTransforms[i].data(), instanceTransforms[i].size() * sizeof(InstanceTransform));
+    }
+}
+
+void StreamingManager::UnloadDistantCells(const glm::vec3& cameraPosition, const glm::vec3& predictedPosition)
+{
+    for (auto it = m_Cells.begin(); it != m_Cells.end();)
+    {
+        const float distance = std::min(DistanceToCell(cameraPosition, it->first), DistanceToCell(predictedPosition, it->first));
+
+        // Queued copies still target the buffers of an uploading cell, it
+        // is unloaded once resident
+        if (distance <= m_Settings.unloadDistance || it->second.state == CellState::Uploading)
+        {
+            ++it;
+            continue;
+        }
+
+        if (it->second.state == CellState::Loading)
+        {
+            // The job notices, stops early and its result is dropped on arrival
+            it->second.payload->cancelled.store(true, std::memory_order_relaxed);
+            CancelReads(*it->second.payload);
+            ++m_Stats.loadsCancelled;
+        }
+        else
+        {
+            ++m_Stats.cellsUnloaded;
+        }
+
+        DestroyCell(it->second);
+        it = m_Cells.erase(it);
+    }
+}
+
+void StreamingManager::CancelReads(const CellPayload& payload)
+{
+    for (IoTicket ticket : payload.reads)
+    {
+        m_Reader.Cancel(ticket);
+    }
+}
+
+void StreamingManager::UploadCompleted(Renderer& renderer)
+{
+    // Swapping keeps both vectors' capacity in circulation
+    std::vector<std::shared_ptr<CellPayload>>& completed = m_Completed;
+    {
+        std::lock_guard<std::mutex> lock(m_Mailbox->mutex);
+        completed.swap(m_Mailbox->completed);
+    }
+
+    m_LoadsInFlight -= static_cast<uint32_t>(completed.size());
+
+    // Oldest requests first; stale payloads sort to the front and are dropped
+    auto requestTime = [this](const std::shared_ptr<CellPayload>& payload)
+    {
+        const auto it = m_Cells.find(payload->coord);
+        return it != m_Cells.end() ? it->second.requestTime : Clock::time_point::min();
+    };
+
+    std::sort(completed.begin(), completed.end(), [&requestTime](const std::shared_ptr<CellPayload>& a, const std::shared_ptr<CellPayload>& b)
+    {
+        return requestTime(a) < requestTime(b);
+    });
+
+    std::pmr::vector<UploadCopy> copies(renderer.GetFrameAllocator().GetResource());
+
+    for (const std::shared_ptr<CellPayload>& payload : completed)
+    {
+        const auto it = m_Cells.find(payload->coord);
+
+        // Unloaded (and maybe requested again) while its job was running
+        if (payload->cancelled.load(std::memory_order_relaxed) || it == m_Cells.end() || it->second.payload != payload)
+        {
+            m_Uploads.Cancel(payload->staging);
+            continue;
+        }
+
+        Cell& cell = it->second;
+        copies.clear();
+
+        for (const CellPayload::Mesh& mesh : payload->meshes)
+        {
+            Object obj = renderer.CreateObj(mesh.vertexCount, mesh.indexCount);
+            obj.m_MeshMin = obj.m_BoundsMin = mesh.min;
+            obj.m_MeshMax = obj.m_BoundsMax = mesh.max;
+            copies.push_back({ mesh.vertexOffset, mesh.vertexCount * sizeof(VertexDataPosition3fColor3f), obj.m_VBO });
+            copies.push_back({ mesh.indexOffset, mesh.indexCount * sizeof(uint32_t), obj.m_IBO });
+            cell.objects.push_back(obj);
+            cell.sharesGeometry.push_back(false);
+        }
+
+        for (const CellPayload::Instances& instances : payload->instanceSets)
+        {
+            if (!IsPrototypeLoaded(instances.prototype))
+            {
+                continue;
+            }
+
+            Object obj = renderer.ShareObj(m_Prototypes[instances.prototype]);
+            renderer.CreateInstanceBuffer(obj, instances.count);
+
+            // The box is linear in the scale, its extremes come from the
+            // smallest and the largest one
+            obj.m_BoundsMin = glm::vec3(std::numeric_limits<float>::max());
+            obj.m_BoundsMax = glm::vec3(std::numeric_limits<float>::lowest());
+            for (const InstanceTransform& corner : { InstanceTransform{ instances.positionMin, instances.minScale }, InstanceTransform{ instances.positionMin, instances.maxScale },
+                                                     InstanceTransform{ instances.positionMax, instances.minScale }, InstanceTransform{ instances.positionMax, instances.maxScale } })
+            {
+                glm::vec3 min, max;
+                GetInstanceBounds(corner, obj.m_MeshMin, obj.m_MeshMax, min, max);
+                obj.m_BoundsMin = glm::min(obj.m_BoundsMin, min);
+                obj.m_BoundsMax = glm::max(obj.m_BoundsMax, max);
+            }
+            copies.push_back({ instances.offset, instances.count * sizeof(InstanceTransform), obj.m_InstanceBuffer });
+            cell.objects.push_back(obj);
+            cell.sharesGeometry.push_back(true);
+        }
+
+        cell.state = CellState::Uploading;
+        cell.byteSize = payload->byteSize;
+        cell.uploadTicket = m_Uploads.Submit(payload->staging, copies);
+        cell.payload.reset();
+    }
+
+    completed.clear();
+}
+
+void StreamingManager::PromoteUploaded()
+{
+    for (auto& [coord, cell] : m_Cells)
+    {
+        if (cell.state != CellState::Uploading || !m_Uploads.IsIssued(cell.uploadTicket))
+        {
+            continue;
+        }
+
+        cell.state = CellState::Resident;
+
+        const float latency = std::chrono::duration<float, std::milli>(Clock::now() - cell.requestTime).count();
+        ++m_Stats.cellsLoaded;
+        m_TotalLoadLatency += latency;
+        m_Stats.lastLoadLatency = latency;
+        m_Stats.averageLoadLatency = static_cast<float>(m_TotalLoadLatency / static_cast<double>(m_Stats.cellsLoaded));
+        m_Stats.maxLoadLatency = std::max(m_Stats.maxLoadLatency, latency);
+        m_Stats.residentBytes += cell.byteSize;
+        m_Stats.peakResidentBytes = std::max(m_Stats.peakResidentBytes, m_Stats.residentBytes);
+    }
+}
+
+void StreamingManager::DestroyCell(Cell& cell)
+{
+    GpuResourceTracker& resources = GpuResourceTracker::GetGlobal();
+
+    for (size_t i = 0; i < cell.objects.size(); ++i)
+    {
+        Object& obj = cell.objects[i];
+
+        if (!cell.sharesGeometry[i])
+        {
+            resources.DeleteBuffer(obj.m_VBO);
+            resources.DeleteBuffer(obj.m_PositionVBO);
+            resources.DeleteBuffer(obj.m_IBO);
+        }
+        resources.DeleteBuffer(obj.m_InstanceBuffer);
+        glDeleteVertexArrays(1, &obj.m_VAO);
+        glDeleteVertexArrays(1, &obj.m_DepthVAO);
+    }
+
+    if (cell.state == CellState::Resident)
+    {
+        m_Stats.residentBytes -= cell.byteSize;
+    }
+
+    cell.objects.clear();
+    cell.sharesGeometry.clear();
+}
+
+void StreamingManager::Cleanup()
+{
+    for (auto& [coord, cell] : m_Cells)
+    {
+        if (cell.payload)
+        {
+            cell.payload->cancelled.store(true, std::memory_order_relaxed);
+            CancelReads(*cell.payload);
+        }
+        DestroyCell(cell);
+    }
+    m_Cells.clear();
+
+    // Jobs may still be writing into the staging ring, wait for all of
+    // them to report back before it can be released
+    while (m_LoadsInFlight > 0)
+    {
+        std::vector<std::shared_ptr<CellPayload>> completed;
+        {
+            std::lock_guard<std::mutex> lock(m_Mailbox->mutex);
+            completed.swap(m_Mailbox->completed);
+        }
+
+        for (const std::shared_ptr<CellPayload>& payload : completed)
+        {
+            m_Uploads.Cancel(payload->staging);
+        }
+
+        m_LoadsInFlight -= static_cast<uint32_t>(completed.size());
+        if (m_LoadsInFlight > 0)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+
+    for (Object& prototype : m_Prototypes)
+    {
+        GpuResourceTracker::GetGlobal().DeleteBuffer(prototype.m_VBO);
+        GpuResourceTracker::GetGlobal().DeleteBuffer(prototype.m_PositionVBO);
+        GpuResourceTracker::GetGlobal().DeleteBuffer(prototype.m_IBO);
+        glDeleteVertexArrays(1, &prototype.m_VAO);
+        glDeleteVertexArrays(1, &prototype.m_DepthVAO);
+    }
+    m_Prototypes.clear();
+}
+
+void StreamingManager::PrintStats() const
+{
+    std::cout << "Streaming: " << m_Stats.residentCells << " resident cells, " << m_Stats.loadingCells << " loading\n"
+              << "  resident " << m_Stats.residentBytes / 1024 << " KiB (peak " << m_Stats.peakResidentBytes / 1024 << " KiB)\n"
+              << "  loaded " << m_Stats.cellsLoaded << ", unloaded " << m_Stats.cellsUnloaded << ", cancelled " << m_Stats.loadsCancelled << '\n'
+              << "  load latency avg " << m_Stats.averageLoadLatency << " ms, max " << m_Stats.maxLoadLatency << " ms\n";
+
+    const AsyncIoStats io = m_Reader.GetStats();
+    std::cout << "  reads " << io.reads << " (" << io.bytesRead / (1024 * 1024) << " MiB, " << io.failed << " failed, " << io.cancelled << " cancelled) through "
+              << (m_Reader.UsesIoUring() ? "io_uring" : "the thread pool") << '\n';
+}
+
+END_VISUALIZER_NAMESPACE